@@ -13,8 +13,11 @@ rm -f src/internal/x86_64/syscall.s
 # Remove default signal restore (but we should add one of our own).
 rm -f src/signal/x86_64/restore.s
 
-# No vfork()
-rm -f src/process/x86_64/vfork.s
+# Custom vfork() using Pedigree's syscall mechanism (musl's does a Linux one).
+cp "$SRCDIR/src/modules/subsys/posix/musl/vfork-x86_64.musl-s" src/process/x86_64/vfork.s
+
+# Custom posix_spawn() that asks the kernel to build the child directly.
+cp "$SRCDIR/src/modules/subsys/posix/musl/posix_spawn.c" src/process/posix_spawn.c
 
 # Remove some .s implementations that have .c alternatives.
 rm -f src/thread/x86_64/{clone,__unmapself,__set_thread_area}.s
@@ -173,6 +173,81 @@ void DiskImage::write(uint64_t location)
 #endif
 }
 
+bool DiskImage::readVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+#if USE_FILE_IO || HAS_ADDRESS_SANITIZER
+    return Disk::readVectored(pSegments, nSegments, pCompletion, param);
+#else
+    bool bSuccess = m_pFile != 0;
+    for (size_t i = 0; i < nSegments; ++i)
+    {
+        uint64_t location = pSegments[i].location;
+        if (!m_pFile || (location + pSegments[i].length) > m_nSize)
+        {
+            pSegments[i].buffer = 0;
+            bSuccess = false;
+            continue;
+        }
+
+        pSegments[i].buffer =
+            reinterpret_cast<uintptr_t>(adjust_pointer(m_pBuffer, location));
+    }
+
+    if (pCompletion)
+    {
+        pCompletion(param, bSuccess);
+    }
+
+    return bSuccess;
+#endif
+}
+
+bool DiskImage::writeVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+#if USE_FILE_IO || HAS_ADDRESS_SANITIZER
+    return Disk::writeVectored(pSegments, nSegments, pCompletion, param);
+#else
+    bool bSuccess = m_pFile != 0;
+    size_t i = 0;
+    while (i < nSegments)
+    {
+        uint64_t start = pSegments[i].location;
+        uint64_t end = start + pSegments[i].length;
+
+        size_t j = i + 1;
+        while (j < nSegments && pSegments[j].location == end)
+        {
+            end += pSegments[j].length;
+            ++j;
+        }
+
+        if (m_pFile && end <= m_nSize)
+        {
+            // msync wants a page-aligned address.
+            uint64_t base = start & ~0xFFFULL;
+            msync(adjust_pointer(m_pBuffer, base), end - base, MS_ASYNC);
+        }
+        else
+        {
+            bSuccess = false;
+        }
+
+        i = j;
+    }
+
+    if (pCompletion)
+    {
+        pCompletion(param, bSuccess);
+    }
+
+    return bSuccess;
+#endif
+}
+
 size_t DiskImage::getSize() const
 {
     return m_nSize;
@@ -52,6 +52,15 @@ class DiskImage : public Disk
     virtual uintptr_t read(uint64_t location);
     virtual void write(uint64_t location);
 
+    /** Hands out mapped addresses directly; no per-block reads. */
+    virtual bool readVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+    /** Syncs each run of adjacent segments with a single msync. */
+    virtual bool writeVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+
     virtual size_t getSize() const;
 
     virtual size_t getBlockSize() const
@@ -25,9 +25,12 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <string>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
@@ -64,6 +67,16 @@ enum long_opts
     opt_max_rows,
 };
 
+/** Options for ring-buffer trace processing. */
+struct TraceOptions
+{
+    /// Where to write folded stacks for flamegraph.pl, if anywhere.
+    const char *flamegraph_file;
+
+    /// Overrides the TSC frequency in the trace header, if non-zero.
+    uint64_t tsc_hz;
+};
+
 struct InstrumentedFunction
 {
     /**
@@ -101,10 +114,11 @@ uintptr_t extendPointer(uintptr_t pointer)
     return pointer;
 }
 
-std::string symbolToName(uintptr_t function, const char *kernel)
+std::string
+runAddr2line(const char *args, uintptr_t function, const char *kernel)
 {
     char buf[256];
-    snprintf(buf, 256, "addr2line -C -p -s -f -i -e %s %lx", kernel, function);
+    snprintf(buf, 256, "addr2line %s -e %s %lx", args, kernel, function);
 
     FILE *fp = popen(buf, "r");
     if (!fp)
@@ -125,10 +139,43 @@ std::string symbolToName(uintptr_t function, const char *kernel)
         }
     }
 
+    pclose(fp);
+    return result;
+}
+
+std::string symbolToName(uintptr_t function, const char *kernel)
+{
+    std::string result = runAddr2line("-C -p -s -f -i", function, kernel);
     result.erase(std::remove(result.begin(), result.end(), '\n'), result.end());
     return result;
 }
 
+/** Just the function name, for call graphs and folded stacks. */
+std::string symbolToFunction(uintptr_t function, const char *kernel)
+{
+    static std::unordered_map<uintptr_t, std::string> cache;
+    auto it = cache.find(function);
+    if (it != cache.end())
+    {
+        return it->second;
+    }
+
+    std::string result = runAddr2line("-C -f", function, kernel);
+    result = result.substr(0, result.find('\n'));
+    if (result.empty() || result == "??")
+    {
+        char buf[32];
+        snprintf(buf, 32, "0x%lx", function);
+        result = buf;
+    }
+
+    // Semicolons separate frames in folded output.
+    std::replace(result.begin(), result.end(), ';', ':');
+
+    cache.insert(std::make_pair(function, result));
+    return result;
+}
+
 /**
  * Processes records that are marked as "lite" instrumentation records.
  */
@@ -255,7 +302,337 @@ int processRecords(FILE *fp, const char *kernel, int max_records)
     return true;
 }
 
-int handleFile(const char *filename, const char *kernel, int max_records)
+/** Per-function totals gathered from a ring-buffer trace. */
+struct TracedFunction
+{
+    uintptr_t address;
+    size_t calls;
+
+    /// Time in this function and everything it called, in TSC ticks.
+    uint64_t inclusive;
+
+    /// Time in this function alone, in TSC ticks.
+    uint64_t self;
+
+    /// callee -> (calls, inclusive ticks)
+    std::unordered_map<uintptr_t, std::pair<size_t, uint64_t>> callees;
+};
+
+/** A call that has been entered but not yet returned from. */
+struct TraceFrame
+{
+    uintptr_t function;
+    uint64_t start;
+    uint64_t children;
+};
+
+/** Replays a merged trace into per-thread call stacks. */
+class TraceReplay
+{
+  public:
+    TraceReplay(const char *kernel) : m_Kernel(kernel)
+    {
+    }
+
+    void entry(uint32_t thread, uintptr_t function, uint64_t timestamp)
+    {
+        TraceFrame frame = {function, timestamp, 0};
+        m_Stacks[thread].push_back(frame);
+    }
+
+    void exit(uint32_t thread, uintptr_t function, uint64_t timestamp)
+    {
+        std::vector<TraceFrame> &stack = m_Stacks[thread];
+
+        // Entries may have been lost to the ring wrapping or to sampling;
+        // an exit with no matching entry is dropped.
+        auto it = std::find_if(
+            stack.rbegin(), stack.rend(),
+            [function](const TraceFrame &f) { return f.function == function; });
+        if (it == stack.rend())
+        {
+            ++m_Unmatched;
+            return;
+        }
+
+        // Anything above the match never saw its exit; close it here.
+        while (stack.back().function != function)
+        {
+            pop(stack, timestamp);
+        }
+        pop(stack, timestamp);
+    }
+
+    /** Closes every call still open at the end of the trace. */
+    void finish(uint64_t timestamp)
+    {
+        for (auto &it : m_Stacks)
+        {
+            while (!it.second.empty())
+            {
+                pop(it.second, timestamp);
+            }
+        }
+    }
+
+    const std::unordered_map<uintptr_t, TracedFunction> &functions() const
+    {
+        return m_Functions;
+    }
+
+    const std::map<std::string, uint64_t> &folded() const
+    {
+        return m_Folded;
+    }
+
+    size_t unmatched() const
+    {
+        return m_Unmatched;
+    }
+
+  private:
+    void pop(std::vector<TraceFrame> &stack, uint64_t timestamp)
+    {
+        TraceFrame frame = stack.back();
+        uint64_t total =
+            timestamp > frame.start ? timestamp - frame.start : 0;
+        uint64_t self = total > frame.children ? total - frame.children : 0;
+
+        // Fold the stack while this frame is still on it.
+        std::string path;
+        for (auto &f : stack)
+        {
+            if (!path.empty())
+            {
+                path += ';';
+            }
+            path += symbolToFunction(f.function, m_Kernel);
+        }
+        m_Folded[path] += self;
+
+        stack.pop_back();
+
+        TracedFunction &fn = m_Functions[frame.function];
+        fn.address = frame.function;
+        ++fn.calls;
+        fn.self += self;
+
+        // Recursive calls are already counted by the outermost frame.
+        bool bRecursive = false;
+        for (auto &f : stack)
+        {
+            if (f.function == frame.function)
+            {
+                bRecursive = true;
+                break;
+            }
+        }
+        if (!bRecursive)
+        {
+            fn.inclusive += total;
+        }
+
+        if (!stack.empty())
+        {
+            TraceFrame &parent = stack.back();
+            parent.children += total;
+
+            auto &edge = m_Functions[parent.function].callees[frame.function];
+            ++edge.first;
+            edge.second += total;
+        }
+    }
+
+    const char *m_Kernel;
+    std::unordered_map<uint32_t, std::vector<TraceFrame>> m_Stacks;
+    std::unordered_map<uintptr_t, TracedFunction> m_Functions;
+    std::map<std::string, uint64_t> m_Folded;
+    size_t m_Unmatched = 0;
+};
+
+/** Formats TSC ticks as microseconds if the frequency is known. */
+std::string formatTicks(uint64_t ticks, uint64_t tsc_hz)
+{
+    char buf[64];
+    if (tsc_hz)
+    {
+        snprintf(buf, 64, "%.3f us", (ticks * 1000000.0) / tsc_hz);
+    }
+    else
+    {
+        snprintf(buf, 64, "%lu ticks", ticks);
+    }
+    return std::string(buf);
+}
+
+int processTrace(
+    FILE *fp, const char *kernel, int max_records, const TraceOptions &opts)
+{
+    InstrumentTraceHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != INSTRUMENT_TRACE_MAGIC)
+    {
+        std::cerr << "Not a trace file (bad magic)." << std::endl;
+        return 1;
+    }
+    else if (
+        header.version != INSTRUMENT_TRACE_VERSION ||
+        header.recordSize != sizeof(InstrumentTraceRecord))
+    {
+        std::cerr << "Unsupported trace version " << header.version
+                  << " (record size " << header.recordSize << ")."
+                  << std::endl;
+        return 1;
+    }
+
+    uint64_t tsc_hz = opts.tsc_hz ? opts.tsc_hz : header.tscHz;
+
+    // Threads can migrate between CPUs, so merge every CPU's stream into
+    // one timeline before splitting it up by stack.
+    std::vector<InstrumentTraceRecord> records;
+    uint64_t lost = 0;
+    for (uint32_t i = 0; i < header.nCpus; ++i)
+    {
+        InstrumentTraceCpuHeader cpu;
+        if (fread(&cpu, sizeof(cpu), 1, fp) != 1)
+        {
+            std::cerr << "Truncated trace file." << std::endl;
+            return 1;
+        }
+
+        size_t base = records.size();
+        records.resize(base + cpu.count);
+        if (fread(&records[base], sizeof(InstrumentTraceRecord), cpu.count,
+                  fp) != cpu.count)
+        {
+            std::cerr << "Truncated trace file." << std::endl;
+            return 1;
+        }
+
+        std::cout << "CPU " << cpu.cpu << ": " << cpu.count << " records";
+        if (cpu.lost)
+        {
+            std::cout << " (" << cpu.lost << " lost to wrapping)";
+        }
+        std::cout << std::endl;
+        lost += cpu.lost;
+    }
+
+    std::stable_sort(
+        records.begin(), records.end(),
+        [](const InstrumentTraceRecord &a, const InstrumentTraceRecord &b) {
+            return (a.timestamp & ~INSTRUMENT_TRACE_EXIT) <
+                   (b.timestamp & ~INSTRUMENT_TRACE_EXIT);
+        });
+
+    TraceReplay replay(kernel);
+    uint64_t last = 0;
+    for (auto &record : records)
+    {
+        uint64_t timestamp = record.timestamp & ~INSTRUMENT_TRACE_EXIT;
+        uintptr_t function = extendPointer(record.function);
+
+        // Kernel stacks sit at fixed strides; anything else (e.g. the boot
+        // stack) is keyed on its rough location instead.
+        uint32_t thread = record.stack >> 16;
+        uint32_t depth = header.stackTop - record.stack;
+        if (header.stackStride && depth < 0x80000000U)
+        {
+            thread = 0x80000000U | (depth / header.stackStride);
+        }
+
+        if (record.timestamp & INSTRUMENT_TRACE_EXIT)
+        {
+            replay.exit(thread, function, timestamp);
+        }
+        else
+        {
+            replay.entry(thread, function, timestamp);
+        }
+        last = timestamp;
+    }
+    replay.finish(last);
+
+    if (replay.unmatched())
+    {
+        std::cout << replay.unmatched()
+                  << " returns had no matching call in the trace."
+                  << std::endl;
+    }
+    std::cout << std::endl;
+
+    // Sort by time spent in each function itself.
+    std::vector<const TracedFunction *> vec;
+    for (auto &it : replay.functions())
+    {
+        vec.push_back(&it.second);
+    }
+    std::sort(
+        vec.begin(), vec.end(),
+        [](const TracedFunction *left, const TracedFunction *right) {
+            return left->self > right->self;
+        });
+
+    int i = 0;
+    for (auto it = vec.begin(); it != vec.end() && i < max_records; ++it, ++i)
+    {
+        const TracedFunction *fn = *it;
+        std::cout << formatTicks(fn->self, tsc_hz) << " self, "
+                  << formatTicks(fn->inclusive, tsc_hz) << " total, "
+                  << fn->calls << " calls:" << std::endl;
+        std::cout << "    " << symbolToName(fn->address, kernel) << std::endl;
+
+        // Show the most expensive callees.
+        typedef std::pair<uintptr_t, std::pair<size_t, uint64_t>> edge_t;
+        std::vector<edge_t> callees(fn->callees.begin(), fn->callees.end());
+        std::sort(
+            callees.begin(), callees.end(),
+            [](const edge_t &left, const edge_t &right) {
+                return left.second.second > right.second.second;
+            });
+
+        int j = 0;
+        for (auto it2 = callees.begin();
+             it2 != callees.end() && j < max_records; ++it2, ++j)
+        {
+            std::cout << "        -> "
+                      << formatTicks(it2->second.second, tsc_hz) << " in "
+                      << it2->second.first << "x "
+                      << symbolToFunction(it2->first, kernel) << std::endl;
+        }
+    }
+
+    if (opts.flamegraph_file)
+    {
+        std::ofstream out(opts.flamegraph_file);
+        if (!out)
+        {
+            std::cerr << "Can't open '" << opts.flamegraph_file
+                      << "': " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        // flamegraph.pl wants integers; use microseconds where we can.
+        for (auto &it : replay.folded())
+        {
+            uint64_t value = it.second;
+            if (tsc_hz)
+            {
+                value = (value * 1000000.0) / tsc_hz;
+            }
+            if (value)
+            {
+                out << it.first << " " << value << "\n";
+            }
+        }
+    }
+
+    return 0;
+}
+
+int handleFile(
+    const char *filename, const char *kernel, int max_records,
+    const TraceOptions &opts)
 {
     FILE *fp = fopen(filename, "rb");
     if (!fp)
@@ -278,7 +655,11 @@ int handleFile(const char *filename, const char *kernel, int max_records)
 
     // Choose which type of read to perform.
     int rc = 0;
-    if (global_flags & INSTRUMENT_GLOBAL_LITE)
+    if (global_flags & INSTRUMENT_GLOBAL_TRACE)
+    {
+        rc = processTrace(fp, kernel, max_records, opts);
+    }
+    else if (global_flags & INSTRUMENT_GLOBAL_LITE)
     {
         rc = processRecords<LiteInstrumentationRecord>(fp, kernel, max_records);
     }
@@ -309,6 +690,12 @@ void usage()
               << std::endl;
     std::cerr << "  --max-rows, -m   Maximum rows to output (default is 10)."
               << std::endl;
+    std::cerr << "  --flamegraph, -f Write folded stacks for flamegraph.pl "
+                 "(trace files only)."
+              << std::endl;
+    std::cerr << "  --tsc-hz, -t     TSC frequency to use instead of the one "
+                 "recorded in the trace."
+              << std::endl;
     std::cerr << std::endl;
 }
 
@@ -323,10 +710,13 @@ int main(int argc, char *argv[])
     const char *input_file = 0;
     const char *kernel_file = 0;
     int maximum = 10;
+    TraceOptions opts = {0, 0};
     const struct option long_options[] = {
         {"input-file", required_argument, 0, 'i'},
         {"kernel-path", required_argument, 0, 'k'},
         {"max-rows", optional_argument, 0, 'm'},
+        {"flamegraph", required_argument, 0, 'f'},
+        {"tsc-hz", required_argument, 0, 't'},
         {"version", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0},
@@ -335,7 +725,7 @@ int main(int argc, char *argv[])
     opterr = 1;
     while (1)
     {
-        int c = getopt_long(argc, argv, "i:m:k:vVh", long_options, NULL);
+        int c = getopt_long(argc, argv, "i:m:k:f:t:vVh", long_options, NULL);
         if (c < 0)
         {
             break;
@@ -347,6 +737,27 @@ int main(int argc, char *argv[])
                 input_file = optarg;
                 break;
 
+            case 'k':
+                kernel_file = optarg;
+                break;
+
+            case 'f':
+                opts.flamegraph_file = optarg;
+                break;
+
+            case 't':
+            {
+                char *end = 0;
+                opts.tsc_hz = strtoull(optarg, &end, 10);
+                if (end == optarg)
+                {
+                    std::cerr << "Could not convert TSC frequency '" << optarg
+                              << "' to a number." << std::endl;
+                    return 1;
+                }
+            }
+            break;
+
             case 'm':
             {
                 // Perform conversion and handle errors.
@@ -397,5 +808,5 @@ int main(int argc, char *argv[])
         kernel_file = "build/kernel/kernel.debug";
     }
 
-    return handleFile(input_file, kernel_file, maximum);
+    return handleFile(input_file, kernel_file, maximum, opts);
 }
@@ -27,6 +27,7 @@
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <set>
 #include <type_traits>
@@ -55,6 +56,24 @@ struct CallerCountEntry
     std::shared_ptr<AllocationTraceEntry> entry;
 };
 
+struct SizeClassEntry
+{
+    SizeClassEntry()
+        : count(0), requested(0), allocated(0), liveCount(0), liveRequested(0),
+          liveAllocated(0)
+    {
+    }
+
+    size_t count;
+    size_t requested;
+    size_t allocated;
+    size_t liveCount;
+    size_t liveRequested;
+    size_t liveAllocated;
+};
+
+typedef std::map<uint32_t, SizeClassEntry> size_classes_t;
+
 /// \todo if uintptr_t == uint32_t, this will not work.
 uintptr_t extendPointer(uint32_t pointer)
 {
@@ -173,8 +192,61 @@ bool processRecord(
     return true;
 }
 
+static double wastePercent(size_t requested, size_t allocated)
+{
+    if (!allocated)
+    {
+        return 0.0;
+    }
+
+    return (100.0 * (allocated - requested)) / allocated;
+}
+
+static void reportSizeClasses(const size_classes_t &classes)
+{
+    std::cout << std::setw(10) << "class" << std::setw(10) << "allocs"
+              << std::setw(14) << "requested" << std::setw(14) << "allocated"
+              << std::setw(8) << "waste" << std::setw(10) << "live"
+              << std::setw(14) << "live req" << std::setw(14) << "live alloc"
+              << std::setw(8) << "waste" << std::endl;
+
+    SizeClassEntry total;
+    for (auto &it : classes)
+    {
+        const SizeClassEntry &entry = it.second;
+        std::cout << std::setw(10) << it.first << std::setw(10) << entry.count
+                  << std::setw(14) << entry.requested << std::setw(14)
+                  << entry.allocated << std::setw(7) << std::fixed
+                  << std::setprecision(1)
+                  << wastePercent(entry.requested, entry.allocated) << "%"
+                  << std::setw(10) << entry.liveCount << std::setw(14)
+                  << entry.liveRequested << std::setw(14)
+                  << entry.liveAllocated << std::setw(7)
+                  << wastePercent(entry.liveRequested, entry.liveAllocated)
+                  << "%" << std::endl;
+
+        total.count += entry.count;
+        total.requested += entry.requested;
+        total.allocated += entry.allocated;
+        total.liveCount += entry.liveCount;
+        total.liveRequested += entry.liveRequested;
+        total.liveAllocated += entry.liveAllocated;
+    }
+
+    std::cout << std::setw(10) << "total" << std::setw(10) << total.count
+              << std::setw(14) << total.requested << std::setw(14)
+              << total.allocated << std::setw(7)
+              << wastePercent(total.requested, total.allocated) << "%"
+              << std::setw(10) << total.liveCount << std::setw(14)
+              << total.liveRequested << std::setw(14) << total.liveAllocated
+              << std::setw(7)
+              << wastePercent(total.liveRequested, total.liveAllocated) << "%"
+              << std::endl;
+}
+
 int processRecords(
-    FILE *fp, int max_records, bool reverse, bool common_callsites, bool seen)
+    FILE *fp, int max_records, bool reverse, bool common_callsites, bool seen,
+    bool size_classes)
 {
     // Dataset of pointers -> metadata.
     dataset_t dataset;
@@ -186,6 +258,9 @@ int processRecords(
     std::set<uintptr_t> seenPointersSet;
     std::set<uintptr_t> *seenPointers = seen ? &seenPointersSet : nullptr;
 
+    // Requested vs. allocated bytes, keyed by allocated size (size class).
+    size_classes_t sizeClasses;
+
     // Read several records at a time.
     bool err = false;
     AllocationTraceEntry *records = new AllocationTraceEntry[RECORDS_PER_READ];
@@ -198,6 +273,12 @@ int processRecords(
             if (records[i].data.type == Allocation)
             {
                 ++totalAllocs;
+
+                SizeClassEntry &entry =
+                    sizeClasses[records[i].data.allocated];
+                ++entry.count;
+                entry.requested += records[i].data.sz;
+                entry.allocated += records[i].data.allocated;
             }
 
             if (!processRecord(records[i], dataset, seenPointers))
@@ -228,6 +309,20 @@ int processRecords(
 
     std::cout << std::endl;
 
+    if (size_classes)
+    {
+        for (auto &it : vec)
+        {
+            SizeClassEntry &entry = sizeClasses[it.second->data.allocated];
+            ++entry.liveCount;
+            entry.liveRequested += it.second->data.sz;
+            entry.liveAllocated += it.second->data.allocated;
+        }
+
+        reportSizeClasses(sizeClasses);
+        return true;
+    }
+
     // What about the top N callers?
     if (common_callsites)
     {
@@ -338,7 +433,7 @@ int processRecords(
 
 int handleFile(
     const char *filename, int max_records, bool reverse, bool common_callsites,
-    bool seen)
+    bool seen, bool size_classes)
 {
     FILE *fp = fopen(filename, "rb");
     if (!fp)
@@ -348,7 +443,8 @@ int handleFile(
         return 1;
     }
 
-    int rc = processRecords(fp, max_records, reverse, common_callsites, seen);
+    int rc = processRecords(
+        fp, max_records, reverse, common_callsites, seen, size_classes);
 
     fclose(fp);
     return rc;
@@ -379,6 +475,9 @@ void usage()
     std::cerr << "  --seen, -s       Ignore double frees unless an address "
                  "has been allocated at least once in the trace."
               << std::endl;
+    std::cerr << "  --classes, -z    Show requested versus allocated bytes "
+                 "for each allocator size class."
+              << std::endl;
     std::cerr << std::endl;
 }
 
@@ -394,6 +493,7 @@ int main(int argc, char *argv[])
     bool reverse = false;
     bool callers = false;
     bool seen = false;
+    bool classes = false;
     int maximum = 10;
     const struct option long_options[] = {
         {"input-file", required_argument, 0, 'i'},
@@ -402,6 +502,7 @@ int main(int argc, char *argv[])
         {"callers", no_argument, 0, 'c'},
         {"reverse", no_argument, 0, 'r'},
         {"seen", no_argument, 0, 's'},
+        {"classes", no_argument, 0, 'z'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0},
     };
@@ -409,7 +510,7 @@ int main(int argc, char *argv[])
     opterr = 1;
     while (1)
     {
-        int c = getopt_long(argc, argv, "i:m::vVhcrs", long_options, NULL);
+        int c = getopt_long(argc, argv, "i:m::vVhcrsz", long_options, NULL);
         if (c < 0)
         {
             break;
@@ -458,6 +559,10 @@ int main(int argc, char *argv[])
                 seen = true;
                 break;
 
+            case 'z':
+                classes = true;
+                break;
+
             case 'v':
             case 'V':
                 version();
@@ -485,5 +590,5 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    return handleFile(input_file, maximum, reverse, callers, seen);
+    return handleFile(input_file, maximum, reverse, callers, seen, classes);
 }
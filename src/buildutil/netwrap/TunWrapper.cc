@@ -24,6 +24,7 @@
 
 #include <errno.h>
 #include <poll.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "modules/system/network-stack/NetworkStack.h"
@@ -72,6 +73,33 @@ bool TunWrapper::send(size_t nBytes, uintptr_t buffer)
     return written == nBytes;
 }
 
+bool TunWrapper::sendFragments(
+    const Fragment *fragments, size_t count, size_t nBytes,
+    SendCompletion completion, void *param)
+{
+    ssize_t written = -1;
+    if (m_Fd >= 0 && count <= NETWORK_MAX_FRAGMENTS)
+    {
+        struct iovec iov[NETWORK_MAX_FRAGMENTS];
+        for (size_t i = 0; i < count; ++i)
+        {
+            iov[i].iov_base = reinterpret_cast<void *>(fragments[i].buffer);
+            iov[i].iov_len = fragments[i].length;
+        }
+
+        // A tap device takes one frame per write, so this is atomic too.
+        written = writev(m_Fd, iov, count);
+    }
+
+    bool result = written == static_cast<ssize_t>(nBytes);
+    if (completion)
+    {
+        completion(param, result);
+    }
+
+    return result;
+}
+
 bool TunWrapper::setStationInfo(StationInfo info)
 {
     m_StationInfo.ipv4 = info.ipv4;
@@ -152,6 +180,9 @@ int TunWrapper::packetPusherThread(void *param)
 
 void TunWrapper::packetPusher()
 {
+    packet *batch[TUN_BATCH_SIZE];
+    NetworkStack::Frame frames[TUN_BATCH_SIZE];
+
     lock.acquire();
     while (true)
     {
@@ -161,16 +192,28 @@ void TunWrapper::packetPusher()
             continue;
         }
 
-        packet *p = m_Packets.popFront();
+        // Hand over everything that queued up while we were busy.
+        size_t n = 0;
+        while (n < TUN_BATCH_SIZE && m_Packets.count())
+        {
+            packet *p = m_Packets.popFront();
+            batch[n] = p;
+            frames[n].buffer = reinterpret_cast<uintptr_t>(p->buffer);
+            frames[n].length = p->bytes;
+            frames[n].offset = 0;
+            ++n;
+        }
 
         lock.release();
 
-        NetworkStack::instance().receive(
-            p->bytes, reinterpret_cast<uintptr_t>(p->buffer), this, 0);
+        NetworkStack::instance().receiveBatch(this, frames, n);
 
-        lock.acquire();
+        for (size_t i = 0; i < n; ++i)
+        {
+            delete batch[i];
+        }
 
-        delete p;
+        lock.acquire();
     }
     lock.release();
 }
@@ -24,6 +24,9 @@
 #include "pedigree/kernel/process/ConditionVariable.h"
 #include "pedigree/kernel/process/Mutex.h"
 
+/// Most frames handed to the stack in one receiveBatch() call.
+#define TUN_BATCH_SIZE 32
+
 class TunWrapper : public Network
 {
   public:
@@ -40,6 +43,11 @@ class TunWrapper : public Network
      * \param buffer A buffer with the packet to send */
     virtual bool send(size_t nBytes, uintptr_t buffer);
 
+    /** Writes the fragments to the tap device with a single writev(). */
+    virtual bool sendFragments(
+        const Fragment *fragments, size_t count, size_t nBytes,
+        SendCompletion completion, void *param);
+
     /** Sets station information (such as IP addresses)
      * \param info The information to set as the station info */
     virtual bool setStationInfo(StationInfo info);
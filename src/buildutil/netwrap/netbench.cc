@@ -0,0 +1,732 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "modules/system/network-stack/NetworkStack.h"
+#include "pedigree/kernel/Log.h"
+
+#include "lwip/api.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/memp.h"
+#include "lwip/netif.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+
+/// Frames injected per run of the receive benchmark.
+#define RX_FRAMES 200000
+/// UDP payload carried by each injected frame.
+#define RX_PAYLOAD 64
+/// Port the receive benchmark's frames are addressed to.
+#define RX_PORT 9
+/// Ethernet, IPv4 and UDP headers precede the payload.
+#define UDP_PAYLOAD_OFFSET (14 + 20 + 8)
+/// Bytes written per run of the transmit benchmark.
+#define TX_BYTES (256 * 1024 * 1024)
+/// Size of each write the transmit benchmark's client makes.
+#define TX_WRITE_SIZE 65536
+/// Allocate/free pairs per thread in each run of the memp benchmark.
+#define MEMP_OPS 2000000
+/// Objects each memp benchmark thread holds at once.
+#define MEMP_BURST 64
+/// Last octet of the address the reflector pretends is a remote server.
+#define REFLECT_SERVER 1
+/// Last octet of the address the reflector gives the server's peer.
+#define REFLECT_CLIENT 3
+
+static const uint8_t g_LocalMac[6] = {0, 0xab, 0xcd, 0, 0, 0x1};
+static const uint8_t g_RemoteMac[6] = {0x02, 0, 0, 0, 0, 0x2};
+
+static uint64_t nowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static uint16_t ipChecksum(const uint8_t *header, size_t len);
+static uint16_t tcpChecksum(const uint8_t *ip, size_t ipLength);
+
+/**
+ * In-process NIC. Transmitted frames are discarded unless reflecting, in
+ * which case the device hairpins them back into the stack (see reflect()).
+ * Unless scatter-gather is enabled, sendFragments is left to Network's
+ * copying fallback so both transmit paths can be compared.
+ */
+class BenchDevice : public Network
+{
+  public:
+    BenchDevice()
+        : Network(), m_Sent(0), m_Reflect(false), m_ScatterGather(true)
+    {
+        m_SpecificType = "netbench device";
+        for (size_t i = 0; i < 6; ++i)
+        {
+            m_StationInfo.mac.setMac(g_LocalMac[i], i);
+        }
+    }
+
+    virtual void getName(String &str)
+    {
+        str = "netbench";
+    }
+
+    virtual bool send(size_t nBytes, uintptr_t buffer)
+    {
+        ++m_Sent;
+        if (m_Reflect && nBytes <= sizeof(m_Frame))
+        {
+            memcpy(m_Frame, reinterpret_cast<void *>(buffer), nBytes);
+            reflect(nBytes);
+        }
+        return true;
+    }
+
+    virtual bool sendFragments(
+        const Fragment *fragments, size_t count, size_t nBytes,
+        SendCompletion completion, void *param)
+    {
+        if (!m_ScatterGather)
+        {
+            return Network::sendFragments(
+                fragments, count, nBytes, completion, param);
+        }
+
+        ++m_Sent;
+        if (m_Reflect && nBytes <= sizeof(m_Frame))
+        {
+            size_t offset = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                memcpy(
+                    m_Frame + offset,
+                    reinterpret_cast<void *>(fragments[i].buffer),
+                    fragments[i].length);
+                offset += fragments[i].length;
+            }
+            reflect(nBytes);
+        }
+        completion(param, true);
+        return true;
+    }
+
+    virtual const StationInfo &getStationInfo()
+    {
+        return m_StationInfo;
+    }
+
+    size_t dropped() const
+    {
+        return m_StationInfo.nDropped;
+    }
+
+    std::atomic<size_t> m_Sent;
+    bool m_Reflect;
+    bool m_ScatterGather;
+
+  private:
+    /**
+     * Hairpins the frame in m_Frame back into the stack as if it came from
+     * another host. Traffic to REFLECT_SERVER (10.0.0.1) comes back addressed
+     * to us from REFLECT_CLIENT (10.0.0.3), and vice versa, so a connection
+     * to 10.0.0.1 ends up at a listener on our own address. ARP requests for
+     * either address are answered on the fake host's behalf.
+     */
+    void reflect(size_t nBytes)
+    {
+        uint8_t *eth = m_Frame;
+        uint8_t *payload = eth + 14;
+        if (nBytes < 14 + 20)
+        {
+            return;
+        }
+
+        memcpy(eth, g_LocalMac, 6);
+        memcpy(eth + 6, g_RemoteMac, 6);
+
+        if (eth[12] == 0x08 && eth[13] == 0x06)
+        {
+            // ARP request: reply with the fake host's MAC.
+            if (payload[7] != 1)
+            {
+                return;
+            }
+            uint8_t targetIp[4];
+            memcpy(targetIp, payload + 24, 4);
+            memcpy(payload + 18, payload + 8, 10);
+            memcpy(payload + 8, g_RemoteMac, 6);
+            memcpy(payload + 14, targetIp, 4);
+            payload[7] = 2;
+        }
+        else if (eth[12] == 0x08 && eth[13] == 0x00)
+        {
+            uint8_t *ip = payload;
+            size_t ipLength = (ip[2] << 8) | ip[3];
+            if (ip[9] != 6 || ipLength + 14 > nBytes)
+            {
+                return;
+            }
+
+            // dst 10.0.0.1 -> 10.0.0.2 from .3; dst .3 -> .2 from .1
+            ip[15] = ip[19] == REFLECT_SERVER ? REFLECT_CLIENT : REFLECT_SERVER;
+            ip[19] = 2;
+
+            ip[10] = ip[11] = 0;
+            uint16_t csum = ipChecksum(ip, 20);
+            ip[10] = csum >> 8;
+            ip[11] = csum & 0xFF;
+
+            uint8_t *tcp = ip + 20;
+            tcp[16] = tcp[17] = 0;
+            csum = tcpChecksum(ip, ipLength);
+            tcp[16] = csum >> 8;
+            tcp[17] = csum & 0xFF;
+        }
+        else
+        {
+            return;
+        }
+
+        Fragment fragment;
+        fragment.buffer = reinterpret_cast<uintptr_t>(m_Frame);
+        fragment.length = nBytes;
+        NetworkStack::instance().receive(this, &fragment, 1, nBytes);
+    }
+
+    uint8_t m_Frame[2048];
+};
+
+/** Receive-side bookkeeping, updated from the lwIP thread. */
+struct RxResults
+{
+    std::atomic<size_t> received;
+    std::vector<uint64_t> latencies;
+};
+
+static RxResults g_Rx;
+
+static void udpReceived(
+    void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
+    u16_t port)
+{
+    uint64_t sentAt = 0;
+    pbuf_copy_partial(p, &sentAt, sizeof(sentAt), 0);
+    g_Rx.latencies.push_back(nowNanoseconds() - sentAt);
+    pbuf_free(p);
+
+    g_Rx.received.fetch_add(1, std::memory_order_release);
+}
+
+/** Runs \p fn on the lwIP thread and waits for it. */
+template <class F>
+static void onLwipThread(F fn)
+{
+    struct Call
+    {
+        F *fn;
+        std::atomic<bool> done;
+    } call;
+    call.fn = &fn;
+    call.done = false;
+
+    tcpip_callback(
+        [](void *ctx) {
+            Call *c = reinterpret_cast<Call *>(ctx);
+            (*c->fn)();
+            c->done = true;
+        },
+        &call);
+
+    while (!call.done)
+    {
+        std::this_thread::yield();
+    }
+}
+
+static uint32_t checksumAdd(uint32_t sum, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i + 1 < len; i += 2)
+    {
+        sum += (data[i] << 8) | data[i + 1];
+    }
+    if (len & 1)
+    {
+        sum += data[len - 1] << 8;
+    }
+    return sum;
+}
+
+static uint16_t checksumFold(uint32_t sum)
+{
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+static uint16_t ipChecksum(const uint8_t *header, size_t len)
+{
+    return checksumFold(checksumAdd(0, header, len));
+}
+
+/** Checksums the TCP segment following the 20-byte header at \p ip. */
+static uint16_t tcpChecksum(const uint8_t *ip, size_t ipLength)
+{
+    size_t tcpLength = ipLength - 20;
+    uint32_t sum = checksumAdd(0, ip + 12, 8);
+    sum += 6 + tcpLength;
+    return checksumFold(checksumAdd(sum, ip + 20, tcpLength));
+}
+
+/** Builds an Ethernet/IPv4/UDP frame to our address and returns its size. */
+static size_t buildUdpFrame(uint8_t *frame, uint16_t id)
+{
+    const size_t udpLength = 8 + RX_PAYLOAD;
+    const size_t ipLength = 20 + udpLength;
+
+    memcpy(frame, g_LocalMac, 6);
+    memcpy(frame + 6, g_RemoteMac, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    uint8_t *ip = frame + 14;
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    ip[2] = ipLength >> 8;
+    ip[3] = ipLength & 0xFF;
+    ip[4] = id >> 8;
+    ip[5] = id & 0xFF;
+    ip[8] = 64;
+    ip[9] = 17;  // UDP
+    const uint8_t src[4] = {10, 0, 0, 1};
+    const uint8_t dst[4] = {10, 0, 0, 2};
+    memcpy(ip + 12, src, 4);
+    memcpy(ip + 16, dst, 4);
+    uint16_t csum = ipChecksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum & 0xFF;
+
+    uint8_t *udp = ip + 20;
+    udp[0] = 0x80;
+    udp[1] = 0x00;
+    udp[2] = 0;
+    udp[3] = RX_PORT;
+    udp[4] = udpLength >> 8;
+    udp[5] = udpLength & 0xFF;
+    udp[6] = udp[7] = 0;  // no checksum
+    memset(udp + 8, 0, RX_PAYLOAD);
+
+    return 14 + ipLength;
+}
+
+static uint64_t percentile(std::vector<uint64_t> &v, double p)
+{
+    if (v.empty())
+    {
+        return 0;
+    }
+    size_t i = static_cast<size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+/**
+ * Injects RX_FRAMES frames in batches of \p batch and reports how many were
+ * delivered, how fast, and with what latency. Unless \p paced, frames are
+ * offered as fast as possible, as a burst from the wire would be, and the
+ * queue's overflow is dropped; paced runs hold back while the interface's
+ * queue is nearly full to find the sustainable rate.
+ */
+static void benchReceive(BenchDevice *dev, size_t batch, bool paced)
+{
+    NetworkStack &stack = NetworkStack::instance();
+
+    std::vector<uint8_t> buffers(batch * 1514);
+    std::vector<NetworkStack::Frame> frames(batch);
+    for (size_t i = 0; i < batch; ++i)
+    {
+        frames[i].buffer = reinterpret_cast<uintptr_t>(&buffers[i * 1514]);
+        frames[i].length = buildUdpFrame(&buffers[i * 1514], i);
+        frames[i].offset = 0;
+    }
+
+    onLwipThread([]() { g_Rx.latencies.clear(); });
+    g_Rx.latencies.reserve(RX_FRAMES);
+    g_Rx.received = 0;
+
+    NetworkStack::ReceiveStatistics before;
+    stack.getReceiveStatistics(dev, before);
+    size_t droppedBefore = dev->dropped();
+
+    uint64_t start = nowNanoseconds();
+    size_t offered = 0;
+    while (offered < RX_FRAMES)
+    {
+        size_t n = std::min(batch, static_cast<size_t>(RX_FRAMES - offered));
+        if (paced)
+        {
+            NetworkStack::ReceiveStatistics now;
+            stack.getReceiveStatistics(dev, now);
+            if (now.queued - now.delivered + n > NETWORK_RX_QUEUE_SIZE)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+        }
+
+        uint64_t stamp = nowNanoseconds();
+        for (size_t i = 0; i < n; ++i)
+        {
+            memcpy(&buffers[i * 1514] + UDP_PAYLOAD_OFFSET, &stamp,
+                   sizeof(stamp));
+        }
+
+        if (batch == 1)
+        {
+            stack.receive(frames[0].length, frames[0].buffer, dev, 0);
+        }
+        else
+        {
+            stack.receiveBatch(dev, frames.data(), n);
+        }
+        offered += n;
+    }
+
+    // Wait for lwIP to catch up with everything that was accepted.
+    NetworkStack::ReceiveStatistics after;
+    do
+    {
+        std::this_thread::yield();
+        stack.getReceiveStatistics(dev, after);
+    } while (after.delivered - before.delivered <
+                 after.queued - before.queued ||
+             g_Rx.received.load(std::memory_order_acquire) <
+                 after.delivered - before.delivered);
+    uint64_t end = nowNanoseconds();
+
+    size_t received = g_Rx.received.load(std::memory_order_acquire);
+    double seconds = (end - start) / 1e9;
+
+    std::vector<uint64_t> latencies;
+    onLwipThread([&latencies]() { latencies.swap(g_Rx.latencies); });
+
+    printf(
+        "  %s batch %3zu: %9.0f pkt/s delivered, %zu/%u received, %zu dropped "
+        "(%llu overrun), latency p50 %llu ns p99 %llu ns, largest drain %llu\n",
+        paced ? "paced" : "flood", batch, received / seconds, received, RX_FRAMES,
+        dev->dropped() - droppedBefore,
+        static_cast<unsigned long long>(after.overruns - before.overruns),
+        static_cast<unsigned long long>(percentile(latencies, 0.5)),
+        static_cast<unsigned long long>(percentile(latencies, 0.99)),
+        static_cast<unsigned long long>(after.largestDrain));
+}
+
+/**
+ * Streams TX_BYTES over a TCP connection that leaves through the device and
+ * is reflected back to a listener on our own address, and reports the
+ * throughput the sender sees. Every segment crosses linkOutput once in each
+ * direction, so the transmit path's copies show up directly in the result.
+ */
+static void benchTransmit(BenchDevice *dev, bool scatterGather, uint16_t port)
+{
+    dev->m_ScatterGather = scatterGather;
+    dev->m_Reflect = true;
+
+    struct netconn *listener = netconn_new(NETCONN_TCP);
+    netconn_bind(listener, IP_ADDR_ANY, port);
+    netconn_listen(listener);
+
+    std::atomic<size_t> received(0);
+    std::thread server([listener, &received]() {
+        struct netconn *conn = nullptr;
+        if (netconn_accept(listener, &conn) != ERR_OK)
+        {
+            return;
+        }
+
+        struct netbuf *buf = nullptr;
+        while (netconn_recv(conn, &buf) == ERR_OK)
+        {
+            received += netbuf_len(buf);
+            netbuf_delete(buf);
+        }
+
+        netconn_close(conn);
+        netconn_delete(conn);
+    });
+
+    std::vector<uint8_t> data(TX_WRITE_SIZE, 0x5a);
+    size_t sentBefore = dev->m_Sent;
+
+    struct netconn *client = netconn_new(NETCONN_TCP);
+    ip_addr_t server_addr;
+    IP_ADDR4(&server_addr, 10, 0, 0, REFLECT_SERVER);
+
+    uint64_t start = nowNanoseconds();
+    if (netconn_connect(client, &server_addr, port) != ERR_OK)
+    {
+        printf("  connect failed\n");
+        netconn_delete(client);
+        netconn_delete(listener);
+        server.detach();
+        return;
+    }
+
+    size_t written = 0;
+    while (written < TX_BYTES)
+    {
+        if (netconn_write(client, data.data(), data.size(), NETCONN_COPY) !=
+            ERR_OK)
+        {
+            break;
+        }
+        written += data.size();
+    }
+    netconn_close(client);
+    server.join();
+    uint64_t end = nowNanoseconds();
+
+    netconn_delete(client);
+    netconn_delete(listener);
+    dev->m_Reflect = false;
+
+    double seconds = (end - start) / 1e9;
+    printf(
+        "  %-15s: %8.1f MB/s, %zu/%u bytes delivered, %zu frames sent\n",
+        scatterGather ? "scatter-gather" : "copy fallback",
+        received / seconds / (1024 * 1024), received.load(), TX_BYTES,
+        dev->m_Sent - sentBefore);
+}
+
+/**
+ * Times allocate/free of the memp types on lwIP's hot paths, in bursts, from
+ * \p nThreads threads at once. With \p crossThread, objects are freed by a
+ * different thread from the one that allocated them, as with pbufs a driver
+ * allocates and the lwIP thread frees.
+ */
+static void benchMemp(size_t nThreads, bool crossThread)
+{
+    const memp_t types[] = {MEMP_PBUF_POOL, MEMP_PBUF, MEMP_TCP_SEG,
+                            MEMP_TCPIP_MSG_INPKT};
+    const size_t nTypes = sizeof(types) / sizeof(types[0]);
+
+    std::atomic<size_t> failures(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+
+    // Cross-thread runs pair threads up; each hands its bursts to the other
+    // through a one-slot mailbox. Bursts live here rather than on the
+    // threads' stacks, as a thread's last burst is freed after it exits.
+    std::vector<void *> bursts(nThreads * 2 * MEMP_BURST);
+    struct Mailbox
+    {
+        std::atomic<void **> burst;
+    };
+    std::vector<Mailbox> mailboxes(nThreads);
+    for (auto &m : mailboxes)
+    {
+        m.burst = nullptr;
+    }
+
+    for (size_t t = 0; t < nThreads; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            void **burst[2] = {&bursts[t * 2 * MEMP_BURST],
+                               &bursts[(t * 2 + 1) * MEMP_BURST]};
+            size_t which = 0;
+            while (!go)
+            {
+                std::this_thread::yield();
+            }
+
+            for (size_t i = 0; i < MEMP_OPS / MEMP_BURST; ++i)
+            {
+                memp_t type = types[i % nTypes];
+                void **mine = burst[which];
+                for (size_t j = 0; j < MEMP_BURST; ++j)
+                {
+                    mine[j] = memp_malloc(type);
+                    if (!mine[j])
+                    {
+                        ++failures;
+                    }
+                }
+
+                void **toFree = mine;
+                if (crossThread)
+                {
+                    // Swap bursts with our partner and free theirs.
+                    Mailbox &out = mailboxes[t ^ 1];
+                    Mailbox &in = mailboxes[t];
+                    void **expected = nullptr;
+                    while (!out.burst.compare_exchange_weak(expected, mine))
+                    {
+                        expected = nullptr;
+                        std::this_thread::yield();
+                    }
+                    while (!(toFree = in.burst.exchange(nullptr)))
+                    {
+                        std::this_thread::yield();
+                    }
+                    which ^= 1;
+                }
+
+                for (size_t j = 0; j < MEMP_BURST; ++j)
+                {
+                    if (toFree[j])
+                    {
+                        memp_free(type, toFree[j]);
+                    }
+                }
+            }
+        });
+    }
+
+    uint64_t start = nowNanoseconds();
+    go = true;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    uint64_t end = nowNanoseconds();
+
+    double seconds = (end - start) / 1e9;
+    printf(
+        "  %zu thread%s%s: %6.1fM alloc+free/s (%zu failed)\n", nThreads,
+        nThreads == 1 ? "" : "s", crossThread ? ", cross-thread free" : "",
+        (nThreads * (MEMP_OPS / MEMP_BURST) * MEMP_BURST) / seconds / 1e6,
+        failures.load());
+}
+
+static void printMempStatistics()
+{
+#if MEMP_PEDIGREE_POOLS
+    struct memp_cache_stats stats[MEMP_MAX];
+    size_t n = memp_cache_statistics(stats, MEMP_MAX);
+
+    printf(
+        "=> memp caches (%-16s %5s %5s %8s %10s %10s %8s)\n", "type", "size",
+        "slabs", "in use", "allocs", "cpu hits", "refills");
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!stats[i].allocations)
+        {
+            continue;
+        }
+
+        printf(
+            "                 %-16s %5zu %5zu %8zu %10zu %9.1f%% %8zu\n",
+            stats[i].name, stats[i].object_size, stats[i].slabs,
+            stats[i].in_use, stats[i].allocations,
+            100.0 * stats[i].cache_hits / stats[i].allocations,
+            stats[i].refills);
+    }
+
+    size_t trimmed = memp_cache_trim();
+    printf("   trim released %zu spare slabs\n", trimmed);
+#endif
+}
+
+class StreamingStderrLogger : public Log::LogCallback
+{
+  public:
+    void callback(const LogCord &cord)
+    {
+        for (size_t i = 0; i < cord.length(); ++i)
+        {
+            fprintf(stderr, "%c", cord[i]);
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+    StreamingStderrLogger logger;
+    Log::instance().installCallback(&logger, true);
+
+    std::atomic<bool> ready(false);
+    tcpip_init(
+        [](void *arg) {
+            reinterpret_cast<std::atomic<bool> *>(arg)->store(true);
+        },
+        &ready);
+    while (!ready)
+    {
+        std::this_thread::yield();
+    }
+
+    new NetworkStack();
+
+    BenchDevice *dev = new BenchDevice();
+    NetworkStack::instance().registerDevice(dev);
+    struct netif *iface = NetworkStack::instance().getInterface(dev);
+
+    onLwipThread([iface]() {
+        ip4_addr_t ip, mask, gw;
+        IP4_ADDR(&ip, 10, 0, 0, 2);
+        IP4_ADDR(&mask, 255, 255, 255, 0);
+        IP4_ADDR(&gw, 10, 0, 0, 1);
+        netif_set_addr(iface, &ip, &mask, &gw);
+        netif_set_default(iface);
+        netif_set_up(iface);
+
+        struct udp_pcb *pcb = udp_new();
+        udp_bind(pcb, IP_ADDR_ANY, RX_PORT);
+        udp_recv(pcb, udpReceived, nullptr);
+    });
+
+    printf("=> Receive path (%u UDP frames of %u bytes)...\n", RX_FRAMES,
+           RX_PAYLOAD);
+    const size_t batches[] = {1, 8, 32, 64};
+    for (size_t batch : batches)
+    {
+        benchReceive(dev, batch, false);
+    }
+    for (size_t batch : batches)
+    {
+        benchReceive(dev, batch, true);
+    }
+
+    printf("=> Transmit path (%u MB over reflected TCP)...\n",
+           TX_BYTES / (1024 * 1024));
+    benchTransmit(dev, false, 5001);
+    benchTransmit(dev, true, 5002);
+    benchTransmit(dev, false, 5003);
+    benchTransmit(dev, true, 5004);
+
+    printf(
+        "=> memp allocation (%s, bursts of %u)...\n",
+        MEMP_PEDIGREE_POOLS ? "per-CPU pools" : "heap", MEMP_BURST);
+    benchMemp(1, false);
+    benchMemp(4, false);
+    benchMemp(4, true);
+
+    printMempStatistics();
+
+    return 0;
+}
@@ -20,15 +20,21 @@
 #define PEDIGREE_EXTERNAL_SOURCE 1
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <thread>
+#include <vector>
 
+#include "modules/system/ramfs/RamFs.h"
 #include "modules/system/vfs/VFS.h"
 
+#include "modules/subsys/posix/FileDescriptor.h"
 #include "modules/subsys/posix/PosixSubsystem.h"
 #include "modules/subsys/posix/UnixFilesystem.h"
+#include "modules/subsys/posix/epoll-syscalls.h"
 #include "modules/subsys/posix/net-syscalls.h"
 #include "modules/subsys/posix/poll-syscalls.h"
 
@@ -39,6 +45,41 @@
 
 UnixFilesystem *g_pUnixFilesystem = 0;
 
+/// Size of the file pushed through the socket for the sendfile() numbers.
+#define PAYLOAD_SIZE (16 << 20)
+/// Per-call transfer size, which fits within the stream's queue.
+#define PAYLOAD_CHUNK 65536
+
+/// Idle descriptors registered for the epoll_wait() vs poll() numbers.
+static const size_t g_IdleCounts[] = {10, 100, 1000, 5000};
+/// Waits timed for each idle count.
+#define WAIT_ITERATIONS 2000
+
+/// Reads exactly \p n bytes from \p sock into \p buf.
+static bool drain(int sock, char *buf, size_t n)
+{
+    while (n)
+    {
+        ssize_t r = posix_recv(sock, buf, n, 0);
+        if (r <= 0)
+        {
+            return false;
+        }
+        buf += r;
+        n -= r;
+    }
+
+    return true;
+}
+
+static double megabytesPerSecond(
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+    std::chrono::duration<double> seconds = end - start;
+    return (PAYLOAD_SIZE / (1024.0 * 1024.0)) / seconds.count();
+}
+
 class StreamingStderrLogger : public Log::LogCallback
 {
   public:
@@ -299,6 +340,211 @@ int main(int argc, char **argv)
     assert(!memcmp(buf, "hello", 6));
     memset(buf, 0, 128);
 
+    printf("=> sendfile() tests...\n");
+
+    RamFs *pRamFs = new RamFs();
+    pRamFs->initialise(nullptr);
+    VFS::instance().addAlias(pRamFs, String("ramfs"));
+    VFS::instance().createFile(String("ramfs»/payload"), 0644);
+    File *pPayload = VFS::instance().find(String("ramfs»/payload"));
+    assert(pPayload);
+
+    std::vector<char> chunk(PAYLOAD_CHUNK), received(PAYLOAD_CHUNK);
+    for (size_t off = 0; off < PAYLOAD_SIZE; off += PAYLOAD_CHUNK)
+    {
+        for (size_t i = 0; i < PAYLOAD_CHUNK; ++i)
+        {
+            chunk[i] = static_cast<char>((off + i) * 13);
+        }
+        pPayload->write(
+            off, PAYLOAD_CHUNK, reinterpret_cast<uintptr_t>(chunk.data()));
+    }
+
+    int payloadFd = getAvailableDescriptor();
+    addDescriptor(
+        payloadFd, new FileDescriptor(pPayload, 0, payloadFd, 0, O_RDONLY));
+
+    printf("  --> file -> stream socket\n");
+
+    // The data must arrive intact, and the descriptor offset must move.
+    assert(posix_sendfile(s2, payloadFd, nullptr, 1000) == 1000);
+    assert(drain(fd2, received.data(), 1000));
+    assert(getDescriptor(payloadFd)->offset == 1000);
+    off_t offset = PAYLOAD_SIZE - 10;
+    assert(posix_sendfile(s2, payloadFd, &offset, 100) == 10);
+    assert(drain(fd2, received.data() + 1000, 10));
+    assert(offset == PAYLOAD_SIZE);
+    assert(getDescriptor(payloadFd)->offset == 1000);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        assert(received[i] == static_cast<char>(i * 13));
+    }
+    for (size_t i = 0; i < 10; ++i)
+    {
+        assert(
+            received[1000 + i] ==
+            static_cast<char>((PAYLOAD_SIZE - 10 + i) * 13));
+    }
+
+    printf("  --> throughput vs read() + send()\n");
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < PAYLOAD_SIZE; off += PAYLOAD_CHUNK)
+    {
+        size_t n = pPayload->read(
+            off, PAYLOAD_CHUNK, reinterpret_cast<uintptr_t>(chunk.data()));
+        assert(posix_send(s2, chunk.data(), n, 0) == ssize_t(n));
+        assert(drain(fd2, received.data(), n));
+    }
+    auto end = std::chrono::steady_clock::now();
+    double readSend = megabytesPerSecond(start, end);
+
+    offset = 0;
+    start = std::chrono::steady_clock::now();
+    while (offset < PAYLOAD_SIZE)
+    {
+        ssize_t n = posix_sendfile(s2, payloadFd, &offset, PAYLOAD_CHUNK);
+        assert(n > 0);
+        assert(drain(fd2, received.data(), n));
+    }
+    end = std::chrono::steady_clock::now();
+    double sendfile = megabytesPerSecond(start, end);
+
+    printf(
+        "  read()+send(): %.1f MB/s, sendfile(): %.1f MB/s\n", readSend,
+        sendfile);
+
+    VFS::instance().removeAllAliases(pRamFs);
+
+    printf("=> epoll() tests...\n");
+
+    int ep = posix_epoll_create1(EPOLL_CLOEXEC);
+    assert(ep >= 0);
+    assert(getDescriptor(ep)->fdflags & FD_CLOEXEC);
+    assert(posix_epoll_create(0) == -1 && errno == EINVAL);
+
+    struct epoll_event ev, evs[8];
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0x1234;
+
+    printf("  --> registration\n");
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_ADD, fd2, &ev) == 0);
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_ADD, fd2, &ev) == -1);
+    assert(errno == EEXIST);
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_ADD, ep, &ev) == -1);
+    assert(errno == EINVAL);
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_MOD, s2, &ev) == -1);
+    assert(errno == ENOENT);
+    assert(posix_epoll_ctl(fd2, EPOLL_CTL_ADD, s2, &ev) == -1);
+    assert(errno == EINVAL);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+
+    printf("  --> level-triggered\n");
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    assert(evs[0].events == EPOLLIN);
+    assert(evs[0].data.u64 == 0x1234);
+    // Still unread, so reported again.
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    assert(posix_recv(fd2, buf, 128, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+
+    printf("  --> edge-triggered\n");
+    ev.events = EPOLLIN | EPOLLET;
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_MOD, fd2, &ev) == 0);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    // Not reported again until more data arrives, even though unread.
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    assert(posix_recv(fd2, buf, 128, 0) == 12);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+
+    printf("  --> one-shot\n");
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_MOD, fd2, &ev) == 0);
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+    // Re-arming reports the data that's already waiting.
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_MOD, fd2, &ev) == 0);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    assert(posix_recv(fd2, buf, 128, 0) == 12);
+
+    printf("  --> writable and maxevents\n");
+    ev.events = EPOLLOUT;
+    ev.data.u64 = 0x5678;
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_ADD, s2, &ev) == 0);
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0x1234;
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_MOD, fd2, &ev) == 0);
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 1, 0) == 1);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 2);
+    assert(evs[0].data.u64 != evs[1].data.u64);
+    assert(posix_recv(fd2, buf, 128, 0) == 6);
+
+    printf("  --> removal\n");
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_DEL, s2, nullptr) == 0);
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_DEL, s2, nullptr) == -1);
+    assert(errno == ENOENT);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 0);
+    assert(posix_send(s2, msg, 6, 0) == 6);
+    assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+    assert(evs[0].data.u64 == 0x1234);
+    assert(posix_recv(fd2, buf, 128, 0) == 6);
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_DEL, fd2, nullptr) == 0);
+    assert(getDescriptor(fd2)->epollItems.count() == 0);
+
+    printf("  --> wait latency vs registered descriptors\n");
+    std::vector<int> idle;
+    std::vector<struct pollfd> pollfds;
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0x1234;
+    assert(posix_epoll_ctl(ep, EPOLL_CTL_ADD, fd2, &ev) == 0);
+    pollfds.push_back({fd2, POLLIN, 0});
+    for (size_t count : g_IdleCounts)
+    {
+        while (idle.size() < count)
+        {
+            int sock = posix_socket(AF_UNIX, SOCK_DGRAM, 0);
+            assert(sock >= 0);
+            ev.data.u64 = sock;
+            assert(posix_epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) == 0);
+            idle.push_back(sock);
+            pollfds.push_back({sock, POLLIN, 0});
+        }
+
+        // One active descriptor among the idle ones, as a busy server sees.
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < WAIT_ITERATIONS; ++i)
+        {
+            assert(posix_send(s2, msg, 1, 0) == 1);
+            assert(posix_epoll_wait(ep, evs, 8, 0) == 1);
+            assert(posix_recv(fd2, buf, 128, 0) == 1);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::micro> epollTime = end - start;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < WAIT_ITERATIONS; ++i)
+        {
+            assert(posix_send(s2, msg, 1, 0) == 1);
+            assert(posix_poll(pollfds.data(), pollfds.size(), 0) == 1);
+            assert(posix_recv(fd2, buf, 128, 0) == 1);
+        }
+        end = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::micro> pollTime = end - start;
+
+        printf(
+            "  %5zd fds: epoll_wait() %.2f us, poll() %.2f us\n", count,
+            epollTime.count() / WAIT_ITERATIONS,
+            pollTime.count() / WAIT_ITERATIONS);
+    }
+
     // final test is to have two threads connect to each other
 
     fprintf(stderr, "All OK\n");
@@ -300,8 +300,6 @@ Mutex::~Mutex()
 
 bool Mutex::acquire()
 {
-    errno = 0;
-
     pthread_mutex_t *mutex = reinterpret_cast<pthread_mutex_t *>(m_Private);
     int r = pthread_mutex_lock(mutex);
     if (r == 0)
@@ -310,6 +308,7 @@ bool Mutex::acquire()
     }
     else
     {
+        errno = r;
         perror("pthread_mutex_lock");
     }
 
@@ -335,12 +334,11 @@ bool Mutex::tryAcquire()
 
 void Mutex::release()
 {
-    errno = 0;
-
     pthread_mutex_t *mutex = reinterpret_cast<pthread_mutex_t *>(m_Private);
     int r = pthread_mutex_unlock(mutex);
     if (r != 0)
     {
+        errno = r;
         perror("pthread_mutex_unlock");
     }
 }
@@ -404,14 +402,24 @@ MemoryPool::~MemoryPool()
 
 bool MemoryPool::initialise(size_t poolSize, size_t bufferSize)
 {
-    m_BufferSize = bufferSize;
+    // As in the kernel, buffers are a power of two in size and aligned to it.
+    m_BufferSize = 1;
+    while (m_BufferSize < bufferSize)
+    {
+        m_BufferSize <<= 1;
+    }
     m_bInitialised = true;
     return true;
 }
 
 uintptr_t MemoryPool::allocate()
 {
-    return reinterpret_cast<uintptr_t>(malloc(m_BufferSize));
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, m_BufferSize, m_BufferSize) != 0)
+    {
+        return 0;
+    }
+    return reinterpret_cast<uintptr_t>(buffer);
 }
 
 uintptr_t MemoryPool::allocateNow()
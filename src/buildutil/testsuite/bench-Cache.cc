@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+
+#include "pedigree/kernel/utilities/Cache.h"
+
+static size_t g_Writebacks = 0;
+
+static void writebackCallback(
+    CacheConstants::CallbackCause cause, uintptr_t loc, uintptr_t page,
+    void *meta)
+{
+    if (cause == CacheConstants::WriteBack)
+    {
+        ++g_Writebacks;
+    }
+}
+
+/// Grows the given cache to at least the given number of (clean) pages.
+static void growCache(Cache &cache, size_t &nPages, size_t target)
+{
+    for (; nPages < target; ++nPages)
+    {
+        uintptr_t key = nPages * 4096;
+        cache.insert(key);
+        cache.markNoLongerEditing(key);
+    }
+}
+
+static void BM_CacheTimerChecksum(benchmark::State &state)
+{
+    static Cache cache;
+    static size_t nPages = 0;
+    static bool setup = false;
+    if (!setup)
+    {
+        cache.setCallback(writebackCallback, nullptr);
+        setup = true;
+    }
+
+    growCache(cache, nPages, state.range(0));
+
+    // Settle page states so we only measure steady-state timer runs.
+    cache.writeBack();
+
+    while (state.KeepRunning())
+    {
+        cache.writeBack();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetComplexityN(state.range(0));
+}
+
+static void BM_CacheTimerDirtyTracking(benchmark::State &state)
+{
+    static Cache cache;
+    static size_t nPages = 0;
+    static bool setup = false;
+    if (!setup)
+    {
+        cache.setCallback(writebackCallback, nullptr);
+        cache.setDirtyTracking(true);
+        setup = true;
+    }
+
+    growCache(cache, nPages, state.range(0));
+    cache.writeBack();
+
+    // A fixed number of pages are dirtied per run, regardless of cache size.
+    const size_t dirtyPerRun = 16;
+    size_t next = 0;
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < dirtyPerRun; ++i)
+        {
+            cache.markDirty((next++ % nPages) * 4096);
+        }
+
+        cache.writeBack();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK(BM_CacheTimerChecksum)->Range(64, 16384)->Complexity();
+BENCHMARK(BM_CacheTimerDirtyTracking)->Range(64, 16384)->Complexity();
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+
+#include "pedigree/kernel/utilities/DescriptorTable.h"
+#include "pedigree/kernel/utilities/Tree.h"
+#include "pedigree/kernel/utilities/UnlikelyLock.h"
+
+/// Looks up every descriptor in a table of state.range(0) descriptors.
+static void BM_DescriptorTableLookup(benchmark::State &state)
+{
+    const size_t count = state.range(0);
+
+    DescriptorTable<int> table;
+    for (size_t i = 0; i < count; ++i)
+    {
+        table.set(i, new int(i));
+    }
+
+    size_t fd = 0;
+    while (state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(table.lookup(fd));
+        if (++fd == count)
+        {
+            fd = 0;
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+/// The Tree + UnlikelyLock reader path that PosixSubsystem used before.
+static void BM_DescriptorTreeLookup(benchmark::State &state)
+{
+    const size_t count = state.range(0);
+
+    Tree<size_t, int *> tree;
+    UnlikelyLock lock;
+    for (size_t i = 0; i < count; ++i)
+    {
+        tree.insert(i, new int(i));
+    }
+
+    size_t fd = 0;
+    while (state.KeepRunning())
+    {
+        while (!lock.enter())
+            ;
+        benchmark::DoNotOptimize(tree.lookup(fd));
+        lock.leave();
+        if (++fd == count)
+        {
+            fd = 0;
+        }
+    }
+
+    for (auto it = tree.begin(); it != tree.end(); ++it)
+    {
+        delete it.value();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+/// Cost of fork(): copying each descriptor into a new table or tree.
+static void BM_DescriptorTableCopy(benchmark::State &state)
+{
+    const size_t count = state.range(0);
+
+    DescriptorTable<int> table;
+    for (size_t i = 0; i < count; ++i)
+    {
+        table.set(i, new int(i));
+    }
+
+    while (state.KeepRunning())
+    {
+        DescriptorTable<int> child;
+        for (size_t i = 0; i < table.capacity(); ++i)
+        {
+            int *p = table.lookup(i);
+            if (p)
+            {
+                child.set(i, new int(*p));
+            }
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+static void BM_DescriptorTreeCopy(benchmark::State &state)
+{
+    const size_t count = state.range(0);
+
+    Tree<size_t, int *> tree;
+    for (size_t i = 0; i < count; ++i)
+    {
+        tree.insert(i, new int(i));
+    }
+
+    while (state.KeepRunning())
+    {
+        Tree<size_t, int *> child;
+        for (auto it = tree.begin(); it != tree.end(); ++it)
+        {
+            child.insert(it.key(), new int(*it.value()));
+        }
+        for (auto it = child.begin(); it != child.end(); ++it)
+        {
+            delete it.value();
+        }
+    }
+
+    for (auto it = tree.begin(); it != tree.end(); ++it)
+    {
+        delete it.value();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+BENCHMARK(BM_DescriptorTableLookup)->Arg(10)->Arg(1000)->Arg(100000);
+BENCHMARK(BM_DescriptorTreeLookup)->Arg(10)->Arg(1000)->Arg(100000);
+BENCHMARK(BM_DescriptorTableCopy)->Arg(10)->Arg(1000)->Arg(100000);
+BENCHMARK(BM_DescriptorTreeCopy)->Arg(10)->Arg(1000)->Arg(100000);
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "pedigree/kernel/utilities/Buffer.h"
+#include "pedigree/kernel/utilities/PageRing.h"
+
+// Same capacity as a pipe.
+#define RING_PAGES 16
+#define RING_SIZE (RING_PAGES * PageRing::PageSize)
+
+/// Pushes 1 MiB through the ring in chunks of state.range(0) bytes.
+static void BM_PageRingWriteRead(benchmark::State &state)
+{
+    const size_t chunk = state.range(0);
+    const size_t total = 1 << 20;
+    std::vector<uint8_t> in(chunk, 0xAB), out(chunk);
+
+    PageRing ring(RING_PAGES);
+    while (state.KeepRunning())
+    {
+        for (size_t done = 0; done < total; done += chunk)
+        {
+            ring.write(in.data(), chunk, false);
+            benchmark::DoNotOptimize(ring.read(out.data(), chunk, false));
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(total));
+}
+
+/// The Buffer<uint8_t> that Pipe used before PageRing, for comparison.
+static void BM_BufferWriteRead(benchmark::State &state)
+{
+    const size_t chunk = state.range(0);
+    const size_t total = 1 << 20;
+    std::vector<uint8_t> in(chunk, 0xAB), out(chunk);
+
+    Buffer<uint8_t> buffer(RING_SIZE);
+    while (state.KeepRunning())
+    {
+        for (size_t done = 0; done < total; done += chunk)
+        {
+            buffer.write(in.data(), chunk, false);
+            benchmark::DoNotOptimize(buffer.read(out.data(), chunk, false));
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(total));
+}
+
+/// Fills the ring, then reads it back in chunks of state.range(0) bytes.
+static void BM_PageRingFillDrain(benchmark::State &state)
+{
+    const size_t chunk = state.range(0);
+    std::vector<uint8_t> in(chunk, 0xAB), out(chunk);
+
+    PageRing ring(RING_PAGES);
+    while (state.KeepRunning())
+    {
+        size_t n = 0;
+        while (ring.write(in.data(), chunk, false) == chunk)
+        {
+            n += chunk;
+        }
+        while (ring.read(out.data(), chunk, false))
+            ;
+        benchmark::DoNotOptimize(n);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(RING_SIZE));
+}
+
+static void BM_BufferFillDrain(benchmark::State &state)
+{
+    const size_t chunk = state.range(0);
+    std::vector<uint8_t> in(chunk, 0xAB), out(chunk);
+
+    Buffer<uint8_t, true> buffer(RING_SIZE);
+    while (state.KeepRunning())
+    {
+        size_t n = 0;
+        while (buffer.write(in.data(), chunk, false) == chunk)
+        {
+            n += chunk;
+        }
+        while (buffer.read(out.data(), chunk, false))
+            ;
+        benchmark::DoNotOptimize(n);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(RING_SIZE));
+}
+
+/// Moves a full ring of data to a second ring and back again without copying.
+static void BM_PageRingSplice(benchmark::State &state)
+{
+    std::vector<uint8_t> in(RING_SIZE, 0xAB);
+
+    PageRing a(RING_PAGES), b(RING_PAGES);
+    a.write(in.data(), RING_SIZE, false);
+    while (state.KeepRunning())
+    {
+        a.splice(b, RING_SIZE, false);
+        b.splice(a, RING_SIZE, false);
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(RING_SIZE) * 2);
+}
+
+BENCHMARK(BM_PageRingWriteRead)->Range(64, 64 << 10);
+BENCHMARK(BM_BufferWriteRead)->Range(64, 64 << 10);
+BENCHMARK(BM_PageRingFillDrain)->Range(64, 64 << 10);
+BENCHMARK(BM_BufferFillDrain)->Range(64, 64 << 10);
+BENCHMARK(BM_PageRingSplice);
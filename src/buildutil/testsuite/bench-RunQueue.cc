@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "pedigree/kernel/process/RunQueue.h"
+#include "pedigree/kernel/utilities/List.h"
+
+#define LEVELS 8
+#define LEVEL 1
+
+struct QueuedThread
+{
+    RunQueueLink<QueuedThread> link;
+};
+
+typedef RunQueue<QueuedThread, LEVELS, &QueuedThread::link> ThreadRunQueue;
+
+/** The List-based ready queues RoundRobin used before RunQueue. */
+class ListRunQueue
+{
+  public:
+    void wake(QueuedThread *p)
+    {
+        // Don't double-queue.
+        for (List<QueuedThread *>::Iterator it = m_Queues[LEVEL].begin();
+             it != m_Queues[LEVEL].end(); ++it)
+        {
+            if (*it == p)
+            {
+                return;
+            }
+        }
+
+        m_Queues[LEVEL].pushBack(p);
+    }
+
+    QueuedThread *next()
+    {
+        for (size_t i = 0; i < LEVELS; ++i)
+        {
+            if (m_Queues[i].count())
+            {
+                return m_Queues[i].popFront();
+            }
+        }
+
+        return 0;
+    }
+
+    void remove(QueuedThread *p)
+    {
+        for (size_t i = 0; i < LEVELS; ++i)
+        {
+            for (List<QueuedThread *>::Iterator it = m_Queues[i].begin();
+                 it != m_Queues[i].end(); ++it)
+            {
+                if (*it == p)
+                {
+                    m_Queues[i].erase(it);
+                    return;
+                }
+            }
+        }
+    }
+
+  private:
+    List<QueuedThread *> m_Queues[LEVELS];
+};
+
+static void BM_RunQueueWakeup(benchmark::State &state)
+{
+    std::vector<QueuedThread> threads(state.range(0));
+    ThreadRunQueue queue;
+    for (auto &thread : threads)
+    {
+        queue.pushBack(&thread, LEVEL);
+    }
+
+    while (state.KeepRunning())
+    {
+        QueuedThread *p = queue.popFront();
+        queue.pushBack(p, LEVEL);
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+static void BM_ListRunQueueWakeup(benchmark::State &state)
+{
+    std::vector<QueuedThread> threads(state.range(0));
+    ListRunQueue queue;
+    for (auto &thread : threads)
+    {
+        queue.wake(&thread);
+    }
+
+    while (state.KeepRunning())
+    {
+        QueuedThread *p = queue.next();
+        queue.wake(p);
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+static void BM_RunQueueRemove(benchmark::State &state)
+{
+    std::vector<QueuedThread> threads(state.range(0));
+    ThreadRunQueue queue;
+    for (auto &thread : threads)
+    {
+        queue.pushBack(&thread, LEVEL);
+    }
+
+    // Remove a thread from the middle of the queue and put it back.
+    size_t i = 0;
+    while (state.KeepRunning())
+    {
+        QueuedThread *p = &threads[i];
+        queue.remove(p);
+        queue.pushBack(p, LEVEL);
+        i = (i + 1) % threads.size();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+static void BM_ListRunQueueRemove(benchmark::State &state)
+{
+    std::vector<QueuedThread> threads(state.range(0));
+    ListRunQueue queue;
+    for (auto &thread : threads)
+    {
+        queue.wake(&thread);
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning())
+    {
+        QueuedThread *p = &threads[i];
+        queue.remove(p);
+        queue.wake(p);
+        i = (i + 1) % threads.size();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+BENCHMARK(BM_RunQueueWakeup)->Range(8, 4096);
+BENCHMARK(BM_ListRunQueueWakeup)->Range(8, 4096);
+BENCHMARK(BM_RunQueueRemove)->Range(8, 4096);
+BENCHMARK(BM_ListRunQueueRemove)->Range(8, 4096);
@@ -21,8 +21,10 @@
 
 #include <benchmark/benchmark.h>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "pedigree/kernel/core/SlamAllocator.h"
 
@@ -52,5 +54,126 @@ static void BM_SlamAllocatorBackForth(benchmark::State &state)
     state.SetBytesProcessed(int64_t(state.iterations()) * OBJECT_MINIMUM_SIZE);
 }
 
+static void BM_SlamAllocatorThreadedBackForth(benchmark::State &state)
+{
+    // Make sure initialisation doesn't end up in the timed region.
+    SlamAllocator::instance().initialise();
+
+    while (state.KeepRunning())
+    {
+        uintptr_t mem = SlamAllocator::instance().allocate(state.range(0));
+        benchmark::DoNotOptimize(mem);
+        SlamAllocator::instance().free(mem);
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+static void BM_SlamAllocatorThreadedBatch(benchmark::State &state)
+{
+    SlamAllocator::instance().initialise();
+
+    // Enough objects to run through several magazines each time.
+    const size_t batch = 256;
+    uintptr_t objects[batch];
+
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < batch; ++i)
+        {
+            objects[i] = SlamAllocator::instance().allocate(state.range(0));
+        }
+
+        for (size_t i = 0; i < batch; ++i)
+        {
+            SlamAllocator::instance().free(objects[i]);
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * batch);
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * batch * state.range(0));
+}
+
+static const size_t crossThreadSlots = 1024;
+static std::atomic<uintptr_t> g_CrossThreadObjects[crossThreadSlots];
+
+static void BM_SlamAllocatorCrossThreadFree(benchmark::State &state)
+{
+    SlamAllocator::instance().initialise();
+
+    // Swap freshly allocated objects into a shared table and free whatever
+    // was there, which most of the time was allocated by another thread.
+    size_t slot = reinterpret_cast<uintptr_t>(&state) % crossThreadSlots;
+    while (state.KeepRunning())
+    {
+        uintptr_t mem = SlamAllocator::instance().allocate(state.range(0));
+        uintptr_t old = g_CrossThreadObjects[slot].exchange(mem);
+        if (old)
+        {
+            SlamAllocator::instance().free(old);
+        }
+
+        slot = (slot + 7) % crossThreadSlots;
+    }
+
+    for (size_t i = 0; i < crossThreadSlots; ++i)
+    {
+        uintptr_t old = g_CrossThreadObjects[i].exchange(0);
+        if (old)
+        {
+            SlamAllocator::instance().free(old);
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+static void BM_SlamAllocatorSlabRefillNearlyFull(benchmark::State &state)
+{
+    SlamAllocator &allocator = SlamAllocator::instance();
+    allocator.clearAll();
+
+    // Fill the heap to 90% with single-page slabs.
+    size_t heapPages =
+        (SlamSupport::getHeapEnd() - SlamSupport::getHeapBase()) / 0x1000;
+    std::vector<uintptr_t> slabs;
+    slabs.reserve((heapPages * 9) / 10);
+    while (allocator.heapPageCount() < (heapPages * 9) / 10)
+    {
+        slabs.push_back(allocator.getSlab(0x1000));
+    }
+
+    // Now see how long it takes to find room for another slab.
+    size_t slabSize = state.range(0) * 0x1000;
+    while (state.KeepRunning())
+    {
+        uintptr_t slab = allocator.getSlab(slabSize);
+        benchmark::DoNotOptimize(slab);
+        allocator.freeSlab(slab, slabSize);
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+
+    allocator.clearAll();
+}
+
 BENCHMARK(BM_SlamAllocatorBackForthReference);
 BENCHMARK(BM_SlamAllocatorBackForth);
+BENCHMARK(BM_SlamAllocatorThreadedBackForth)
+    ->Arg(64)
+    ->Arg(512)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_SlamAllocatorThreadedBatch)
+    ->Arg(64)
+    ->Arg(512)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_SlamAllocatorCrossThreadFree)
+    ->Arg(64)
+    ->Arg(512)
+    ->ThreadRange(2, 8)
+    ->UseRealTime();
+BENCHMARK(BM_SlamAllocatorSlabRefillNearlyFull)->Arg(1)->Arg(4)->Arg(128);
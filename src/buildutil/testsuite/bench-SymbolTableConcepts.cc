@@ -322,6 +322,100 @@ static void BM_SymbolsLookup_KernelGlobal(benchmark::State &state)
     state.SetItemsProcessed(int64_t(state.iterations()));
 }
 
+/// Loads state.range(0) modules into a table already holding the kernel's
+/// symbols. Each module exports some globals, has some locals, and then
+/// resolves its relocations against the kernel and earlier modules, as
+/// Elf::relocateModinfo does. The kernel ELF sorts after every module, as the
+/// lookup used to walk the per-ELF tables in address order.
+static void BM_SymbolsModuleLoad(benchmark::State &state)
+{
+    const int nModules = state.range(0);
+    const int nExports = 200;
+    const int nLocals = 100;
+    const int nRelocations = 1000;
+
+    std::vector<String> kernelSymbols;
+    LoadSymbols(kernelSymbols);
+
+    std::vector<std::vector<String>> exports(nModules);
+    std::vector<std::vector<String>> locals(nModules);
+    std::vector<std::vector<const String *>> relocations(nModules);
+    srand(0);
+    for (int m = 0; m < nModules; ++m)
+    {
+        for (int i = 0; i < nExports; ++i)
+        {
+            String name;
+            name.Format("module%d_export%d", m, i);
+            exports[m].push_back(name);
+        }
+        for (int i = 0; i < nLocals; ++i)
+        {
+            String name;
+            name.Format("module%d_local%d", m, i);
+            locals[m].push_back(name);
+        }
+
+        // Mostly kernel symbols, the rest exported by earlier modules.
+        for (int i = 0; i < nRelocations; ++i)
+        {
+            if (m && (rand() % 10) < 3)
+            {
+                int dep = rand() % m;
+                relocations[m].push_back(&exports[dep][rand() % nExports]);
+            }
+            else
+            {
+                relocations[m].push_back(
+                    &kernelSymbols[rand() % kernelSymbols.size()]);
+            }
+        }
+    }
+
+    Elf *kernelElf = reinterpret_cast<Elf *>(0x100000);
+    std::vector<Elf *> moduleElfs;
+    for (int m = 0; m < nModules; ++m)
+    {
+        moduleElfs.push_back(reinterpret_cast<Elf *>(0x1000 + (m * 0x100)));
+    }
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        SymbolTable *table = new SymbolTable(kernelElf);
+        for (auto &word : kernelSymbols)
+        {
+            table->insert(word, SymbolTable::Global, kernelElf, 0xdeadbeef);
+        }
+        state.ResumeTiming();
+
+        for (int m = 0; m < nModules; ++m)
+        {
+            Elf *pElf = moduleElfs[m];
+            for (auto &word : exports[m])
+            {
+                table->insert(word, SymbolTable::Global, pElf, 0xdeadbeef);
+            }
+            for (auto &word : locals[m])
+            {
+                table->insert(word, SymbolTable::Local, pElf, 0xdeadbeef);
+            }
+
+            for (auto pWord : relocations[m])
+            {
+                benchmark::DoNotOptimize(table->lookup(*pWord, pElf));
+            }
+        }
+
+        state.PauseTiming();
+        delete table;
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(
+        int64_t(state.iterations()) * nModules * nRelocations);
+}
+
 static void BM_SymbolsHash_ElfHash(benchmark::State &state)
 {
     std::vector<String> symbols;
@@ -387,6 +481,7 @@ BENCHMARK(BM_SymbolsInsert_ElfHash);
 BENCHMARK(BM_SymbolsInsert_JenkinsHash);
 BENCHMARK(BM_SymbolsLookup_KernelLocal);
 BENCHMARK(BM_SymbolsLookup_KernelGlobal);
+BENCHMARK(BM_SymbolsModuleLoad)->Arg(8)->Arg(64);
 BENCHMARK(BM_SymbolsHash_ElfHash);
 BENCHMARK(BM_SymbolsHash_JenkinsHash);
 
@@ -19,18 +19,26 @@
 
 #define PEDIGREE_EXTERNAL_SOURCE 1
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <memory>
 
 #include <benchmark/benchmark.h>
 #include <valgrind/callgrind.h>
 
+#include "modules/system/ext2/Ext2Filesystem.h"
+#include "modules/system/fat/FatFilesystem.h"
+#include "modules/system/fat/fat.h"
 #include "modules/system/ramfs/RamFs.h"
+#include "modules/system/vfs/File.h"
 #include "modules/system/vfs/VFS.h"
 
+#include "buildutil/ext2img/DiskImage.h"
+
 static String g_DeepPath("ramfs»/foo/foo/foo/foo");
 static String g_ShallowPath("ramfs»/");
 static String g_MiddlePath("ramfs»/foo/foo");
@@ -971,6 +979,362 @@ static void BM_VFSRandomDirectoryTraverseNoFs(benchmark::State &state)
     vfs.removeAllAliases(ramfs.get(), false);
 }
 
+// Ext2Filesystem expects the host to provide timestamps (see ext2img).
+uint32_t getUnixTimestamp()
+{
+    return time(0);
+}
+
+static const size_t g_Ext2FileSize = 16 << 20;
+static const size_t g_Ext2ReadSize = 64 << 10;
+static String g_Ext2Alias("ext2bench");
+static String g_Ext2Path("ext2bench»/data");
+
+/// Creates (once) an ext2 image holding one large file, written through the
+/// VFS like ext2img does.
+static DiskImage *prepareExt2Image()
+{
+    static DiskImage *image = nullptr;
+    static bool tried = false;
+    if (tried)
+    {
+        return image;
+    }
+    tried = true;
+
+    static char path[64];
+    snprintf(path, sizeof path, "/tmp/bench-vfs-%d.img", getpid());
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        return nullptr;
+    }
+    int ok = ftruncate(fileno(fp), 64 << 20);
+    fclose(fp);
+
+    char cmd[192];
+    snprintf(
+        cmd, sizeof cmd,
+        "PATH=$PATH:/sbin:/usr/sbin mke2fs -q -F -b 4096 -I 128 "
+        "-O ^dir_index %s >/dev/null 2>&1",
+        path);
+    if (ok != 0 || system(cmd) != 0)
+    {
+        unlink(path);
+        return nullptr;
+    }
+
+    image = new DiskImage(path);
+    if (!image->initialise())
+    {
+        delete image;
+        image = nullptr;
+        unlink(path);
+        return nullptr;
+    }
+
+    // The mapping keeps the image alive for the rest of the run.
+    unlink(path);
+
+    VFS vfs;
+    Ext2Filesystem *pFs = new Ext2Filesystem();
+    pFs->initialise(image);
+    vfs.addAlias(pFs, g_Ext2Alias);
+    vfs.createFile(g_Ext2Path, 0644);
+
+    char *buffer = new char[g_Ext2ReadSize];
+    File *pFile = vfs.find(g_Ext2Path);
+    for (size_t off = 0; pFile && off < g_Ext2FileSize; off += g_Ext2ReadSize)
+    {
+        memset(buffer, off / g_Ext2ReadSize, g_Ext2ReadSize);
+        pFile->write(
+            off, g_Ext2ReadSize, reinterpret_cast<uintptr_t>(buffer));
+    }
+    delete[] buffer;
+
+    vfs.removeAllAliases(pFs);
+    return image;
+}
+
+/// Reads the whole test file in 64K chunks, either front to back or in a
+/// shuffled order, against a freshly-mounted (cold) filesystem each pass.
+static void ext2ReadFile(benchmark::State &state, bool sequential)
+{
+    DiskImage *image = prepareExt2Image();
+    if (!image)
+    {
+        state.SkipWithError("could not create an ext2 image (mke2fs?)");
+        return;
+    }
+
+    const size_t nChunks = g_Ext2FileSize / g_Ext2ReadSize;
+    size_t *order = new size_t[nChunks];
+    for (size_t i = 0; i < nChunks; ++i)
+    {
+        order[i] = i;
+    }
+    if (!sequential)
+    {
+        srand(0);
+        for (size_t i = nChunks - 1; i > 0; --i)
+        {
+            size_t j = rand() % (i + 1);
+            size_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    char *buffer = new char[g_Ext2ReadSize];
+    VFS vfs;
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        Ext2Filesystem *pFs = new Ext2Filesystem();
+        pFs->initialise(image);
+        vfs.addAlias(pFs, g_Ext2Alias);
+        File *pFile = vfs.find(g_Ext2Path);
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < nChunks; ++i)
+        {
+            benchmark::DoNotOptimize(pFile->read(
+                order[i] * g_Ext2ReadSize, g_Ext2ReadSize,
+                reinterpret_cast<uintptr_t>(buffer)));
+        }
+
+        state.PauseTiming();
+        vfs.removeAllAliases(pFs);
+        state.ResumeTiming();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * g_Ext2FileSize);
+
+    delete[] buffer;
+    delete[] order;
+}
+
+static void BM_VFSExt2SequentialRead(benchmark::State &state)
+{
+    ext2ReadFile(state, true);
+}
+
+static void BM_VFSExt2RandomRead(benchmark::State &state)
+{
+    ext2ReadFile(state, false);
+}
+
+/// Appends a log-style file in small records and fsyncs it, with the
+/// filesystem mounted write-through (0) or write-back (1).
+static void BM_VFSExt2SmallAppend(benchmark::State &state)
+{
+    DiskImage *image = prepareExt2Image();
+    if (!image)
+    {
+        state.SkipWithError("could not create an ext2 image (mke2fs?)");
+        return;
+    }
+
+    const size_t recordSize = 128;
+    const size_t nRecords = 4096;
+    String logPath("ext2bench»/log");
+
+    char record[recordSize];
+    memset(record, 'x', recordSize);
+
+    VFS vfs;
+    Ext2Filesystem *pFs = new Ext2Filesystem();
+    pFs->initialise(image);
+    pFs->setWriteBack(state.range(0) != 0);
+    vfs.addAlias(pFs, g_Ext2Alias);
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        vfs.createFile(logPath, 0644);
+        File *pFile = vfs.find(logPath);
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < nRecords; ++i)
+        {
+            pFile->write(
+                i * recordSize, recordSize,
+                reinterpret_cast<uintptr_t>(record));
+        }
+        pFile->sync();
+
+        state.PauseTiming();
+        vfs.remove(logPath);
+        state.ResumeTiming();
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * nRecords * recordSize);
+    state.SetItemsProcessed(int64_t(state.iterations()) * nRecords);
+
+    vfs.removeAllAliases(pFs);
+}
+
+static const size_t g_FatFileSize = 16 << 20;
+static String g_FatAlias("fatbench");
+static String g_FatPath("fatbench»/data");
+
+/// Formats an empty FAT32 volume by hand (1K clusters, so a 16M file has a
+/// long chain) and writes the test file into it through the VFS.
+static DiskImage *prepareFatImage()
+{
+    static DiskImage *image = nullptr;
+    static bool tried = false;
+    if (tried)
+    {
+        return image;
+    }
+    tried = true;
+
+    const uint32_t totalSectors = 80 << 11;  // 80M
+    const uint32_t reservedSectors = 32;
+    const uint32_t fatSectors = 640;
+
+    uint8_t boot[512], fsInfo[512];
+    memset(boot, 0, sizeof boot);
+    memset(fsInfo, 0, sizeof fsInfo);
+
+    Superblock *sb = reinterpret_cast<Superblock *>(boot);
+    sb->BS_jmpBoot[0] = 0xEB;
+    sb->BS_jmpBoot[1] = 0x58;
+    sb->BS_jmpBoot[2] = 0x90;
+    memcpy(sb->BS_OEMName, "PEDIGREE", 8);
+    sb->BPB_BytsPerSec = 512;
+    sb->BPB_SecPerClus = 2;
+    sb->BPB_RsvdSecCnt = reservedSectors;
+    sb->BPB_NumFATs = 2;
+    sb->BPB_Media = 0xF8;
+    sb->BPB_TotSec32 = totalSectors;
+
+    Superblock32 *sb32 =
+        reinterpret_cast<Superblock32 *>(boot + sizeof(Superblock));
+    sb32->BPB_FATSz32 = fatSectors;
+    sb32->BPB_RootClus = 2;
+    sb32->BPB_FsInfo = 1;
+    sb32->BS_BootSig = 0x29;
+    memcpy(sb32->BS_VolLab, "NO NAME    ", 11);
+    memcpy(sb32->BS_FilSysType, "FAT32   ", 8);
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+
+    FSInfo32 *info = reinterpret_cast<FSInfo32 *>(fsInfo);
+    info->FSI_LeadSig = 0x41615252;
+    info->FSI_StrucSig = 0x61417272;
+    info->FSI_Free_Count = 0xFFFFFFFF;
+    info->FSI_NxtFree = 3;
+    info->FSI_TrailSig = 0xAA550000;
+
+    // Media descriptor, the reserved entry, and EOF for the root directory.
+    uint32_t fat[3] = {0x0FFFFFF8, 0x0FFFFFFF, 0x0FFFFFFF};
+
+    static char path[64];
+    snprintf(path, sizeof path, "/tmp/bench-vfs-fat-%d.img", getpid());
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        return nullptr;
+    }
+    bool ok = ftruncate(fileno(fp), totalSectors * 512ULL) == 0;
+    ok = ok && fwrite(boot, sizeof boot, 1, fp) == 1;
+    ok = ok && fwrite(fsInfo, sizeof fsInfo, 1, fp) == 1;
+    for (uint32_t i = 0; ok && i < 2; ++i)
+    {
+        ok = fseek(fp, (reservedSectors + (i * fatSectors)) * 512, SEEK_SET) ==
+             0;
+        ok = ok && fwrite(fat, sizeof fat, 1, fp) == 1;
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        unlink(path);
+        return nullptr;
+    }
+
+    image = new DiskImage(path);
+    if (!image->initialise())
+    {
+        delete image;
+        image = nullptr;
+        unlink(path);
+        return nullptr;
+    }
+
+    // The mapping keeps the image alive for the rest of the run.
+    unlink(path);
+
+    VFS vfs;
+    FatFilesystem *pFs = new FatFilesystem();
+    if (!pFs->initialise(image))
+    {
+        delete pFs;
+        delete image;
+        image = nullptr;
+        return nullptr;
+    }
+    vfs.addAlias(pFs, g_FatAlias);
+    vfs.createFile(g_FatPath, 0644);
+
+    char *buffer = new char[g_Ext2ReadSize];
+    File *pFile = vfs.find(g_FatPath);
+    for (size_t off = 0; pFile && off < g_FatFileSize; off += g_Ext2ReadSize)
+    {
+        memset(buffer, off / g_Ext2ReadSize, g_Ext2ReadSize);
+        pFile->write(
+            off, g_Ext2ReadSize, reinterpret_cast<uintptr_t>(buffer));
+    }
+    delete[] buffer;
+
+    vfs.removeAllAliases(pFs);
+    return image;
+}
+
+/// Reads the whole FAT test file in 64K chunks from a freshly-mounted
+/// filesystem each pass, so the cluster chain has to be resolved from cold.
+static void BM_VFSFatSequentialRead(benchmark::State &state)
+{
+    DiskImage *image = prepareFatImage();
+    if (!image)
+    {
+        state.SkipWithError("could not create a FAT32 image");
+        return;
+    }
+
+    char *buffer = new char[g_Ext2ReadSize];
+    VFS vfs;
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        FatFilesystem *pFs = new FatFilesystem();
+        pFs->initialise(image);
+        vfs.addAlias(pFs, g_FatAlias);
+        File *pFile = vfs.find(g_FatPath);
+        state.ResumeTiming();
+
+        for (size_t off = 0; off < g_FatFileSize; off += g_Ext2ReadSize)
+        {
+            benchmark::DoNotOptimize(pFile->read(
+                off, g_Ext2ReadSize, reinterpret_cast<uintptr_t>(buffer)));
+        }
+
+        state.PauseTiming();
+        vfs.removeAllAliases(pFs);
+        state.ResumeTiming();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * g_FatFileSize);
+
+    delete[] buffer;
+}
+
 BENCHMARK(BM_VFSDeepDirectoryTraverse);
 BENCHMARK(BM_VFSMediumDirectoryTraverse);
 BENCHMARK(BM_VFSShallowDirectoryTraverse);
@@ -980,3 +1344,8 @@ BENCHMARK(BM_VFSDeepDirectoryTraverseNoFs);
 BENCHMARK(BM_VFSMediumDirectoryTraverseNoFs);
 BENCHMARK(BM_VFSShallowDirectoryTraverseNoFs);
 BENCHMARK(BM_VFSRandomDirectoryTraverseNoFs);
+
+BENCHMARK(BM_VFSExt2SequentialRead);
+BENCHMARK(BM_VFSExt2RandomRead);
+BENCHMARK(BM_VFSExt2SmallAppend)->Arg(0)->Arg(1);
+BENCHMARK(BM_VFSFatSequentialRead);
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/utilities/Cache.h"
+
+static size_t g_Writebacks = 0;
+static uintptr_t g_LastWriteback = 0;
+
+static void writebackCallback(
+    CacheConstants::CallbackCause cause, uintptr_t loc, uintptr_t page,
+    void *meta)
+{
+    if (cause == CacheConstants::WriteBack)
+    {
+        ++g_Writebacks;
+        g_LastWriteback = loc;
+    }
+}
+
+class PedigreeCacheDirtyTracking : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        g_Writebacks = 0;
+        g_LastWriteback = 0;
+        cache.setCallback(writebackCallback, nullptr);
+        cache.setDirtyTracking(true);
+    }
+
+    Cache cache;
+};
+
+TEST_F(PedigreeCacheDirtyTracking, FillIsClean)
+{
+    cache.insert(0);
+    cache.markNoLongerEditing(0);
+
+    EXPECT_FALSE(cache.isDirty(0));
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 0U);
+}
+
+TEST_F(PedigreeCacheDirtyTracking, MarkDirtyWritesBack)
+{
+    cache.insert(0x1000);
+    cache.markNoLongerEditing(0x1000);
+
+    cache.markDirty(0x1000);
+    EXPECT_TRUE(cache.isDirty(0x1000));
+
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 1U);
+    EXPECT_EQ(g_LastWriteback, 0x1000U);
+    EXPECT_FALSE(cache.isDirty(0x1000));
+
+    // Clean now, so no further writebacks.
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 1U);
+}
+
+TEST_F(PedigreeCacheDirtyTracking, SynchronousWriteBack)
+{
+    cache.insert(0x5000);
+    cache.markNoLongerEditing(0x5000);
+    cache.markDirty(0x5000);
+
+    // As used by sync(): the writeback is done by the time this returns.
+    cache.writeBack(false);
+    EXPECT_EQ(g_Writebacks, 1U);
+    EXPECT_EQ(g_LastWriteback, 0x5000U);
+    EXPECT_FALSE(cache.isDirty(0x5000));
+}
+
+TEST_F(PedigreeCacheDirtyTracking, EditingDefersWriteback)
+{
+    cache.insert(0x2000);
+    cache.markNoLongerEditing(0x2000);
+
+    cache.markEditing(0x2000);
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 0U);
+
+    cache.markNoLongerEditing(0x2000);
+    EXPECT_TRUE(cache.isDirty(0x2000));
+
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 1U);
+}
+
+TEST_F(PedigreeCacheDirtyTracking, TimerIgnoresUntrackedWrites)
+{
+    uintptr_t page = cache.insert(0x3000);
+    cache.markNoLongerEditing(0x3000);
+    cache.writeBack();
+
+    // No page tables in the hosted build, so this isn't seen.
+    *reinterpret_cast<volatile char *>(page) = 1;
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 0U);
+}
+
+TEST_F(PedigreeCacheDirtyTracking, DisableFallsBackToChecksums)
+{
+    cache.insert(0x4000);
+    cache.markNoLongerEditing(0x4000);
+    cache.markDirty(0x4000);
+
+    cache.setDirtyTracking(false);
+    EXPECT_FALSE(cache.isDirtyTracking());
+
+    cache.writeBack();
+    EXPECT_EQ(g_Writebacks, 1U);
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/utilities/DescriptorTable.h"
+
+/// Counts live instances so tests can check who deleted what.
+struct Entry
+{
+    Entry(int v) : value(v)
+    {
+        ++live;
+    }
+
+    Entry(const Entry &other) : value(other.value)
+    {
+        ++live;
+    }
+
+    ~Entry()
+    {
+        --live;
+    }
+
+    int value;
+    static int live;
+};
+
+int Entry::live = 0;
+
+class PedigreeDescriptorTable : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        Entry::live = 0;
+    }
+
+    virtual void TearDown()
+    {
+        EXPECT_EQ(Entry::live, 0);
+    }
+};
+
+TEST_F(PedigreeDescriptorTable, Empty)
+{
+    DescriptorTable<Entry> table;
+
+    EXPECT_EQ(table.capacity(), 0);
+    EXPECT_EQ(table.lookup(0), nullptr);
+    EXPECT_EQ(table.lookup(12345), nullptr);
+    EXPECT_EQ(table.remove(3), nullptr);
+}
+
+TEST_F(PedigreeDescriptorTable, SetAndLookup)
+{
+    DescriptorTable<Entry> table;
+
+    EXPECT_EQ(table.set(3, new Entry(3)), nullptr);
+    EXPECT_EQ(table.capacity(), DescriptorTable<Entry>::MinimumSize);
+    ASSERT_NE(table.lookup(3), nullptr);
+    EXPECT_EQ(table.lookup(3)->value, 3);
+    EXPECT_EQ(table.lookup(2), nullptr);
+
+    Entry *old = table.set(3, new Entry(4));
+    ASSERT_NE(old, nullptr);
+    EXPECT_EQ(old->value, 3);
+    delete old;
+    EXPECT_EQ(table.lookup(3)->value, 4);
+}
+
+TEST_F(PedigreeDescriptorTable, GrowsInPowersOfTwo)
+{
+    DescriptorTable<Entry> table;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.set(i, new Entry(i));
+    }
+
+    EXPECT_EQ(table.capacity(), 1024);
+    for (int i = 0; i < 1000; ++i)
+    {
+        ASSERT_NE(table.lookup(i), nullptr);
+        EXPECT_EQ(table.lookup(i)->value, i);
+    }
+
+    table.set(5000, new Entry(5000));
+    EXPECT_EQ(table.capacity(), 8192);
+    EXPECT_EQ(table.lookup(5000)->value, 5000);
+    EXPECT_EQ(table.lookup(999)->value, 999);
+}
+
+TEST_F(PedigreeDescriptorTable, Remove)
+{
+    DescriptorTable<Entry> table;
+
+    table.set(1, new Entry(1));
+    Entry *p = table.remove(1);
+    ASSERT_NE(p, nullptr);
+    delete p;
+    EXPECT_EQ(table.lookup(1), nullptr);
+    EXPECT_EQ(table.remove(1), nullptr);
+}
+
+TEST_F(PedigreeDescriptorTable, ClearDeletesEntries)
+{
+    DescriptorTable<Entry> table;
+
+    table.set(0, new Entry(0));
+    table.set(40, new Entry(40));
+    EXPECT_EQ(Entry::live, 2);
+
+    table.clear();
+    EXPECT_EQ(Entry::live, 0);
+    EXPECT_EQ(table.lookup(40), nullptr);
+}
+
+TEST_F(PedigreeDescriptorTable, OldTableStaysReadable)
+{
+    DescriptorTable<Entry> table;
+
+    table.set(0, new Entry(0));
+    Entry *before = table.lookup(0);
+
+    // Force several reallocations; the entry pointer must not move.
+    table.set(100000, new Entry(1));
+    EXPECT_EQ(table.lookup(0), before);
+    EXPECT_EQ(table.capacity(), 131072);
+}
@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "buildutil/ext2img/DiskImage.h"
+#include "pedigree/kernel/machine/IoScheduler.h"
+
+#define IMAGE_SIZE (1024 * 1024)
+
+/** Disk image that records the commands it is sent. */
+class TracingDiskImage : public DiskImage
+{
+  public:
+    struct Command
+    {
+        bool bWrite;
+        std::vector<uint64_t> locations;
+    };
+
+    TracingDiskImage(const char *path) : DiskImage(path), pins(0)
+    {
+    }
+
+    virtual bool readVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0)
+    {
+        record(false, pSegments, nSegments);
+        return DiskImage::readVectored(
+            pSegments, nSegments, pCompletion, param);
+    }
+
+    virtual bool writeVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0)
+    {
+        record(true, pSegments, nSegments);
+        return DiskImage::writeVectored(
+            pSegments, nSegments, pCompletion, param);
+    }
+
+    virtual void pin(uint64_t location)
+    {
+        ++pins;
+        DiskImage::pin(location);
+    }
+
+    virtual void unpin(uint64_t location)
+    {
+        --pins;
+        DiskImage::unpin(location);
+    }
+
+    std::vector<Command> commands;
+    /// Pages currently pinned through us.
+    int pins;
+
+  private:
+    void record(bool bWrite, IoSegment *pSegments, size_t nSegments)
+    {
+        Command command;
+        command.bWrite = bWrite;
+        for (size_t i = 0; i < nSegments; ++i)
+        {
+            command.locations.push_back(pSegments[i].location);
+        }
+        commands.push_back(command);
+    }
+};
+
+/** Scheduler with a clock the test controls. */
+class TestIoScheduler : public IoScheduler
+{
+  public:
+    TestIoScheduler(Disk *pTarget, Policy policy)
+        : IoScheduler(pTarget, policy), currentTime(0)
+    {
+    }
+
+    Time::Timestamp currentTime;
+
+  protected:
+    virtual Time::Timestamp now()
+    {
+        return currentTime;
+    }
+};
+
+class PedigreeIoScheduler : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        strcpy(m_Path, "/tmp/pedigree-iosched-XXXXXX");
+        int fd = mkstemp(m_Path);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(ftruncate(fd, IMAGE_SIZE), 0);
+
+        // Tag each page with its own index so reads can be checked.
+        for (uint32_t page = 0; page < IMAGE_SIZE / 4096; ++page)
+        {
+            ASSERT_EQ(pwrite(fd, &page, sizeof(page), page * 4096), 4);
+        }
+        close(fd);
+
+        disk = new TracingDiskImage(m_Path);
+        ASSERT_TRUE(disk->initialise());
+    }
+
+    virtual void TearDown()
+    {
+        delete disk;
+        unlink(m_Path);
+    }
+
+    TestIoScheduler *create(IoScheduler::Policy policy)
+    {
+        TestIoScheduler *pScheduler = new TestIoScheduler(disk, policy);
+        // Nothing dispatches behind the test's back.
+        pScheduler->setBatchSize(~0U);
+        return pScheduler;
+    }
+
+    TracingDiskImage *disk;
+
+  private:
+    char m_Path[64];
+};
+
+static void countCompletion(void *param, bool bSuccess)
+{
+    size_t *pCount = reinterpret_cast<size_t *>(param);
+    if (bSuccess)
+    {
+        ++*pCount;
+    }
+}
+
+TEST_F(PedigreeIoScheduler, NoOpKeepsSubmissionOrder)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::NoOp);
+    pScheduler->write(0x8000);
+    pScheduler->write(0x2000);
+    pScheduler->write(0x5000);
+    EXPECT_TRUE(disk->commands.empty());
+
+    pScheduler->drain();
+    ASSERT_EQ(disk->commands.size(), 3U);
+    EXPECT_EQ(disk->commands[0].locations[0], 0x8000U);
+    EXPECT_EQ(disk->commands[1].locations[0], 0x2000U);
+    EXPECT_EQ(disk->commands[2].locations[0], 0x5000U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, DeadlineSortsByLocation)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->write(0x8000);
+    pScheduler->write(0x2000);
+    pScheduler->write(0x5000);
+    pScheduler->drain();
+
+    ASSERT_EQ(disk->commands.size(), 3U);
+    EXPECT_EQ(disk->commands[0].locations[0], 0x2000U);
+    EXPECT_EQ(disk->commands[1].locations[0], 0x5000U);
+    EXPECT_EQ(disk->commands[2].locations[0], 0x8000U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, DeadlineWrapsAroundHead)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->write(0x6000);
+    pScheduler->dispatch();
+
+    // Head is now past 0x6000, so 0x9000 goes before the wrap to 0x1000.
+    pScheduler->write(0x1000);
+    pScheduler->write(0x9000);
+    pScheduler->drain();
+
+    ASSERT_EQ(disk->commands.size(), 3U);
+    EXPECT_EQ(disk->commands[1].locations[0], 0x9000U);
+    EXPECT_EQ(disk->commands[2].locations[0], 0x1000U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, MergesAdjacentRequests)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::NoOp);
+    pScheduler->write(0x3000);
+    pScheduler->write(0x1000);
+    pScheduler->write(0x2000);
+    pScheduler->write(0x4000);
+    pScheduler->write(0x10000);
+    pScheduler->drain();
+
+    ASSERT_EQ(disk->commands.size(), 2U);
+    ASSERT_EQ(disk->commands[0].locations.size(), 4U);
+    EXPECT_EQ(disk->commands[0].locations[0], 0x1000U);
+    EXPECT_EQ(disk->commands[0].locations[3], 0x4000U);
+    EXPECT_EQ(disk->commands[1].locations[0], 0x10000U);
+
+    IoScheduler::Statistics stats = pScheduler->getStatistics();
+    EXPECT_EQ(stats.submitted, 5U);
+    EXPECT_EQ(stats.dispatched, 2U);
+    EXPECT_EQ(stats.merged, 3U);
+    EXPECT_EQ(stats.queueDepth, 0U);
+    EXPECT_EQ(stats.maxQueueDepth, 5U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, DoesNotMergeAcrossDirections)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::NoOp);
+    pScheduler->write(0x1000);
+    pScheduler->read(0x2000);
+
+    // The read dispatched the queued write ahead of itself.
+    ASSERT_EQ(disk->commands.size(), 2U);
+    EXPECT_TRUE(disk->commands[0].bWrite);
+    EXPECT_FALSE(disk->commands[1].bWrite);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, MergeSizeIsCapped)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->setMaxMerge(0x4000);
+    for (uint64_t location = 0; location < 0xA000; location += 0x1000)
+    {
+        pScheduler->write(location);
+    }
+    pScheduler->drain();
+
+    ASSERT_EQ(disk->commands.size(), 3U);
+    EXPECT_EQ(disk->commands[0].locations.size(), 4U);
+    EXPECT_EQ(disk->commands[1].locations.size(), 4U);
+    EXPECT_EQ(disk->commands[2].locations.size(), 2U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, DeadlineSortsLargeQueue)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+
+    // Every other page, in a scrambled order, so nothing merges.
+    for (uint64_t i = 0; i < 128; ++i)
+    {
+        pScheduler->write(((i * 37) % 128) * 0x2000);
+    }
+    EXPECT_EQ(pScheduler->getStatistics().queueDepth, 128U);
+    pScheduler->drain();
+
+    ASSERT_EQ(disk->commands.size(), 128U);
+    for (size_t i = 0; i < 128; ++i)
+    {
+        EXPECT_EQ(disk->commands[i].locations[0], i * 0x2000);
+    }
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, SameLocationKeepsSubmissionOrder)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+
+    // Writes with completions aren't collapsed, so these queue side by side
+    // and can't merge with each other.
+    Disk::IoSegment segments[3];
+    size_t completions = 0;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        segments[i].location = 0x4000;
+        segments[i].length = 4096;
+        segments[i].buffer = 0;
+        pScheduler->writeVectored(
+            &segments[i], 1, countCompletion, &completions);
+    }
+    pScheduler->write(0x5000);
+    pScheduler->write(0x3000);
+    EXPECT_EQ(pScheduler->getStatistics().queueDepth, 5U);
+
+    pScheduler->drain();
+    EXPECT_EQ(completions, 3U);
+    ASSERT_EQ(disk->commands.size(), 3U);
+
+    // The first at 0x4000 takes both neighbours; the rest follow alone.
+    ASSERT_EQ(disk->commands[0].locations.size(), 3U);
+    EXPECT_EQ(disk->commands[0].locations[0], 0x3000U);
+    EXPECT_EQ(disk->commands[0].locations[2], 0x5000U);
+    EXPECT_EQ(disk->commands[1].locations[0], 0x4000U);
+    EXPECT_EQ(disk->commands[2].locations[0], 0x4000U);
+    EXPECT_EQ(pScheduler->getStatistics().queueDepth, 0U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, RepeatedWritesCollapse)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->write(0x3000);
+    pScheduler->write(0x3000);
+    pScheduler->write(0x3000);
+    EXPECT_EQ(pScheduler->getStatistics().queueDepth, 1U);
+    pScheduler->drain();
+
+    ASSERT_EQ(disk->commands.size(), 1U);
+    EXPECT_EQ(pScheduler->getStatistics().merged, 2U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, ExpiredRequestGoesFirst)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->setExpiry(100, 1000);
+
+    pScheduler->write(0x9000);
+    pScheduler->currentTime = 500;
+    pScheduler->write(0x1000);
+
+    // 0x9000 is not yet overdue, so the elevator picks 0x1000 first.
+    pScheduler->dispatch();
+    ASSERT_EQ(disk->commands.size(), 1U);
+    EXPECT_EQ(disk->commands[0].locations[0], 0x1000U);
+
+    pScheduler->write(0x2000);
+    pScheduler->write(0x4000);
+    pScheduler->currentTime = 1200;
+    pScheduler->dispatch();
+    ASSERT_EQ(disk->commands.size(), 2U);
+    EXPECT_EQ(disk->commands[1].locations[0], 0x9000U);
+    EXPECT_EQ(pScheduler->getStatistics().expired, 1U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, ExpiredWriteForcesDispatch)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->setExpiry(100, 1000);
+
+    pScheduler->write(0x1000);
+    EXPECT_TRUE(disk->commands.empty());
+
+    pScheduler->currentTime = 2000;
+    pScheduler->write(0x5000);
+    EXPECT_EQ(disk->commands.size(), 2U);
+    EXPECT_EQ(pScheduler->getStatistics().queueDepth, 0U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, BatchSizeForcesDispatch)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->setBatchSize(4);
+    pScheduler->write(0x1000);
+    pScheduler->write(0x3000);
+    pScheduler->write(0x5000);
+    EXPECT_TRUE(disk->commands.empty());
+
+    pScheduler->write(0x7000);
+    EXPECT_EQ(disk->commands.size(), 4U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, ReadReturnsData)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    for (uint32_t page = 0; page < 8; ++page)
+    {
+        uintptr_t buffer = pScheduler->read(page * 4096 + 8);
+        ASSERT_NE(buffer, static_cast<uintptr_t>(~0));
+        EXPECT_EQ(*reinterpret_cast<uint32_t *>(buffer - 8), page);
+    }
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, VectoredReadMergesAndFillsBuffers)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+
+    Disk::IoSegment segments[4];
+    for (size_t i = 0; i < 4; ++i)
+    {
+        segments[i].location = (3 - i) * 4096;
+        segments[i].length = 4096;
+        segments[i].buffer = 0;
+    }
+
+    size_t completions = 0;
+    EXPECT_TRUE(
+        pScheduler->readVectored(segments, 4, countCompletion, &completions));
+    EXPECT_EQ(completions, 1U);
+
+    ASSERT_EQ(disk->commands.size(), 1U);
+    EXPECT_EQ(disk->commands[0].locations.size(), 4U);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_NE(segments[i].buffer, 0U);
+        EXPECT_EQ(*reinterpret_cast<uint32_t *>(segments[i].buffer), 3 - i);
+    }
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, VectoredWriteCompletesOnce)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+
+    Disk::IoSegment segments[3];
+    for (size_t i = 0; i < 3; ++i)
+    {
+        segments[i].location = i * 0x2000;
+        segments[i].length = 4096;
+        segments[i].buffer = 0;
+    }
+
+    size_t completions = 0;
+    pScheduler->writeVectored(segments, 3, countCompletion, &completions);
+    EXPECT_EQ(completions, 0U);
+
+    pScheduler->flush(0);
+    EXPECT_EQ(completions, 1U);
+    EXPECT_EQ(disk->commands.size(), 3U);
+    delete pScheduler;
+}
+
+TEST_F(PedigreeIoScheduler, DestructionDrainsQueue)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::NoOp);
+    pScheduler->write(0x1000);
+    pScheduler->write(0x8000);
+    delete pScheduler;
+
+    EXPECT_EQ(disk->commands.size(), 2U);
+}
+
+TEST_F(PedigreeIoScheduler, QueuedWritesStayPinned)
+{
+    TestIoScheduler *pScheduler = create(IoScheduler::Deadline);
+    pScheduler->write(0x1000);
+    pScheduler->write(0x1000);
+    pScheduler->write(0x4000);
+    EXPECT_EQ(disk->pins, 2);
+
+    pScheduler->sync();
+    EXPECT_EQ(disk->commands.size(), 2U);
+    EXPECT_EQ(disk->pins, 0);
+    delete pScheduler;
+}
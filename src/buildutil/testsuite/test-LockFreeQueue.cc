@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "pedigree/kernel/utilities/LockFreeQueue.h"
+
+TEST(PedigreeLockFreeQueue, CapacityRoundsUp)
+{
+    LockFreeQueue<size_t> q(100);
+    EXPECT_EQ(q.capacity(), 128U);
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(PedigreeLockFreeQueue, Fifo)
+{
+    LockFreeQueue<size_t> q(8);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        EXPECT_TRUE(q.push(i));
+    }
+    EXPECT_EQ(q.count(), 5U);
+
+    size_t v;
+    for (size_t i = 0; i < 5; ++i)
+    {
+        EXPECT_TRUE(q.pop(v));
+        EXPECT_EQ(v, i);
+    }
+    EXPECT_FALSE(q.pop(v));
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(PedigreeLockFreeQueue, FullRejects)
+{
+    LockFreeQueue<size_t> q(4);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(q.push(i));
+    }
+    EXPECT_FALSE(q.push(4));
+    EXPECT_EQ(q.count(), 4U);
+
+    size_t v;
+    EXPECT_TRUE(q.pop(v));
+    EXPECT_EQ(v, 0U);
+    EXPECT_TRUE(q.push(4));
+    EXPECT_FALSE(q.push(5));
+}
+
+TEST(PedigreeLockFreeQueue, WrapsAround)
+{
+    LockFreeQueue<size_t> q(4);
+    size_t v;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        EXPECT_TRUE(q.push(i));
+        EXPECT_TRUE(q.push(i + 1));
+        EXPECT_TRUE(q.pop(v));
+        EXPECT_EQ(v, i);
+        EXPECT_TRUE(q.pop(v));
+        EXPECT_EQ(v, i + 1);
+    }
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(PedigreeLockFreeQueue, BatchPop)
+{
+    LockFreeQueue<size_t> q(16);
+    for (size_t i = 0; i < 10; ++i)
+    {
+        q.push(i);
+    }
+
+    size_t out[16];
+    EXPECT_EQ(q.pop(out, 4), 4U);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(out[i], i);
+    }
+
+    EXPECT_EQ(q.pop(out, 16), 6U);
+    EXPECT_EQ(out[0], 4U);
+    EXPECT_EQ(out[5], 9U);
+    EXPECT_EQ(q.pop(out, 16), 0U);
+}
+
+TEST(PedigreeLockFreeQueue, ManyProducersOneConsumer)
+{
+    const size_t producers = 4;
+    const size_t perProducer = 20000;
+
+    LockFreeQueue<size_t> q(256);
+    std::atomic<size_t> rejected(0);
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&q, &rejected, p, perProducer]() {
+            for (size_t i = 0; i < perProducer; ++i)
+            {
+                // Values encode the producer so per-producer order can be
+                // checked on the other side.
+                while (!q.push((p << 32) | i))
+                {
+                    ++rejected;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<size_t> next(producers, 0);
+    size_t seen = 0;
+    size_t batch[32];
+    while (seen < producers * perProducer)
+    {
+        size_t n = q.pop(batch, 32);
+        for (size_t i = 0; i < n; ++i)
+        {
+            size_t p = batch[i] >> 32;
+            size_t value = batch[i] & 0xFFFFFFFFU;
+            ASSERT_LT(p, producers);
+            EXPECT_EQ(value, next[p]);
+            next[p] = value + 1;
+        }
+        seen += n;
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    EXPECT_TRUE(q.empty());
+    for (size_t p = 0; p < producers; ++p)
+    {
+        EXPECT_EQ(next[p], perProducer);
+    }
+}
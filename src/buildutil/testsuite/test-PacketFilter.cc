@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+#include "modules/system/network-stack/Filter.h"
+#include "modules/system/network-stack/PacketFilter.h"
+
+#define COUNT(x) (sizeof(x) / sizeof((x)[0]))
+
+typedef std::vector<uint8_t> Frame;
+
+static void put16(Frame &f, size_t offset, uint16_t value)
+{
+    f[offset] = value >> 8;
+    f[offset + 1] = value & 0xFF;
+}
+
+static void put32(Frame &f, size_t offset, uint32_t value)
+{
+    put16(f, offset, value >> 16);
+    put16(f, offset + 2, value & 0xFFFF);
+}
+
+/** Ethernet + IPv4 frame carrying \p payloadLength bytes of \p protocol. */
+static Frame ipFrame(
+    uint8_t protocol, uint32_t src, uint32_t dst, size_t payloadLength)
+{
+    Frame f(14 + 20 + payloadLength, 0);
+    put16(f, 12, 0x0800);
+    f[14] = 0x45;
+    put16(f, 16, 20 + payloadLength);
+    f[22] = 64;
+    f[23] = protocol;
+    put32(f, 26, src);
+    put32(f, 30, dst);
+    return f;
+}
+
+static Frame tcpFrame(
+    uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+    const char *payload = "")
+{
+    size_t payloadLength = strlen(payload);
+    Frame f = ipFrame(6, src, dst, 20 + payloadLength);
+    put16(f, 34, sport);
+    put16(f, 36, dport);
+    f[46] = 5 << 4;
+    memcpy(&f[54], payload, payloadLength);
+    return f;
+}
+
+static Frame udpFrame(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport)
+{
+    Frame f = ipFrame(17, src, dst, 8 + 32);
+    put16(f, 34, sport);
+    put16(f, 36, dport);
+    put16(f, 38, 8 + 32);
+    return f;
+}
+
+static Frame arpRequest(uint32_t sender, uint32_t target)
+{
+    Frame f(14 + 28, 0);
+    memset(&f[0], 0xFF, 6);
+    put16(f, 12, 0x0806);
+    put16(f, 14, 1);
+    put16(f, 16, 0x0800);
+    f[18] = 6;
+    f[19] = 4;
+    put16(f, 20, 1);
+    put32(f, 28, sender);
+    put32(f, 38, target);
+    return f;
+}
+
+static uint32_t run(const PacketFilter &filter, const Frame &f)
+{
+    return filter.run(f.data(), f.size());
+}
+
+template <size_t N>
+static void load(PacketFilter &filter, const PacketFilterInstruction (&p)[N])
+{
+    ASSERT_TRUE(filter.load(p, N));
+}
+
+static const uint32_t HOST_A = 0x0A000001;  // 10.0.0.1
+static const uint32_t HOST_B = 0x0A000002;  // 10.0.0.2
+static const uint32_t HOST_C = 0xC0A80101;  // 192.168.1.1
+
+// tcpdump -dd ip
+static const PacketFilterInstruction g_Ip[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 1, 0x00000800},
+    {0x6, 0, 0, 0x00040000},
+    {0x6, 0, 0, 0x00000000},
+};
+
+// tcpdump -dd arp
+static const PacketFilterInstruction g_Arp[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 1, 0x00000806},
+    {0x6, 0, 0, 0x00040000},
+    {0x6, 0, 0, 0x00000000},
+};
+
+// tcpdump -dd -s 96 ip
+static const PacketFilterInstruction g_IpSnap96[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 1, 0x00000800},
+    {0x6, 0, 0, 0x00000060},
+    {0x6, 0, 0, 0x00000000},
+};
+
+// tcpdump -dd tcp port 80
+static const PacketFilterInstruction g_TcpPort80[] = {
+    {0x28, 0, 0, 0x0000000c},  {0x15, 0, 6, 0x000086dd},
+    {0x30, 0, 0, 0x00000014},  {0x15, 0, 15, 0x00000006},
+    {0x28, 0, 0, 0x00000036},  {0x15, 12, 0, 0x00000050},
+    {0x28, 0, 0, 0x00000038},  {0x15, 10, 11, 0x00000050},
+    {0x15, 0, 10, 0x00000800}, {0x30, 0, 0, 0x00000017},
+    {0x15, 0, 8, 0x00000006},  {0x28, 0, 0, 0x00000014},
+    {0x45, 6, 0, 0x00001fff},  {0xb1, 0, 0, 0x0000000e},
+    {0x48, 0, 0, 0x0000000e},  {0x15, 2, 0, 0x00000050},
+    {0x48, 0, 0, 0x00000010},  {0x15, 0, 1, 0x00000050},
+    {0x6, 0, 0, 0x00040000},   {0x6, 0, 0, 0x00000000},
+};
+
+// tcpdump -dd udp and dst port 53
+static const PacketFilterInstruction g_UdpDstPort53[] = {
+    {0x28, 0, 0, 0x0000000c}, {0x15, 0, 4, 0x000086dd},
+    {0x30, 0, 0, 0x00000014}, {0x15, 0, 11, 0x00000011},
+    {0x28, 0, 0, 0x00000038}, {0x15, 8, 9, 0x00000035},
+    {0x15, 0, 8, 0x00000800}, {0x30, 0, 0, 0x00000017},
+    {0x15, 0, 6, 0x00000011}, {0x28, 0, 0, 0x00000014},
+    {0x45, 4, 0, 0x00001fff}, {0xb1, 0, 0, 0x0000000e},
+    {0x48, 0, 0, 0x00000010}, {0x15, 0, 1, 0x00000035},
+    {0x6, 0, 0, 0x00040000},  {0x6, 0, 0, 0x00000000},
+};
+
+// tcpdump -dd host 10.0.0.1
+static const PacketFilterInstruction g_HostA[] = {
+    {0x28, 0, 0, 0x0000000c}, {0x15, 0, 4, 0x00000800},
+    {0x20, 0, 0, 0x0000001a}, {0x15, 8, 0, 0x0a000001},
+    {0x20, 0, 0, 0x0000001e}, {0x15, 6, 7, 0x0a000001},
+    {0x15, 1, 0, 0x00000806}, {0x15, 0, 5, 0x00008035},
+    {0x20, 0, 0, 0x0000001c}, {0x15, 2, 0, 0x0a000001},
+    {0x20, 0, 0, 0x00000026}, {0x15, 0, 1, 0x0a000001},
+    {0x6, 0, 0, 0x00040000},  {0x6, 0, 0, 0x00000000},
+};
+
+TEST(PedigreePacketFilter, EmptyFilterAcceptsEverything)
+{
+    PacketFilter filter;
+    EXPECT_FALSE(filter.isLoaded());
+    EXPECT_NE(run(filter, arpRequest(HOST_A, HOST_B)), 0U);
+}
+
+TEST(PedigreePacketFilter, Ip)
+{
+    PacketFilter filter;
+    load(filter, g_Ip);
+    EXPECT_EQ(run(filter, tcpFrame(HOST_A, 1234, HOST_B, 80)), 0x40000U);
+    EXPECT_EQ(run(filter, udpFrame(HOST_A, 1234, HOST_B, 53)), 0x40000U);
+    EXPECT_EQ(run(filter, arpRequest(HOST_A, HOST_B)), 0U);
+}
+
+TEST(PedigreePacketFilter, Arp)
+{
+    PacketFilter filter;
+    load(filter, g_Arp);
+    EXPECT_EQ(run(filter, arpRequest(HOST_A, HOST_B)), 0x40000U);
+    EXPECT_EQ(run(filter, tcpFrame(HOST_A, 1234, HOST_B, 80)), 0U);
+}
+
+TEST(PedigreePacketFilter, SnapLength)
+{
+    PacketFilter filter;
+    load(filter, g_IpSnap96);
+    EXPECT_EQ(run(filter, tcpFrame(HOST_A, 1234, HOST_B, 80)), 96U);
+    EXPECT_EQ(run(filter, arpRequest(HOST_A, HOST_B)), 0U);
+}
+
+TEST(PedigreePacketFilter, TcpPort80)
+{
+    PacketFilter filter;
+    load(filter, g_TcpPort80);
+    EXPECT_NE(run(filter, tcpFrame(HOST_A, 40000, HOST_B, 80)), 0U);
+    EXPECT_NE(run(filter, tcpFrame(HOST_B, 80, HOST_A, 40000)), 0U);
+    EXPECT_EQ(run(filter, tcpFrame(HOST_A, 40000, HOST_B, 443)), 0U);
+    EXPECT_EQ(run(filter, udpFrame(HOST_A, 40000, HOST_B, 80)), 0U);
+    EXPECT_EQ(run(filter, arpRequest(HOST_A, HOST_B)), 0U);
+
+    // Non-first fragments carry no TCP header and never match.
+    Frame fragment = tcpFrame(HOST_A, 40000, HOST_B, 80);
+    put16(fragment, 20, 0x0010);
+    EXPECT_EQ(run(filter, fragment), 0U);
+}
+
+TEST(PedigreePacketFilter, TcpPortFollowsIpOptions)
+{
+    PacketFilter filter;
+    load(filter, g_TcpPort80);
+
+    // Grow the IP header by one word of options; the ports move with it.
+    Frame f = tcpFrame(HOST_A, 40000, HOST_B, 443);
+    f.insert(f.begin() + 34, 4, 1);
+    f[14] = 0x46;
+    EXPECT_EQ(run(filter, f), 0U);
+    put16(f, 40, 80);
+    EXPECT_NE(run(filter, f), 0U);
+}
+
+TEST(PedigreePacketFilter, UdpDstPort53)
+{
+    PacketFilter filter;
+    load(filter, g_UdpDstPort53);
+    EXPECT_NE(run(filter, udpFrame(HOST_A, 40000, HOST_C, 53)), 0U);
+    EXPECT_EQ(run(filter, udpFrame(HOST_C, 53, HOST_A, 40000)), 0U);
+    EXPECT_EQ(run(filter, tcpFrame(HOST_A, 40000, HOST_C, 53)), 0U);
+}
+
+TEST(PedigreePacketFilter, Host)
+{
+    PacketFilter filter;
+    load(filter, g_HostA);
+    EXPECT_NE(run(filter, tcpFrame(HOST_A, 1, HOST_B, 2)), 0U);
+    EXPECT_NE(run(filter, tcpFrame(HOST_B, 1, HOST_A, 2)), 0U);
+    EXPECT_EQ(run(filter, tcpFrame(HOST_B, 1, HOST_C, 2)), 0U);
+    EXPECT_NE(run(filter, arpRequest(HOST_B, HOST_A)), 0U);
+    EXPECT_NE(run(filter, arpRequest(HOST_A, HOST_C)), 0U);
+    EXPECT_EQ(run(filter, arpRequest(HOST_B, HOST_C)), 0U);
+}
+
+TEST(PedigreePacketFilter, ShortPacketIsDropped)
+{
+    PacketFilter filter;
+    load(filter, g_TcpPort80);
+    Frame f = tcpFrame(HOST_A, 40000, HOST_B, 80);
+    EXPECT_EQ(filter.run(f.data(), 36), 0U);
+    EXPECT_EQ(filter.run(f.data(), 0), 0U);
+}
+
+TEST(PedigreePacketFilter, HttpGetPayload)
+{
+    // tcp[((tcp[12] & 0xf0) >> 2):4] = 0x47455420 ("GET "), via the index
+    // register and ALU rather than tcpdump's output.
+    static const PacketFilterInstruction program[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x800, 0, 11),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 9),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+        BPF_STMT(BPF_LD | BPF_B | BPF_IND, 26),
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xf0),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 2),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_IND, 14),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x47455420, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFF),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+
+    PacketFilter filter;
+    load(filter, program);
+    EXPECT_EQ(
+        run(filter, tcpFrame(HOST_A, 40000, HOST_B, 80, "GET / HTTP/1.0")),
+        0xFFFFU);
+    EXPECT_EQ(
+        run(filter, tcpFrame(HOST_A, 40000, HOST_B, 80, "POST / HTTP/1.0")),
+        0U);
+    // No payload: the load runs off the end of the packet.
+    EXPECT_EQ(run(filter, tcpFrame(HOST_A, 40000, HOST_B, 80)), 0U);
+}
+
+TEST(PedigreePacketFilter, ArithmeticAndScratchMemory)
+{
+    // Returns ((len / 10) % 7) * 3 + 1, round-tripping through M[15].
+    static const PacketFilterInstruction program[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+        BPF_STMT(BPF_ST, 15),
+        BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, 10),
+        BPF_STMT(BPF_LD | BPF_IMM, 0),
+        BPF_STMT(BPF_LD | BPF_MEM, 15),
+        BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, 7),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 3),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 1),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+
+    PacketFilter filter;
+    load(filter, program);
+    uint8_t packet[200] = {0};
+    for (size_t len = 0; len < sizeof(packet); ++len)
+    {
+        EXPECT_EQ(filter.run(packet, len), ((len / 10) % 7) * 3 + 1);
+    }
+}
+
+TEST(PedigreePacketFilter, DivideByZeroRegisterDrops)
+{
+    static const PacketFilterInstruction program[] = {
+        BPF_STMT(BPF_LD | BPF_IMM, 100),
+        BPF_STMT(BPF_LDX | BPF_W | BPF_LEN, 0),
+        BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 1),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+
+    PacketFilter filter;
+    load(filter, program);
+    uint8_t packet[10] = {0};
+    EXPECT_EQ(filter.run(packet, 10), 11U);
+    EXPECT_EQ(filter.run(packet, 0), 0U);
+}
+
+TEST(PedigreePacketFilter, JumpIntoCompareIsNotFused)
+{
+    // Instruction 1 jumps straight to the compare at 3 with A already set,
+    // skipping the load before it; that load must not be folded into it.
+    static const PacketFilterInstruction program[] = {
+        BPF_STMT(BPF_LD | BPF_IMM, 0x800),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x800, 1, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x800, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+
+    PacketFilter filter;
+    load(filter, program);
+    EXPECT_EQ(run(filter, arpRequest(HOST_A, HOST_B)), 1U);
+}
+
+TEST(PedigreePacketFilter, BranchesToSamePlace)
+{
+    static const PacketFilterInstruction program[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 1, 1, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+
+    PacketFilter filter;
+    load(filter, program);
+    uint8_t packet[1] = {0x42};
+    EXPECT_EQ(filter.run(packet, 1), 0x42U);
+    // The load still has to happen, and still drops short packets.
+    EXPECT_EQ(filter.run(packet, 0), 0U);
+}
+
+TEST(PedigreePacketFilter, VerifierRejectsBadPrograms)
+{
+    static const PacketFilterInstruction noReturn[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    };
+    static const PacketFilterInstruction badOpcode[] = {
+        {0xFF, 0, 0, 0},
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction jumpPastEnd[] = {
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 2),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction alwaysPastEnd[] = {
+        BPF_STMT(BPF_JMP | BPF_JA, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction badMemory[] = {
+        BPF_STMT(BPF_ST, BPF_MEMWORDS),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction divideByZero[] = {
+        BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction modByZero[] = {
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction wideShift[] = {
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 32),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    static const PacketFilterInstruction ancillary[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0xfffff000),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    static const PacketFilterInstruction returnX[] = {
+        BPF_STMT(BPF_RET | BPF_X, 0),
+    };
+
+    EXPECT_FALSE(PacketFilter::verify(g_Ip, 0));
+    EXPECT_FALSE(PacketFilter::verify(nullptr, 4));
+    EXPECT_FALSE(PacketFilter::verify(noReturn, COUNT(noReturn)));
+    EXPECT_FALSE(PacketFilter::verify(badOpcode, COUNT(badOpcode)));
+    EXPECT_FALSE(PacketFilter::verify(jumpPastEnd, COUNT(jumpPastEnd)));
+    EXPECT_FALSE(PacketFilter::verify(alwaysPastEnd, COUNT(alwaysPastEnd)));
+    EXPECT_FALSE(PacketFilter::verify(badMemory, COUNT(badMemory)));
+    EXPECT_FALSE(PacketFilter::verify(divideByZero, COUNT(divideByZero)));
+    EXPECT_FALSE(PacketFilter::verify(modByZero, COUNT(modByZero)));
+    EXPECT_FALSE(PacketFilter::verify(wideShift, COUNT(wideShift)));
+    EXPECT_FALSE(PacketFilter::verify(ancillary, COUNT(ancillary)));
+    EXPECT_FALSE(PacketFilter::verify(returnX, COUNT(returnX)));
+
+    std::vector<PacketFilterInstruction> huge(
+        BPF_MAXINSNS + 1, PacketFilterInstruction(BPF_STMT(BPF_RET | BPF_K, 0)));
+    EXPECT_FALSE(PacketFilter::verify(huge.data(), huge.size()));
+    EXPECT_TRUE(PacketFilter::verify(huge.data(), BPF_MAXINSNS));
+
+    EXPECT_TRUE(PacketFilter::verify(g_TcpPort80, COUNT(g_TcpPort80)));
+}
+
+TEST(PedigreePacketFilter, RejectedLoadLeavesFilterEmpty)
+{
+    static const PacketFilterInstruction noReturn[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    };
+
+    PacketFilter filter;
+    load(filter, g_Arp);
+    EXPECT_TRUE(filter.isLoaded());
+    EXPECT_FALSE(filter.load(noReturn, COUNT(noReturn)));
+    EXPECT_FALSE(filter.isLoaded());
+    EXPECT_NE(run(filter, tcpFrame(HOST_A, 1, HOST_B, 2)), 0U);
+}
+
+static size_t g_CallbackCalls = 0;
+
+static bool countingCallback(uintptr_t, size_t)
+{
+    ++g_CallbackCalls;
+    return true;
+}
+
+static bool filter(NetworkFilter &networkFilter, size_t level, const Frame &f)
+{
+    return networkFilter.filter(
+        level, reinterpret_cast<uintptr_t>(f.data()), f.size());
+}
+
+TEST(PedigreePacketFilter, NetworkFilterPrograms)
+{
+    NetworkFilter networkFilter;
+    Frame arp = arpRequest(HOST_A, HOST_B);
+    Frame tcp = tcpFrame(HOST_A, 40000, HOST_B, 80);
+
+    EXPECT_FALSE(networkFilter.hasCallbacks(1));
+    EXPECT_TRUE(filter(networkFilter, 1, tcp));
+
+    size_t id = networkFilter.installProgram(1, g_Arp, COUNT(g_Arp));
+    ASSERT_NE(id, static_cast<size_t>(-1));
+    EXPECT_TRUE(networkFilter.hasCallbacks(1));
+    EXPECT_FALSE(networkFilter.hasCallbacks(2));
+    EXPECT_TRUE(filter(networkFilter, 1, arp));
+    EXPECT_FALSE(filter(networkFilter, 1, tcp));
+    EXPECT_TRUE(filter(networkFilter, 2, tcp));
+
+    // Every program has to accept the packet.
+    size_t host = networkFilter.installProgram(1, g_HostA, COUNT(g_HostA));
+    ASSERT_NE(host, static_cast<size_t>(-1));
+    EXPECT_NE(host, id);
+    EXPECT_TRUE(filter(networkFilter, 1, arp));
+    EXPECT_FALSE(filter(networkFilter, 1, arpRequest(HOST_B, HOST_C)));
+
+    networkFilter.removeProgram(1, id);
+    EXPECT_TRUE(filter(networkFilter, 1, tcp));
+    networkFilter.removeProgram(1, host);
+    EXPECT_FALSE(networkFilter.hasCallbacks(1));
+    EXPECT_TRUE(filter(networkFilter, 1, arpRequest(HOST_B, HOST_C)));
+}
+
+TEST(PedigreePacketFilter, NetworkFilterRejectsBadPrograms)
+{
+    static const PacketFilterInstruction noReturn[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    };
+
+    NetworkFilter networkFilter;
+    EXPECT_EQ(
+        networkFilter.installProgram(1, noReturn, COUNT(noReturn)),
+        static_cast<size_t>(-1));
+    EXPECT_EQ(
+        networkFilter.installProgram(5, g_Arp, COUNT(g_Arp)),
+        static_cast<size_t>(-1));
+    EXPECT_FALSE(networkFilter.hasCallbacks(1));
+}
+
+TEST(PedigreePacketFilter, ProgramsRunBeforeCallbacks)
+{
+    NetworkFilter networkFilter;
+    g_CallbackCalls = 0;
+
+    size_t callback = networkFilter.installCallback(1, countingCallback);
+    ASSERT_NE(callback, static_cast<size_t>(-1));
+    size_t second = networkFilter.installCallback(1, countingCallback);
+    ASSERT_NE(second, static_cast<size_t>(-1));
+    size_t id = networkFilter.installProgram(1, g_Arp, COUNT(g_Arp));
+
+    EXPECT_FALSE(filter(networkFilter, 1, tcpFrame(HOST_A, 1, HOST_B, 2)));
+    EXPECT_EQ(g_CallbackCalls, 0U);
+    EXPECT_TRUE(filter(networkFilter, 1, arpRequest(HOST_A, HOST_B)));
+    EXPECT_EQ(g_CallbackCalls, 2U);
+
+    // Removing a callback leaves the other's identifier working.
+    networkFilter.removeCallback(1, callback);
+    networkFilter.removeProgram(1, id);
+    EXPECT_TRUE(networkFilter.hasCallbacks(1));
+    EXPECT_TRUE(filter(networkFilter, 1, tcpFrame(HOST_A, 1, HOST_B, 2)));
+    EXPECT_EQ(g_CallbackCalls, 3U);
+
+    networkFilter.removeCallback(1, second);
+    EXPECT_FALSE(networkFilter.hasCallbacks(1));
+    EXPECT_TRUE(filter(networkFilter, 1, tcpFrame(HOST_A, 1, HOST_B, 2)));
+    EXPECT_EQ(g_CallbackCalls, 3U);
+}
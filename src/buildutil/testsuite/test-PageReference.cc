@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/processor/PageReference.h"
+
+TEST(PedigreePageReference, UntrackedPageIsFreed)
+{
+    PageReference p;
+    EXPECT_TRUE(p.release());
+    EXPECT_FALSE(p.unpin());
+}
+
+TEST(PedigreePageReference, PinnedTwiceNeedsTwoFrees)
+{
+    PageReference p;
+    p.pin();
+    p.pin();
+    EXPECT_FALSE(p.release());
+    EXPECT_TRUE(p.release());
+    EXPECT_FALSE(p.active);
+}
+
+TEST(PedigreePageReference, ShareUnshareShareAgain)
+{
+    // A page table shared by fork, taken back by its last user, then
+    // shared again by the next fork.
+    PageReference p;
+    p.pin();
+    EXPECT_FALSE(p.unpin());
+    EXPECT_FALSE(p.active);
+    EXPECT_EQ(p.refcount, 0U);
+
+    p.pin();
+    p.pin();
+    EXPECT_EQ(p.refcount, 2U);
+    EXPECT_TRUE(p.unpin());
+    EXPECT_FALSE(p.unpin());
+    EXPECT_FALSE(p.active);
+}
+
+TEST(PedigreePageReference, PinAfterReleaseStartsAgain)
+{
+    PageReference p;
+    p.pin();
+    p.pin();
+    EXPECT_TRUE(p.unpin());
+    EXPECT_TRUE(p.release());
+
+    p.pin();
+    p.pin();
+    EXPECT_EQ(p.refcount, 2U);
+    EXPECT_FALSE(p.release());
+    EXPECT_TRUE(p.release());
+}
+
+TEST(PedigreePageReference, StaleCountIsIgnored)
+{
+    // Whatever an inactive entry was left holding, the next pin starts
+    // counting afresh.
+    PageReference p;
+    p.refcount = 5;
+    p.pin();
+    EXPECT_EQ(p.refcount, 1U);
+    EXPECT_FALSE(p.unpin());
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "pedigree/kernel/utilities/PageRing.h"
+
+static std::vector<uint8_t> pattern(size_t n, uint8_t seed = 0)
+{
+    std::vector<uint8_t> v(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        v[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+    return v;
+}
+
+static size_t countingProducer(void *param, uint8_t *buffer, size_t size)
+{
+    uint8_t *next = reinterpret_cast<uint8_t *>(param);
+    for (size_t i = 0; i < size; ++i)
+    {
+        buffer[i] = (*next)++;
+    }
+    return size;
+}
+
+static size_t shortConsumer(void *param, const uint8_t *buffer, size_t size)
+{
+    size_t *budget = reinterpret_cast<size_t *>(param);
+    size_t n = (size < *budget) ? size : *budget;
+    *budget -= n;
+    return n;
+}
+
+TEST(PedigreePageRing, InitialSettings)
+{
+    PageRing ring(4);
+
+    EXPECT_EQ(ring.getDataSize(), 0);
+    EXPECT_EQ(ring.getSize(), 4 * PageRing::PageSize);
+    EXPECT_FALSE(ring.canRead(false));
+    EXPECT_TRUE(ring.canWrite(false));
+}
+
+TEST(PedigreePageRing, RoundTripAcrossPages)
+{
+    PageRing ring(4);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize * 2 + 100);
+    std::vector<uint8_t> out(in.size());
+
+    EXPECT_EQ(ring.write(in.data(), in.size(), false), in.size());
+    EXPECT_EQ(ring.getDataSize(), in.size());
+    EXPECT_EQ(ring.read(out.data(), out.size(), false), in.size());
+    EXPECT_EQ(in, out);
+    EXPECT_EQ(ring.getDataSize(), 0);
+}
+
+TEST(PedigreePageRing, SmallWritesShareAPage)
+{
+    PageRing ring(1);
+    std::vector<uint8_t> in = pattern(16);
+
+    for (size_t i = 0; i < PageRing::PageSize / 16; ++i)
+    {
+        EXPECT_EQ(ring.write(in.data(), 16, false), 16);
+    }
+
+    // One page, completely filled.
+    EXPECT_EQ(ring.write(in.data(), 16, false), 0);
+    EXPECT_FALSE(ring.canWrite(false));
+}
+
+TEST(PedigreePageRing, FullRingShortWrite)
+{
+    PageRing ring(2);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize * 3);
+
+    EXPECT_EQ(ring.write(in.data(), in.size(), false), ring.getSize());
+    EXPECT_EQ(ring.getDataSize(), ring.getSize());
+}
+
+TEST(PedigreePageRing, PagesAreReused)
+{
+    PageRing ring(4);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize * 4);
+    std::vector<uint8_t> out(in.size());
+
+    ring.write(in.data(), in.size(), false);
+    ring.read(out.data(), out.size(), false);
+    EXPECT_EQ(ring.getCachedPages(), 4);
+
+    ring.write(in.data(), PageRing::PageSize, false);
+    EXPECT_EQ(ring.getCachedPages(), 3);
+}
+
+TEST(PedigreePageRing, SpliceMovesPages)
+{
+    PageRing a(4), b(4);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize * 2);
+    std::vector<uint8_t> out(in.size());
+
+    a.write(in.data(), in.size(), false);
+    EXPECT_EQ(a.splice(b, in.size(), false), in.size());
+    EXPECT_EQ(a.getDataSize(), 0);
+    EXPECT_EQ(b.getDataSize(), in.size());
+
+    // The pages left with the data, so nothing was freed in the source.
+    EXPECT_EQ(a.getCachedPages(), 0);
+
+    EXPECT_EQ(b.read(out.data(), out.size(), false), in.size());
+    EXPECT_EQ(in, out);
+    EXPECT_EQ(b.getCachedPages(), 2);
+}
+
+TEST(PedigreePageRing, SplicePartialPage)
+{
+    PageRing a(4), b(4);
+    std::vector<uint8_t> in = pattern(300);
+    std::vector<uint8_t> out(300);
+
+    a.write(in.data(), 300, false);
+    EXPECT_EQ(a.splice(b, 100, false), 100);
+    EXPECT_EQ(a.getDataSize(), 200);
+    EXPECT_EQ(b.getDataSize(), 100);
+
+    // The page is now shared, so new data must not land in it.
+    std::vector<uint8_t> more = pattern(50, 99);
+    a.write(more.data(), 50, false);
+    b.write(more.data(), 50, false);
+
+    EXPECT_EQ(b.read(out.data(), 150, false), 150);
+    EXPECT_EQ(0, memcmp(out.data(), in.data(), 100));
+    EXPECT_EQ(0, memcmp(out.data() + 100, more.data(), 50));
+
+    EXPECT_EQ(a.read(out.data(), 250, false), 250);
+    EXPECT_EQ(0, memcmp(out.data(), in.data() + 100, 200));
+    EXPECT_EQ(0, memcmp(out.data() + 200, more.data(), 50));
+}
+
+TEST(PedigreePageRing, SpliceToFullRing)
+{
+    PageRing a(2), b(1);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize * 2);
+
+    a.write(in.data(), in.size(), false);
+    EXPECT_EQ(a.splice(b, in.size(), false), PageRing::PageSize);
+    EXPECT_EQ(a.splice(b, in.size(), false), 0);
+    EXPECT_EQ(a.getDataSize(), PageRing::PageSize);
+}
+
+TEST(PedigreePageRing, TeeDuplicates)
+{
+    PageRing a(4), b(4);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize + 10);
+    std::vector<uint8_t> outA(in.size()), outB(in.size());
+
+    a.write(in.data(), in.size(), false);
+    EXPECT_EQ(a.tee(b, in.size(), false), in.size());
+    EXPECT_EQ(a.getDataSize(), in.size());
+    EXPECT_EQ(b.getDataSize(), in.size());
+
+    EXPECT_EQ(a.read(outA.data(), outA.size(), false), in.size());
+    EXPECT_EQ(b.read(outB.data(), outB.size(), false), in.size());
+    EXPECT_EQ(in, outA);
+    EXPECT_EQ(in, outB);
+
+    // Only the last reader of each page gets to keep it.
+    EXPECT_EQ(a.getCachedPages() + b.getCachedPages(), 2);
+}
+
+TEST(PedigreePageRing, ProduceConsume)
+{
+    PageRing ring(4);
+    uint8_t next = 0;
+
+    EXPECT_EQ(ring.produce(countingProducer, &next, 5000, false), 5000);
+
+    // The consumer stops early and only what it took is removed.
+    size_t budget = 1000;
+    EXPECT_EQ(ring.consume(shortConsumer, &budget, 5000, false), 1000);
+    EXPECT_EQ(ring.getDataSize(), 4000);
+
+    uint8_t b = 0;
+    EXPECT_EQ(ring.read(&b, 1, false), 1);
+    EXPECT_EQ(b, static_cast<uint8_t>(1000));
+}
+
+TEST(PedigreePageRing, EndOfFile)
+{
+    PageRing ring(4);
+    uint8_t b = 0;
+
+    ring.disableWrites();
+    EXPECT_TRUE(ring.canRead(false));
+    EXPECT_EQ(ring.read(&b, 1, true), 0);
+    EXPECT_EQ(ring.write(&b, 1, true), 0);
+}
+
+TEST(PedigreePageRing, Wipe)
+{
+    PageRing a(4), b(4);
+    std::vector<uint8_t> in = pattern(PageRing::PageSize);
+
+    a.write(in.data(), in.size(), false);
+    a.tee(b, in.size(), false);
+    a.wipe();
+    EXPECT_EQ(a.getDataSize(), 0);
+    EXPECT_EQ(a.getCachedPages(), 0);
+
+    std::vector<uint8_t> out(in.size());
+    EXPECT_EQ(b.read(out.data(), out.size(), false), in.size());
+    EXPECT_EQ(in, out);
+}
+
+struct Reentry
+{
+    PageRing *pRing;
+    uint8_t drained[16];
+    size_t nDrained;
+};
+
+static size_t drainingProducer(void *param, uint8_t *buffer, size_t size)
+{
+    // Reads everything already queued, including the tail page being filled.
+    Reentry *state = reinterpret_cast<Reentry *>(param);
+    state->nDrained = state->pRing->read(
+        state->drained, sizeof(state->drained), false);
+    memset(buffer, 0xAB, size);
+    return size;
+}
+
+static size_t echoConsumer(void *param, const uint8_t *buffer, size_t size)
+{
+    PageRing *pRing = reinterpret_cast<PageRing *>(param);
+    return pRing->write(buffer, size, false);
+}
+
+TEST(PedigreePageRing, CallbacksRunUnlocked)
+{
+    PageRing ring(4);
+    std::vector<uint8_t> in = pattern(10);
+    ring.write(in.data(), in.size(), false);
+
+    // The producer empties the ring (freeing up the tail slot it is filling)
+    // before it returns; its bytes still land in the ring.
+    Reentry state;
+    state.pRing = &ring;
+    state.nDrained = 0;
+    EXPECT_EQ(ring.produce(drainingProducer, &state, 100, false), 100);
+    EXPECT_EQ(state.nDrained, 10);
+    EXPECT_EQ(memcmp(state.drained, in.data(), 10), 0);
+    EXPECT_EQ(ring.getDataSize(), 100);
+
+    // The consumer writes what it is given back into the same ring.
+    EXPECT_EQ(ring.consume(echoConsumer, &ring, 100, false), 100);
+    EXPECT_EQ(ring.getDataSize(), 100);
+
+    std::vector<uint8_t> out(100);
+    EXPECT_EQ(ring.read(out.data(), out.size(), false), 100);
+    EXPECT_EQ(out, std::vector<uint8_t>(100, 0xAB));
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "modules/drivers/common/partition/Partition.h"
+#include "pedigree/kernel/machine/Disk.h"
+
+#define PARTITION_START 0x10200
+#define PARTITION_LENGTH 0x8000
+
+/** Disk that records the vectored requests it is sent. */
+class RecordingDisk : public Disk
+{
+  public:
+    RecordingDisk() : requests(0), syncs(0)
+    {
+    }
+
+    virtual bool readVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0)
+    {
+        return record(pSegments, nSegments, pCompletion, param);
+    }
+
+    virtual bool writeVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0)
+    {
+        return record(pSegments, nSegments, pCompletion, param);
+    }
+
+    virtual void align(uint64_t location)
+    {
+        alignments.push_back(location);
+    }
+
+    virtual void sync()
+    {
+        ++syncs;
+    }
+
+    int requests;
+    int syncs;
+    std::vector<IoSegment> segments;
+    std::vector<uint64_t> alignments;
+
+  private:
+    bool record(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+        void *param)
+    {
+        ++requests;
+        segments.assign(pSegments, pSegments + nSegments);
+        for (size_t i = 0; i < nSegments; ++i)
+        {
+            // Hand back something the partition has to copy to its caller.
+            pSegments[i].buffer = 0x1000000 + pSegments[i].location;
+        }
+
+        if (pCompletion)
+        {
+            pCompletion(param, true);
+        }
+        return true;
+    }
+};
+
+static void completion(void *param, bool bSuccess)
+{
+    *reinterpret_cast<int *>(param) = bSuccess ? 1 : 2;
+}
+
+class PedigreePartition : public ::testing::Test
+{
+  protected:
+    PedigreePartition()
+        : partition(String("test"), PARTITION_START, PARTITION_LENGTH)
+    {
+        partition.setParent(&disk);
+    }
+
+    RecordingDisk disk;
+    Partition partition;
+};
+
+TEST_F(PedigreePartition, TranslatesSegments)
+{
+    Disk::IoSegment segments[3] = {
+        {0, 0x1000, 0}, {0x2000, 0x400, 0}, {0x5800, 0x800, 0}};
+
+    int done = 0;
+    EXPECT_TRUE(partition.readVectored(segments, 3, &completion, &done));
+    EXPECT_EQ(done, 1);
+
+    ASSERT_EQ(disk.requests, 1);
+    ASSERT_EQ(disk.segments.size(), 3u);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(
+            disk.segments[i].location, segments[i].location + PARTITION_START);
+        EXPECT_EQ(disk.segments[i].length, segments[i].length);
+
+        // The caller's segments keep their locations but get the buffers.
+        EXPECT_EQ(
+            segments[i].buffer,
+            0x1000000 + segments[i].location + PARTITION_START);
+    }
+
+    // The first request aligns the parent on the partition's start.
+    ASSERT_EQ(disk.alignments.size(), 1u);
+    EXPECT_EQ(disk.alignments[0], PARTITION_START);
+}
+
+TEST_F(PedigreePartition, AcceptsSegmentEndingAtBoundary)
+{
+    Disk::IoSegment segment = {PARTITION_LENGTH - 0x200, 0x200, 0};
+    EXPECT_TRUE(partition.writeVectored(&segment, 1));
+    ASSERT_EQ(disk.requests, 1);
+    EXPECT_EQ(
+        disk.segments[0].location, PARTITION_START + PARTITION_LENGTH - 0x200);
+}
+
+TEST_F(PedigreePartition, RejectsSegmentCrossingBoundary)
+{
+    // Starts inside the partition but its length runs past the end.
+    Disk::IoSegment segments[2] = {
+        {0, 0x1000, 0}, {PARTITION_LENGTH - 0x200, 0x400, 0}};
+
+    int done = 0;
+    EXPECT_FALSE(partition.writeVectored(segments, 2, &completion, &done));
+    EXPECT_EQ(done, 2);
+    EXPECT_EQ(disk.requests, 0);
+}
+
+TEST_F(PedigreePartition, RejectsSegmentPastEnd)
+{
+    Disk::IoSegment segment = {PARTITION_LENGTH, 0x200, 0};
+    EXPECT_FALSE(partition.readVectored(&segment, 1));
+
+    // A location so large that location + length would wrap around.
+    segment.location = ~0ULL - 0x100;
+    EXPECT_FALSE(partition.readVectored(&segment, 1));
+
+    segment.location = 0;
+    segment.length = PARTITION_LENGTH + 0x200;
+    EXPECT_FALSE(partition.readVectored(&segment, 1));
+
+    EXPECT_EQ(disk.requests, 0);
+}
+
+TEST_F(PedigreePartition, ForwardsSync)
+{
+    // Writes held back by the disk's cache must reach it on fsync().
+    partition.sync();
+    EXPECT_EQ(disk.syncs, 1);
+}
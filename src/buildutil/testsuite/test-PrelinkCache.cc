@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "user/applications/libload/prelink.h"
+
+#define IDENT 0x1234567890abcdefULL
+#define SCOPE 0xfedcba0987654321ULL
+
+class PedigreePrelinkCache : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        strcpy(m_Dir, "/tmp/pedigree-prelink-XXXXXX");
+        ASSERT_NE(mkdtemp(m_Dir), nullptr);
+
+        entries.resize(8);
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            entries[i].value = 0x400000 + (i * 0x10);
+            entries[i].size = i;
+            entries[i].flags = (i & 1) ? PrelinkResolved : 0;
+        }
+
+        path = prelinkPath(m_Dir, IDENT, SCOPE);
+    }
+
+    virtual void TearDown()
+    {
+        unlink(path.c_str());
+        rmdir(m_Dir);
+    }
+
+    std::vector<prelink_entry_t> entries;
+    std::string path;
+
+  private:
+    char m_Dir[64];
+};
+
+TEST_F(PedigreePrelinkCache, RoundTrip)
+{
+    savePrelinkCache(path, IDENT, SCOPE, entries);
+
+    std::vector<prelink_entry_t> loaded(entries.size());
+    ASSERT_TRUE(loadPrelinkCache(path, IDENT, SCOPE, loaded));
+    EXPECT_EQ(
+        memcmp(
+            &loaded[0], &entries[0], entries.size() * sizeof(prelink_entry_t)),
+        0);
+}
+
+TEST_F(PedigreePrelinkCache, MismatchedKey)
+{
+    savePrelinkCache(path, IDENT, SCOPE, entries);
+
+    // A file renamed (or written) under the wrong name doesn't match the
+    // key in its header.
+    std::vector<prelink_entry_t> loaded(entries.size());
+    EXPECT_FALSE(loadPrelinkCache(path, IDENT, SCOPE + 1, loaded));
+    EXPECT_FALSE(loadPrelinkCache(path, IDENT + 1, SCOPE, loaded));
+    EXPECT_EQ(loaded[1].value, 0);
+
+    // Nor does an object that has since gained or lost relocations.
+    std::vector<prelink_entry_t> wrongSize(entries.size() + 1);
+    EXPECT_FALSE(loadPrelinkCache(path, IDENT, SCOPE, wrongSize));
+}
+
+TEST_F(PedigreePrelinkCache, RejectsWritableFiles)
+{
+    savePrelinkCache(path, IDENT, SCOPE, entries);
+
+    std::vector<prelink_entry_t> loaded(entries.size());
+    ASSERT_EQ(chmod(path.c_str(), 0666), 0);
+    EXPECT_FALSE(loadPrelinkCache(path, IDENT, SCOPE, loaded));
+    EXPECT_EQ(loaded[1].value, 0);
+
+    ASSERT_EQ(chmod(path.c_str(), 0664), 0);
+    EXPECT_FALSE(loadPrelinkCache(path, IDENT, SCOPE, loaded));
+
+    ASSERT_EQ(chmod(path.c_str(), 0644), 0);
+    EXPECT_TRUE(loadPrelinkCache(path, IDENT, SCOPE, loaded));
+}
+
+TEST_F(PedigreePrelinkCache, MissingFile)
+{
+    std::vector<prelink_entry_t> loaded(entries.size());
+    EXPECT_FALSE(loadPrelinkCache(path, IDENT, SCOPE, loaded));
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/process/RunQueue.h"
+
+struct Item
+{
+    RunQueueLink<Item> link;
+};
+
+typedef RunQueue<Item, 8, &Item::link> ItemQueue;
+
+TEST(PedigreeRunQueue, Empty)
+{
+    ItemQueue queue;
+    EXPECT_EQ(queue.count(), 0U);
+    EXPECT_EQ(queue.getBitmap(), 0U);
+    EXPECT_EQ(queue.popFront(), nullptr);
+}
+
+TEST(PedigreeRunQueue, FifoWithinLevel)
+{
+    ItemQueue queue;
+    Item a, b, c;
+    queue.pushBack(&a, 3);
+    queue.pushBack(&b, 3);
+    queue.pushBack(&c, 3);
+
+    EXPECT_EQ(queue.popFront(), &a);
+    EXPECT_EQ(queue.popFront(), &b);
+    EXPECT_EQ(queue.popFront(), &c);
+    EXPECT_EQ(queue.popFront(), nullptr);
+}
+
+TEST(PedigreeRunQueue, HighestPriorityFirst)
+{
+    ItemQueue queue;
+    Item low, mid, high;
+    queue.pushBack(&low, 7);
+    queue.pushBack(&mid, 4);
+    queue.pushBack(&high, 0);
+    EXPECT_EQ(queue.getBitmap(), 0x91U);
+
+    EXPECT_EQ(queue.popFront(), &high);
+    EXPECT_EQ(queue.popFront(), &mid);
+    EXPECT_EQ(queue.popFront(), &low);
+    EXPECT_EQ(queue.getBitmap(), 0U);
+}
+
+TEST(PedigreeRunQueue, NoDoubleQueue)
+{
+    ItemQueue queue;
+    Item a;
+    EXPECT_TRUE(queue.pushBack(&a, 1));
+    EXPECT_FALSE(queue.pushBack(&a, 1));
+    EXPECT_FALSE(queue.pushBack(&a, 2));
+    EXPECT_EQ(queue.count(), 1U);
+    EXPECT_EQ(queue.getBitmap(), 0x2U);
+}
+
+TEST(PedigreeRunQueue, RemoveFromMiddle)
+{
+    ItemQueue queue;
+    Item a, b, c;
+    queue.pushBack(&a, 1);
+    queue.pushBack(&b, 1);
+    queue.pushBack(&c, 1);
+
+    EXPECT_TRUE(queue.remove(&b));
+    EXPECT_FALSE(queue.contains(&b));
+    EXPECT_FALSE(queue.remove(&b));
+    EXPECT_EQ(queue.count(), 2U);
+
+    EXPECT_EQ(ItemQueue::getNext(queue.getFirst(1)), &c);
+    EXPECT_EQ(queue.popFront(), &a);
+    EXPECT_EQ(queue.popFront(), &c);
+}
+
+TEST(PedigreeRunQueue, RemoveLastClearsLevel)
+{
+    ItemQueue queue;
+    Item a, b;
+    queue.pushBack(&a, 2);
+    queue.pushBack(&b, 5);
+
+    queue.remove(&a);
+    EXPECT_EQ(queue.getBitmap(), 0x20U);
+    EXPECT_EQ(queue.popFront(), &b);
+}
+
+TEST(PedigreeRunQueue, OwnedByOneQueue)
+{
+    ItemQueue first, second;
+    Item a;
+    first.pushBack(&a, 1);
+
+    EXPECT_FALSE(second.pushBack(&a, 1));
+    EXPECT_FALSE(second.remove(&a));
+    EXPECT_TRUE(first.contains(&a));
+
+    first.remove(&a);
+    EXPECT_TRUE(second.pushBack(&a, 1));
+    EXPECT_TRUE(second.contains(&a));
+}
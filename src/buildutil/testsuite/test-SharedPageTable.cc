@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+#include "pedigree/kernel/processor/PageReference.h"
+#include "pedigree/kernel/processor/x64/SharedPageTable.h"
+
+/** Page tables and reference counts kept in host memory. */
+class FakeMemory
+{
+  public:
+    FakeMemory() : next(0x1000), bFail(false)
+    {
+    }
+
+    uint64_t *table(physical_uintptr_t address)
+    {
+        return &tables[address][0];
+    }
+
+    physical_uintptr_t allocateTable()
+    {
+        if (bFail)
+        {
+            return 0;
+        }
+
+        physical_uintptr_t address = next;
+        next += 0x1000;
+        tables[address].assign(512, 0);
+        return address;
+    }
+
+    void pin(physical_uintptr_t address)
+    {
+        refs[address].pin();
+    }
+
+    bool unpin(physical_uintptr_t address)
+    {
+        return refs[address].unpin();
+    }
+
+    /** References held on a page, counting an untracked page as one. */
+    size_t references(physical_uintptr_t address)
+    {
+        const PageReference &ref = refs[address];
+        return ref.active ? ref.refcount : 1;
+    }
+
+    physical_uintptr_t next;
+    bool bFail;
+    std::map<physical_uintptr_t, std::vector<uint64_t> > tables;
+    std::map<physical_uintptr_t, PageReference> refs;
+};
+
+typedef SharedPageTable<FakeMemory> Shared;
+
+#define USER 0x04
+#define PRIVATE_PAGE 0x100000
+#define READONLY_PAGE 0x101000
+#define SHARED_PAGE 0x102000
+#define COW_PAGE 0x103000
+
+class PedigreeSharedPageTable : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        table = memory.allocateTable();
+
+        uint64_t *entries = memory.table(table);
+        entries[0] = PRIVATE_PAGE | Shared::Present | Shared::Write | USER;
+        entries[1] = READONLY_PAGE | Shared::Present | USER;
+        entries[2] = SHARED_PAGE | Shared::Present | Shared::Write |
+                     Shared::SharedPage | USER;
+        entries[3] = COW_PAGE | Shared::Present | Shared::CopyOnWrite | USER;
+
+        // An earlier fork left the copy-on-write page with two references.
+        memory.pin(COW_PAGE);
+        memory.pin(COW_PAGE);
+
+        parent = table | Shared::Present | Shared::Write | USER;
+    }
+
+    uint64_t entry(physical_uintptr_t t, size_t index)
+    {
+        return memory.table(t)[index];
+    }
+
+    FakeMemory memory;
+    physical_uintptr_t table;
+    uint64_t parent;
+};
+
+TEST_F(PedigreeSharedPageTable, ShareMakesBothEntriesReadOnly)
+{
+    uint64_t child = Shared::share(parent, memory);
+    EXPECT_EQ(child, parent);
+    EXPECT_EQ(Shared::addressOf(child), table);
+    EXPECT_FALSE(child & Shared::Write);
+    EXPECT_TRUE(child & Shared::SharedTable);
+    EXPECT_EQ(memory.references(table), 2U);
+
+    // Sharing again only adds the new address space's reference.
+    uint64_t grandchild = Shared::share(parent, memory);
+    EXPECT_EQ(grandchild, parent);
+    EXPECT_EQ(memory.references(table), 3U);
+
+    // Nothing in the table itself changes until someone writes.
+    EXPECT_EQ(
+        entry(table, 0), PRIVATE_PAGE | Shared::Present | Shared::Write | USER);
+}
+
+TEST_F(PedigreeSharedPageTable, CopyMakesPrivatePagesCopyOnWrite)
+{
+    uint64_t child = Shared::share(parent, memory);
+
+    ASSERT_EQ(Shared::unshare(child, memory), Shared::Copied);
+    physical_uintptr_t copy = Shared::addressOf(child);
+    EXPECT_NE(copy, table);
+    EXPECT_TRUE(child & Shared::Write);
+    EXPECT_FALSE(child & Shared::SharedTable);
+    EXPECT_EQ(Shared::flagsOf(child), Shared::Present | Shared::Write | USER);
+
+    // The parent still reaches the old table through its read-only entry,
+    // but is now its only user.
+    EXPECT_TRUE(parent & Shared::SharedTable);
+    EXPECT_EQ(memory.references(table), 1U);
+
+    // The writable private page is copy-on-write in both tables, with a
+    // reference for each.
+    uint64_t cow = PRIVATE_PAGE | Shared::Present | Shared::CopyOnWrite | USER;
+    EXPECT_EQ(entry(table, 0), cow);
+    EXPECT_EQ(entry(copy, 0), cow);
+    EXPECT_EQ(memory.references(PRIVATE_PAGE), 2U);
+
+    // Read-only pages stay read-only, but are referenced twice all the same.
+    EXPECT_EQ(entry(copy, 1), entry(table, 1));
+    EXPECT_FALSE(entry(copy, 1) & Shared::CopyOnWrite);
+    EXPECT_EQ(memory.references(READONLY_PAGE), 2U);
+
+    // Shared pages stay writable in both.
+    EXPECT_EQ(entry(copy, 2), entry(table, 2));
+    EXPECT_TRUE(entry(copy, 2) & Shared::Write);
+
+    // Already copy-on-write pages only gain the new table's reference.
+    EXPECT_EQ(entry(copy, 3), entry(table, 3));
+    EXPECT_EQ(memory.references(COW_PAGE), 3U);
+
+    EXPECT_EQ(entry(copy, 4), 0U);
+}
+
+TEST_F(PedigreeSharedPageTable, LastUserTakesTableOver)
+{
+    uint64_t child = Shared::share(parent, memory);
+    ASSERT_EQ(Shared::unshare(child, memory), Shared::Copied);
+
+    ASSERT_EQ(Shared::unshare(parent, memory), Shared::TookOver);
+    EXPECT_EQ(parent, table | Shared::Present | Shared::Write | USER);
+    EXPECT_FALSE(memory.refs[table].active);
+
+    // Taking over doesn't touch the entries.
+    EXPECT_EQ(
+        entry(table, 0),
+        PRIVATE_PAGE | Shared::Present | Shared::CopyOnWrite | USER);
+    EXPECT_EQ(memory.references(PRIVATE_PAGE), 2U);
+
+    // Nor is there anything left to do on the next write.
+    EXPECT_EQ(Shared::unshare(parent, memory), Shared::NotShared);
+}
+
+TEST_F(PedigreeSharedPageTable, ParentWritesFirst)
+{
+    uint64_t child = Shared::share(parent, memory);
+
+    // The parent copies just like a child would; the child then takes over
+    // the original table.
+    ASSERT_EQ(Shared::unshare(parent, memory), Shared::Copied);
+    EXPECT_NE(Shared::addressOf(parent), table);
+    ASSERT_EQ(Shared::unshare(child, memory), Shared::TookOver);
+    EXPECT_EQ(Shared::addressOf(child), table);
+    EXPECT_EQ(memory.references(PRIVATE_PAGE), 2U);
+}
+
+TEST_F(PedigreeSharedPageTable, ThreeWayShare)
+{
+    uint64_t first = Shared::share(parent, memory);
+    uint64_t second = Shared::share(parent, memory);
+
+    ASSERT_EQ(Shared::unshare(first, memory), Shared::Copied);
+    EXPECT_EQ(memory.references(PRIVATE_PAGE), 2U);
+
+    // The page is copy-on-write by now, so the second copy only adds its own
+    // reference.
+    ASSERT_EQ(Shared::unshare(second, memory), Shared::Copied);
+    EXPECT_EQ(memory.references(PRIVATE_PAGE), 3U);
+    EXPECT_NE(Shared::addressOf(first), Shared::addressOf(second));
+
+    ASSERT_EQ(Shared::unshare(parent, memory), Shared::TookOver);
+    EXPECT_EQ(Shared::addressOf(parent), table);
+    EXPECT_EQ(memory.references(COW_PAGE), 4U);
+}
+
+TEST_F(PedigreeSharedPageTable, OutOfMemoryKeepsSharing)
+{
+    uint64_t child = Shared::share(parent, memory);
+    uint64_t before = child;
+
+    memory.bFail = true;
+    EXPECT_EQ(Shared::unshare(child, memory), Shared::OutOfMemory);
+    EXPECT_EQ(child, before);
+    EXPECT_EQ(memory.references(table), 2U);
+    EXPECT_EQ(memory.references(PRIVATE_PAGE), 1U);
+
+    memory.bFail = false;
+    EXPECT_EQ(Shared::unshare(child, memory), Shared::Copied);
+}
+
+TEST_F(PedigreeSharedPageTable, ReleaseOnTeardown)
+{
+    uint64_t child = Shared::share(parent, memory);
+
+    // The child exits without writing: the table stays with the parent.
+    EXPECT_TRUE(Shared::release(child, memory));
+    EXPECT_EQ(child, 0U);
+
+    // Then the parent exits too, and has to free the table itself.
+    uint64_t before = parent;
+    EXPECT_FALSE(Shared::release(parent, memory));
+    EXPECT_EQ(parent, before);
+    EXPECT_FALSE(memory.refs[table].active);
+}
+
+TEST_F(PedigreeSharedPageTable, IgnoresUnsharedEntries)
+{
+    uint64_t before = parent;
+    EXPECT_EQ(Shared::unshare(parent, memory), Shared::NotShared);
+    EXPECT_FALSE(Shared::release(parent, memory));
+    EXPECT_EQ(parent, before);
+
+    // 2MB pages are never shared tables, whatever their other bits say.
+    uint64_t huge = 0x200000 | Shared::Present | Shared::HugePage |
+                    Shared::SharedTable;
+    EXPECT_EQ(Shared::unshare(huge, memory), Shared::NotShared);
+}
@@ -21,6 +21,11 @@
 
 #include <gtest/gtest.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "pedigree/kernel/core/SlamAllocator.h"
 
 TEST(PedigreeSlamAllocator, DISABLE_EmptyStartup)
@@ -72,3 +77,249 @@ TEST(PedigreeSlamAllocator, DISABLE_Alignment)
     EXPECT_EQ(alloc & 15, 0);
     SlamAllocator::instance().free(alloc);
 }
+
+TEST(PedigreeSlamAllocator, SizeClassesAreTight)
+{
+    SlamAllocator::instance().initialise();
+
+    // Size classes are at most a quarter step apart, so no allocation should
+    // ever be handed more than 25% (plus the minimum object size) extra.
+    for (size_t n = 1; n < 100000; n = (n * 9) / 8 + 1)
+    {
+        uintptr_t alloc = SlamAllocator::instance().allocate(n);
+        size_t actual = SlamAllocator::instance().allocSize(alloc);
+        EXPECT_GE(actual, n);
+        EXPECT_LE(actual, ((n * 5) / 4) + 4096);
+        if (n < 4096)
+        {
+            EXPECT_LE(actual, ((n * 5) / 4) + 64);
+        }
+        SlamAllocator::instance().free(alloc);
+    }
+}
+
+TEST(PedigreeSlamAllocator, SizeClassLookupIsMonotonic)
+{
+    SlamAllocator &allocator = SlamAllocator::instance();
+    allocator.initialise();
+
+    size_t lastClass = 0;
+    for (size_t n = 64; n < (1U << 24); n += 16)
+    {
+        size_t sizeClass = allocator.sizeClass(n);
+        EXPECT_GE(sizeClass, lastClass);
+        EXPECT_LT(sizeClass, SLAM_NUM_SIZE_CLASSES);
+        EXPECT_GE(allocator.sizeClassSize(sizeClass), n);
+        if (sizeClass)
+        {
+            EXPECT_LT(allocator.sizeClassSize(sizeClass - 1), n);
+        }
+        lastClass = sizeClass;
+    }
+}
+
+TEST(PedigreeSlamAllocator, MultiPageSlabRecovery)
+{
+    SlamAllocator::instance().initialise();
+
+    // 2100 bytes lands in a class with multi-page slabs; once everything in
+    // such a slab is freed, recovery must be able to find and release it.
+    SlamAllocator::instance().recovery(1024);
+    size_t before = SlamAllocator::instance().heapPageCount();
+
+    uintptr_t allocs[16];
+    for (size_t i = 0; i < 16; ++i)
+    {
+        allocs[i] = SlamAllocator::instance().allocate(2100);
+        EXPECT_EQ(allocs[i] & 15, 0);
+    }
+
+    // Three objects in two pages, rather than one object per page.
+    EXPECT_LE(SlamAllocator::instance().heapPageCount() - before, 12);
+
+    for (size_t i = 0; i < 16; ++i)
+    {
+        SlamAllocator::instance().free(allocs[i]);
+    }
+
+    SlamAllocator::instance().recovery(1024);
+    EXPECT_EQ(SlamAllocator::instance().heapPageCount(), before);
+}
+
+TEST(PedigreeSlamAllocator, SlabRegionAllocation)
+{
+    SlamAllocator &allocator = SlamAllocator::instance();
+    allocator.initialise();
+
+    size_t before = allocator.heapPageCount();
+
+    uintptr_t single = allocator.getSlab(0x1000);
+    uintptr_t aligned = allocator.getSlab(0x4000);
+    uintptr_t large = allocator.getSlab(0x1000 * 100);
+
+    // Power-of-two slabs are naturally aligned, and nothing overlaps.
+    EXPECT_EQ(aligned & 0x3FFF, 0);
+    EXPECT_TRUE((single + 0x1000 <= aligned) || (aligned + 0x4000 <= single));
+    EXPECT_TRUE((single + 0x1000 <= large) || (large + 0x64000 <= single));
+    EXPECT_TRUE((aligned + 0x4000 <= large) || (large + 0x64000 <= aligned));
+    EXPECT_EQ(allocator.heapPageCount(), before + 105);
+
+    allocator.freeSlab(single, 0x1000);
+    allocator.freeSlab(aligned, 0x4000);
+    allocator.freeSlab(large, 0x1000 * 100);
+    EXPECT_EQ(allocator.heapPageCount(), before);
+
+    // Freed pages are found again.
+    uintptr_t again = allocator.getSlab(0x1000);
+    EXPECT_LE(again, single);
+    allocator.freeSlab(again, 0x1000);
+}
+
+TEST(PedigreeSlamAllocator, SlabRegionFillsGaps)
+{
+    SlamAllocator &allocator = SlamAllocator::instance();
+    allocator.initialise();
+
+    // Single pages fill the lowest free pages, so this leaves no gaps below
+    // the last of them.
+    std::vector<uintptr_t> singles;
+    for (size_t i = 0; i < 256; ++i)
+    {
+        singles.push_back(allocator.getSlab(0x1000));
+    }
+
+    // Punch an aligned four-page hole somewhere in the middle.
+    size_t hole = 128;
+    while (singles[hole] & 0x3FFF)
+    {
+        ++hole;
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(singles[hole + i], singles[hole] + (i * 0x1000));
+        allocator.freeSlab(singles[hole + i], 0x1000);
+    }
+
+    // Multi-page slabs go straight to the first gap that fits them.
+    uintptr_t three = allocator.getSlab(0x3000);
+    EXPECT_EQ(three, singles[hole]);
+    allocator.freeSlab(three, 0x3000);
+
+    uintptr_t four = allocator.getSlab(0x4000);
+    EXPECT_EQ(four, singles[hole]);
+
+    // With the hole filled, a two-page slab lands past every single page.
+    uintptr_t two = allocator.getSlab(0x2000);
+    EXPECT_EQ(two & 0x1FFF, 0);
+    for (size_t i = 0; i < singles.size(); ++i)
+    {
+        EXPECT_GT(two, singles[i]);
+    }
+
+    // Slabs of whole entries don't overlap any of it either.
+    uintptr_t large = allocator.getSlab(0x1000 * 100);
+    EXPECT_TRUE((two + 0x2000 <= large) || (large + 0x64000 <= two));
+    for (size_t i = 0; i < singles.size(); ++i)
+    {
+        EXPECT_TRUE(
+            (singles[i] + 0x1000 <= large) || (large + 0x64000 <= singles[i]));
+    }
+
+    allocator.freeSlab(large, 0x1000 * 100);
+    allocator.freeSlab(two, 0x2000);
+    allocator.freeSlab(four, 0x4000);
+    for (size_t i = 0; i < singles.size(); ++i)
+    {
+        if (i < hole || i >= (hole + 4))
+        {
+            allocator.freeSlab(singles[i], 0x1000);
+        }
+    }
+}
+
+TEST(PedigreeSlamAllocator, RecoveryFlushesOtherMagazines)
+{
+    SlamAllocator &allocator = SlamAllocator::instance();
+    allocator.initialise();
+
+    allocator.recovery(1024);
+    size_t before = allocator.heapPageCount();
+
+    // Objects freed on another thread (CPU) sit in its magazines, which
+    // recovery on this one must still be able to get back.
+    std::thread other([&allocator]() {
+        uintptr_t allocs[8];
+        for (size_t i = 0; i < 8; ++i)
+        {
+            allocs[i] = allocator.allocate(64);
+        }
+        for (size_t i = 0; i < 8; ++i)
+        {
+            allocator.free(allocs[i]);
+        }
+    });
+    other.join();
+
+    EXPECT_GT(allocator.heapPageCount(), before);
+    allocator.recovery(1024);
+    EXPECT_EQ(allocator.heapPageCount(), before);
+}
+
+TEST(PedigreeSlamAllocator, RecoveryAsksBusyCpusToFlush)
+{
+    SlamAllocator &allocator = SlamAllocator::instance();
+    allocator.initialise();
+
+    allocator.recovery(1024);
+    size_t before = allocator.heapPageCount();
+
+    std::mutex lock;
+    std::condition_variable cond;
+    int stage = 0;
+    uintptr_t handedOver = 0;
+
+    // This thread stays around, so only it may empty its magazines.
+    std::thread other([&]() {
+        uintptr_t allocs[8];
+        for (size_t i = 0; i < 8; ++i)
+        {
+            allocs[i] = allocator.allocate(64);
+        }
+        for (size_t i = 0; i < 8; ++i)
+        {
+            allocator.free(allocs[i]);
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        stage = 1;
+        cond.notify_all();
+        cond.wait(guard, [&]() { return stage == 2; });
+
+        // Its next use of the allocator honours the flush request.
+        handedOver = allocator.allocate(64);
+        stage = 3;
+        cond.notify_all();
+    });
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&]() { return stage == 1; });
+    }
+
+    // The objects are still in the other CPU's magazines.
+    allocator.recovery(1024);
+    EXPECT_GT(allocator.heapPageCount(), before);
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stage = 2;
+        cond.notify_all();
+        cond.wait(guard, [&]() { return stage == 3; });
+    }
+
+    allocator.free(handedOver);
+    allocator.recovery(1024);
+    EXPECT_EQ(allocator.heapPageCount(), before);
+
+    other.join();
+}
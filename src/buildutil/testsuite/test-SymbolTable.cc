@@ -21,6 +21,9 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+
 #include "pedigree/kernel/linker/SymbolTable.h"
 
 TEST(PedigreeSymbolTable, KernelLookup)
@@ -72,3 +75,135 @@ TEST(PedigreeSymbolTable, EraseByElf)
     EXPECT_EQ(symbolTable.lookup(String("gsym2"), nullptr), 0);
     EXPECT_EQ(symbolTable.lookup(String("wsym"), elf), 0);
 }
+
+TEST(PedigreeSymbolTable, GlobalShadowsWeak)
+{
+    Elf *elf1 = reinterpret_cast<Elf *>(1);
+    Elf *elf2 = reinterpret_cast<Elf *>(2);
+
+    SymbolTable symbolTable(nullptr);
+
+    symbolTable.insert(String("sym"), SymbolTable::Weak, elf1, 0xabcd1);
+    EXPECT_EQ(symbolTable.lookup(String("sym"), nullptr), 0xabcd1);
+
+    symbolTable.insert(String("sym"), SymbolTable::Global, elf2, 0xabcd2);
+
+    SymbolTable::Binding binding = SymbolTable::Local;
+    EXPECT_EQ(
+        symbolTable.lookup(String("sym"), nullptr, SymbolTable::LocalFirst,
+                           &binding),
+        0xabcd2);
+    EXPECT_EQ(binding, SymbolTable::Global);
+
+    symbolTable.eraseByElf(elf2);
+    EXPECT_EQ(
+        symbolTable.lookup(String("sym"), nullptr, SymbolTable::LocalFirst,
+                           &binding),
+        0xabcd1);
+    EXPECT_EQ(binding, SymbolTable::Weak);
+}
+
+TEST(PedigreeSymbolTable, EraseRevealsShadowedGlobal)
+{
+    Elf *elf1 = reinterpret_cast<Elf *>(1);
+    Elf *elf2 = reinterpret_cast<Elf *>(2);
+
+    SymbolTable symbolTable(nullptr);
+
+    // The definition from the lowest ELF wins, whatever the insertion order.
+    symbolTable.insert(String("sym"), SymbolTable::Global, elf2, 0xabcd2);
+    symbolTable.insert(String("sym"), SymbolTable::Global, elf1, 0xabcd1);
+    EXPECT_EQ(symbolTable.lookup(String("sym"), nullptr), 0xabcd1);
+
+    symbolTable.eraseByElf(elf1);
+    EXPECT_EQ(symbolTable.lookup(String("sym"), nullptr), 0xabcd2);
+
+    // Reloading the ELF brings its definition back to the front.
+    symbolTable.insert(String("sym"), SymbolTable::Global, elf1, 0xabcd3);
+    EXPECT_EQ(symbolTable.lookup(String("sym"), nullptr), 0xabcd3);
+}
+
+TEST(PedigreeSymbolTable, FirstDefinitionPerElfWins)
+{
+    Elf *elf = reinterpret_cast<Elf *>(1);
+
+    SymbolTable symbolTable(elf);
+
+    symbolTable.insert(String("sym"), SymbolTable::Global, elf, 0xabcd1);
+    symbolTable.insert(String("sym"), SymbolTable::Global, elf, 0xabcd2);
+
+    EXPECT_EQ(symbolTable.lookup(String("sym"), elf), 0xabcd1);
+}
+
+TEST(PedigreeSymbolTable, NotOriginatingElfSkipsLocals)
+{
+    Elf *elf = reinterpret_cast<Elf *>(1);
+
+    SymbolTable symbolTable(elf);
+
+    symbolTable.insert(String("sym"), SymbolTable::Local, elf, 0xabcd1);
+    symbolTable.insert(String("sym"), SymbolTable::Global, nullptr, 0xabcd2);
+
+    EXPECT_EQ(symbolTable.lookup(String("sym"), elf), 0xabcd1);
+    EXPECT_EQ(
+        symbolTable.lookup(String("sym"), elf, SymbolTable::NotOriginatingElf),
+        0xabcd2);
+}
+
+TEST(PedigreeSymbolTable, ManySymbols)
+{
+    SymbolTable symbolTable(nullptr);
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        String name;
+        name.Format("sym%d", i);
+        symbolTable.insert(name, SymbolTable::Global, nullptr, i + 1);
+    }
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        String name;
+        name.Format("sym%d", i);
+        EXPECT_EQ(symbolTable.lookup(name, nullptr), uintptr_t(i + 1));
+    }
+
+    EXPECT_EQ(symbolTable.lookup(String("sym10000"), nullptr), 0);
+}
+
+TEST(PedigreeSymbolTable, RecycledDefinitionsReadConsistently)
+{
+    Elf *elfA = reinterpret_cast<Elf *>(1);
+    Elf *elfB = reinterpret_cast<Elf *>(2);
+
+    SymbolTable symbolTable(nullptr);
+    String name("lsym");
+    symbolTable.insert(name, SymbolTable::Local, elfA, 0xaaaa);
+
+    // The one definition keeps being recycled between two ELFs. A lookup
+    // must never pair one's parent with the other's value.
+    std::atomic<bool> stop(false);
+    std::thread writer([&]() {
+        for (size_t i = 0; i < 100000; ++i)
+        {
+            symbolTable.eraseByElf(elfA);
+            symbolTable.insert(name, SymbolTable::Local, elfB, 0xbbbb);
+            symbolTable.eraseByElf(elfB);
+            symbolTable.insert(name, SymbolTable::Local, elfA, 0xaaaa);
+        }
+        stop = true;
+    });
+
+    size_t torn = 0;
+    while (!stop)
+    {
+        uintptr_t value = symbolTable.lookup(name, elfA);
+        if (value && (value != 0xaaaa))
+        {
+            ++torn;
+        }
+    }
+    writer.join();
+
+    EXPECT_EQ(torn, 0);
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "pedigree/kernel/utilities/TimerWheel.h"
+
+// 1us ticks keep the numbers in these tests readable.
+#define SHIFT 10
+#define TICK (1ULL << SHIFT)
+
+class TestTimer : public TimerWheel::Entry
+{
+  public:
+    TestTimer() : fired(0), firedAt(0)
+    {
+    }
+
+    size_t fired;
+    uint64_t firedAt;
+};
+
+static size_t fire(TimerWheel::Entry *chain, uint64_t now)
+{
+    size_t n = 0;
+    while (chain)
+    {
+        TimerWheel::Entry *next = chain->next();
+        TestTimer *t = static_cast<TestTimer *>(chain);
+        ++t->fired;
+        t->firedAt = now;
+        ++n;
+        chain = next;
+    }
+    return n;
+}
+
+TEST(PedigreeTimerWheel, Empty)
+{
+    TimerWheel wheel(SHIFT);
+    EXPECT_EQ(wheel.count(), 0U);
+    EXPECT_EQ(wheel.advance(1000000), nullptr);
+    EXPECT_EQ(wheel.find(&wheel), nullptr);
+}
+
+TEST(PedigreeTimerWheel, FiresOnTime)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer t;
+
+    wheel.insert(&t, 10 * TICK);
+    EXPECT_TRUE(t.isPending());
+    EXPECT_EQ(wheel.count(), 1U);
+
+    EXPECT_EQ(wheel.advance(9 * TICK), nullptr);
+    EXPECT_EQ(fire(wheel.advance(10 * TICK), 10 * TICK), 1U);
+    EXPECT_FALSE(t.isPending());
+    EXPECT_EQ(wheel.count(), 0U);
+}
+
+TEST(PedigreeTimerWheel, NeverFiresEarly)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer t;
+
+    // Part-way into a tick rounds up to the next one.
+    wheel.insert(&t, (10 * TICK) + 1);
+    EXPECT_EQ(wheel.advance(10 * TICK), nullptr);
+    EXPECT_EQ(fire(wheel.advance(11 * TICK), 11 * TICK), 1U);
+}
+
+TEST(PedigreeTimerWheel, OverdueFiresNextAdvance)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer t;
+
+    wheel.advance(100 * TICK);
+    wheel.insert(&t, 5 * TICK);
+    EXPECT_EQ(fire(wheel.advance(101 * TICK), 101 * TICK), 1U);
+}
+
+TEST(PedigreeTimerWheel, Remove)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer a, b;
+
+    wheel.insert(&a, 10 * TICK);
+    wheel.insert(&b, 10 * TICK);
+    wheel.remove(&a);
+    EXPECT_FALSE(a.isPending());
+    EXPECT_EQ(wheel.count(), 1U);
+
+    // Removing again is harmless.
+    wheel.remove(&a);
+    EXPECT_EQ(wheel.count(), 1U);
+
+    TimerWheel::Entry *chain = wheel.advance(10 * TICK);
+    EXPECT_EQ(chain, &b);
+    EXPECT_EQ(chain->next(), nullptr);
+}
+
+TEST(PedigreeTimerWheel, FindByKey)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer a, b, c;
+    int keyA, keyB;
+
+    wheel.insert(&a, 10 * TICK, &keyA);
+    wheel.insert(&b, 20 * TICK, &keyB);
+    wheel.insert(&c, 30 * TICK, &keyB);
+
+    EXPECT_EQ(wheel.find(&keyA), &a);
+    TimerWheel::Entry *found = wheel.find(&keyB);
+    EXPECT_TRUE(found == &b || found == &c);
+
+    // Duplicates are found one at a time until none remain.
+    wheel.remove(found);
+    found = wheel.find(&keyB);
+    EXPECT_TRUE(found == &b || found == &c);
+    wheel.remove(found);
+    EXPECT_EQ(wheel.find(&keyB), nullptr);
+
+    // Fired entries leave the index too.
+    fire(wheel.advance(10 * TICK), 10 * TICK);
+    EXPECT_EQ(wheel.find(&keyA), nullptr);
+}
+
+TEST(PedigreeTimerWheel, CascadesFromHigherLevels)
+{
+    TimerWheel wheel(SHIFT);
+    std::vector<TestTimer> timers(TimerWheel::Levels);
+
+    // One timer landing in each level.
+    uint64_t expiry = 1;
+    for (size_t i = 0; i < timers.size(); ++i)
+    {
+        wheel.insert(&timers[i], expiry * TICK);
+        expiry <<= TimerWheel::LevelBits;
+    }
+
+    expiry = 1;
+    for (size_t i = 0; i < timers.size(); ++i)
+    {
+        EXPECT_EQ(wheel.advance((expiry - 1) * TICK), nullptr);
+        EXPECT_EQ(fire(wheel.advance(expiry * TICK), expiry * TICK), 1U);
+        EXPECT_EQ(timers[i].fired, 1U);
+        expiry <<= TimerWheel::LevelBits;
+    }
+}
+
+TEST(PedigreeTimerWheel, BeyondRange)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer t;
+
+    uint64_t range = 1ULL << (TimerWheel::Levels * TimerWheel::LevelBits);
+    uint64_t expiry = (range * 3 + 12345) * TICK;
+    wheel.insert(&t, expiry);
+
+    EXPECT_EQ(wheel.advance(expiry - TICK), nullptr);
+    EXPECT_EQ(t.getExpiry(), expiry);
+    EXPECT_EQ(fire(wheel.advance(expiry), expiry), 1U);
+}
+
+TEST(PedigreeTimerWheel, LateInsertAfterIdleGap)
+{
+    TimerWheel wheel(SHIFT);
+    TestTimer far, near;
+
+    // A lone far-away timer lets the wheel skip ahead; it mustn't skip past
+    // the time it was advanced to.
+    wheel.insert(&far, 1000000 * TICK);
+    wheel.advance(100 * TICK);
+    wheel.insert(&near, 101 * TICK);
+    EXPECT_EQ(fire(wheel.advance(101 * TICK), 101 * TICK), 1U);
+    EXPECT_EQ(near.fired, 1U);
+    EXPECT_EQ(far.fired, 0U);
+}
+
+TEST(PedigreeTimerWheel, HundredThousandTimers)
+{
+    const size_t count = 100000;
+    // ~10 seconds of 1us ticks, advanced in 1ms steps.
+    const uint64_t span = 10000000ULL * TICK;
+    const uint64_t step = 1000 * TICK;
+
+    TimerWheel wheel(SHIFT);
+    std::vector<TestTimer> timers(count);
+    std::mt19937_64 rng(0x5eed);
+    std::uniform_int_distribution<uint64_t> dist(0, span);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        wheel.insert(&timers[i], dist(rng), &timers[i]);
+    }
+    EXPECT_EQ(wheel.count(), count);
+
+    // Cancel every third timer.
+    for (size_t i = 0; i < count; i += 3)
+    {
+        TimerWheel::Entry *entry = wheel.find(&timers[i]);
+        ASSERT_EQ(entry, &timers[i]);
+        wheel.remove(entry);
+    }
+
+    size_t fired = 0;
+    uint64_t lastExpiry = 0;
+    for (uint64_t now = 0; now <= span + step; now += step)
+    {
+        TimerWheel::Entry *chain = wheel.advance(now);
+        for (TimerWheel::Entry *e = chain; e; e = e->next())
+        {
+            // Each chain comes out in expiry-tick order.
+            uint64_t tick = (e->getExpiry() + TICK - 1) / TICK;
+            EXPECT_GE(tick, lastExpiry);
+            lastExpiry = tick;
+
+            // Never early, and never later than one advance step.
+            EXPECT_LE(e->getExpiry(), now);
+            EXPECT_LT(now - e->getExpiry(), step + TICK);
+        }
+        fired += fire(chain, now);
+    }
+
+    EXPECT_EQ(wheel.count(), 0U);
+    for (size_t i = 0; i < count; ++i)
+    {
+        EXPECT_EQ(timers[i].fired, (i % 3) ? 1U : 0U);
+    }
+    EXPECT_EQ(fired, count - ((count + 2) / 3));
+}
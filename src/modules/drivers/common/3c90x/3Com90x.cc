@@ -265,6 +265,87 @@ void Nic3C90x::reset()
 }
 
 bool Nic3C90x::send(size_t nBytes, uintptr_t buffer)
+{
+    Fragment fragment = {buffer, nBytes};
+    return transmit(&fragment, 1, nBytes);
+}
+
+bool Nic3C90x::sendFragments(
+    const Fragment *fragments, size_t count, size_t nBytes,
+    SendCompletion completion, void *param)
+{
+    // transmit() waits for the download to complete, after which the card
+    // is done with the fragments.
+    bool result = transmit(fragments, count, nBytes);
+    if (completion)
+    {
+        completion(param, result);
+    }
+
+    return result;
+}
+
+size_t Nic3C90x::mapFragments(const Fragment *fragments, size_t count)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uintptr_t addr = fragments[i].buffer;
+        size_t remaining = fragments[i].length;
+        while (remaining)
+        {
+            void *page = reinterpret_cast<void *>(addr & ~(PAGE_SIZE - 1));
+            if (!va.isMapped(page))
+            {
+                return 0;
+            }
+
+            physical_uintptr_t phys = 0;
+            size_t flags = 0;
+            va.getMapping(page, phys, flags);
+            phys += addr & (PAGE_SIZE - 1);
+
+            size_t chunk = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+            if (chunk > remaining)
+            {
+                chunk = remaining;
+            }
+
+            // The DPD only holds 32-bit addresses.
+            if ((phys + chunk) > 0x100000000ULL)
+            {
+                return 0;
+            }
+
+            if (n && (m_TransmitDPD->Frags[n - 1].DataAddr +
+                      m_TransmitDPD->Frags[n - 1].DataLength) == phys)
+            {
+                // Physically follows the previous piece; extend it.
+                m_TransmitDPD->Frags[n - 1].DataLength += chunk;
+            }
+            else
+            {
+                if (n == NUM_DPD_FRAGMENTS)
+                {
+                    return 0;
+                }
+
+                m_TransmitDPD->Frags[n].DataAddr = static_cast<uint32_t>(phys);
+                m_TransmitDPD->Frags[n].DataLength = chunk;
+                ++n;
+            }
+
+            addr += chunk;
+            remaining -= chunk;
+        }
+    }
+
+    return n;
+}
+
+bool Nic3C90x::transmit(const Fragment *fragments, size_t count, size_t nBytes)
 {
     /** Stall the download engine **/
     issueCommand(cmdStallCtl, 2);
@@ -275,18 +356,6 @@ bool Nic3C90x::send(size_t nBytes, uintptr_t buffer)
     while (m_pBase->read16(regCommandIntStatus_w) & INT_CMDINPROGRESS)
         ;
 
-    physical_uintptr_t destPtr = m_pTxBuffPhys;
-    size_t dud = 0;
-    if (Processor::information().getVirtualAddressSpace().isMapped(
-            reinterpret_cast<void *>(buffer)))
-    {
-        Processor::information().getVirtualAddressSpace().getMapping(
-            reinterpret_cast<void *>(buffer), destPtr, dud);
-        destPtr += buffer & 0xFFF;
-    }
-    else
-        MemoryCopy(m_pTxBuffVirt, reinterpret_cast<void *>(buffer), nBytes);
-
     /** Setup the DPD (download descriptor) **/
     m_TransmitDPD->DnNextPtr = 0;
 
@@ -294,10 +363,30 @@ bool Nic3C90x::send(size_t nBytes, uintptr_t buffer)
     m_TransmitDPD->FrameStartHeader = nBytes | 0x8000;
     // m_TransmitDPD->HdrAddr = m_pTxBuffPhys;
     // m_TransmitDPD->HdrLength = Ethernet::instance().ethHeaderSize();
-    m_TransmitDPD->DataAddr = static_cast<uint32_t>(
-        destPtr);  // m_pTxBuffPhys; // + m_TransmitDPD->HdrLength;
-    m_TransmitDPD->DataLength =
-        (nBytes /* - m_TransmitDPD->HdrLength */) + (1U << 31U);
+
+    /** Have the card gather the fragments itself where it can **/
+    size_t nFrags = mapFragments(fragments, count);
+    if (!nFrags)
+    {
+        // Bounce through our own transmit buffer instead.
+        size_t offset = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            MemoryCopy(
+                m_pTxBuffVirt + offset,
+                reinterpret_cast<void *>(fragments[i].buffer),
+                fragments[i].length);
+            offset += fragments[i].length;
+        }
+
+        m_TransmitDPD->Frags[0].DataAddr =
+            static_cast<uint32_t>(m_pTxBuffPhys);
+        m_TransmitDPD->Frags[0].DataLength = nBytes;
+        nFrags = 1;
+    }
+
+    /** Mark the last fragment **/
+    m_TransmitDPD->Frags[nFrags - 1].DataLength |= (1U << 31U);
 
     /** Send the packet **/
     m_pBase->write32(m_pDPD, regDnListPtr_l);
@@ -619,48 +708,74 @@ int Nic3C90x::trampoline(void *p)
 
 void Nic3C90x::receiveThread()
 {
+    NetworkStack::Frame frames[NUM_UPDS];
+    RXD *used[NUM_UPDS];
+
     while (true)
     {
         m_RxMutex.acquire();
 
-        // When we come here, the UpListPtr register will hold the *next* UPD...
-        // What we want is the one that it used! That's ok, it's not difficult
-        // to find that out...
-        // However, if the next is zero, the IRQ notified us of the *last* UPD
-        // in the list. That needs to be handled properly too.
-        uintptr_t currUpdPhys =
-            reinterpret_cast<uintptr_t>(m_PendingPackets.popFront());
-        uintptr_t myNum;
-        if (currUpdPhys != 0)
+        // Pick up every upload completed so far, not just the one that woke
+        // us, and hand them to the stack together.
+        size_t nFrames = 0;
+        bool stalled = false;
+        bool failed = false;
+        do
         {
-            uintptr_t myOffset = (currUpdPhys - m_pUPD);
-            myNum = (myOffset / sizeof(RXD)) - 1;
-        }
-        else
-            myNum = NUM_UPDS - 1;
-        RXD *usedUpd = &m_ReceiveUPD[myNum];
+            // When we come here, the UpListPtr register will hold the *next*
+            // UPD... What we want is the one that it used! That's ok, it's not
+            // difficult to find that out...
+            // However, if the next is zero, the IRQ notified us of the *last*
+            // UPD in the list. That needs to be handled properly too.
+            uintptr_t currUpdPhys =
+                reinterpret_cast<uintptr_t>(m_PendingPackets.popFront());
+            uintptr_t myNum;
+            if (currUpdPhys != 0)
+            {
+                uintptr_t myOffset = (currUpdPhys - m_pUPD);
+                myNum = (myOffset / sizeof(RXD)) - 1;
+            }
+            else
+            {
+                myNum = NUM_UPDS - 1;
+                stalled = true;
+            }
+            RXD *usedUpd = &m_ReceiveUPD[myNum];
 
-        if (usedUpd->UpPktStatus & (1 << 14))
-        {
-            // an error occurred
-            ERROR(
-                "3C90x: error, UpPktStatus = " << usedUpd->UpPktStatus << ".");
-            return;
-        }
+            if (usedUpd->UpPktStatus & (1 << 14))
+            {
+                // an error occurred
+                ERROR(
+                    "3C90x: error, UpPktStatus = " << usedUpd->UpPktStatus
+                                                   << ".");
+                failed = true;
+                break;
+            }
 
-        size_t packLen = usedUpd->UpPktStatus & 0x1FFF;
+            frames[nFrames].buffer =
+                reinterpret_cast<uintptr_t>(m_pRxBuffVirt + (myNum * 1536));
+            frames[nFrames].length = usedUpd->UpPktStatus & 0x1FFF;
+            frames[nFrames].offset = 0;
+            used[nFrames] = usedUpd;
+            ++nFrames;
+        } while (nFrames < NUM_UPDS && m_RxMutex.tryAcquire());
 
-        NetworkStack::instance().receive(
-            packLen,
-            reinterpret_cast<uintptr_t>(m_pRxBuffVirt + (myNum * 1536)), this,
-            0);
+        // The stack copies each frame before returning, so the UPDs can be
+        // handed back to the card straight afterwards.
+        NetworkStack::instance().receiveBatch(this, frames, nFrames);
 
-        // reset the UPD's status so it can be used again
-        usedUpd->UpPktStatus = 0;
+        for (size_t i = 0; i < nFrames; ++i)
+        {
+            // reset the UPD's status so it can be used again
+            used[i]->UpPktStatus = 0;
+        }
 
         // Reset the location for the UPD, if we're stalling
-        if (currUpdPhys == 0)
+        if (stalled)
             m_pBase->write32(m_pUPD, regUpListPtr_l);
+
+        if (failed)
+            return;
     }
 }
 
@@ -20,6 +20,7 @@
 #ifndef NIC_3C90X_H
 #define NIC_3C90X_H
 
+#include "3Com90xConstants.h"
 #include "pedigree/kernel/machine/IrqHandler.h"
 #include "pedigree/kernel/machine/Network.h"
 #include "pedigree/kernel/machine/types.h"
@@ -46,6 +47,10 @@ class Nic3C90x : public Network, public IrqHandler
 
     virtual bool send(size_t nBytes, uintptr_t buffer);
 
+    virtual bool sendFragments(
+        const Fragment *fragments, size_t count, size_t nBytes,
+        SendCompletion completion, void *param);
+
     virtual bool setStationInfo(const StationInfo &info);
 
     virtual const StationInfo &getStationInfo();
@@ -58,6 +63,14 @@ class Nic3C90x : public Network, public IrqHandler
   private:
     int issueCommand(int cmd, int param);
 
+    /** Downloads the fragments to the card and waits for it to finish. */
+    bool transmit(const Fragment *fragments, size_t count, size_t nBytes);
+
+    /** Points the DPD's fragment list at the physical pages backing
+     * \p fragments. \return the number of entries used, or zero if the
+     * fragments can't be described that way. */
+    size_t mapFragments(const Fragment *fragments, size_t count);
+
     int setWindow(int window);
 
     uint16_t readEeprom(int address);
@@ -95,8 +108,11 @@ class Nic3C90x : public Network, public IrqHandler
         uint32_t FrameStartHeader;
         // uint32_t HdrAddr;
         // uint32_t HdrLength;
-        uint32_t DataAddr;
-        uint32_t DataLength;
+        struct
+        {
+            uint32_t DataAddr;
+            uint32_t DataLength;
+        } Frags[NUM_DPD_FRAGMENTS];
     } __attribute__((aligned(8)));
 
     /** RX Descriptor */
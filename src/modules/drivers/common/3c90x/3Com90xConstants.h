@@ -28,6 +28,9 @@
 
 #define NUM_UPDS 32
 
+/** Fragments in the transmit DPD; the card accepts up to 63. **/
+#define NUM_DPD_FRAGMENTS 32
+
 #define XCVR_MAGIC (0x5A00)
 /** any single transmission fails after 16 collisions or other errors
  ** this is the number of times to retry the transmission -- this should
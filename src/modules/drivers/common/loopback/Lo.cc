@@ -76,6 +76,30 @@ bool Loopback::send(size_t nBytes, uintptr_t buffer)
     return true;
 }
 
+bool Loopback::sendFragments(
+    const Fragment *fragments, size_t count, size_t nBytes,
+    SendCompletion completion, void *param)
+{
+    bool result = false;
+    if (nBytes > 0xffff)
+    {
+        ERROR("Loopback: Attempt to send a packet with size > 64 KB");
+    }
+    else
+    {
+        // Gather straight into the received pbuf.
+        result = NetworkStack::instance().receive(
+            this, fragments, count, nBytes);
+    }
+
+    if (completion)
+    {
+        completion(param, result);
+    }
+
+    return result;
+}
+
 bool Loopback::setStationInfo(StationInfo info)
 {
     // Nothing here is modifiable
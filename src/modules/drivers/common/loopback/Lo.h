@@ -50,6 +50,10 @@ class Loopback : public Network
 
     virtual bool send(size_t nBytes, uintptr_t buffer);
 
+    virtual bool sendFragments(
+        const Fragment *fragments, size_t count, size_t nBytes,
+        SendCompletion completion, void *param);
+
     virtual bool setStationInfo(StationInfo info);
 
     virtual StationInfo getStationInfo();
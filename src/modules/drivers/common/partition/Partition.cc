@@ -33,3 +33,97 @@ uint64_t Partition::getStart()
 {
     return m_Start;
 }
+
+bool Partition::readVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    VectoredRequest *pRequest =
+        translate(pSegments, nSegments, pCompletion, param);
+    if (!pRequest)
+    {
+        if (pCompletion)
+        {
+            pCompletion(param, false);
+        }
+        return false;
+    }
+
+    Disk *pParent = static_cast<Disk *>(getParent());
+    return pParent->readVectored(
+        pRequest->pTranslated, nSegments, &vectoredComplete, pRequest);
+}
+
+bool Partition::writeVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    VectoredRequest *pRequest =
+        translate(pSegments, nSegments, pCompletion, param);
+    if (!pRequest)
+    {
+        if (pCompletion)
+        {
+            pCompletion(param, false);
+        }
+        return false;
+    }
+
+    Disk *pParent = static_cast<Disk *>(getParent());
+    return pParent->writeVectored(
+        pRequest->pTranslated, nSegments, &vectoredComplete, pRequest);
+}
+
+Partition::VectoredRequest *Partition::translate(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    for (size_t i = 0; i < nSegments; ++i)
+    {
+        // Every byte of the segment must lie within the partition.
+        uint64_t location = pSegments[i].location;
+        uint64_t length = pSegments[i].length;
+        if ((length > m_Length) || (location > (m_Length - length)))
+        {
+            return 0;
+        }
+    }
+
+    if (!m_bAligned)
+    {
+        m_bAligned = true;
+        static_cast<Disk *>(getParent())->align(m_Start);
+    }
+
+    VectoredRequest *pRequest = new VectoredRequest;
+    pRequest->pSegments = pSegments;
+    pRequest->pTranslated = new IoSegment[nSegments];
+    pRequest->nSegments = nSegments;
+    pRequest->pCompletion = pCompletion;
+    pRequest->param = param;
+
+    for (size_t i = 0; i < nSegments; ++i)
+    {
+        pRequest->pTranslated[i] = pSegments[i];
+        pRequest->pTranslated[i].location += m_Start;
+    }
+
+    return pRequest;
+}
+
+void Partition::vectoredComplete(void *param, bool bSuccess)
+{
+    VectoredRequest *pRequest = reinterpret_cast<VectoredRequest *>(param);
+    for (size_t i = 0; i < pRequest->nSegments; ++i)
+    {
+        pRequest->pSegments[i].buffer = pRequest->pTranslated[i].buffer;
+    }
+
+    if (pRequest->pCompletion)
+    {
+        pRequest->pCompletion(pRequest->param, bSuccess);
+    }
+
+    delete[] pRequest->pTranslated;
+    delete pRequest;
+}
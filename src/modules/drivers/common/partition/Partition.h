@@ -95,6 +95,20 @@ class Partition : public Disk
         pParent->write(location + m_Start);
     }
 
+    virtual void sync()
+    {
+        static_cast<Disk *>(getParent())->sync();
+    }
+
+    /** Translates the segments to the parent disk and submits them to it as
+     * a single request. */
+    virtual bool readVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+    virtual bool writeVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+
     virtual size_t getSize() const
     {
         return getLength();
@@ -122,6 +136,25 @@ class Partition : public Disk
     }
 
   private:
+    /** Context for a vectored request in flight on the parent disk. */
+    struct VectoredRequest
+    {
+        IoSegment *pSegments;
+        IoSegment *pTranslated;
+        size_t nSegments;
+        IoCompletion pCompletion;
+        void *param;
+    };
+
+    /** Builds the parent-relative request, or returns null if any segment
+     * lies outside the partition. */
+    VectoredRequest *translate(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+        void *param);
+
+    /** Parent completion: hands buffers back to the original segments. */
+    static void vectoredComplete(void *param, bool bSuccess);
+
     String m_Type;
     uint64_t m_Start;
     uint64_t m_Length;
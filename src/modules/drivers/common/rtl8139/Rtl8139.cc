@@ -147,6 +147,27 @@ void Rtl8139::reset()
 }
 
 bool Rtl8139::send(size_t nBytes, uintptr_t buffer)
+{
+    Fragment fragment = {buffer, nBytes};
+    return transmit(&fragment, 1, nBytes);
+}
+
+bool Rtl8139::sendFragments(
+    const Fragment *fragments, size_t count, size_t nBytes,
+    SendCompletion completion, void *param)
+{
+    // The card has no gather DMA, but the fragments can at least go straight
+    // into the transmit buffer instead of via an intermediate copy.
+    bool result = transmit(fragments, count, nBytes);
+    if (completion)
+    {
+        completion(param, result);
+    }
+
+    return result;
+}
+
+bool Rtl8139::transmit(const Fragment *fragments, size_t count, size_t nBytes)
 {
     LockGuard<Spinlock> guard(m_TxLock);
 
@@ -157,7 +178,14 @@ bool Rtl8139::send(size_t nBytes, uintptr_t buffer)
     }
 
     // copy to the buffer and pad the packet
-    MemoryCopy(m_pTxBuffVirt, reinterpret_cast<void *>(buffer), nBytes);
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        MemoryCopy(
+            m_pTxBuffVirt + offset,
+            reinterpret_cast<void *>(fragments[i].buffer), fragments[i].length);
+        offset += fragments[i].length;
+    }
     for (int i = nBytes; i < RTL_BUFF_SIZE; i++)
         m_pTxBuffVirt[i] = 0;
 
@@ -222,9 +250,10 @@ void Rtl8139::recv()
     // adjust current offset (it never should be over the buffer's size)
     m_RxCurr %= RTL_BUFF_SIZE;
 
-    // send the packet to the stack
+    // send the packet to the stack, which takes its own copy
     NetworkStack::instance().receive(
         length - 4, reinterpret_cast<uintptr_t>(packBuff), this, 0);
+    delete[] packBuff;
 
     m_RxLock = false;
 }
@@ -48,6 +48,10 @@ class Rtl8139 : public Network, public IrqHandler
 
     virtual bool send(size_t nBytes, uintptr_t buffer);
 
+    virtual bool sendFragments(
+        const Fragment *fragments, size_t count, size_t nBytes,
+        SendCompletion completion, void *param);
+
     virtual bool setStationInfo(StationInfo info);
 
     virtual StationInfo getStationInfo();
@@ -62,6 +66,9 @@ class Rtl8139 : public Network, public IrqHandler
   private:
     void recv();
 
+    /** Gathers the fragments into the transmit buffer and sends them. */
+    bool transmit(const Fragment *fragments, size_t count, size_t nBytes);
+
     void reset();
 
     struct packet
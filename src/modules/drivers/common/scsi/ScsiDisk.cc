@@ -69,6 +69,10 @@ ScsiDisk::ScsiDisk()
       m_DeviceType(NoDevice)
 {
     m_Cache.setCallback(cacheCallback, this);
+
+    // write() only marks pages dirty, so the write-back timer doesn't have to
+    // checksum the whole cache to find them.
+    m_Cache.setDirtyTracking(true);
 }
 
 ScsiDisk::~ScsiDisk()
@@ -380,12 +384,17 @@ void ScsiDisk::write(uint64_t location)
         return;
     }
 
-    // Implicit pin caused by lookup() must be released by the write request
-    // handler, to ensure the refcount is correct.
-    ScsiController *pParent = static_cast<ScsiController *>(m_pParent);
-    pParent->addAsyncRequest(
-        0, SCSI_REQUEST_WRITE, reinterpret_cast<uint64_t>(this),
-        location + offs);
+    // Leave the write to the cache's write-back timer (or sync()), so that
+    // repeated writes to the same page only go to the device once.
+    m_Cache.markDirty(location + offs);
+    m_Cache.release(location + offs);
+#endif
+}
+
+void ScsiDisk::sync()
+{
+#ifndef CRIPPLE_HDD
+    m_Cache.writeBack(false);
 #endif
 }
 
@@ -94,6 +94,7 @@ class EXPORTED_PUBLIC ScsiDisk : public Disk
     virtual uintptr_t read(uint64_t location);
     virtual void write(uint64_t location);
     virtual void flush(uint64_t location);
+    virtual void sync();
     virtual void align(uint64_t location);
 
     virtual void getName(String &str)
@@ -225,6 +225,7 @@ FramebufferFile::FramebufferFile(
 
 FramebufferFile::~FramebufferFile()
 {
+    quiesce();
     delete m_pGraphicsParameters;
 }
 
@@ -18,6 +18,7 @@
  */
 
 #include "FileDescriptor.h"
+#include "epoll-syscalls.h"
 #include "net-syscalls.h"  // to get destructor for SharedPointer<NetworkSyscalls>
 
 #include "modules/subsys/posix/IoEvent.h"
@@ -33,8 +34,9 @@ RadixTree<LockedFile *> g_PosixGlobalLockedFiles;
 
 /// Default constructor
 FileDescriptor::FileDescriptor()
-    : file(0), offset(0), fd(0xFFFFFFFF), lockedFile(0), networkImpl(nullptr),
-    ioevent(nullptr), fdflags(0), flflags(0)
+    : file(0), offset(0), readAhead(), fd(0xFFFFFFFF), lockedFile(0),
+    networkImpl(nullptr), ioevent(nullptr), epollItems(), fdflags(0),
+    flflags(0)
 {
 }
 
@@ -42,8 +44,9 @@ FileDescriptor::FileDescriptor()
 FileDescriptor::FileDescriptor(
     File *newFile, uint64_t newOffset, size_t newFd, int fdFlags, int flFlags,
     LockedFile *lf)
-    : file(newFile), offset(newOffset), fd(newFd), lockedFile(lf),
-    networkImpl(nullptr), ioevent(nullptr), fdflags(fdFlags), flflags(flFlags)
+    : file(newFile), offset(newOffset), readAhead(), fd(newFd),
+    lockedFile(lf), networkImpl(nullptr), ioevent(nullptr), epollItems(),
+    fdflags(fdFlags), flflags(flFlags)
 {
     /// \todo need a copy constructor for networkImpl
     if (file)
@@ -57,9 +60,9 @@ FileDescriptor::FileDescriptor(
 
 /// Copy constructor
 FileDescriptor::FileDescriptor(FileDescriptor &desc)
-    : file(desc.file), offset(desc.offset), fd(desc.fd), lockedFile(0),
-      networkImpl(desc.networkImpl), ioevent(nullptr), fdflags(desc.fdflags),
-      flflags(desc.flflags)
+    : file(desc.file), offset(desc.offset), readAhead(), fd(desc.fd),
+      lockedFile(0), networkImpl(desc.networkImpl), ioevent(nullptr),
+      epollItems(), fdflags(desc.fdflags), flflags(desc.flflags)
 {
     if (file)
     {
@@ -79,8 +82,8 @@ FileDescriptor::FileDescriptor(FileDescriptor &desc)
 
 /// Pointer copy constructor
 FileDescriptor::FileDescriptor(FileDescriptor *desc)
-    : file(0), offset(0), fd(0), lockedFile(0), ioevent(nullptr), fdflags(0),
-    flflags(0)
+    : file(0), offset(0), readAhead(), fd(0), lockedFile(0), ioevent(nullptr),
+    epollItems(), fdflags(0), flflags(0)
 {
     if (!desc)
         return;
@@ -139,6 +142,9 @@ FileDescriptor &FileDescriptor::operator=(FileDescriptor &desc)
 /// Destructor - decreases file reference count
 FileDescriptor::~FileDescriptor()
 {
+    // Stop any epoll instances watching through this descriptor first.
+    epollDetachDescriptor(this);
+
     if (file)
     {
 #if ENABLE_LOCKED_FILES
@@ -20,15 +20,17 @@
 #ifndef POSIX_FILEDESCRIPTOR_H
 #define POSIX_FILEDESCRIPTOR_H
 
+#include "modules/system/vfs/File.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/SharedPointer.h"
 #include "pedigree/kernel/utilities/String.h"
 
-class File;
 class LockedFile;
 class UnixSocket;
 class IoEvent;
+class EpollItem;
 
 /** Abstraction of a file descriptor, which defines an open file
  * and related flags.
@@ -80,6 +82,9 @@ class EXPORTED_PUBLIC FileDescriptor
     /// Offset within the file for I/O
     uint64_t offset;
 
+    /// Sequential read detection for read-ahead on this open file
+    File::ReadAheadState readAhead;
+
     /// Descriptor number
     size_t fd;
 
@@ -92,6 +97,9 @@ class EXPORTED_PUBLIC FileDescriptor
     /// IO event for reporting changes to files
     IoEvent *ioevent;
 
+    /// epoll registrations of this descriptor, dropped when it is closed
+    List<EpollItem *> epollItems;
+
   public:  /// \todo swap this to private and fix everything that breaks
     /// File descriptor flags (fcntl)
     int fdflags;
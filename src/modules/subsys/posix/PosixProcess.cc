@@ -56,7 +56,12 @@ PosixProcess::PosixProcess()
 
 /** Copy constructor. */
 PosixProcess::PosixProcess(Process *pParent, bool bCopyOnWrite)
-    : Process(pParent, bCopyOnWrite), m_pSession(0), m_pProcessGroup(0),
+    : PosixProcess(pParent, bCopyOnWrite ? CopyOnWrite : Shared)
+{
+}
+
+PosixProcess::PosixProcess(Process *pParent, AddressSpaceMode mode)
+    : Process(pParent, mode), m_pSession(0), m_pProcessGroup(0),
       m_GroupMembership(NoGroup), m_Mask(0),
       m_RealIntervalTimer(this, IntervalTimer::Hardware),
       m_VirtualIntervalTimer(this, IntervalTimer::Virtual),
@@ -154,6 +154,9 @@ class EXPORTED_PUBLIC PosixProcess : public Process
 
     /** Copy constructor. */
     PosixProcess(Process *pParent, bool bCopyOnWrite = true);
+
+    /** Copy constructor with explicit address space handling. */
+    PosixProcess(Process *pParent, AddressSpaceMode mode);
     virtual ~PosixProcess();
 
     void setProcessGroup(ProcessGroup *newGroup, bool bRemoveFromGroup = true);
@@ -66,7 +66,6 @@ extern char __posix_compat_vsyscall_base;
 #define FD_CLOEXEC 1
 
 typedef Tree<size_t, PosixSubsystem::SignalHandler *> sigHandlerTree;
-typedef Tree<size_t, FileDescriptor *> FdMap;
 
 ProcessGroupManager ProcessGroupManager::m_Instance;
 
@@ -109,8 +108,28 @@ void ProcessGroupManager::returnGroupId(size_t gid)
     m_GroupIds.clear(gid);
 }
 
+// Out of line so that m_FdTable's destructor is only instantiated where
+// FileDescriptor is complete; elsewhere it would delete without destroying.
+PosixSubsystem::PosixSubsystem()
+    : Subsystem(Posix), m_SignalHandlers(), m_SignalHandlersLock(),
+      m_FdTable(), m_NextFd(0), m_FdLock(), m_FdBitmap(), m_LastFd(0),
+      m_FreeCount(1), m_AltSigStack(), m_SyncObjects(), m_Threads(),
+      m_ThreadWaiters(), m_NextThreadWaiter(0), m_Abi(PosixAbi),
+      m_bAcquired(false), m_pAcquiredThread(nullptr)
+{
+}
+
+PosixSubsystem::PosixSubsystem(SubsystemType type)
+    : Subsystem(type), m_SignalHandlers(), m_SignalHandlersLock(),
+      m_FdTable(), m_NextFd(0), m_FdLock(), m_FdBitmap(), m_LastFd(0),
+      m_FreeCount(1), m_AltSigStack(), m_SyncObjects(), m_Threads(),
+      m_ThreadWaiters(), m_NextThreadWaiter(0), m_Abi(PosixAbi),
+      m_bAcquired(false), m_pAcquiredThread(nullptr)
+{
+}
+
 PosixSubsystem::PosixSubsystem(PosixSubsystem &s)
-    : Subsystem(s), m_SignalHandlers(), m_SignalHandlersLock(), m_FdMap(),
+    : Subsystem(s), m_SignalHandlers(), m_SignalHandlersLock(), m_FdTable(),
       m_NextFd(s.m_NextFd), m_FdLock(), m_FdBitmap(), m_LastFd(0),
       m_FreeCount(s.m_FreeCount), m_AltSigStack(), m_SyncObjects(), m_Threads(),
       m_ThreadWaiters(), m_NextThreadWaiter(1)
@@ -445,6 +464,10 @@ void PosixSubsystem::exit(int code)
 
     // We're the lowest in the stack, so we can proceed with the exit function.
 
+    // Stop using our parent's address space (if vforked) before tearing ours
+    // down, and let the parent run again.
+    pProcess->releaseVforkParent();
+
     delete pProcess->getLinker();
 
     MemoryMapManager::instance().unmapAll();
@@ -803,12 +826,7 @@ void PosixSubsystem::freeFd(size_t fdNum)
 
     m_FdBitmap.clear(fdNum);
 
-    FileDescriptor *pFd = m_FdMap.lookup(fdNum);
-    if (pFd)
-    {
-        m_FdMap.remove(fdNum);
-        delete pFd;
-    }
+    delete m_FdTable.remove(fdNum);
 
     if (fdNum < m_LastFd)
         m_LastFd = fdNum;
@@ -832,25 +850,24 @@ bool PosixSubsystem::copyDescriptors(PosixSubsystem *pSubsystem)
     while (!pSubsystem->m_FdLock.acquire())
         ;
 
-    // Copy each descriptor across from the original subsystem
-    FdMap &map = pSubsystem->m_FdMap;
-    for (FdMap::Iterator it = map.begin(); it != map.end(); it++)
+    // Copy each descriptor across from the original subsystem. This is done
+    // eagerly so the parent keeps its own descriptors (and anything, such as
+    // epoll registrations, that refers to them).
+    DescriptorTable<FileDescriptor> &table = pSubsystem->m_FdTable;
+    for (size_t fd = 0; fd < table.capacity(); ++fd)
     {
-        FileDescriptor *pFd = it.value();
+        FileDescriptor *pFd = table.lookup(fd);
         if (!pFd)
             continue;
-        size_t newFd = it.key();
-
-        FileDescriptor *pNewFd = new FileDescriptor(*pFd);
 
         // Perform the same action as addFileDescriptor. We need to duplicate
         // here because we currently hold the FD lock, which will deadlock if we
         // call any function which attempts to acquire it.
-        if (newFd >= m_NextFd)
-            m_NextFd = newFd + 1;
-        m_FdBitmap.set(newFd);
-        m_FdMap.insert(newFd, pNewFd);
+        m_FdTable.set(fd, new FileDescriptor(*pFd));
     }
+    m_FdBitmap = pSubsystem->m_FdBitmap;
+    m_NextFd = pSubsystem->m_NextFd;
+    m_LastFd = pSubsystem->m_LastFd;
 
     pSubsystem->m_FdLock.release();
     m_FdLock.release();
@@ -867,26 +884,27 @@ void PosixSubsystem::freeMultipleFds(
     while (!m_FdLock.acquire())
         ;  // Don't allow any access to the FD data
 
-    // Because removing FDs as we go from the Tree can actually leave the Tree
-    // iterators in a dud state, we'll add all the FDs to remove to this list.
-    List<void *> fdsToRemove;
-
     // Are all FDs to be freed? Or only a selection?
     bool bAllToBeFreed = ((iFirst == 0 && iLast == ~0UL) && !bOnlyCloExec);
     if (bAllToBeFreed)
+    {
+        m_FdTable.clear();
+        m_FdBitmap = ExtensibleBitmap();
         m_LastFd = 0;
 
-    FdMap &map = m_FdMap;
-    for (FdMap::Iterator it = map.begin(); it != map.end(); it++)
+        m_FdLock.release();
+        return;
+    }
+
+    size_t capacity = m_FdTable.capacity();
+    if (iLast >= capacity)
+        iLast = capacity - 1;
+    for (size_t Fd = iFirst; capacity && Fd <= iLast; ++Fd)
     {
-        size_t Fd = it.key();
-        FileDescriptor *pFd = it.value();
+        FileDescriptor *pFd = m_FdTable.lookup(Fd);
         if (!pFd)
             continue;
 
-        if (!(Fd >= iFirst && Fd <= iLast))
-            continue;
-
         if (bOnlyCloExec)
         {
             if (!(pFd->fdflags & FD_CLOEXEC))
@@ -900,13 +918,8 @@ void PosixSubsystem::freeMultipleFds(
         // No longer usable
         m_FdBitmap.clear(Fd);
 
-        // Add to the list of FDs to remove, iff we won't be cleaning up the
-        // entire set
-        if (!bAllToBeFreed)
-            fdsToRemove.pushBack(reinterpret_cast<void *>(Fd));
-
         // Delete the descriptor itself
-        delete pFd;
+        delete m_FdTable.remove(Fd);
 
         // And reset the "last freed" tracking variable, if this is lower than
         // it already.
@@ -914,33 +927,14 @@ void PosixSubsystem::freeMultipleFds(
             m_LastFd = Fd;
     }
 
-    // Clearing all AND not caring about CLOEXEC FDs? If so, clear the map.
-    // Otherwise, only clear the FDs that are supposed to be cleared.
-    if (bAllToBeFreed)
-        m_FdMap.clear();
-    else
-    {
-        for (List<void *>::Iterator it = fdsToRemove.begin();
-             it != fdsToRemove.end(); it++)
-            m_FdMap.remove(reinterpret_cast<size_t>(*it));
-    }
-
     m_FdLock.release();
 }
 
 FileDescriptor *PosixSubsystem::getFileDescriptor(size_t fd)
 {
-    Uninterruptible throughout;
-
-    // Enter the critical section, for reading.
-    while (!m_FdLock.enter())
-        ;
-
-    FileDescriptor *pFd = m_FdMap.lookup(fd);
-
-    m_FdLock.leave();
-
-    return pFd;
+    // No lock needed: the table is published atomically, and tables replaced
+    // by growth stay valid until the subsystem is destroyed.
+    return m_FdTable.lookup(fd);
 }
 
 void PosixSubsystem::addFileDescriptor(size_t fd, FileDescriptor *pFd)
@@ -956,7 +950,7 @@ void PosixSubsystem::addFileDescriptor(size_t fd, FileDescriptor *pFd)
         while (!m_FdLock.acquire())
             ;
 
-        m_FdMap.insert(fd, pFd);
+        delete m_FdTable.set(fd, pFd);
 
         m_FdLock.release();
     }
@@ -1496,6 +1490,10 @@ bool PosixSubsystem::invoke(
     pLinker = 0;
     pProcess->setLinker(pLinker);
 
+    // A vfork() child moves onto its own address space here, leaving its
+    // parent's untouched, and the parent may continue.
+    pProcess->releaseVforkParent();
+
     // Wipe out old address space.
     MemoryMapManager::instance().unmapAll();
 
@@ -28,6 +28,7 @@
 #include "pedigree/kernel/processor/types.h"
 
 #include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/utilities/DescriptorTable.h"
 #include "pedigree/kernel/utilities/ExtensibleBitmap.h"
 #include "pedigree/kernel/utilities/LruCache.h"
 #include "pedigree/kernel/utilities/RadixTree.h"
@@ -118,27 +119,13 @@ class EXPORTED_PUBLIC PosixSubsystem : public Subsystem
     };
 
     /** Default constructor */
-    PosixSubsystem()
-        : Subsystem(Posix), m_SignalHandlers(), m_SignalHandlersLock(),
-          m_FdMap(), m_NextFd(0), m_FdLock(), m_FdBitmap(), m_LastFd(0),
-          m_FreeCount(1), m_AltSigStack(), m_SyncObjects(), m_Threads(),
-          m_ThreadWaiters(), m_NextThreadWaiter(0), m_Abi(PosixAbi),
-          m_bAcquired(false), m_pAcquiredThread(nullptr)
-    {
-    }
+    PosixSubsystem();
 
     /** Copy constructor */
     PosixSubsystem(PosixSubsystem &s);
 
     /** Parameterised constructor */
-    PosixSubsystem(SubsystemType type)
-        : Subsystem(type), m_SignalHandlers(), m_SignalHandlersLock(),
-          m_FdMap(), m_NextFd(0), m_FdLock(), m_FdBitmap(), m_LastFd(0),
-          m_FreeCount(1), m_AltSigStack(), m_SyncObjects(), m_Threads(),
-          m_ThreadWaiters(), m_NextThreadWaiter(0), m_Abi(PosixAbi),
-          m_bAcquired(false), m_pAcquiredThread(nullptr)
-    {
-    }
+    PosixSubsystem(SubsystemType type);
 
     /** Default destructor */
     virtual ~PosixSubsystem();
@@ -545,16 +532,16 @@ class EXPORTED_PUBLIC PosixSubsystem : public Subsystem
     UnlikelyLock m_SignalHandlersLock;
 
     /**
-     * The file descriptor map. Maps number to pointers, the type of which is
-     * decided by the subsystem.
+     * The file descriptor table. Lookups are lock-free; changes are made
+     * under m_FdLock. Shared copy-on-write with the parent after fork().
      */
-    Tree<size_t, FileDescriptor *> m_FdMap;
+    DescriptorTable<FileDescriptor> m_FdTable;
     /**
      * The next available file descriptor.
      */
     size_t m_NextFd;
     /**
-     * Lock to guard the next file descriptor while it is being changed.
+     * Lock to guard the descriptor table and allocator while being changed.
      */
     UnlikelyLock m_FdLock;
     /**
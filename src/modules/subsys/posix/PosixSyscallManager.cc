@@ -29,6 +29,7 @@
 
 #include "PosixSyscallManager.h"
 #include "console-syscalls.h"
+#include "epoll-syscalls.h"
 #include "file-syscalls.h"
 #include "logging.h"
 #include "net-syscalls.h"
@@ -152,6 +153,8 @@ uintptr_t PosixSyscallManager::syscall(SyscallState &state)
             return posix_sbrk(p1);
         case POSIX_FORK:
             return posix_fork(state);
+        case POSIX_VFORK:
+            return posix_vfork(state);
         case POSIX_EXECVE:
             return posix_execve(
                 reinterpret_cast<const char *>(p1),
@@ -680,6 +683,46 @@ uintptr_t PosixSyscallManager::syscall(SyscallState &state)
                 reinterpret_cast<const void *>(p2));
         case POSIX_PRCTL:
             return posix_prctl(p1, p2, p3, p4, p5);
+        case POSIX_SPLICE:
+            return posix_splice(
+                static_cast<int>(p1), reinterpret_cast<off_t *>(p2),
+                static_cast<int>(p3), reinterpret_cast<off_t *>(p4), p5,
+                static_cast<unsigned int>(p6));
+        case POSIX_TEE:
+            return posix_tee(
+                static_cast<int>(p1), static_cast<int>(p2), p3,
+                static_cast<unsigned int>(p4));
+        case POSIX_VMSPLICE:
+            return posix_vmsplice(
+                static_cast<int>(p1),
+                reinterpret_cast<const struct iovec *>(p2), p3,
+                static_cast<unsigned int>(p4));
+        case POSIX_SENDFILE:
+            return posix_sendfile(
+                static_cast<int>(p1), static_cast<int>(p2),
+                reinterpret_cast<off_t *>(p3), p4);
+        case POSIX_COPY_FILE_RANGE:
+            return posix_copy_file_range(
+                static_cast<int>(p1), reinterpret_cast<off_t *>(p2),
+                static_cast<int>(p3), reinterpret_cast<off_t *>(p4), p5,
+                static_cast<unsigned int>(p6));
+        case POSIX_EPOLL_CREATE:
+            return posix_epoll_create(static_cast<int>(p1));
+        case POSIX_EPOLL_CREATE1:
+            return posix_epoll_create1(static_cast<int>(p1));
+        case POSIX_EPOLL_CTL:
+            return posix_epoll_ctl(
+                static_cast<int>(p1), static_cast<int>(p2),
+                static_cast<int>(p3),
+                reinterpret_cast<struct epoll_event *>(p4));
+        case POSIX_EPOLL_WAIT:
+            return posix_epoll_wait(
+                static_cast<int>(p1),
+                reinterpret_cast<struct epoll_event *>(p2),
+                static_cast<int>(p3), static_cast<int>(p4));
+        case POSIX_SPAWN:
+            return posix_spawn(
+                reinterpret_cast<const struct pedigree_spawn_args *>(p1));
 
         default:
             ERROR(
@@ -25,9 +25,15 @@
 #include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Version.h"
 #include "pedigree/kernel/machine/Device.h"
+#include "pedigree/kernel/process/PerProcessorScheduler.h"
+#include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/time/Time.h"
 
+#ifdef INSTRUMENTATION
+#include "system/kernel/core/lib/instrument.h"
+#endif
+
 #include "file-syscalls.h"
 
 #include "PosixProcess.h"
@@ -319,6 +325,255 @@ String UptimeFile::generateString()
     return f;
 }
 
+SchedStatFile::SchedStatFile(size_t inode, Filesystem *pParentFS, File *pParent)
+    : File(String("schedstat"), 0, 0, 0, inode, pParentFS, 0, pParent)
+{
+    setPermissionsOnly(FILE_UR | FILE_GR | FILE_OR);
+    setUidOnly(0);
+    setGidOnly(0);
+}
+
+SchedStatFile::~SchedStatFile() = default;
+
+uint64_t SchedStatFile::readBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    String f = generateString();
+
+    if (location >= f.length())
+    {
+        // "EOF"
+        return 0;
+    }
+
+    if ((location + size) >= f.length())
+    {
+        size = f.length() - location;
+    }
+
+    char *destination = reinterpret_cast<char *>(buffer);
+    StringCopyN(destination, static_cast<const char *>(f) + location, size);
+
+    return size;
+}
+
+uint64_t SchedStatFile::writeBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    return 0;
+}
+
+size_t SchedStatFile::getSize()
+{
+    String f = generateString();
+    return f.length();
+}
+
+String SchedStatFile::generateString()
+{
+    String f;
+
+    size_t nSchedulers = Scheduler::instance().getNumProcessorSchedulers();
+    for (size_t i = 0; i < nSchedulers; ++i)
+    {
+        PerProcessorScheduler *pScheduler =
+            Scheduler::instance().getProcessorScheduler(i);
+        PerProcessorScheduler::Statistics stats = pScheduler->getStatistics();
+
+        LargeStaticString line;
+        line += "cpu";
+        line += pScheduler->getProcessorId();
+        line += " load ";
+        line += pScheduler->getLoad();
+        line += " migrated-in ";
+        line += stats.migratedIn;
+        line += " migrated-out ";
+        line += stats.migratedOut;
+        line += " idle-steals ";
+        line += stats.idleSteals;
+        line += " balance-steals ";
+        line += stats.balanceSteals;
+        line += "\n";
+
+        f += static_cast<const char *>(line);
+    }
+
+    return f;
+}
+
+#ifdef INSTRUMENTATION
+TraceFile::TraceFile(size_t inode, Filesystem *pParentFS, File *pParent)
+    : File(String("trace"), 0, 0, 0, inode, pParentFS, 0, pParent),
+      m_pSnapshot(0), m_SnapshotSize(0), m_Lock(false)
+{
+    setPermissionsOnly(FILE_UR | FILE_GR);
+    setUidOnly(0);
+    setGidOnly(0);
+}
+
+TraceFile::~TraceFile()
+{
+    delete[] m_pSnapshot;
+}
+
+uint64_t TraceFile::readBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    // Reading from the start takes a new snapshot; the rest of the file is
+    // then served from it so a sequential reader sees a consistent trace.
+    if (location == 0)
+    {
+        if (!m_pSnapshot)
+        {
+            m_pSnapshot = new uint8_t[instrumentSnapshotSize()];
+        }
+        m_SnapshotSize =
+            instrumentSnapshot(m_pSnapshot, instrumentSnapshotSize());
+    }
+
+    if (location >= m_SnapshotSize)
+    {
+        return 0;  // EOF
+    }
+    else if ((location + size) > m_SnapshotSize)
+    {
+        size = m_SnapshotSize - location;
+    }
+
+    MemoryCopy(
+        reinterpret_cast<void *>(buffer), m_pSnapshot + location, size);
+
+    return size;
+}
+
+uint64_t TraceFile::writeBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    return 0;
+}
+
+size_t TraceFile::getSize()
+{
+    // Not known until the snapshot is taken, so give the upper bound.
+    return instrumentSnapshotSize();
+}
+
+TraceControlFile::TraceControlFile(
+    size_t inode, Filesystem *pParentFS, File *pParent)
+    : File(String("trace_control"), 0, 0, 0, inode, pParentFS, 0, pParent)
+{
+    setPermissionsOnly(FILE_UR | FILE_UW | FILE_GR);
+    setUidOnly(0);
+    setGidOnly(0);
+}
+
+TraceControlFile::~TraceControlFile() = default;
+
+uint64_t TraceControlFile::readBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    String f = generateString();
+
+    if (location >= f.length())
+    {
+        // "EOF"
+        return 0;
+    }
+
+    if ((location + size) >= f.length())
+    {
+        size = f.length() - location;
+    }
+
+    char *destination = reinterpret_cast<char *>(buffer);
+    StringCopyN(destination, static_cast<const char *>(f) + location, size);
+
+    return size;
+}
+
+uint64_t TraceControlFile::writeBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    const char *p = reinterpret_cast<const char *>(buffer);
+    size_t start = 0;
+    for (size_t i = 0; i <= size; ++i)
+    {
+        if (i == size || p[i] == '\n')
+        {
+            command(&p[start], i - start);
+            start = i + 1;
+        }
+    }
+
+    return size;
+}
+
+size_t TraceControlFile::getSize()
+{
+    String f = generateString();
+    return f.length();
+}
+
+String TraceControlFile::generateString()
+{
+    uintptr_t low = 0, high = 0;
+    instrumentGetFilter(low, high);
+
+    String f;
+    f.Format(
+        "enabled %d\nsample %d\nfilter %lx %lx\n", instrumentIsEnabled(),
+        instrumentGetSampling(), low, high);
+
+    return f;
+}
+
+void TraceControlFile::command(const char *cmd, size_t length)
+{
+    while (length && (cmd[length - 1] == ' ' || cmd[length - 1] == '\r'))
+    {
+        --length;
+    }
+
+    NormalStaticString s;
+    s.assign(cmd, length);
+    const char *str = static_cast<const char *>(s);
+
+    if (!StringCompare(str, "on"))
+    {
+        instrumentSetEnabled(true);
+    }
+    else if (!StringCompare(str, "off"))
+    {
+        instrumentSetEnabled(false);
+    }
+    else if (!StringCompare(str, "clear"))
+    {
+        instrumentClear();
+    }
+    else if (!StringCompareN(str, "sample ", 7))
+    {
+        instrumentSetSampling(StringToUnsignedLong(str + 7, 0, 10));
+    }
+    else if (!StringCompare(str, "filter off"))
+    {
+        instrumentSetFilter(0, 0);
+    }
+    else if (!StringCompareN(str, "filter ", 7))
+    {
+        const char *end = 0;
+        uintptr_t low = StringToUnsignedLong(str + 7, &end, 16);
+        uintptr_t high = StringToUnsignedLong(end, 0, 16);
+        instrumentSetFilter(low, high);
+    }
+    else if (length)
+    {
+        WARNING("procfs: unknown trace_control command '" << str << "'");
+    }
+}
+#endif
+
 ConstantFile::ConstantFile(
     String name, const char *value, size_t size, size_t inode,
     Filesystem *pParentFS, File *pParent)
@@ -411,6 +666,19 @@ bool ProcFs::initialise(Disk *pDisk)
     UptimeFile *uptime = new UptimeFile(getNextInode(), this, m_pRoot);
     m_pRoot->addEntry(uptime->getName(), uptime);
 
+    SchedStatFile *schedstat =
+        new SchedStatFile(getNextInode(), this, m_pRoot);
+    m_pRoot->addEntry(schedstat->getName(), schedstat);
+
+#ifdef INSTRUMENTATION
+    TraceFile *trace = new TraceFile(getNextInode(), this, m_pRoot);
+    m_pRoot->addEntry(trace->getName(), trace);
+
+    TraceControlFile *traceControl =
+        new TraceControlFile(getNextInode(), this, m_pRoot);
+    m_pRoot->addEntry(traceControl->getName(), traceControl);
+#endif
+
     String fs("\text2\nnodev\tproc\nnodev\ttmpfs\n");
     ConstantFile *pFilesystems = new ConstantFile(
         String("filesystems"), fs, fs.length(), getNextInode(), this, m_pRoot);
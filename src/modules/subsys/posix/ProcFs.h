@@ -138,6 +138,91 @@ class UptimeFile : public File
     }
 };
 
+/** Per-processor load and thread migration counters. */
+class SchedStatFile : public File
+{
+  public:
+    SchedStatFile(size_t inode, Filesystem *pParentFS, File *pParent);
+    ~SchedStatFile();
+
+    virtual uint64_t readBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+    virtual uint64_t writeBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+
+    virtual size_t getSize();
+
+  private:
+    String generateString();
+
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+};
+
+#ifdef INSTRUMENTATION
+/** Binary snapshot of the kernel function tracer's ring buffers. */
+class TraceFile : public File
+{
+  public:
+    TraceFile(size_t inode, Filesystem *pParentFS, File *pParent);
+    ~TraceFile();
+
+    virtual uint64_t readBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+    virtual uint64_t writeBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+
+    virtual size_t getSize();
+
+  private:
+    /// Snapshot taken by the last read from the start of the file.
+    uint8_t *m_pSnapshot;
+    size_t m_SnapshotSize;
+    Mutex m_Lock;
+
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+};
+
+/**
+ * Controls the function tracer. Reading shows the current settings; writing
+ * takes one command per line: "on", "off", "clear", "sample <log2 rate>",
+ * "filter <low> <high>" (hex addresses) or "filter off".
+ */
+class TraceControlFile : public File
+{
+  public:
+    TraceControlFile(size_t inode, Filesystem *pParentFS, File *pParent);
+    ~TraceControlFile();
+
+    virtual uint64_t readBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+    virtual uint64_t writeBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+
+    virtual size_t getSize();
+
+  private:
+    String generateString();
+    void command(const char *cmd, size_t length);
+
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+};
+#endif
+
 class ConstantFile : public File
 {
   public:
@@ -141,8 +141,15 @@ uint64_t UnixSocket::recvfrom(
     if (m_pOther)
     {
         from = String();
-        return m_Stream.read(
-            reinterpret_cast<uint8_t *>(buffer), size, bCanBlock);
+        uint64_t n =
+            m_Stream.read(reinterpret_cast<uint8_t *>(buffer), size, bCanBlock);
+        UnixSocket *pOther = m_pOther;
+        if (n && pOther)
+        {
+            // The other end may have room to write again.
+            pOther->dataChanged();
+        }
+        return n;
     }
 
     if (bCanBlock)
@@ -185,8 +192,13 @@ uint64_t UnixSocket::writeBytewise(
 
     if (m_pOther)
     {
-        return m_pOther->m_Stream.write(
+        uint64_t n = m_pOther->m_Stream.write(
             reinterpret_cast<uint8_t *>(buffer), size, bCanBlock);
+        if (n)
+        {
+            m_pOther->dataChanged();
+        }
+        return n;
     }
 
     if (bCanBlock)
@@ -306,6 +318,9 @@ void UnixSocket::unbind()
         m_Stream.notifyMonitors();
         m_pOther->m_Stream.notifyMonitors();
     }
+
+    dataChanged();
+    m_pOther->dataChanged();
 }
 
 void UnixSocket::acknowledgeBind()
@@ -356,6 +371,8 @@ void UnixSocket::addSocket(UnixSocket *socket)
     // signaling primitive.
     uint8_t c = 0;
     m_Stream.write(&c, 1);
+
+    dataChanged();
 }
 
 UnixSocket *UnixSocket::getSocket(bool block)
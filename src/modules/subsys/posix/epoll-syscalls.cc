@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "epoll-syscalls.h"
+#include "logging.h"
+#include "net-syscalls.h"
+
+#include "modules/subsys/posix/FileDescriptor.h"
+#include "modules/subsys/posix/PosixSubsystem.h"
+#include "pedigree/kernel/syscallError.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+#include <fcntl.h>
+
+/// Serialises registration changes against descriptors and instances closing.
+static Mutex g_EpollLock(false);
+/// Live instances, to recognise epoll descriptors without RTTI.
+static Tree<File *, EpollInstance *> g_EpollInstances;
+
+EpollItem::EpollItem(
+    EpollInstance *pParent, int fd, FileDescriptor *pFd,
+    const struct epoll_event &event)
+    : m_pParent(pParent), m_Fd(fd), m_pFd(pFd), m_Events(event.events),
+      m_Data(event.data), m_bQueued(false), m_bDisarmed(false)
+{
+}
+
+EpollItem::~EpollItem()
+{
+}
+
+void EpollItem::changed()
+{
+    m_pParent->queue(this);
+}
+
+uint32_t EpollItem::poll()
+{
+    if (m_bDisarmed)
+    {
+        return 0;
+    }
+
+    // Errors and hangups are always reported, as with poll().
+    uint32_t revents = 0;
+    if (m_pFd->networkImpl)
+    {
+        if (!m_pFd->networkImpl->canPoll())
+        {
+            return 0;
+        }
+
+        bool read = m_Events & EPOLLIN;
+        bool write = m_Events & EPOLLOUT;
+        bool error = true;
+        m_pFd->networkImpl->poll(read, write, error, nullptr);
+
+        if (read)
+        {
+            revents |= EPOLLIN;
+        }
+        if (write)
+        {
+            revents |= EPOLLOUT;
+        }
+        if (error)
+        {
+            revents |= EPOLLERR;
+        }
+    }
+    else if (m_pFd->file)
+    {
+        if ((m_Events & EPOLLIN) && m_pFd->file->select(false, 0))
+        {
+            revents |= EPOLLIN;
+        }
+        if ((m_Events & EPOLLOUT) && m_pFd->file->select(true, 0))
+        {
+            revents |= EPOLLOUT;
+        }
+    }
+
+    return revents;
+}
+
+bool EpollItem::attach()
+{
+    if (m_pFd->networkImpl)
+    {
+        return m_pFd->networkImpl->watch(this);
+    }
+    else if (m_pFd->file)
+    {
+        m_pFd->file->watch(this);
+        return true;
+    }
+
+    return false;
+}
+
+void EpollItem::detach()
+{
+    if (m_pFd->networkImpl)
+    {
+        m_pFd->networkImpl->unwatch(this);
+    }
+    else if (m_pFd->file)
+    {
+        m_pFd->file->unwatch(this);
+    }
+}
+
+EpollInstance::EpollInstance()
+    : File(), m_Items(), m_ItemsLock(false), m_Ready(), m_ReadyLock(false),
+#ifdef THREADS
+      m_Wakeup(0),
+#endif
+      m_nWaiters(0), m_nRefs(0)
+{
+    LockGuard<Mutex> guard(g_EpollLock);
+    g_EpollInstances.insert(this, this);
+}
+
+EpollInstance::~EpollInstance()
+{
+    LockGuard<Mutex> guard(g_EpollLock);
+    g_EpollInstances.remove(this);
+
+    LockGuard<Mutex> itemsGuard(m_ItemsLock);
+
+    while (m_Items.count())
+    {
+        destroy(m_Items.begin().value());
+    }
+}
+
+int EpollInstance::control(int op, int fd, struct epoll_event *event)
+{
+    FileDescriptor *pFd = getDescriptor(fd);
+    if (!pFd)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    if (pFd->file == this)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    LockGuard<Mutex> guard(g_EpollLock);
+    LockGuard<Mutex> itemsGuard(m_ItemsLock);
+
+    EpollItem *pItem = m_Items.lookup(fd);
+    if (pItem && pItem->m_pFd != pFd)
+    {
+        // The descriptor number has been reused since it was registered.
+        destroy(pItem);
+        pItem = nullptr;
+    }
+
+    switch (op)
+    {
+        case EPOLL_CTL_ADD:
+            if (pItem)
+            {
+                SYSCALL_ERROR(FileExists);
+                return -1;
+            }
+
+            pItem = new EpollItem(this, fd, pFd, *event);
+            if (!pItem->attach())
+            {
+                delete pItem;
+                SYSCALL_ERROR(NotEnoughPermissions);
+                return -1;
+            }
+
+            m_Items.insert(fd, pItem);
+            pFd->epollItems.pushBack(pItem);
+            break;
+
+        case EPOLL_CTL_MOD:
+            if (!pItem)
+            {
+                SYSCALL_ERROR(DoesNotExist);
+                return -1;
+            }
+
+            pItem->m_Events = event->events;
+            pItem->m_Data = event->data;
+            pItem->m_bDisarmed = false;
+            break;
+
+        case EPOLL_CTL_DEL:
+            if (!pItem)
+            {
+                SYSCALL_ERROR(DoesNotExist);
+                return -1;
+            }
+
+            destroy(pItem);
+            return 0;
+
+        default:
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+    }
+
+    // Pick up anything that was already ready before we started watching.
+    queue(pItem);
+    return 0;
+}
+
+int EpollInstance::wait(struct epoll_event *events, int maxevents, int timeout)
+{
+#ifdef THREADS
+    size_t timeoutSecs = 0;
+    size_t timeoutUSecs = 0;
+    if (timeout > 0)
+    {
+        timeoutSecs = timeout / 1000;
+        timeoutUSecs = (timeout % 1000) * 1000;
+    }
+#endif
+
+    while (true)
+    {
+        int n = 0;
+        {
+            LockGuard<Mutex> guard(m_ItemsLock);
+
+            // Level-triggered items go back on the ready list once we're
+            // done, so they don't get reported twice in this call.
+            List<EpollItem *> requeue;
+            while (n < maxevents)
+            {
+                m_ReadyLock.acquire();
+                if (!m_Ready.count())
+                {
+                    m_ReadyLock.release();
+                    break;
+                }
+                EpollItem *pItem = m_Ready.popFront();
+                pItem->m_bQueued = false;
+                m_ReadyLock.release();
+
+                // Spurious or stale notifications just drop off the list.
+                uint32_t revents = pItem->poll();
+                if (!revents)
+                {
+                    continue;
+                }
+
+                events[n].events = revents;
+                events[n].data = pItem->m_Data;
+                ++n;
+
+                if (pItem->m_Events & EPOLLONESHOT)
+                {
+                    pItem->m_bDisarmed = true;
+                }
+                else if (!(pItem->m_Events & EPOLLET))
+                {
+                    requeue.pushBack(pItem);
+                }
+            }
+
+            for (auto pItem : requeue)
+            {
+                queue(pItem);
+            }
+        }
+
+        if (n || !timeout)
+        {
+            return n;
+        }
+
+#ifdef THREADS
+        m_ReadyLock.acquire();
+        bool bEmpty = !m_Ready.count();
+        if (bEmpty)
+        {
+            ++m_nWaiters;
+        }
+        m_ReadyLock.release();
+
+        if (!bEmpty)
+        {
+            continue;
+        }
+
+        Semaphore::SemaphoreResult result =
+            m_Wakeup.acquireWithResult(1, timeoutSecs, timeoutUSecs);
+
+        m_ReadyLock.acquire();
+        --m_nWaiters;
+        m_ReadyLock.release();
+
+        if (result.hasError())
+        {
+            if (result.error() == Semaphore::TimedOut)
+            {
+                return 0;
+            }
+
+            SYSCALL_ERROR(Interrupted);
+            return -1;
+        }
+#else
+        // Nothing can make an item ready while we wait without threads.
+        return 0;
+#endif
+    }
+}
+
+void EpollInstance::forget(EpollItem *pItem)
+{
+    LockGuard<Mutex> guard(m_ItemsLock);
+    destroy(pItem);
+}
+
+int EpollInstance::select(bool bWriting, int timeout)
+{
+    if (bWriting)
+    {
+        return 0;
+    }
+
+    LockGuard<Mutex> guard(m_ReadyLock);
+    return m_Ready.count() ? 1 : 0;
+}
+
+EpollInstance *EpollInstance::fromFile(File *pFile)
+{
+    LockGuard<Mutex> guard(g_EpollLock);
+    EpollInstance *pEpoll = g_EpollInstances.lookup(pFile);
+    if (pEpoll)
+    {
+        ++pEpoll->m_nRefs;
+    }
+    return pEpoll;
+}
+
+void EpollInstance::increaseRefCount(bool bIsWriter)
+{
+    LockGuard<Mutex> guard(g_EpollLock);
+    ++m_nRefs;
+}
+
+void EpollInstance::decreaseRefCount(bool bIsWriter)
+{
+    bool bLast = false;
+    {
+        // Under the global lock, so fromFile() can't find us and take a new
+        // reference once the last one is gone.
+        LockGuard<Mutex> guard(g_EpollLock);
+        bLast = !--m_nRefs;
+        if (bLast)
+        {
+            g_EpollInstances.remove(this);
+        }
+    }
+
+    // The instance only lives as long as descriptors refer to it.
+    if (bLast)
+    {
+        delete this;
+    }
+}
+
+void EpollInstance::queue(EpollItem *pItem)
+{
+    {
+        LockGuard<Mutex> guard(m_ReadyLock);
+        if (pItem->m_bQueued)
+        {
+            return;
+        }
+
+        m_Ready.pushBack(pItem);
+        pItem->m_bQueued = true;
+
+#ifdef THREADS
+        if (m_nWaiters)
+        {
+            m_Wakeup.release();
+        }
+#endif
+    }
+
+    // We may ourselves be polled or registered with another instance.
+    dataChanged();
+}
+
+void EpollInstance::dequeue(EpollItem *pItem)
+{
+    LockGuard<Mutex> guard(m_ReadyLock);
+    if (!pItem->m_bQueued)
+    {
+        return;
+    }
+
+    for (auto it = m_Ready.begin(); it != m_Ready.end(); ++it)
+    {
+        if (*it == pItem)
+        {
+            m_Ready.erase(it);
+            break;
+        }
+    }
+    pItem->m_bQueued = false;
+}
+
+void EpollInstance::destroy(EpollItem *pItem)
+{
+    pItem->detach();
+    dequeue(pItem);
+
+    if (m_Items.lookup(pItem->m_Fd) == pItem)
+    {
+        m_Items.remove(pItem->m_Fd);
+    }
+
+    List<EpollItem *> &fdItems = pItem->m_pFd->epollItems;
+    for (auto it = fdItems.begin(); it != fdItems.end(); ++it)
+    {
+        if (*it == pItem)
+        {
+            fdItems.erase(it);
+            break;
+        }
+    }
+
+    delete pItem;
+}
+
+void epollDetachDescriptor(FileDescriptor *pFd)
+{
+    LockGuard<Mutex> guard(g_EpollLock);
+
+    while (pFd->epollItems.count())
+    {
+        EpollItem *pItem = pFd->epollItems.popFront();
+        pItem->m_pParent->forget(pItem);
+    }
+}
+
+/// Looks up the instance behind \p epfd and takes a reference to it, which
+/// the caller drops once done, so a concurrent close() can't free it.
+static EpollInstance *getEpoll(int epfd)
+{
+    FileDescriptor *pFd = getDescriptor(epfd);
+    if (!pFd)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return nullptr;
+    }
+
+    EpollInstance *pEpoll = nullptr;
+    if (pFd->file && !pFd->networkImpl)
+    {
+        pEpoll = EpollInstance::fromFile(pFd->file);
+    }
+    if (!pEpoll)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+    }
+    return pEpoll;
+}
+
+int posix_epoll_create(int size)
+{
+    // The size hint is ignored, but must be positive.
+    if (size <= 0)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    return posix_epoll_create1(0);
+}
+
+int posix_epoll_create1(int flags)
+{
+    POLL_NOTICE("epoll_create1(" << Hex << flags << ")");
+
+    if (flags & ~EPOLL_CLOEXEC)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    size_t fd = getAvailableDescriptor();
+    FileDescriptor *pFd = new FileDescriptor(
+        new EpollInstance(), 0, fd, (flags & EPOLL_CLOEXEC) ? FD_CLOEXEC : 0,
+        O_RDONLY);
+    addDescriptor(fd, pFd);
+
+    POLL_NOTICE(" -> " << fd);
+    return fd;
+}
+
+int posix_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    POLL_NOTICE("epoll_ctl(" << epfd << ", " << op << ", " << fd << ")");
+
+    if (op != EPOLL_CTL_DEL &&
+        !PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(event), sizeof(*event),
+            PosixSubsystem::SafeRead))
+    {
+        SYSCALL_ERROR(BadAddress);
+        return -1;
+    }
+
+    EpollInstance *pEpoll = getEpoll(epfd);
+    if (!pEpoll)
+    {
+        return -1;
+    }
+
+    int result = pEpoll->control(op, fd, event);
+    pEpoll->decreaseRefCount(false);
+    return result;
+}
+
+int posix_epoll_wait(
+    int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    POLL_NOTICE(
+        "epoll_wait(" << epfd << ", " << maxevents << ", " << timeout << ")");
+
+    if (maxevents <= 0)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if (!PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(events),
+            maxevents * sizeof(struct epoll_event), PosixSubsystem::SafeWrite))
+    {
+        SYSCALL_ERROR(BadAddress);
+        return -1;
+    }
+
+    EpollInstance *pEpoll = getEpoll(epfd);
+    if (!pEpoll)
+    {
+        return -1;
+    }
+
+    int result = pEpoll->wait(events, maxevents, timeout);
+    pEpoll->decreaseRefCount(false);
+    return result;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef EPOLL_SYSCALLS_H
+#define EPOLL_SYSCALLS_H
+
+#include "modules/system/vfs/File.h"
+#include "pedigree/kernel/process/Mutex.h"
+#ifdef THREADS
+#include "pedigree/kernel/process/Semaphore.h"
+#endif
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/utilities/Tree.h"
+
+#include <sys/epoll.h>
+
+class EpollInstance;
+class FileDescriptor;
+
+/** One descriptor registered with an EpollInstance. */
+class EpollItem : public FileWatcher
+{
+    friend class EpollInstance;
+    friend void epollDetachDescriptor(FileDescriptor *pFd);
+
+  public:
+    EpollItem(
+        EpollInstance *pParent, int fd, FileDescriptor *pFd,
+        const struct epoll_event &event);
+    virtual ~EpollItem();
+
+    /** Queues this item on its instance's ready list. */
+    virtual void changed();
+
+    /** \return the events currently pending, masked by the interest set. */
+    uint32_t poll();
+
+  private:
+    /** Starts receiving change notifications from the descriptor. */
+    bool attach();
+    void detach();
+
+    EpollInstance *m_pParent;
+    int m_Fd;
+    FileDescriptor *m_pFd;
+    uint32_t m_Events;
+    epoll_data_t m_Data;
+
+    /** On the ready list (protected by the instance's ready lock). */
+    bool m_bQueued;
+    /** An EPOLLONESHOT item that has fired, until re-armed by MOD. */
+    bool m_bDisarmed;
+};
+
+/**
+ * A persistent interest set, as created by epoll_create1().
+ *
+ * Registered descriptors stay watched (File::watch) across waits; their
+ * change notifications append them to a ready list, so epoll_wait() only
+ * looks at descriptors that have had activity. Level-triggered items are
+ * put back on the ready list after being reported, so they are reported
+ * again while they stay ready; edge-triggered items wait for the next
+ * notification.
+ */
+class EpollInstance : public File
+{
+    friend class EpollItem;
+
+  public:
+    EpollInstance();
+    virtual ~EpollInstance();
+
+    /** epoll_ctl() */
+    int control(int op, int fd, struct epoll_event *event);
+
+    /** epoll_wait() */
+    int wait(struct epoll_event *events, int maxevents, int timeout);
+
+    /** Drops \p pItem because its descriptor has been closed. */
+    void forget(EpollItem *pItem);
+
+    /** Finds the instance backing \p pFile, if it is one, and takes a
+     * reference to it that the caller must drop with decreaseRefCount(). */
+    static EpollInstance *fromFile(File *pFile);
+
+    /** Readable when there may be events to collect. */
+    virtual int select(bool bWriting = false, int timeout = 0);
+
+    virtual void increaseRefCount(bool bIsWriter);
+    virtual void decreaseRefCount(bool bIsWriter);
+
+  protected:
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+
+  private:
+    /** Adds \p pItem to the ready list if it isn't already on it. */
+    void queue(EpollItem *pItem);
+
+    /** Removes \p pItem from the ready list. */
+    void dequeue(EpollItem *pItem);
+
+    /** Unregisters and frees \p pItem. Items lock must be held. */
+    void destroy(EpollItem *pItem);
+
+    /** Registered items, by descriptor number. */
+    Tree<size_t, EpollItem *> m_Items;
+    /** Held while items are added, removed or being reported. */
+    Mutex m_ItemsLock;
+
+    List<EpollItem *> m_Ready;
+    Mutex m_ReadyLock;
+
+#ifdef THREADS
+    /** Released when an item becomes ready and someone is waiting. */
+    Semaphore m_Wakeup;
+#endif
+    size_t m_nWaiters;
+
+    /** Descriptors and in-flight syscalls using us; under the global lock. */
+    size_t m_nRefs;
+};
+
+/** Drops every registration of \p pFd, called as it is closed. */
+void epollDetachDescriptor(FileDescriptor *pFd);
+
+int posix_epoll_create(int size);
+int posix_epoll_create1(int flags);
+int posix_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int posix_epoll_wait(
+    int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+#endif
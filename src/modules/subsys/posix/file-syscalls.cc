@@ -35,6 +35,7 @@
 #include "pedigree/kernel/machine/KeymapManager.h"
 #include "pedigree/kernel/machine/Machine.h"
 #include "pedigree/kernel/process/Process.h"
+#include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/processor/MemoryRegion.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
@@ -662,7 +663,8 @@ int posix_read(int fd, char *ptr, int len)
         Thread::WakeReason wakeReason = Thread::NotWoken;
         pThread->addWakeupWatcher(&wakeReason);
         nRead = pFd->file->read(
-            pFd->offset, len, reinterpret_cast<uintptr_t>(ptr), canBlock);
+            pFd->offset, len, reinterpret_cast<uintptr_t>(ptr), canBlock,
+            &pFd->readAhead);
         pThread->removeWakeupWatcher(&wakeReason);
         /// \todo any mechanism used to block read() will cause a sleep+wake,
         /// so need to rethink how to use wakeReason above to detect interrupted
@@ -2289,6 +2291,161 @@ int posix_fsync(int fd)
     return 0;
 }
 
+/// Destination of a copy_file_range() while source pages are handed out.
+struct CopyRangeTarget
+{
+    File *pFile;
+    uint64_t location;
+};
+
+static uint64_t copyRangeCallback(
+    void *param, const File::TransferSegment *segments, size_t count)
+{
+    CopyRangeTarget *target = reinterpret_cast<CopyRangeTarget *>(param);
+
+    uint64_t n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t r = target->pFile->write(
+            target->location, segments[i].size, segments[i].buffer);
+        target->location += r;
+        n += r;
+        if (r < segments[i].size)
+        {
+            break;
+        }
+    }
+    return n;
+}
+
+ssize_t posix_copy_file_range(
+    int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len,
+    unsigned int flags)
+{
+    F_NOTICE(
+        "copy_file_range(" << fd_in << ", " << fd_out << ", " << len << ", "
+                           << flags << ")");
+
+    if ((off_in && !PosixSubsystem::checkAddress(
+                       reinterpret_cast<uintptr_t>(off_in), sizeof(off_t),
+                       PosixSubsystem::SafeRead | PosixSubsystem::SafeWrite)) ||
+        (off_out && !PosixSubsystem::checkAddress(
+                        reinterpret_cast<uintptr_t>(off_out), sizeof(off_t),
+                        PosixSubsystem::SafeRead | PosixSubsystem::SafeWrite)))
+    {
+        SYSCALL_ERROR(BadAddress);
+        return -1;
+    }
+
+    if (flags)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    Process *pProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    FileDescriptor *pIn = pSubsystem->getFileDescriptor(fd_in);
+    FileDescriptor *pOut = pSubsystem->getFileDescriptor(fd_out);
+    if (!pIn || !pOut || pIn->networkImpl || pOut->networkImpl)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    // The source must be open for reading and the destination for writing.
+    if ((pIn->flflags & O_ACCMODE) == O_WRONLY ||
+        (pOut->flflags & O_ACCMODE) == O_RDONLY)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    // Only regular files have a page cache to copy between.
+    File *pSource = pIn->file;
+    File *pDest = pOut->file;
+    if (pSource->isDirectory() || pDest->isDirectory())
+    {
+        SYSCALL_ERROR(IsADirectory);
+        return -1;
+    }
+    if (pSource->isPipe() || pSource->isFifo() || pDest->isPipe() ||
+        pDest->isFifo())
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    uint64_t location = off_in ? *off_in : pIn->offset;
+    CopyRangeTarget target = {pDest, off_out ? *off_out : pOut->offset};
+
+    // Copying a range onto itself would read back what it just wrote.
+    if (pSource == pDest && location < (target.location + len) &&
+        target.location < (location + len))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    // Same chunking as sendfile(), for the same reasons.
+    size_t total = 0;
+    while (len)
+    {
+        size_t chunk = (len > SENDFILE_CHUNK) ? SENDFILE_CHUNK : len;
+        uint64_t n = pSource->transfer(
+            location, chunk, copyRangeCallback, &target, true,
+            &pIn->readAhead);
+
+        location += n;
+        total += n;
+        len -= n;
+
+        if (n < chunk)
+        {
+            break;
+        }
+
+#ifdef THREADS
+        // Return early if a signal is waiting to be delivered.
+        if (Processor::information().getCurrentThread()->hasEvents())
+        {
+            break;
+        }
+
+        Scheduler::instance().yield();
+#endif
+    }
+
+    if (off_in)
+    {
+        *off_in = location;
+    }
+    else
+    {
+        pIn->offset = location;
+    }
+
+    if (off_out)
+    {
+        *off_out = target.location;
+    }
+    else
+    {
+        pOut->offset = target.location;
+    }
+
+    F_NOTICE(" -> " << total);
+    return total;
+}
+
 EXPORTED_PUBLIC int
 pedigree_get_mount(char *mount_buf, char *info_buf, size_t n)
 {
@@ -93,6 +93,10 @@ int posix_ftruncate(int a, off_t b);
 
 int posix_fsync(int fd);
 
+ssize_t posix_copy_file_range(
+    int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len,
+    unsigned int flags);
+
 int posix_fstatvfs(int fd, struct statvfs *buf);
 int posix_statvfs(const char *path, struct statvfs *buf);
 
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* posix_spawn for Pedigree, replacing musl's clone()-based implementation. */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "syscall.h"
+#include "fdop.h"
+
+// From the Pedigree source tree.
+#include <posix-spawn.h>
+
+/* Pedigree pass-through syscall number for POSIX_SPAWN (see translate.h). */
+#define PEDIGREE_SYS_spawn 0x8001
+
+/* Largest set of file actions passed to the kernel in one go. */
+#define MAX_KERNEL_ACTIONS 32
+
+/*
+ * Common case: no attributes and an explicit path. The kernel builds the
+ * child from scratch - nothing of ours is ever copied, not even
+ * copy-on-write - so this costs the same however large we are.
+ * Returns -1 if the request can't be expressed to the kernel.
+ */
+static int spawn_kernel(pid_t *restrict res, const char *restrict path,
+    const posix_spawn_file_actions_t *fa,
+    char *const argv[restrict], char *const envp[restrict])
+{
+    struct pedigree_spawn_action actions[MAX_KERNEL_ACTIONS];
+    struct pedigree_spawn_args args;
+    struct fdop *op;
+    unsigned long n = 0;
+    long pid;
+
+    if (fa && fa->__actions) {
+        /* The list is kept newest-first, but applies oldest-first. */
+        for (op = fa->__actions; op->next; op = op->next);
+        for (; op; op = op->prev) {
+            if (n == MAX_KERNEL_ACTIONS) return -1;
+            switch (op->cmd) {
+            case FDOP_CLOSE:
+                actions[n].cmd = PEDIGREE_SPAWN_CLOSE;
+                break;
+            case FDOP_DUP2:
+                actions[n].cmd = PEDIGREE_SPAWN_DUP2;
+                break;
+            case FDOP_OPEN:
+                actions[n].cmd = PEDIGREE_SPAWN_OPEN;
+                break;
+            default:
+                return -1;
+            }
+            actions[n].fd = op->fd;
+            actions[n].srcfd = op->srcfd;
+            actions[n].oflag = op->oflag;
+            actions[n].mode = op->mode;
+            actions[n].path = op->path;
+            n++;
+        }
+    }
+
+    args.path = path;
+    args.argv = argv;
+    args.envp = envp;
+    args.actions = actions;
+    args.nactions = n;
+
+    pid = __syscall(PEDIGREE_SYS_spawn, &args);
+    if (pid < 0) return -pid;
+    if (res) *res = pid;
+    return 0;
+}
+
+/*
+ * Everything else runs in a vfork() child, which borrows our address space
+ * until it execs, so it can report failures by writing straight into *ec.
+ * Only raw syscalls are used in the child to leave our libc state alone.
+ */
+static void child(volatile int *ec, const char *path,
+    int (*exec)(const char *, char *const *, char *const *),
+    const posix_spawn_file_actions_t *fa,
+    const posix_spawnattr_t *restrict attr, const sigset_t *oldmask,
+    char *const argv[restrict], char *const envp[restrict])
+{
+    struct sigaction sa;
+    struct fdop *op;
+    int i, ret = 0;
+
+    /* Our handlers would run on the parent's stack: reset them all. */
+    for (i = 1; i < _NSIG; i++) {
+        if (sigaction(i, 0, &sa)) continue;
+        if (!((attr->__flags & POSIX_SPAWN_SETSIGDEF)
+              && sigismember(&attr->__def, i))
+            && (sa.sa_handler == SIG_DFL || sa.sa_handler == SIG_IGN))
+            continue;
+        sa.sa_handler = SIG_DFL;
+        sa.sa_flags = 0;
+        sigaction(i, &sa, 0);
+    }
+
+    if (attr->__flags & POSIX_SPAWN_SETPGROUP)
+        if ((ret = __syscall(SYS_setpgid, 0, attr->__pgrp)))
+            goto fail;
+
+    if (attr->__flags & POSIX_SPAWN_RESETIDS)
+        if ((ret = __syscall(SYS_setgid, __syscall(SYS_getgid))) ||
+            (ret = __syscall(SYS_setuid, __syscall(SYS_getuid))))
+            goto fail;
+
+    if (fa && fa->__actions) {
+        for (op = fa->__actions; op->next; op = op->next);
+        for (; op; op = op->prev) {
+            switch (op->cmd) {
+            case FDOP_CLOSE:
+                __syscall(SYS_close, op->fd);
+                break;
+            case FDOP_DUP2:
+                if ((ret = __syscall(SYS_dup2, op->srcfd, op->fd)) < 0)
+                    goto fail;
+                break;
+            case FDOP_OPEN:
+                ret = __syscall(SYS_open, op->path, op->oflag, op->mode);
+                if (ret < 0) goto fail;
+                if (ret != op->fd) {
+                    int fd = ret;
+                    if ((ret = __syscall(SYS_dup2, fd, op->fd)) < 0)
+                        goto fail;
+                    __syscall(SYS_close, fd);
+                }
+                break;
+            }
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, (attr->__flags & POSIX_SPAWN_SETSIGMASK)
+        ? &attr->__mask : oldmask, 0);
+
+    exec(path, argv, envp);
+    ret = -errno;
+
+fail:
+    *ec = -ret;
+    _exit(127);
+}
+
+int __posix_spawnx(pid_t *restrict res, const char *restrict path,
+    int (*exec)(const char *, char *const *, char *const *),
+    const posix_spawn_file_actions_t *fa,
+    const posix_spawnattr_t *restrict attr,
+    char *const argv[restrict], char *const envp[restrict])
+{
+    static const posix_spawnattr_t noattr;
+    volatile int ec = 0;
+    sigset_t oldmask, all;
+    pid_t pid;
+    int cs, r;
+
+    if (exec == execve && (!attr || !attr->__flags)) {
+        r = spawn_kernel(res, path, fa, argv, envp);
+        if (r >= 0) return r;
+    }
+
+    if (!attr) attr = &noattr;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &oldmask);
+
+    pid = vfork();
+    if (!pid)
+        child(&ec, path, exec, fa, attr, &oldmask, argv, envp);
+
+    if (pid < 0) {
+        ec = errno;
+    } else if (ec) {
+        /* Exec never happened; don't leave a zombie behind. */
+        waitpid(pid, &(int){0}, 0);
+    } else if (res) {
+        *res = pid;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &oldmask, 0);
+    pthread_setcancelstate(cs, 0);
+
+    return ec;
+}
+
+int posix_spawn(pid_t *restrict res, const char *restrict path,
+    const posix_spawn_file_actions_t *fa,
+    const posix_spawnattr_t *restrict attr,
+    char *const argv[restrict], char *const envp[restrict])
+{
+    return __posix_spawnx(res, path, execve, fa, attr, argv, envp);
+}
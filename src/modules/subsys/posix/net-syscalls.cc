@@ -19,8 +19,10 @@
 
 #define LWIP_DONT_PROVIDE_BYTEORDER_FUNCTIONS  // don't need them here
 
+#include "modules/system/network-stack/Filter.h"
 #include "modules/system/vfs/File.h"
 #include "modules/system/vfs/VFS.h"
+#include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/process/Process.h"
 #include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/processor/Processor.h"
@@ -689,6 +691,145 @@ ssize_t posix_recvmsg(int sockfd, struct msghdr *msg, int flags)
     return n;
 }
 
+/// Destination of a sendfile() while the source file's pages are handed out.
+struct SendfileTarget
+{
+    FileDescriptor *pFd;
+    bool bFailed;
+};
+
+static uint64_t sendfileCallback(
+    void *param, const File::TransferSegment *segments, size_t count)
+{
+    SendfileTarget *target = reinterpret_cast<SendfileTarget *>(param);
+    FileDescriptor *pFd = target->pFd;
+
+    if (pFd->networkImpl)
+    {
+        // Send the whole batch of cached blocks in one gathered send.
+        struct iovec iov[File::MaxTransferSegments];
+        for (size_t i = 0; i < count; ++i)
+        {
+            iov[i].iov_base = reinterpret_cast<void *>(segments[i].buffer);
+            iov[i].iov_len = segments[i].size;
+        }
+
+        struct msghdr msg;
+        ByteSet(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t r = pFd->networkImpl->sendto_msg(&msg);
+        if (r < 0)
+        {
+            target->bFailed = true;
+            return 0;
+        }
+        return r;
+    }
+
+    uint64_t n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t r =
+            pFd->file->write(pFd->offset, segments[i].size, segments[i].buffer);
+        pFd->offset += r;
+        n += r;
+        if (r < segments[i].size)
+        {
+            break;
+        }
+    }
+    return n;
+}
+
+ssize_t posix_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    N_NOTICE(
+        "sendfile(" << out_fd << ", " << in_fd << ", " << offset << ", "
+                    << count << ")");
+
+    if (offset && !PosixSubsystem::checkAddress(
+                      reinterpret_cast<uintptr_t>(offset), sizeof(off_t),
+                      PosixSubsystem::SafeRead | PosixSubsystem::SafeWrite))
+    {
+        SYSCALL_ERROR(BadAddress);
+        return -1;
+    }
+
+    FileDescriptor *pIn = getDescriptor(in_fd);
+    FileDescriptor *pOut = getDescriptor(out_fd);
+    if (!pIn || !pOut)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    // The source has to be something with a page cache behind it.
+    if (pIn->networkImpl || !pIn->file || pIn->file->isPipe() ||
+        pIn->file->isFifo() || pIn->file->isDirectory() ||
+        (!pOut->networkImpl && !pOut->file))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if (count > SENDFILE_MAX)
+    {
+        count = SENDFILE_MAX;
+    }
+
+    uint64_t location = offset ? *offset : pIn->offset;
+    SendfileTarget target = {pOut, false};
+
+    // Move the data in chunks so a large file doesn't hold up everything
+    // else (or a pending signal) until the whole thing has been sent.
+    size_t total = 0;
+    while (count)
+    {
+        size_t chunk = (count > SENDFILE_CHUNK) ? SENDFILE_CHUNK : count;
+        uint64_t n = pIn->file->transfer(
+            location, chunk, sendfileCallback, &target, true,
+            &pIn->readAhead);
+
+        location += n;
+        total += n;
+        count -= n;
+
+        if (n < chunk)
+        {
+            break;
+        }
+
+#ifdef THREADS
+        // Return early if a signal is waiting to be delivered.
+        if (Processor::information().getCurrentThread()->hasEvents())
+        {
+            break;
+        }
+
+        Scheduler::instance().yield();
+#endif
+    }
+
+    if (offset)
+    {
+        *offset = location;
+    }
+    else
+    {
+        pIn->offset = location;
+    }
+
+    if (!total && target.bFailed)
+    {
+        return -1;
+    }
+
+    N_NOTICE(" -> " << total);
+    return total;
+}
+
 NetworkSyscalls::NetworkSyscalls(int domain, int type, int protocol)
     : m_Domain(domain), m_Type(type), m_Protocol(protocol), m_Blocking(true),
     m_Fd(nullptr)
@@ -787,6 +928,15 @@ bool NetworkSyscalls::unmonitor(Event *pEvent)
     return false;
 }
 
+bool NetworkSyscalls::watch(FileWatcher *pWatcher)
+{
+    return false;
+}
+
+void NetworkSyscalls::unwatch(FileWatcher *pWatcher)
+{
+}
+
 void NetworkSyscalls::associate(FileDescriptor *fd)
 {
     m_Fd = fd;
@@ -803,8 +953,13 @@ void NetworkSyscalls::setBlocking(bool blocking)
 }
 
 LwipSocketSyscalls::LwipSocketSyscalls(int domain, int type, int protocol)
-    : NetworkSyscalls(domain, type, protocol), m_Socket(nullptr), m_Metadata()
+    : NetworkSyscalls(domain, type, protocol), m_Socket(nullptr),
+      m_pFilter(nullptr), m_NetworkPrograms(), m_Metadata()
 {
+    for (size_t i = 0; i < 5; ++i)
+    {
+        m_NetworkPrograms[i] = static_cast<size_t>(-1);
+    }
 }
 
 LwipSocketSyscalls::~LwipSocketSyscalls()
@@ -816,6 +971,16 @@ LwipSocketSyscalls::~LwipSocketSyscalls()
         netconn_delete(m_Socket);
         m_Socket = nullptr;
     }
+
+    for (size_t i = 1; i < 5; ++i)
+    {
+        if (m_NetworkPrograms[i] != static_cast<size_t>(-1))
+        {
+            NetworkFilter::instance().removeProgram(i, m_NetworkPrograms[i]);
+        }
+    }
+
+    delete m_pFilter;
 }
 
 bool LwipSocketSyscalls::create()
@@ -1050,7 +1215,7 @@ ssize_t LwipSocketSyscalls::recvfrom_msg(struct msghdr *msghdr)
     }
 
     err_t err;
-    if (!m_Metadata.pb)
+    while (!m_Metadata.pb)
     {
         struct pbuf *pb = nullptr;
         struct netbuf *buf = nullptr;
@@ -1078,6 +1243,22 @@ ssize_t LwipSocketSyscalls::recvfrom_msg(struct msghdr *msghdr)
             pb = buf->p;
         }
 
+        // Datagrams the socket filter rejects are thrown away as if they had
+        // never arrived.
+        if (buf && !filterDatagram(pb))
+        {
+            N_NOTICE(" -> dropped by socket filter");
+            netbuf_delete(buf);
+
+            if (!isBlocking() && !m_Metadata.recv)
+            {
+                SYSCALL_ERROR(NoMoreProcesses);
+                return -1;
+            }
+
+            continue;
+        }
+
         m_Metadata.offset = 0;
         m_Metadata.pb = pb;
         m_Metadata.buf = buf;
@@ -1309,10 +1490,173 @@ int LwipSocketSyscalls::setsockopt(
 #endif
     }
 
+    if (level == SOL_SOCKET)
+    {
+#ifdef SO_ATTACH_FILTER
+        if (optname == SO_ATTACH_FILTER)
+        {
+            N_NOTICE(" -> SO_ATTACH_FILTER");
+
+            // Only raw sockets hand the program the IP header onward, which
+            // is what filters built for Linux (e.g. tcpdump -dd) expect. TCP
+            // delivers reassembled data and UDP only the payload, so either
+            // would silently mis-filter.
+            if (NETCONNTYPE_GROUP(netconn_type(m_Socket)) != NETCONN_RAW ||
+                optlen < sizeof(PacketFilterProgram))
+            {
+                SYSCALL_ERROR(InvalidArgument);
+                return -1;
+            }
+
+            const PacketFilterProgram *program =
+                reinterpret_cast<const PacketFilterProgram *>(optvalue);
+            if (!PosixSubsystem::checkAddress(
+                    reinterpret_cast<uintptr_t>(program->instructions),
+                    program->length * sizeof(PacketFilterInstruction),
+                    PosixSubsystem::SafeRead))
+            {
+                SYSCALL_ERROR(InvalidArgument);
+                return -1;
+            }
+
+            PacketFilter *pFilter = new PacketFilter;
+            if (!pFilter->load(program->instructions, program->length))
+            {
+                N_NOTICE(" -> rejected by verifier");
+                delete pFilter;
+                SYSCALL_ERROR(InvalidArgument);
+                return -1;
+            }
+
+            LockGuard<Mutex> guard(m_Metadata.lock);
+            delete m_pFilter;
+            m_pFilter = pFilter;
+            return 0;
+        }
+#endif
+#ifdef SO_DETACH_FILTER
+        if (optname == SO_DETACH_FILTER)
+        {
+            N_NOTICE(" -> SO_DETACH_FILTER");
+
+            LockGuard<Mutex> guard(m_Metadata.lock);
+            if (!m_pFilter)
+            {
+                SYSCALL_ERROR(DoesNotExist);
+                return -1;
+            }
+
+            delete m_pFilter;
+            m_pFilter = nullptr;
+            return 0;
+        }
+#endif
+    }
+    else if (level == SOL_PEDIGREE_NETFILTER)
+    {
+        return setNetworkProgram(optname, optvalue, optlen);
+    }
+
     /// \todo implement with lwIP functionality
     return -1;
 }
 
+int LwipSocketSyscalls::setNetworkProgram(
+    size_t level, const void *optvalue, socklen_t optlen)
+{
+    N_NOTICE(" -> network filter program for level " << level);
+
+    // Only level 1 (whole frames) is ever filtered by the stack; a program
+    // at any other level would be accepted and then never run.
+    if (level != 1)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+#ifdef THREADS
+    // These apply to every packet on the system, not just this socket's.
+    Process *pCurrentProcess =
+        Processor::information().getCurrentThread()->getParent();
+    if (pCurrentProcess->getUserId() != 0)
+    {
+        SYSCALL_ERROR(NotEnoughPermissions);
+        return -1;
+    }
+#endif
+
+    size_t id = static_cast<size_t>(-1);
+    if (optlen)
+    {
+        const PacketFilterProgram *program =
+            reinterpret_cast<const PacketFilterProgram *>(optvalue);
+        if (optlen < sizeof(PacketFilterProgram) ||
+            !PosixSubsystem::checkAddress(
+                reinterpret_cast<uintptr_t>(program->instructions),
+                program->length * sizeof(PacketFilterInstruction),
+                PosixSubsystem::SafeRead))
+        {
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+
+        id = NetworkFilter::instance().installProgram(
+            level, program->instructions, program->length);
+        if (id == static_cast<size_t>(-1))
+        {
+            N_NOTICE(" -> rejected by verifier");
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+    }
+
+    // Replaces whatever this socket had attached at the level before.
+    size_t previous = m_NetworkPrograms[level];
+    m_NetworkPrograms[level] = id;
+    if (previous != static_cast<size_t>(-1))
+    {
+        NetworkFilter::instance().removeProgram(level, previous);
+    }
+
+    return 0;
+}
+
+bool LwipSocketSyscalls::filterDatagram(struct pbuf *pb)
+{
+    LockGuard<Mutex> guard(m_Metadata.lock);
+    if (!m_pFilter)
+    {
+        return true;
+    }
+
+    uint32_t accepted;
+    if (pb->len == pb->tot_len)
+    {
+        accepted = m_pFilter->run(
+            reinterpret_cast<const uint8_t *>(pb->payload), pb->len);
+    }
+    else
+    {
+        // Chained: the filter needs to see the datagram in one piece.
+        uint8_t *data = new uint8_t[pb->tot_len];
+        pbuf_copy_partial(pb, data, pb->tot_len, 0);
+        accepted = m_pFilter->run(data, pb->tot_len);
+        delete[] data;
+    }
+
+    if (!accepted)
+    {
+        return false;
+    }
+
+    if (accepted < pb->tot_len)
+    {
+        pbuf_realloc(pb, accepted);
+    }
+
+    return true;
+}
+
 int LwipSocketSyscalls::getsockopt(
     int level, int optname, void *optvalue, socklen_t *optlen)
 {
@@ -1436,6 +1780,11 @@ void LwipSocketSyscalls::netconnCallback(
             N_NOTICE("Unknown netconn callback error.");
     }
 
+    for (auto &it : obj->m_Metadata.watchers)
+    {
+        it->changed();
+    }
+
         /// \todo need a way to do this with lwip when threads are off
 #ifdef THREADS
     for (auto &it : obj->m_Metadata.semaphores)
@@ -1447,6 +1796,31 @@ void LwipSocketSyscalls::netconnCallback(
 #endif
 }
 
+bool LwipSocketSyscalls::watch(FileWatcher *pWatcher)
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Metadata.lock);
+#endif
+    m_Metadata.watchers.pushBack(pWatcher);
+    return true;
+}
+
+void LwipSocketSyscalls::unwatch(FileWatcher *pWatcher)
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Metadata.lock);
+#endif
+    for (auto it = m_Metadata.watchers.begin();
+         it != m_Metadata.watchers.end(); ++it)
+    {
+        if ((*it) == pWatcher)
+        {
+            m_Metadata.watchers.erase(it);
+            return;
+        }
+    }
+}
+
 void LwipSocketSyscalls::lwipToSyscallError(err_t err)
 {
     if (err != ERR_OK)
@@ -1511,8 +1885,8 @@ void LwipSocketSyscalls::lwipToSyscallError(err_t err)
 }
 
 LwipSocketSyscalls::LwipMetadata::LwipMetadata()
-    : recv(0), send(0), error(false), lock(false), semaphores(), offset(0),
-      pb(nullptr), buf(nullptr)
+    : recv(0), send(0), error(false), lock(false), semaphores(), watchers(),
+      offset(0), pb(nullptr), buf(nullptr)
 {
 }
 
@@ -2064,6 +2438,27 @@ bool UnixSocketSyscalls::unmonitor(Event *pEvent)
     return true;
 }
 
+bool UnixSocketSyscalls::watch(FileWatcher *pWatcher)
+{
+    // UnixSocket reports changes to either direction of a stream on both
+    // ends, so the local socket is enough here.
+    if (!m_Socket)
+    {
+        return false;
+    }
+
+    m_Socket->watch(pWatcher);
+    return true;
+}
+
+void UnixSocketSyscalls::unwatch(FileWatcher *pWatcher)
+{
+    if (m_Socket)
+    {
+        m_Socket->unwatch(pWatcher);
+    }
+}
+
 bool UnixSocketSyscalls::pairWith(UnixSocketSyscalls *other)
 {
     if (!m_Socket->bind(other->m_Socket))
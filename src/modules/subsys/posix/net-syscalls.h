@@ -28,6 +28,7 @@
 #include "pedigree/kernel/utilities/Tree.h"
 
 #include "modules/subsys/posix/UnixFilesystem.h"
+#include "modules/system/network-stack/PacketFilter.h"
 
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -42,11 +43,23 @@ struct pbuf;
 struct netbuf;
 struct netconn;
 
+/// sendfile() moves at most this many bytes per call, as Linux does.
+#define SENDFILE_MAX 0x7ffff000
+/// sendfile() yields to other threads after each chunk of this size.
+#define SENDFILE_CHUNK 65536
+
+/// setsockopt() level for attaching a BPF program to a NetworkFilter level
+/// rather than to the socket itself. The option name is the level (1 to 4)
+/// and the value a struct sock_fprog; an empty value detaches the program.
+/// Only root may do this, and the program lasts as long as the socket.
+#define SOL_PEDIGREE_NETFILTER 0x5046
+
 class Semaphore;
 class FileDescriptor;
 class UnixSocket;
 class Thread;
 class Event;
+class FileWatcher;
 
 class NetworkSyscalls
 {
@@ -92,6 +105,11 @@ class NetworkSyscalls
     virtual bool monitor(Thread *pThread, Event *pEvent);
     virtual bool unmonitor(Event *pEvent);
 
+    /// Persistently watch this socket for activity (see File::watch).
+    /// \return false if the socket can't be watched.
+    virtual bool watch(FileWatcher *pWatcher);
+    virtual void unwatch(FileWatcher *pWatcher);
+
     void associate(FileDescriptor *fd);
 
     int getDomain() const
@@ -159,6 +177,9 @@ class LwipSocketSyscalls : public NetworkSyscalls
     virtual bool poll(bool &read, bool &write, bool &error, Semaphore *waiter);
     virtual void unPoll(Semaphore *waiter);
 
+    virtual bool watch(FileWatcher *pWatcher);
+    virtual void unwatch(FileWatcher *pWatcher);
+
   private:
     static Tree<struct netconn *, LwipSocketSyscalls *> m_SyscallObjects;
 
@@ -166,8 +187,23 @@ class LwipSocketSyscalls : public NetworkSyscalls
     netconnCallback(struct netconn *conn, enum netconn_evt evt, uint16_t len);
     static void lwipToSyscallError(err_t err);
 
+    /// Runs the socket filter over a received datagram, truncating it to
+    /// the length the filter returns. Filters are only attached to raw
+    /// sockets, so the program sees the IP header onward. \return false
+    /// to drop it.
+    bool filterDatagram(struct pbuf *pb);
+
+    /// Handles SOL_PEDIGREE_NETFILTER options. Only level 1 is accepted.
+    int setNetworkProgram(size_t level, const void *optvalue, socklen_t optlen);
+
     struct netconn *m_Socket;
 
+    /// Program attached with SO_ATTACH_FILTER, if any.
+    PacketFilter *m_pFilter;
+
+    /// NetworkFilter programs attached through this socket, by level.
+    size_t m_NetworkPrograms[5];
+
     struct LwipMetadata
     {
         LwipMetadata();
@@ -178,6 +214,7 @@ class LwipSocketSyscalls : public NetworkSyscalls
 
         Mutex lock;
         List<Semaphore *> semaphores;
+        List<FileWatcher *> watchers;
 
         size_t offset;
         struct pbuf *pb;
@@ -219,6 +256,9 @@ class UnixSocketSyscalls : public NetworkSyscalls
     virtual bool monitor(Thread *pThread, Event *pEvent);
     virtual bool unmonitor(Event *pEvent);
 
+    virtual bool watch(FileWatcher *pWatcher);
+    virtual void unwatch(FileWatcher *pWatcher);
+
     /// Pair two UnixSocketSyscalls objects such that the referenced
     /// sockets directly communicate with each other.
     bool pairWith(UnixSocketSyscalls *other);
@@ -275,4 +315,6 @@ int posix_sethostname(const char *name, size_t len);
 ssize_t posix_sendmsg(int sockfd, const struct msghdr *msg, int flags);
 ssize_t posix_recvmsg(int sockfd, struct msghdr *msg, int flags);
 
+ssize_t posix_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
 #endif
@@ -22,6 +22,7 @@
 #include "file-syscalls.h"
 #include "modules/system/vfs/Pipe.h"
 #include "modules/system/vfs/VFS.h"
+#include "net-syscalls.h"
 #include "pipe-syscalls.h"
 
 #include "pedigree/kernel/Subsystem.h"
@@ -35,8 +36,109 @@
 
 #include <fcntl.h>
 
+#ifndef SPLICE_F_NONBLOCK
+#define SPLICE_F_MOVE 1
+#define SPLICE_F_NONBLOCK 2
+#define SPLICE_F_MORE 4
+#define SPLICE_F_GIFT 8
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 typedef Tree<size_t, FileDescriptor *> FdMap;
 
+static bool isReadable(FileDescriptor *pFd)
+{
+    return (pFd->flflags & O_ACCMODE) != O_WRONLY;
+}
+
+static bool isWritable(FileDescriptor *pFd)
+{
+    return (pFd->flflags & O_ACCMODE) != O_RDONLY;
+}
+
+/// State for moving data between a pipe and a file or socket descriptor.
+struct SpliceTarget
+{
+    FileDescriptor *pFd;
+    uint64_t location;
+    bool bCanBlock;
+    bool bFailed;
+};
+
+static size_t spliceProducer(void *param, uint8_t *buffer, size_t size)
+{
+    SpliceTarget *target = reinterpret_cast<SpliceTarget *>(param);
+    FileDescriptor *pFd = target->pFd;
+
+    if (pFd->networkImpl)
+    {
+        ssize_t r = pFd->networkImpl->recvfrom(
+            buffer, size, target->bCanBlock ? 0 : MSG_DONTWAIT, nullptr,
+            nullptr);
+        if (r < 0)
+        {
+            target->bFailed = true;
+            return 0;
+        }
+        return r;
+    }
+
+    uint64_t r = pFd->file->read(
+        target->location, size, reinterpret_cast<uintptr_t>(buffer),
+        target->bCanBlock, &pFd->readAhead);
+    target->location += r;
+    return r;
+}
+
+static size_t spliceConsumer(void *param, const uint8_t *buffer, size_t size)
+{
+    SpliceTarget *target = reinterpret_cast<SpliceTarget *>(param);
+    FileDescriptor *pFd = target->pFd;
+
+    if (pFd->networkImpl)
+    {
+        ssize_t r = pFd->networkImpl->sendto(
+            buffer, size, target->bCanBlock ? 0 : MSG_DONTWAIT, nullptr, 0);
+        if (r < 0)
+        {
+            target->bFailed = true;
+            return 0;
+        }
+        return r;
+    }
+
+    uint64_t r = pFd->file->write(
+        target->location, size, reinterpret_cast<uintptr_t>(buffer),
+        target->bCanBlock);
+    target->location += r;
+    return r;
+}
+
+static bool isPipeDescriptor(FileDescriptor *pFd)
+{
+    return !pFd->networkImpl && pFd->file &&
+           (pFd->file->isPipe() || pFd->file->isFifo());
+}
+
+/// Raises EPIPE/SIGPIPE when nothing could be written to \p pFd.
+static ssize_t brokenPipe(PosixSubsystem *pSubsystem, FileDescriptor *pFd)
+{
+    if (isPipeDescriptor(pFd) &&
+        !Pipe::fromFile(pFd->file)->getReaderCount())
+    {
+        F_NOTICE("  -> write to a broken pipe");
+        SYSCALL_ERROR(BrokenPipe);
+        pSubsystem->threadException(
+            Processor::information().getCurrentThread(), Subsystem::Pipe);
+        return -1;
+    }
+
+    return 0;
+}
+
 int posix_pipe(int filedes[2])
 {
     if (!PosixSubsystem::checkAddress(
@@ -79,3 +181,297 @@ int posix_pipe(int filedes[2])
 
     return 0;
 }
+
+ssize_t posix_splice(
+    int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len,
+    unsigned int flags)
+{
+    F_NOTICE(
+        "splice(" << fd_in << ", " << fd_out << ", " << len << ", " << Hex
+                  << flags << ")");
+
+    Process *pProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for the process!");
+        return -1;
+    }
+
+    FileDescriptor *pIn = pSubsystem->getFileDescriptor(fd_in);
+    FileDescriptor *pOut = pSubsystem->getFileDescriptor(fd_out);
+    if (!pIn || !pOut)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    // Data comes out of a readable descriptor and into a writable one, so
+    // neither a pipe's write end nor a read-only file can be a source.
+    if (!isReadable(pIn) || !isWritable(pOut))
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    bool bInPipe = isPipeDescriptor(pIn);
+    bool bOutPipe = isPipeDescriptor(pOut);
+    if (!(bInPipe || bOutPipe) ||
+        (bInPipe && bOutPipe && pIn->file == pOut->file))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    // Pipes and sockets can't be seeked.
+    if ((off_in && (bInPipe || pIn->networkImpl)) ||
+        (off_out && (bOutPipe || pOut->networkImpl)))
+    {
+        SYSCALL_ERROR(IllegalSeek);
+        return -1;
+    }
+
+    if ((off_in && !PosixSubsystem::checkAddress(
+                       reinterpret_cast<uintptr_t>(off_in), sizeof(off_t),
+                       PosixSubsystem::SafeRead | PosixSubsystem::SafeWrite)) ||
+        (off_out && !PosixSubsystem::checkAddress(
+                        reinterpret_cast<uintptr_t>(off_out), sizeof(off_t),
+                        PosixSubsystem::SafeRead | PosixSubsystem::SafeWrite)))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    bool bCanBlock = !(flags & SPLICE_F_NONBLOCK);
+
+    uint64_t result = 0;
+    if (bInPipe && bOutPipe)
+    {
+        result = Pipe::fromFile(pIn->file)->splice(
+            Pipe::fromFile(pOut->file), len, bCanBlock);
+    }
+    else if (bOutPipe)
+    {
+        // File or socket into the pipe: fill the pipe's pages directly.
+        SpliceTarget target = {pIn, off_in ? *off_in : pIn->offset,
+                               bCanBlock && !(pIn->flflags & O_NONBLOCK),
+                               false};
+        result = Pipe::fromFile(pOut->file)->spliceFrom(
+            spliceProducer, &target, len, bCanBlock);
+        if (off_in)
+        {
+            *off_in = target.location;
+        }
+        else if (!pIn->networkImpl)
+        {
+            pIn->offset = target.location;
+        }
+        if (!result && target.bFailed)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        // Pipe out to a file or socket, straight from the pipe's pages.
+        SpliceTarget target = {pOut, off_out ? *off_out : pOut->offset,
+                               bCanBlock && !(pOut->flflags & O_NONBLOCK),
+                               false};
+        result = Pipe::fromFile(pIn->file)->spliceTo(
+            spliceConsumer, &target, len, bCanBlock);
+        if (off_out)
+        {
+            *off_out = target.location;
+        }
+        else if (!pOut->networkImpl)
+        {
+            pOut->offset = target.location;
+        }
+        if (!result && target.bFailed)
+        {
+            return -1;
+        }
+    }
+
+    if (!result && len)
+    {
+        if (brokenPipe(pSubsystem, pOut) < 0)
+        {
+            return -1;
+        }
+
+        // Non-blocking, and either side could make progress later on.
+        bool bWouldBlock =
+            (bInPipe && Pipe::fromFile(pIn->file)->getWriterCount()) ||
+            (bOutPipe && !pOut->file->select(true, 0));
+        if (!bCanBlock && bWouldBlock)
+        {
+            SYSCALL_ERROR(NoMoreProcesses);
+            return -1;
+        }
+    }
+
+    F_NOTICE("  -> " << Dec << result);
+    return result;
+}
+
+ssize_t posix_tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+    F_NOTICE(
+        "tee(" << fd_in << ", " << fd_out << ", " << len << ", " << Hex
+               << flags << ")");
+
+    Process *pProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for the process!");
+        return -1;
+    }
+
+    FileDescriptor *pIn = pSubsystem->getFileDescriptor(fd_in);
+    FileDescriptor *pOut = pSubsystem->getFileDescriptor(fd_out);
+    if (!pIn || !pOut)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    if (!isReadable(pIn) || !isWritable(pOut))
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    if (!isPipeDescriptor(pIn) || !isPipeDescriptor(pOut) ||
+        pIn->file == pOut->file)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    bool bCanBlock = !(flags & SPLICE_F_NONBLOCK);
+    Pipe *pInPipe = Pipe::fromFile(pIn->file);
+    uint64_t result =
+        pInPipe->tee(Pipe::fromFile(pOut->file), len, bCanBlock);
+
+    if (!result && len)
+    {
+        if (brokenPipe(pSubsystem, pOut) < 0)
+        {
+            return -1;
+        }
+
+        if (!bCanBlock && pInPipe->getWriterCount())
+        {
+            SYSCALL_ERROR(NoMoreProcesses);
+            return -1;
+        }
+    }
+
+    F_NOTICE("  -> " << Dec << result);
+    return result;
+}
+
+ssize_t posix_vmsplice(
+    int fd, const struct iovec *iov, size_t nr_segs, unsigned int flags)
+{
+    F_NOTICE(
+        "vmsplice(" << fd << ", <iov>, " << nr_segs << ", " << Hex << flags
+                    << ")");
+
+    // Bound the count first so the size of the array can't overflow.
+    if (nr_segs > IOV_MAX ||
+        !PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(iov), sizeof(struct iovec) * nr_segs,
+            PosixSubsystem::SafeRead))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    Process *pProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for the process!");
+        return -1;
+    }
+
+    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    if (!pFd)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    if (!isPipeDescriptor(pFd))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    // The write end maps user memory into the pipe, the read end maps pipe
+    // pages out to user memory. Pages can't be gifted here, so both go
+    // through a single copy between user memory and the pipe's pages.
+    bool bWriting = isWritable(pFd);
+    bool bCanBlock = !(flags & SPLICE_F_NONBLOCK);
+    Pipe *pPipe = Pipe::fromFile(pFd->file);
+
+    ssize_t total = 0;
+    for (size_t i = 0; i < nr_segs; ++i)
+    {
+        if (!iov[i].iov_len)
+        {
+            continue;
+        }
+
+        uintptr_t base = reinterpret_cast<uintptr_t>(iov[i].iov_base);
+        if (!PosixSubsystem::checkAddress(
+                base, iov[i].iov_len,
+                bWriting ? PosixSubsystem::SafeRead
+                         : PosixSubsystem::SafeWrite))
+        {
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+
+        uint64_t r = bWriting
+                         ? pPipe->write(0, iov[i].iov_len, base, bCanBlock)
+                         : pPipe->read(0, iov[i].iov_len, base, bCanBlock);
+        total += r;
+        if (r < iov[i].iov_len)
+        {
+            break;
+        }
+
+        // As with read(), only wait for the first bytes to arrive.
+        if (!bWriting)
+        {
+            bCanBlock = false;
+        }
+    }
+
+    if (!total)
+    {
+        if (bWriting && brokenPipe(pSubsystem, pFd) < 0)
+        {
+            return -1;
+        }
+
+        if (!bCanBlock && (bWriting || pPipe->getWriterCount()))
+        {
+            SYSCALL_ERROR(NoMoreProcesses);
+            return -1;
+        }
+    }
+
+    F_NOTICE("  -> " << Dec << total);
+    return total;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _POSIX_SPAWN_ABI_H
+#define _POSIX_SPAWN_ABI_H
+
+/**
+ * Userspace <-> kernel interface for POSIX_SPAWN. The kernel creates the
+ * child with an empty address space, applies the file actions to its
+ * descriptor table and loads the new image, without ever copying the
+ * parent's mappings. Shared between the kernel and the C library glue, so
+ * this must remain plain C.
+ */
+
+/** File action commands, applied to the child in array order. */
+#define PEDIGREE_SPAWN_CLOSE 1
+#define PEDIGREE_SPAWN_DUP2 2
+#define PEDIGREE_SPAWN_OPEN 3
+
+struct pedigree_spawn_action
+{
+    /// One of the PEDIGREE_SPAWN_* commands.
+    int cmd;
+    /// Target descriptor in the child.
+    int fd;
+    /// Source descriptor in the child, for PEDIGREE_SPAWN_DUP2.
+    int srcfd;
+    /// open() flags and mode, for PEDIGREE_SPAWN_OPEN.
+    int oflag;
+    int mode;
+    /// Path to open(), for PEDIGREE_SPAWN_OPEN.
+    const char *path;
+};
+
+struct pedigree_spawn_args
+{
+    /// Path to the program to run (no PATH search is performed).
+    const char *path;
+    /// NULL-terminated argument and environment vectors.
+    char *const *argv;
+    char *const *envp;
+    /// File actions to apply to the child, in order.
+    const struct pedigree_spawn_action *actions;
+    unsigned long nactions;
+};
+
+#endif
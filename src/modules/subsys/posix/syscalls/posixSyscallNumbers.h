@@ -279,5 +279,16 @@
 #define POSIX_CAPGET 267
 #define POSIX_CAPSET 268
 #define POSIX_PRCTL 269
+#define POSIX_SPLICE 270
+#define POSIX_TEE 271
+#define POSIX_VMSPLICE 272
+#define POSIX_SENDFILE 273
+#define POSIX_COPY_FILE_RANGE 274
+#define POSIX_EPOLL_CREATE 275
+#define POSIX_EPOLL_CREATE1 276
+#define POSIX_EPOLL_CTL 277
+#define POSIX_EPOLL_WAIT 278
+#define POSIX_VFORK 279
+#define POSIX_SPAWN 280
 
 #endif
@@ -131,7 +131,9 @@ inline long posix_translate_syscall(long which)
         case SYS_getpid:
             pedigree_translation = POSIX_GETPID;
             break;
-        // ...
+        case SYS_sendfile:
+            pedigree_translation = POSIX_SENDFILE;
+            break;
         case SYS_socket:
             pedigree_translation = POSIX_SOCKET;
             break;
@@ -183,7 +185,9 @@ inline long posix_translate_syscall(long which)
         case SYS_fork:
             pedigree_translation = POSIX_FORK;
             break;
-        // ...
+        case SYS_vfork:
+            pedigree_translation = POSIX_VFORK;
+            break;
         case SYS_execve:
             pedigree_translation = POSIX_EXECVE;
             break;
@@ -422,6 +426,10 @@ inline long posix_translate_syscall(long which)
             pedigree_translation = POSIX_SET_TLS_AREA;
             break;
         // ...
+        case SYS_epoll_create:
+            pedigree_translation = POSIX_EPOLL_CREATE;
+            break;
+        // ...
         case SYS_getdents64:
             pedigree_translation = POSIX_GETDENTS64;
             break;
@@ -436,6 +444,12 @@ inline long posix_translate_syscall(long which)
         case SYS_exit_group:
             pedigree_translation = POSIX_EXIT_GROUP;
             break;
+        case SYS_epoll_wait:
+            pedigree_translation = POSIX_EPOLL_WAIT;
+            break;
+        case SYS_epoll_ctl:
+            pedigree_translation = POSIX_EPOLL_CTL;
+            break;
         // ...
         case SYS_utimes:
             pedigree_translation = POSIX_UTIMES;
@@ -485,10 +499,33 @@ inline long posix_translate_syscall(long which)
         case SYS_get_robust_list:
             pedigree_translation = POSIX_GET_ROBUST_LIST;
             break;
+        case SYS_splice:
+            pedigree_translation = POSIX_SPLICE;
+            break;
+        case SYS_tee:
+            pedigree_translation = POSIX_TEE;
+            break;
+        case SYS_vmsplice:
+            pedigree_translation = POSIX_VMSPLICE;
+            break;
+        // ...
+        case SYS_epoll_create1:
+            pedigree_translation = POSIX_EPOLL_CREATE1;
+            break;
+        // ...
+#ifdef SYS_copy_file_range
+        case SYS_copy_file_range:
+            pedigree_translation = POSIX_COPY_FILE_RANGE;
+            break;
+#endif
 
         // Pedigree pass-through syscalls.
         case 0x8000:
             pedigree_translation = POSIX_TTYNAME;
+            break;
+        case 0x8001:
+            pedigree_translation = POSIX_SPAWN;
+            break;
     }
 
     return pedigree_translation;
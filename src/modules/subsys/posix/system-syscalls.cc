@@ -19,6 +19,7 @@
 
 #include "system-syscalls.h"
 #include "file-syscalls.h"
+#include "modules/subsys/posix/FileDescriptor.h"
 #include "modules/system/linker/DynamicLinker.h"
 #include "modules/system/vfs/File.h"
 #include "modules/system/vfs/Symlink.h"
@@ -43,6 +44,7 @@
 #include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/Vector.h"
 #include "pipe-syscalls.h"
+#include "posix-spawn.h"
 #include "posixSyscallNumbers.h"
 #include "pthread-syscalls.h"
 #include "signal-syscalls.h"
@@ -61,6 +63,7 @@
 #include "modules/system/users/UserManager.h"
 #include "modules/system/vfs/MemoryMappedFile.h"
 
+#include <fcntl.h>
 #include <grp.h>
 #include <limits.h>
 #include <pwd.h>
@@ -237,12 +240,13 @@ long posix_clone(
     {
         SC_NOTICE(" -> CLONE_PARENT is not yet supported!");
     }
-    if (flags & CLONE_VFORK)
-    {
-        // Halts parent until child ruins execve() or exit(), just like vfork.
-        // We should support this properly.
-        SC_NOTICE(" -> CLONE_VFORK is not yet supported!");
-    }
+
+    // CLONE_VFORK halts the parent until the child calls execve() or exit().
+    // Combined with CLONE_VM (and without CLONE_THREAD) the child runs in the
+    // parent's own address space rather than becoming a thread - vfork().
+    bool bVfork = (flags & CLONE_VFORK) == CLONE_VFORK;
+    bool bBorrow = bVfork && ((flags & CLONE_VM) == CLONE_VM) &&
+                   ((flags & CLONE_THREAD) != CLONE_THREAD);
 
 #if 0
     if (flags & CLONE_VM) SC_NOTICE("\t\t-> CLONE_VM");
@@ -269,7 +273,7 @@ long posix_clone(
     if (flags & CLONE_IO) SC_NOTICE("\t\t-> CLONE_IO");
 #endif
 
-    if ((flags & CLONE_VM) == CLONE_VM)
+    if (((flags & CLONE_VM) == CLONE_VM) && !bBorrow)
     {
         // clone vm doesn't actually copy the address space, it shares it
 
@@ -328,7 +332,8 @@ long posix_clone(
     // Create a new process.
     Process *pParentProcess =
         Processor::information().getCurrentThread()->getParent();
-    PosixProcess *pProcess = new PosixProcess(pParentProcess);
+    PosixProcess *pProcess = new PosixProcess(
+        pParentProcess, bBorrow ? Process::Borrowed : Process::CopyOnWrite);
     if (!pProcess)
     {
         SYSCALL_ERROR(OutOfMemory);
@@ -384,15 +389,24 @@ long posix_clone(
         }
     }
 
-    // Register with the dynamic linker.
-    DynamicLinker *oldLinker = pProcess->getLinker();
-    if (oldLinker)
+    if (bBorrow)
     {
-        DynamicLinker *newLinker = new DynamicLinker(*oldLinker);
-        pProcess->setLinker(newLinker);
+        // The child runs the parent's image (and so the parent's linker state)
+        // until it calls exec or exit, neither of which may free it.
+        pProcess->setLinker(0);
     }
+    else
+    {
+        // Register with the dynamic linker.
+        DynamicLinker *oldLinker = pProcess->getLinker();
+        if (oldLinker)
+        {
+            DynamicLinker *newLinker = new DynamicLinker(*oldLinker);
+            pProcess->setLinker(newLinker);
+        }
 
-    MemoryMapManager::instance().clone(pProcess);
+        MemoryMapManager::instance().clone(pProcess);
+    }
 
     // Copy the file descriptors from the parent
     pSubsystem->copyDescriptors(pParentSubsystem);
@@ -400,9 +414,21 @@ long posix_clone(
     // Child returns 0.
     clonedState.setSyscallReturnValue(0);
 
-    // Allow signals to the parent again
-    for (int sig = 0; sig < 32; sig++)
-        Processor::information().getCurrentThread()->inhibitEvent(sig, false);
+    // A vfork() parent stays blocked until the child execs or exits. Signals
+    // to it stay inhibited until then too, as a handler would run on the
+    // stack the child is using.
+    Semaphore vforkWaiter(0);
+    if (bVfork)
+    {
+        pProcess->setVforkWaiter(&vforkWaiter);
+    }
+    else
+    {
+        // Allow signals to the parent again
+        for (int sig = 0; sig < 32; sig++)
+            Processor::information().getCurrentThread()->inhibitEvent(
+                sig, false);
+    }
 
     // Set ctid in the new address space if we are required to.
     if (flags & CLONE_CHILD_SETTID)
@@ -427,9 +453,24 @@ long posix_clone(
         Processor::information().getCurrentThread(), pParentSubsystem, pThread,
         pSubsystem);
 
+    // The child may be gone entirely by the time a vfork() parent wakes up.
+    size_t pid = pProcess->getId();
+
+    if (bVfork)
+    {
+        SC_NOTICE(" -> waiting for vfork child " << pid);
+        Processor::setInterrupts(true);
+        while (!vforkWaiter.acquire())
+            ;
+
+        for (int sig = 0; sig < 32; sig++)
+            Processor::information().getCurrentThread()->inhibitEvent(
+                sig, false);
+    }
+
     // Parent returns child ID.
-    SC_NOTICE(" -> " << pProcess->getId() << " [new process]");
-    return pProcess->getId();
+    SC_NOTICE(" -> " << pid << " [new process]");
+    return pid;
 }
 
 int posix_fork(SyscallState &state)
@@ -439,6 +480,13 @@ int posix_fork(SyscallState &state)
     return posix_clone(state, 0, 0, 0, 0, 0);
 }
 
+int posix_vfork(SyscallState &state)
+{
+    SC_NOTICE("vfork");
+
+    return posix_clone(state, CLONE_VM | CLONE_VFORK, 0, 0, 0, 0);
+}
+
 int posix_execve(
     const char *name, const char **argv, const char **env, SyscallState &state)
 {
@@ -496,6 +544,246 @@ int posix_execve(
     return 0;
 }
 
+/** Everything a spawned child needs to load its image. */
+struct SpawnRequest
+{
+    File *pFile;
+    String name;
+    Vector<String> argv;
+    Vector<String> env;
+};
+
+/** Kernel-mode entry point of a spawned process, which replaces itself with
+ * the requested image just as init does. */
+static int spawnLoader(void *param)
+{
+    SpawnRequest *pRequest = reinterpret_cast<SpawnRequest *>(param);
+
+    Process *pProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pProcess->getSubsystem());
+
+    bool bLoaded = pSubsystem->invoke(
+        pRequest->pFile, pRequest->name, pRequest->argv, pRequest->env);
+    delete pRequest;
+
+    if (!bLoaded)
+    {
+        // The parent already has our pid, so report the failure the way
+        // POSIX specifies for errors after posix_spawn() has returned.
+        SC_NOTICE("spawn: failed to load the new image");
+        pSubsystem->exit(127);
+    }
+
+    return 0;
+}
+
+/** Applies one posix_spawn file action to the child's descriptor table. */
+static bool applySpawnAction(
+    PosixSubsystem *pParentSubsystem, PosixSubsystem *pSubsystem,
+    const pedigree_spawn_action &action)
+{
+    switch (action.cmd)
+    {
+        case PEDIGREE_SPAWN_CLOSE:
+            // Closing a descriptor that is not open is harmless here.
+            pSubsystem->freeFd(action.fd);
+            return true;
+
+        case PEDIGREE_SPAWN_DUP2:
+        {
+            FileDescriptor *pFd = pSubsystem->getFileDescriptor(action.srcfd);
+            if (!pFd || action.fd < 0)
+            {
+                SYSCALL_ERROR(BadFileDescriptor);
+                return false;
+            }
+
+            if (action.srcfd == action.fd)
+            {
+                // Only clears close-on-exec, as the descriptor is kept.
+                pFd->fdflags &= ~FD_CLOEXEC;
+                return true;
+            }
+
+            FileDescriptor *pNewFd = new FileDescriptor(*pFd);
+            pNewFd->fdflags &= ~FD_CLOEXEC;
+            pSubsystem->addFileDescriptor(action.fd, pNewFd);
+            return true;
+        }
+
+        case PEDIGREE_SPAWN_OPEN:
+        {
+            if (action.fd < 0)
+            {
+                SYSCALL_ERROR(BadFileDescriptor);
+                return false;
+            }
+
+            // Open on the parent's side (the path is in its address space and
+            // the child shares its working directory), then move the new
+            // descriptor across to the child. posix_open checks the path.
+            int fd = posix_open(action.path, action.oflag, action.mode);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            FileDescriptor *pFd = pParentSubsystem->getFileDescriptor(fd);
+            pSubsystem->addFileDescriptor(action.fd, new FileDescriptor(*pFd));
+            pParentSubsystem->freeFd(fd);
+            return true;
+        }
+
+        default:
+            SYSCALL_ERROR(InvalidArgument);
+            return false;
+    }
+}
+
+long posix_spawn(const pedigree_spawn_args *args)
+{
+    if (!PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(args), sizeof(*args),
+            PosixSubsystem::SafeRead))
+    {
+        SC_NOTICE("spawn -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    // Take a copy so the arguments can't change underneath us.
+    pedigree_spawn_args spawnArgs = *args;
+    if (!PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(spawnArgs.path), PATH_MAX,
+            PosixSubsystem::SafeRead) ||
+        (spawnArgs.nactions &&
+         !PosixSubsystem::checkAddress(
+             reinterpret_cast<uintptr_t>(spawnArgs.actions),
+             spawnArgs.nactions * sizeof(pedigree_spawn_action),
+             PosixSubsystem::SafeRead)))
+    {
+        SC_NOTICE("spawn -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    SC_NOTICE(
+        "spawn(\"" << spawnArgs.path << "\", " << spawnArgs.nactions
+                   << " file actions)");
+
+    // Bad arguments?
+    if (spawnArgs.argv == 0 || spawnArgs.envp == 0)
+    {
+        SYSCALL_ERROR(ExecFormatError);
+        return -1;
+    }
+
+    Process *pParentProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pParentSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pParentProcess->getSubsystem());
+    if (!pParentSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    // Find the target now, so the common failures are reported to the caller
+    // rather than turning into an exit status of 127 in the child.
+    String invokePath;
+    normalisePath(invokePath, spawnArgs.path);
+    File *pFile = findFileWithAbiFallbacks(invokePath);
+    while (pFile && pFile->isSymlink())
+    {
+        pFile = Symlink::fromFile(pFile)->followLink();
+    }
+    if (!pFile)
+    {
+        SC_NOTICE(" -> does not exist");
+        SYSCALL_ERROR(DoesNotExist);
+        return -1;
+    }
+    if (pFile->isDirectory())
+    {
+        SC_NOTICE(" -> is a directory");
+        SYSCALL_ERROR(IsADirectory);
+        return -1;
+    }
+    if (!VFS::checkAccess(pFile, true, false, true))
+    {
+        // checkAccess does a SYSCALL_ERROR for us.
+        SC_NOTICE(" -> not executable");
+        return -1;
+    }
+
+    // Build argv and env lists - the child cannot see our memory.
+    SpawnRequest *pRequest = new SpawnRequest;
+    pRequest->pFile = pFile;
+    pRequest->name = invokePath;
+    for (char *const *arg = spawnArgs.argv; *arg != 0; ++arg)
+    {
+        pRequest->argv.pushBack(String(*arg));
+    }
+    for (char *const *e = spawnArgs.envp; *e != 0; ++e)
+    {
+        pRequest->env.pushBack(String(*e));
+    }
+
+    // The child is going to load a new image straight away, so there's no
+    // point in cloning (even copy-on-write) any of our mappings.
+    PosixProcess *pProcess =
+        new PosixProcess(pParentProcess, Process::Empty);
+    PosixSubsystem *pSubsystem = new PosixSubsystem;
+    pSubsystem->setAbi(pParentSubsystem->getAbi());
+    pProcess->setSubsystem(pSubsystem);
+    pSubsystem->setProcess(pProcess);
+
+    // Nothing of ours is loaded in the child.
+    pProcess->setLinker(0);
+
+    if (pParentProcess->getType() == Process::Posix)
+    {
+        PosixProcess *p = static_cast<PosixProcess *>(pParentProcess);
+        pProcess->setProcessGroup(p->getProcessGroup());
+
+        // default to being a member of the group
+        pProcess->setGroupMembership(PosixProcess::Member);
+
+        // Do not adopt leadership status.
+        if (p->getGroupMembership() != PosixProcess::Leader)
+        {
+            pProcess->setGroupMembership(p->getGroupMembership());
+        }
+    }
+
+    // Inherit our descriptors and then apply the file actions, in order.
+    pSubsystem->copyDescriptors(pParentSubsystem);
+    for (size_t i = 0; i < spawnArgs.nactions; ++i)
+    {
+        pedigree_spawn_action action = spawnArgs.actions[i];
+        if (!applySpawnAction(pParentSubsystem, pSubsystem, action))
+        {
+            SC_NOTICE(" -> file action " << i << " failed");
+
+            // The child never ran, so there's nobody to wait() for.
+            pProcess->setProcessGroup(0);
+            delete pProcess;
+            delete pRequest;
+            return -1;
+        }
+    }
+
+    size_t pid = pProcess->getId();
+
+    Thread *pThread = new Thread(pProcess, spawnLoader, pRequest);
+    pThread->detach();
+
+    SC_NOTICE(" -> " << pid << " [spawned]");
+    return pid;
+}
+
 /**
  * Class intended to be used for RAII to clean up waitpid state on exit.
  */
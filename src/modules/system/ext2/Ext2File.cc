@@ -43,6 +43,7 @@ Ext2File::Ext2File(
 
 Ext2File::~Ext2File()
 {
+    quiesce();
 }
 
 void Ext2File::preallocate(size_t expectedSize, bool zero)
@@ -88,6 +89,11 @@ void Ext2File::writeBlock(uint64_t location, uintptr_t addr)
     Ext2Node::writeBlock(location);
 }
 
+void Ext2File::writeExtent(uint64_t location, size_t nBlocks)
+{
+    Ext2Node::writeBlocks(location, nBlocks);
+}
+
 void Ext2File::pinBlock(uint64_t location)
 {
     Ext2Node::pinBlock(location);
@@ -55,6 +55,7 @@ class Ext2File : public File, public Ext2Node
 
     virtual uintptr_t readBlock(uint64_t location);
     virtual void writeBlock(uint64_t location, uintptr_t addr);
+    virtual void writeExtent(uint64_t location, size_t nBlocks);
 
     virtual void pinBlock(uint64_t location);
     virtual void unpinBlock(uint64_t location);
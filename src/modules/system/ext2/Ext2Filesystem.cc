@@ -572,6 +572,34 @@ void Ext2Filesystem::writeBlock(uint32_t block)
         static_cast<uint64_t>(m_BlockSize) * static_cast<uint64_t>(block));
 }
 
+void Ext2Filesystem::writeBlocks(const uint32_t *blocks, size_t nBlocks)
+{
+    Disk::IoSegment segments[EXT2_MAX_WRITE_SEGMENTS];
+    size_t nSegments = 0;
+    for (size_t i = 0; i < nBlocks; ++i)
+    {
+        // Block zero is the shared sparse block and is never written.
+        if (blocks[i] == 0)
+            continue;
+
+        segments[nSegments].location = static_cast<uint64_t>(m_BlockSize) *
+                                       static_cast<uint64_t>(blocks[i]);
+        segments[nSegments].length = m_BlockSize;
+        segments[nSegments].buffer = 0;
+
+        if (++nSegments == EXT2_MAX_WRITE_SEGMENTS)
+        {
+            m_pDisk->writeVectored(segments, nSegments);
+            nSegments = 0;
+        }
+    }
+
+    if (nSegments)
+    {
+        m_pDisk->writeVectored(segments, nSegments);
+    }
+}
+
 void Ext2Filesystem::pinBlock(uint64_t location)
 {
     m_pDisk->pin(static_cast<uint64_t>(m_BlockSize) * location);
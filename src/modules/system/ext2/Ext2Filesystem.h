@@ -25,6 +25,9 @@
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/String.h"
 
+/// Most blocks submitted to the disk in one vectored write.
+#define EXT2_MAX_WRITE_SEGMENTS 32
+
 class Disk;
 class File;
 struct GroupDesc;
@@ -77,6 +80,8 @@ class Ext2Filesystem : public Filesystem
     uintptr_t readBlock(uint32_t block);
     /** Writes a block of data to the disk. */
     void writeBlock(uint32_t block);
+    /** Writes a set of blocks to the disk as one vectored request. */
+    void writeBlocks(const uint32_t *blocks, size_t nBlocks);
 
     void pinBlock(uint64_t location);
     void unpinBlock(uint64_t location);
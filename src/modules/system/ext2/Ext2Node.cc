@@ -99,6 +99,22 @@ void Ext2Node::writeBlock(uint64_t location)
     m_pExt2Fs->writeBlock(m_Blocks[nBlock]);
 }
 
+void Ext2Node::writeBlocks(uint64_t location, size_t nBlocks)
+{
+    uint32_t nBlock = location / m_pExt2Fs->m_BlockSize;
+    if (nBlock >= m_Blocks.count())
+        return;
+    if ((nBlock + nBlocks) > m_Blocks.count())
+        nBlocks = m_Blocks.count() - nBlock;
+
+    for (size_t i = 0; i < nBlocks; ++i)
+    {
+        ensureBlockLoaded(nBlock + i);
+    }
+
+    m_pExt2Fs->writeBlocks(&m_Blocks[nBlock], nBlocks);
+}
+
 void Ext2Node::trackBlock(uint32_t block)
 {
     m_Blocks.pushBack(block);
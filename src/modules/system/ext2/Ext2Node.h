@@ -66,6 +66,8 @@ class Ext2Node
 
     uintptr_t readBlock(uint64_t location);
     void writeBlock(uint64_t location);
+    /** Writes back nBlocks consecutive file blocks in one disk request. */
+    void writeBlocks(uint64_t location, size_t nBlocks);
 
     void trackBlock(uint32_t block);
 
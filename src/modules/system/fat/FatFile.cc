@@ -19,6 +19,7 @@
 
 #include "FatFile.h"
 #include "FatFilesystem.h"
+#include "pedigree/kernel/LockGuard.h"
 
 FatFile::FatFile(
     String name, Time::Timestamp accessedTime, Time::Timestamp modifiedTime,
@@ -27,7 +28,9 @@ FatFile::FatFile(
     : File(
           name, accessedTime, modifiedTime, creationTime, inode, pFs, size,
           pParent),
-      m_DirClus(dirClus), m_DirOffset(dirOffset), m_FileBlockCache()
+      m_DirClus(dirClus), m_DirOffset(dirOffset), m_Extents(),
+      m_nExtentClusters(0), m_bExtentsValid(false), m_ExtentLock(false),
+      m_FileBlockCache()
 {
     m_FileBlockCache.setCallback(writeCallback, static_cast<File *>(this));
 
@@ -39,6 +42,7 @@ FatFile::FatFile(
 
 FatFile::~FatFile()
 {
+    quiesce();
 }
 
 uintptr_t FatFile::readBlock(uint64_t location)
@@ -95,3 +99,86 @@ void FatFile::extend(size_t newSize, uint64_t location, uint64_t size)
     // not using the hints at all
     extend(newSize);
 }
+
+bool FatFile::hasExtents()
+{
+    LockGuard<Mutex> guard(m_ExtentLock);
+    return m_bExtentsValid;
+}
+
+uint32_t FatFile::lookupCluster(uint32_t fileCluster, uint32_t *pContiguous)
+{
+    LockGuard<Mutex> guard(m_ExtentLock);
+    if (!m_bExtentsValid || fileCluster >= m_nExtentClusters)
+        return 0;
+
+    // Find the last run starting at or before fileCluster.
+    size_t lo = 0, hi = m_Extents.count();
+    while ((hi - lo) > 1)
+    {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (m_Extents[mid].fileCluster <= fileCluster)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const ClusterRun &run = m_Extents[lo];
+    uint32_t delta = fileCluster - run.fileCluster;
+    if (pContiguous)
+        *pContiguous = run.length - delta;
+    return run.diskCluster + delta;
+}
+
+void FatFile::appendCluster(uint32_t diskCluster)
+{
+    LockGuard<Mutex> guard(m_ExtentLock);
+    if (m_bExtentsValid)
+        appendClusterLocked(diskCluster);
+}
+
+void FatFile::setExtents(const Vector<uint32_t> &chain)
+{
+    LockGuard<Mutex> guard(m_ExtentLock);
+    m_Extents.clear();
+    m_nExtentClusters = 0;
+    for (size_t i = 0; i < chain.count(); ++i)
+        appendClusterLocked(chain[i]);
+    m_bExtentsValid = true;
+}
+
+void FatFile::invalidateExtents()
+{
+    LockGuard<Mutex> guard(m_ExtentLock);
+    m_Extents.clear(true);
+    m_nExtentClusters = 0;
+    m_bExtentsValid = false;
+}
+
+uint32_t FatFile::getExtentClusters()
+{
+    LockGuard<Mutex> guard(m_ExtentLock);
+    return m_bExtentsValid ? m_nExtentClusters : 0;
+}
+
+void FatFile::appendClusterLocked(uint32_t diskCluster)
+{
+    size_t n = m_Extents.count();
+    if (n)
+    {
+        ClusterRun &last = m_Extents[n - 1];
+        if ((last.diskCluster + last.length) == diskCluster)
+        {
+            ++last.length;
+            ++m_nExtentClusters;
+            return;
+        }
+    }
+
+    ClusterRun run;
+    run.fileCluster = m_nExtentClusters;
+    run.diskCluster = diskCluster;
+    run.length = 1;
+    m_Extents.pushBack(run);
+    ++m_nExtentClusters;
+}
@@ -21,10 +21,12 @@
 #define FAT_FILE_H
 
 #include "modules/system/vfs/File.h"
+#include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/time/Time.h"
 #include "pedigree/kernel/utilities/Cache.h"
 #include "pedigree/kernel/utilities/String.h"
+#include "pedigree/kernel/utilities/Vector.h"
 
 /** A File is a file, a directory or a symlink. */
 class FatFile : public File
@@ -73,10 +75,54 @@ class FatFile : public File
     virtual void pinBlock(uint64_t location);
     virtual void unpinBlock(uint64_t location);
 
+    /** Whether the extent map describes the file's whole cluster chain. */
+    bool hasExtents();
+
+    /** Maps a cluster index within the file to a cluster on disk, using the
+     * extent map. Returns zero if the map is invalid or too short. If
+     * pContiguous is given, it receives how many clusters (including the
+     * returned one) follow contiguously on disk. */
+    uint32_t lookupCluster(uint32_t fileCluster, uint32_t *pContiguous = 0);
+
+    /** Appends a cluster to the end of a valid extent map. */
+    void appendCluster(uint32_t diskCluster);
+
+    /** Replaces the extent map with the given chain, as walked by the
+     * filesystem. */
+    void setExtents(const Vector<uint32_t> &chain);
+
+    /** Discards the extent map; the next lookup rebuilds it. */
+    void invalidateExtents();
+
+    /** Number of clusters covered by the extent map. */
+    uint32_t getExtentClusters();
+
   private:
+    /** A run of clusters that are contiguous both in the file and on disk. */
+    struct ClusterRun
+    {
+        /** Index of the run's first cluster within the file. */
+        uint32_t fileCluster;
+        /** Cluster number of the run's first cluster on disk. */
+        uint32_t diskCluster;
+        /** Number of clusters in the run. */
+        uint32_t length;
+    };
+
+    void appendClusterLocked(uint32_t diskCluster);
+
     uint32_t m_DirClus;
     uint32_t m_DirOffset;
 
+    /** Cluster chain, as runs sorted by fileCluster. Built lazily by
+     * FatFilesystem and kept in step with extend/truncate/setCluster, so
+     * finding the cluster for an offset is a binary search rather than a
+     * walk of the FAT from the first cluster. */
+    Vector<ClusterRun> m_Extents;
+    uint32_t m_nExtentClusters;
+    bool m_bExtentsValid;
+    Mutex m_ExtentLock;
+
     Cache m_FileBlockCache;
 };
 
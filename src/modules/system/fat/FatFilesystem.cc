@@ -61,7 +61,8 @@ FatFilesystem::FatFilesystem()
     : m_Superblock(), m_Superblock16(), m_Superblock32(), m_FsInfo(),
       m_Type(FAT12), m_DataAreaStart(0), m_RootDirCount(0), m_FatSector(0),
       m_RootDir(), m_BlockSize(0), m_pFatCache(0), m_FatLock(), m_pRoot(0),
-      m_FatCache(), m_FreeClusterHint()
+      m_FatCache(), m_ClusterCount(0), m_ClusterBitmap(),
+      m_bClusterBitmapValid(false), m_ClusterBitmapLock(false)
 {
 }
 
@@ -216,11 +217,12 @@ bool FatFilesystem::initialise(Disk *pDisk)
     // Save the start sector of the FAT now
     m_FatSector = m_Superblock.BPB_RsvdSecCnt;
 
-    // Setup the free cluster hint for non-FAT32 volumes
-    m_FreeClusterHint = 2;
+    // Data clusters are numbered from 2.
+    m_ClusterCount = clusterCount + 2;
 
     // Define the root directory early
-    getRoot();
+    loadRootDir();
+    cacheVolumeLabel();
 
     return true;
 }
@@ -390,6 +392,25 @@ uint64_t FatFilesystem::read(
 
     uint64_t bytesRead = 0;
     uint64_t currOffset = firstOffset;
+    uint32_t clusIndex = clusOffset;
+
+    // Regular files resolve clusters through their extent map, which turns the
+    // walk from the first cluster into a binary search.
+    FatFile *pExtents = getExtentFile(pFile);
+    uint32_t contiguous = 0;
+    if (pExtents)
+    {
+        clus = pExtents->lookupCluster(clusIndex, &contiguous);
+        if (!clus)
+        {
+            WARNING(
+                "FAT: cluster offset " << clusOffset
+                                       << " is beyond the file's chain");
+            WARNING("    -> file: " << pFile->getFullPath());
+            return 0;
+        }
+        clusOffset = 0;
+    }
     while (clusOffset)
     {
         clus = getClusterEntry(clus);
@@ -414,18 +435,36 @@ uint64_t FatFilesystem::read(
     // main read loop
     while (true)
     {
-        // read in the entire cluster
-        readCluster(clus, reinterpret_cast<uintptr_t>(tmpBuffer));
-
-        // How many bytes should we copy?
         size_t bytesToCopy = finalSize - bytesRead;
-        if (bytesToCopy > m_BlockSize)
+        if ((currOffset == 0) && (contiguous > 1) &&
+            (bytesToCopy >= (2 * m_BlockSize)))
         {
-            bytesToCopy = m_BlockSize;
+            // Whole clusters that sit next to each other on disk can go
+            // straight into the caller's buffer in one go.
+            uint32_t nClusters = bytesToCopy / m_BlockSize;
+            if (nClusters > contiguous)
+                nClusters = contiguous;
+            bytesToCopy = nClusters * m_BlockSize;
+            readSectorBlock(
+                getSectorNumber(clus), bytesToCopy,
+                reinterpret_cast<uintptr_t>(&destBuffer[bytesRead]));
+            clusIndex += nClusters - 1;
         }
+        else
+        {
+            // read in the entire cluster
+            readCluster(clus, reinterpret_cast<uintptr_t>(tmpBuffer));
+
+            // How many bytes should we copy?
+            if (bytesToCopy > (m_BlockSize - currOffset))
+            {
+                bytesToCopy = m_BlockSize - currOffset;
+            }
 
-        // Perform the copy.
-        MemoryCopy(&destBuffer[bytesRead], &tmpBuffer[currOffset], bytesToCopy);
+            // Perform the copy.
+            MemoryCopy(
+                &destBuffer[bytesRead], &tmpBuffer[currOffset], bytesToCopy);
+        }
         bytesRead += bytesToCopy;
 
         // Done?
@@ -439,7 +478,14 @@ uint64_t FatFilesystem::read(
         currOffset = 0;
 
         // grab the next cluster, check for EOF
-        clus = getClusterEntry(clus);
+        if (pExtents)
+        {
+            clus = pExtents->lookupCluster(++clusIndex, &contiguous);
+        }
+        else
+        {
+            clus = getClusterEntry(clus);
+        }
         if (clus == 0)
             break;  // something broke!
 
@@ -458,40 +504,116 @@ uint64_t FatFilesystem::read(
 
 uint32_t FatFilesystem::findFreeCluster(bool bLock)
 {
-    size_t j;
-    uint32_t clus;
-    uint32_t totalSectors = m_Superblock.BPB_TotSec32;
-    if (totalSectors == 0)
+    m_ClusterBitmapLock.acquire();
+    if (!m_bClusterBitmapValid)
     {
-        if (m_Type != FAT32)
-            totalSectors = m_Superblock.BPB_TotSec16;
-        else
+        buildClusterBitmap();
+    }
+
+    uint32_t clus = m_ClusterBitmap.getFirstClear();
+    if (clus >= m_ClusterCount)
+    {
+        m_ClusterBitmapLock.release();
+        WARNING("FAT: no free clusters left on the volume");
+        return 0;
+    }
+
+    // Claim it before dropping the lock so nobody else can.
+    m_ClusterBitmap.set(clus);
+    m_ClusterBitmapLock.release();
+
+    /// \todo For FAT32, update the FSInfo structure
+    setClusterEntry(
+        clus, eofValue(),
+        false);  // default to it being EOF - ie, pin the cluster
+
+    return clus;
+}
+
+void FatFilesystem::buildClusterBitmap()
+{
+    // Marking the bit past the last cluster first sizes the bitmap in one
+    // allocation, and means getFirstClear() stops there on a full volume.
+    m_ClusterBitmap.set(m_ClusterCount);
+    m_ClusterBitmap.set(0);
+    m_ClusterBitmap.set(1);
+
+    // Read the FAT in large chunks rather than an entry at a time. A FAT12
+    // FAT always fits in the first chunk, so its 1.5-byte entries never
+    // straddle a chunk boundary.
+    const size_t chunkSectors = 64;
+    const size_t chunkSize = chunkSectors * m_Superblock.BPB_BytsPerSec;
+    uint8_t *chunk = new uint8_t[chunkSize];
+    size_t loadedChunk = ~0UL;
+
+    size_t nUsed = 0;
+    for (uint32_t clus = 2; clus < m_ClusterCount; ++clus)
+    {
+        size_t fatOffset = 0;
+        switch (m_Type)
         {
-            return 0;
+            case FAT12:
+                fatOffset = clus + (clus / 2);
+                break;
+
+            case FAT16:
+                fatOffset = clus * 2;
+                break;
+
+            case FAT32:
+                fatOffset = clus * 4;
+                break;
         }
-    }
 
-    uint32_t mask = m_Type == FAT32 ? 0x0FFFFFFF : 0xFFFF;
+        size_t chunkIndex = fatOffset / chunkSize;
+        if (chunkIndex != loadedChunk)
+        {
+            if (!readSectorBlock(
+                    m_FatSector + (chunkIndex * chunkSectors), chunkSize,
+                    reinterpret_cast<uintptr_t>(chunk)))
+            {
+                ERROR("FAT: reading the FAT for the cluster bitmap failed");
+                ByteSet(chunk, 0xFF, chunkSize);
+            }
+            loadedChunk = chunkIndex;
+        }
 
-    for (j = (m_Type == FAT32 ? m_FsInfo.FSI_NxtFree : m_FreeClusterHint);
-         j < (totalSectors / m_Superblock.BPB_SecPerClus); j++)
-    {
-        clus = getClusterEntry(j, false);
-        if ((clus & mask) == 0)
+        uint8_t *p = &chunk[fatOffset % chunkSize];
+        uint32_t entry = 0;
+        switch (m_Type)
+        {
+            case FAT12:
+                entry = p[0] | (p[1] << 8);
+                if (clus & 0x1)
+                    entry >>= 4;
+                else
+                    entry &= 0x0FFF;
+                break;
+
+            case FAT16:
+                entry = p[0] | (p[1] << 8);
+                break;
+
+            case FAT32:
+                entry = (p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24)) &
+                        0x0FFFFFFF;
+                break;
+        }
+
+        if (entry)
         {
-            /// \todo For FAT32, update the FSInfo structure
-            setClusterEntry(
-                j, eofValue(),
-                false);  // default to it being EOF - ie, pin the cluster
-
-            // All done!
-            m_FreeClusterHint = j + 1;
-            return j;
+            m_ClusterBitmap.set(clus);
+            ++nUsed;
         }
     }
 
-    FATAL("findFreeCluster returning zero!");
-    return 0;
+    delete[] chunk;
+
+    m_bClusterBitmapValid = true;
+
+    NOTICE(
+        "FAT: " << Dec << nUsed << " of " << (m_ClusterCount - 2)
+                << " clusters in use" << Hex);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -542,6 +664,8 @@ uint64_t FatFilesystem::write(
         setCluster(pFile, freeClus);
     }
 
+    FatFile *pExtents = getExtentFile(pFile);
+
     uint32_t clusSize =
         m_Superblock.BPB_SecPerClus * m_Superblock.BPB_BytsPerSec;
     uint32_t finalOffset = location + size;
@@ -570,14 +694,7 @@ uint64_t FatFilesystem::write(
         if (numExtraBytes % i)
             j++;
 
-        clus = firstClus;
-
-        uint32_t lastClus = clus;
-        while (!isEof(clus))
-        {
-            lastClus = clus;
-            clus = getClusterEntry(clus, false);
-        }
+        uint32_t lastClus = findLastCluster(pFile, firstClus);
 
         uint32_t prev = 0;
         for (i = 0; i < j; i++)
@@ -591,6 +708,8 @@ uint64_t FatFilesystem::write(
             }
 
             setClusterEntry(prev, lastClus, false);
+            if (pExtents)
+                pExtents->appendCluster(lastClus);
         }
 
         setClusterEntry(lastClus, eofValue(), false);
@@ -614,7 +733,15 @@ uint64_t FatFilesystem::write(
 
     uint64_t bytesWritten = 0;
     uint64_t currOffset = firstOffset;
+    uint32_t clusIndex = clusOffset;
     clus = firstClus;
+    if (pExtents)
+    {
+        clus = pExtents->lookupCluster(clusIndex);
+        if (!clus)
+            return 0;
+        clusOffset = 0;
+    }
     for (uint32_t z = 0; z < clusOffset; z++)
     {
         clus = getClusterEntry(clus, false);
@@ -658,7 +785,12 @@ uint64_t FatFilesystem::write(
         currOffset = 0;
 
         // Grab next cluster ready for further writing.
-        clus = getClusterEntry(clus, false);
+        if (bytesWritten >= finalSize)
+            break;
+        if (pExtents)
+            clus = pExtents->lookupCluster(++clusIndex);
+        else
+            clus = getClusterEntry(clus, false);
         if (clus == 0)
             break;
 
@@ -716,6 +848,10 @@ void FatFilesystem::setCluster(File *pFile, uint32_t clus)
     if (clus == 0)
         return;
 
+    // The chain now starts elsewhere, so the extent map no longer applies.
+    if (!pFile->isDirectory() && !pFile->isSymlink())
+        static_cast<FatFile *>(pFile)->invalidateExtents();
+
     uint32_t dirClus = static_cast<FatFile *>(pFile)->getDirCluster();
     uint32_t dirOffset = static_cast<FatFile *>(pFile)->getDirOffset();
 
@@ -729,6 +865,58 @@ void FatFilesystem::setCluster(File *pFile, uint32_t clus)
     delete p;
 }
 
+FatFile *FatFilesystem::getExtentFile(File *pFile)
+{
+    // Only regular files carry an extent map.
+    if (pFile->isDirectory() || pFile->isSymlink())
+        return 0;
+
+    FatFile *pFatFile = static_cast<FatFile *>(pFile);
+    if (pFatFile->hasExtents())
+        return pFatFile;
+
+    uint32_t clus = pFile->getInode();
+    if (clus == 0)
+        return 0;
+
+    // Walk the chain once; every later lookup is served from the map.
+    Vector<uint32_t> chain;
+    while (!isEof(clus))
+    {
+        if (clus < 2 || clus >= m_ClusterCount ||
+            chain.count() >= m_ClusterCount)
+        {
+            WARNING(
+                "FAT: broken cluster chain for " << pFile->getFullPath()
+                                                 << " at cluster " << clus);
+            return 0;
+        }
+
+        chain.pushBack(clus);
+        clus = getClusterEntry(clus);
+    }
+
+    pFatFile->setExtents(chain);
+    return pFatFile;
+}
+
+uint32_t FatFilesystem::findLastCluster(File *pFile, uint32_t firstClus)
+{
+    FatFile *pExtents = getExtentFile(pFile);
+    if (pExtents && pExtents->getExtentClusters())
+        return pExtents->lookupCluster(pExtents->getExtentClusters() - 1);
+
+    uint32_t clus = firstClus;
+    uint32_t lastClus = clus;
+    while (!isEof(clus))
+    {
+        lastClus = clus;
+        clus = getClusterEntry(clus, false);
+    }
+
+    return lastClus;
+}
+
 void *FatFilesystem::readDirectoryPortion(uint32_t clus) const
 {
     uint32_t dirClus = clus;
@@ -1018,6 +1206,8 @@ FatFilesystem::setClusterEntry(uint32_t cluster, uint32_t value, bool bLock)
         return 0;
     }
 
+    bool bFree = (value == 0);
+
     uint32_t fatOffset = 0;
     switch (m_Type)
     {
@@ -1128,6 +1318,17 @@ FatFilesystem::setClusterEntry(uint32_t cluster, uint32_t value, bool bLock)
     // All done with the update
     m_FatLock.release();
 
+    // Keep the free-cluster bitmap in step with the FAT.
+    m_ClusterBitmapLock.acquire();
+    if (m_bClusterBitmapValid)
+    {
+        if (bFree)
+            m_ClusterBitmap.clear(cluster);
+        else
+            m_ClusterBitmap.set(cluster);
+    }
+    m_ClusterBitmapLock.release();
+
 ///\todo
 // delete [] fatBlocks;
 
@@ -1303,6 +1504,14 @@ void FatFilesystem::truncate(File *pFile)
             }
             setClusterEntry(prev, 0, true);
         }
+
+        // Only the first cluster remains in the chain.
+        if (!pFile->isDirectory() && !pFile->isSymlink())
+        {
+            Vector<uint32_t> chain;
+            chain.pushBack(pFile->getInode());
+            static_cast<FatFile *>(pFile)->setExtents(chain);
+        }
     }
 }
 
@@ -1347,7 +1556,6 @@ void FatFilesystem::extend(File *pFile, size_t size)
     }
 
     uint32_t finalOffset = size;
-    uint32_t clus = 0;
 
     // Figure out how many (if any) additional clusters we need to link in now.
     int i = clusSize;
@@ -1369,14 +1577,8 @@ void FatFilesystem::extend(File *pFile, size_t size)
         if (numExtraBytes % i)
             j++;
 
-        clus = firstClus;
-
-        uint32_t lastClus = clus;
-        while (!isEof(clus))
-        {
-            lastClus = clus;
-            clus = getClusterEntry(clus, false);
-        }
+        FatFile *pExtents = getExtentFile(pFile);
+        uint32_t lastClus = findLastCluster(pFile, firstClus);
 
         uint32_t prev = 0;
         for (i = 0; i < j; i++)
@@ -1390,6 +1592,8 @@ void FatFilesystem::extend(File *pFile, size_t size)
             }
 
             setClusterEntry(prev, lastClus, false);
+            if (pExtents)
+                pExtents->appendCluster(lastClus);
         }
 
         // Final cluster must always point to EOF.
@@ -1567,6 +1771,9 @@ bool FatFilesystem::remove(File *parent, File *file)
 
     // LockGuard<Mutex> guard(m_FatLock);
 
+    if (!file->isDirectory() && !file->isSymlink())
+        static_cast<FatFile *>(file)->invalidateExtents();
+
     // Then, clean up the cluster chain
     uint32_t clus = file->getInode();
     if (clus != 0)
@@ -1592,6 +1799,7 @@ bool FatFilesystem::remove(File *parent, File *file)
     return true;
 }
 
+#ifndef FAT_STANDALONE
 static bool initFat()
 {
     VFS::instance().addProbeCallback(&FatFilesystem::probe);
@@ -1603,3 +1811,4 @@ static void destroyFat()
 }
 
 MODULE_INFO("fat", &initFat, &destroyFat, "vfs");
+#endif
@@ -25,6 +25,7 @@
 #include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/utilities/Cache.h"
+#include "pedigree/kernel/utilities/ExtensibleBitmap.h"
 #include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/Tree.h"
 #include "pedigree/kernel/utilities/UnlikelyLock.h"
@@ -115,6 +116,17 @@ class FatFilesystem : public Filesystem
      * function that has already locked the FAT */
     uint32_t findFreeCluster(bool bLock = false);
 
+    /** Reads the whole FAT once to build the free-cluster bitmap. */
+    void buildClusterBitmap();
+
+    /** Returns pFile as a FatFile with a valid extent map, building the map
+     * from the FAT if needed. Returns null for directories, symlinks and
+     * files without a usable chain. */
+    FatFile *getExtentFile(File *pFile);
+
+    /** Finds the last cluster in the chain of the given file. */
+    uint32_t findLastCluster(File *pFile, uint32_t firstClus);
+
     /** Updates the size of a file on disk */
     void updateFileSize(File *pFile, int64_t sizeChange);
 
@@ -256,11 +268,17 @@ class FatFilesystem : public Filesystem
     // Cache<uint8_t*, 512> m_FatCache;
     Tree<uintptr_t, uintptr_t> m_FatCache;
 
+    /** One past the highest valid cluster number. */
+    uint32_t m_ClusterCount;
+
     /**
-     * Hint for the free cluster code, to avoid searching the ENTIRE FAT each
-     * time someone wants a free cluster (on non-FAT32 volumes).
+     * Allocated clusters, one bit each, so findFreeCluster doesn't have to
+     * search the FAT. Built on first use and kept in step by
+     * setClusterEntry.
      */
-    uint32_t m_FreeClusterHint;
+    ExtensibleBitmap m_ClusterBitmap;
+    bool m_bClusterBitmapValid;
+    Mutex m_ClusterBitmapLock;
 
     /** Cached volume label for the filesystem. */
     String m_VolumeLabel;
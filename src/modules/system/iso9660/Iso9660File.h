@@ -52,6 +52,7 @@ class Iso9660File : public File
     }
     virtual ~Iso9660File()
     {
+        quiesce();
     }
 
     inline Iso9660DirRecord &getDirRecord()
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LWIP_ARCH_MEMP_CACHE_H
+#define LWIP_ARCH_MEMP_CACHE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Backend for lwIP's memp pools when MEMP_PEDIGREE_POOLS is set.
+ *
+ * Each memp type gets a cache of page-sized slabs taken from a shared
+ * MemoryPool, fronted by a small per-CPU stack of free objects so that the
+ * common allocate/free pair touches no lock. Slabs that become entirely free
+ * are kept for reuse until memory pressure (or memp_cache_trim) hands them
+ * back to the page pool.
+ */
+
+struct memp_desc;
+
+/** Per-type state hung off each memp_desc; opaque outside memp_cache.cc. */
+struct memp_cache
+{
+    void *impl;
+};
+
+/** Snapshot of one memp type's cache. */
+struct memp_cache_stats
+{
+    /** memp type name, e.g. "TCP_SEG"; "custom" for private pools. */
+    const char *name;
+    /** Bytes per object, including any memp header. */
+    size_t object_size;
+    /** Objects carved from each slab. */
+    size_t objects_per_slab;
+    /** Slabs currently held, including wholly free ones. */
+    size_t slabs;
+    /** Slabs held that have no objects in use. */
+    size_t empty_slabs;
+    /** Objects handed out and not yet returned. */
+    size_t in_use;
+    /** Allocations, and how many of them the per-CPU cache satisfied. */
+    size_t allocations;
+    size_t cache_hits;
+    /** Batches moved from slabs into a per-CPU cache, and back. */
+    size_t refills;
+    size_t flushes;
+    /** Allocations that failed because no page was available. */
+    size_t failures;
+    /** Slabs handed back to the page pool by trimming. */
+    size_t trimmed;
+};
+
+void memp_cache_init(const struct memp_desc *desc, size_t object_size);
+void *memp_cache_alloc(const struct memp_desc *desc);
+void memp_cache_free(const struct memp_desc *desc, void *mem);
+
+/**
+ * Fills \p stats with up to \p max entries, one per initialised memp type.
+ * \return the number of entries written.
+ */
+size_t memp_cache_statistics(struct memp_cache_stats *stats, size_t max);
+
+/**
+ * Returns wholly free slabs from every cache to the page pool, and releases
+ * the pool's unused pages. Objects held in per-CPU caches are left alone.
+ * \return the number of slabs returned.
+ */
+size_t memp_cache_trim(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LWIP_ARCH_MEMP_CACHE_H
@@ -29,6 +29,13 @@
 #define MEM_LIBC_MALLOC 1
 #define MEMP_MEM_MALLOC 1
 
+// memp objects come from per-type slab caches with per-CPU fronts (see
+// lwip/arch/memp_cache.h) rather than straight from the heap. Define as 0 to
+// go back to mem_malloc for every pbuf, segment and message.
+#ifndef MEMP_PEDIGREE_POOLS
+#define MEMP_PEDIGREE_POOLS 1
+#endif
+
 /// \todo should be architecture specific
 #define MEM_ALIGNMENT 8
 
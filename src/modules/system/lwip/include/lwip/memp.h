@@ -87,9 +87,11 @@ extern const struct memp_desc* const memp_pools[MEMP_MAX];
 
 #define LWIP_MEMPOOL_DECLARE(name,num,size,desc) \
   LWIP_MEMPOOL_DECLARE_STATS_INSTANCE(memp_stats_ ## name) \
+  LWIP_MEMPOOL_DECLARE_CACHE_INSTANCE(memp_cache_ ## name) \
   const struct memp_desc memp_ ## name = { \
     DECLARE_LWIP_MEMPOOL_DESC(desc) \
     LWIP_MEMPOOL_DECLARE_STATS_REFERENCE(memp_stats_ ## name) \
+    LWIP_MEMPOOL_DECLARE_CACHE_REFERENCE(memp_cache_ ## name) \
     LWIP_MEM_ALIGN_SIZE(size) \
   };
 
@@ -65,6 +65,10 @@ extern "C" {
 
 #include "lwip/mem.h"
 
+#if MEMP_MEM_MALLOC && MEMP_PEDIGREE_POOLS
+#include "lwip/arch/memp_cache.h"
+#endif
+
 #if MEMP_OVERFLOW_CHECK
 /* if MEMP_OVERFLOW_CHECK is turned on, we reserve some bytes at the beginning
  * and at the end of each element, initialize them as 0xcd and check
@@ -155,6 +159,10 @@ struct memp_desc {
   /** Statistics */
   struct stats_mem *stats;
 #endif
+#if MEMP_MEM_MALLOC && MEMP_PEDIGREE_POOLS
+  /** Backing cache, set up by memp_init_pool */
+  struct memp_cache *cache;
+#endif
 
   /** Element size */
   u16_t size;
@@ -185,6 +193,14 @@ struct memp_desc {
 #define LWIP_MEMPOOL_DECLARE_STATS_REFERENCE(name)
 #endif
 
+#if MEMP_MEM_MALLOC && MEMP_PEDIGREE_POOLS
+#define LWIP_MEMPOOL_DECLARE_CACHE_INSTANCE(name) static struct memp_cache name;
+#define LWIP_MEMPOOL_DECLARE_CACHE_REFERENCE(name) &name,
+#else
+#define LWIP_MEMPOOL_DECLARE_CACHE_INSTANCE(name)
+#define LWIP_MEMPOOL_DECLARE_CACHE_REFERENCE(name)
+#endif
+
 void memp_init_pool(const struct memp_desc *desc);
 
 #if MEMP_OVERFLOW_CHECK
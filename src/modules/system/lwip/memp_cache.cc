@@ -0,0 +1,757 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <lwip/opt.h>
+
+#include <lwip/mem.h>
+#include <lwip/memp.h>
+
+#if MEMP_MEM_MALLOC && MEMP_PEDIGREE_POOLS
+
+#include <lwip/arch/memp_cache.h>
+
+#include <pedigree/kernel/LockGuard.h>
+#include <pedigree/kernel/Log.h>
+#include <pedigree/kernel/Spinlock.h>
+#include <pedigree/kernel/processor/Processor.h>
+#include <pedigree/kernel/utilities/MemoryPool.h>
+#include <pedigree/kernel/utilities/utility.h>
+
+/// Free objects each CPU keeps for itself, per memp type.
+#define MEMP_CACHE_DEPTH 32
+/// Objects moved between a CPU's cache and the slabs at a time.
+#define MEMP_CACHE_BATCH 16
+/// Free objects' worth of wholly free slabs a cache keeps before returning
+/// them to the page pool; at least MEMP_CACHE_MIN_SPARE_SLABS are kept.
+#define MEMP_CACHE_SPARE_OBJECTS 256
+#define MEMP_CACHE_MIN_SPARE_SLABS 4
+/// Slabs are single pages from the page pool.
+#define MEMP_SLAB_SIZE 4096
+/// Pages of address space reserved for slabs; populated as they're used.
+#define MEMP_CACHE_POOL_PAGES 8192
+
+#ifdef UTILITY_LINUX
+/// Hosted builds have no CPUs to pin to; threads claim a slot each instead.
+#define MEMP_CACHE_SLOTS 64
+#elif defined(MULTIPROCESSOR)
+///\todo MAX_CPUS
+#define MEMP_CACHE_SLOTS 255
+#else
+#define MEMP_CACHE_SLOTS 1
+#endif
+
+/// Returned by cacheSlot() when the caller can't use a per-CPU cache.
+#define MEMP_NO_SLOT (~0UL)
+
+static const char *const g_MempNames[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include <lwip/priv/memp_std.h>
+};
+
+#ifdef UTILITY_LINUX
+namespace
+{
+/// Gives each thread a per-CPU cache slot of its own for its lifetime. Once
+/// every slot is taken, further threads go straight to the slabs.
+class ThreadSlot
+{
+  public:
+    ThreadSlot() : m_Slot(MEMP_NO_SLOT)
+    {
+        for (size_t i = 0; i < MEMP_CACHE_SLOTS; ++i)
+        {
+            bool expected = false;
+            if (__atomic_compare_exchange_n(
+                    &m_SlotsInUse[i], &expected, true, false, __ATOMIC_ACQUIRE,
+                    __ATOMIC_RELAXED))
+            {
+                m_Slot = i;
+                break;
+            }
+        }
+    }
+
+    ~ThreadSlot()
+    {
+        // Objects left in the slot's caches pass to its next owner.
+        if (m_Slot != MEMP_NO_SLOT)
+        {
+            __atomic_store_n(&m_SlotsInUse[m_Slot], false, __ATOMIC_RELEASE);
+        }
+    }
+
+    size_t slot() const
+    {
+        return m_Slot;
+    }
+
+  private:
+    size_t m_Slot;
+
+    static bool m_SlotsInUse[MEMP_CACHE_SLOTS];
+};
+
+bool ThreadSlot::m_SlotsInUse[MEMP_CACHE_SLOTS];
+}  // namespace
+#endif
+
+/// Prevents migration to another CPU (or re-entry from an interrupt handler)
+/// while using this CPU's cache. Returns the previous interrupt state.
+static inline bool enterCpuCache()
+{
+#ifdef UTILITY_LINUX
+    return false;
+#else
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+    return bInterrupts;
+#endif
+}
+
+static inline void leaveCpuCache(bool bInterrupts)
+{
+#ifndef UTILITY_LINUX
+    if (bInterrupts)
+    {
+        Processor::setInterrupts(true);
+    }
+#endif
+}
+
+/// Gets the index of the calling CPU's caches.
+static inline size_t cacheSlot()
+{
+#ifdef UTILITY_LINUX
+    static thread_local ThreadSlot slot;
+    return slot.slot();
+#elif defined(MULTIPROCESSOR)
+    return Processor::id();
+#else
+    return 0;
+#endif
+}
+
+/// Pages backing every memp slab.
+static MemoryPool g_MempPages("lwip-memp");
+
+/**
+ * Slab header, at the start of the page it describes. Objects follow it;
+ * free ones are chained through their first word.
+ */
+struct MempSlab
+{
+    MempSlab *pNext;
+    MempSlab *pPrev;
+    void *pFree;
+    size_t nInUse;
+};
+
+/// Objects start at this offset into each slab.
+#define MEMP_SLAB_HEADER 64
+
+/** One CPU's stack of free objects, plus counters only it writes. */
+struct MempCpuCache
+{
+    size_t count;
+    void *objects[MEMP_CACHE_DEPTH];
+
+    size_t allocations;
+    size_t frees;
+    size_t hits;
+    size_t refills;
+    size_t flushes;
+};
+
+/**
+ * Slab cache for one memp type. Allocation and free go to the calling CPU's
+ * cache first; it is refilled from, and flushed to, the slabs in batches
+ * under a lock.
+ */
+class MempCache
+{
+  public:
+    MempCache(const char *name, size_t objectSize);
+    ~MempCache();
+
+    void *allocate();
+    void free(void *mem);
+
+    /** Returns all wholly free slabs to the page pool. */
+    size_t trim();
+
+    void getStatistics(struct memp_cache_stats &stats);
+
+    /// All caches, for statistics and trimming.
+    MempCache *m_pNextCache;
+
+  private:
+    NOT_COPYABLE_OR_ASSIGNABLE(MempCache);
+
+    MempCpuCache *cpuCache(size_t slot);
+
+    /** Takes up to \p max objects from the slabs. Lock must be held. */
+    size_t take(void **objects, size_t max);
+
+    /**
+     * Puts objects back into their slabs. Lock must be held. Slabs beyond
+     * the spare allowance that become free are chained onto \p pSurplus.
+     */
+    void put(void *const *objects, size_t count, MempSlab *&pSurplus);
+
+    /** Adds a fresh slab. */
+    bool grow();
+
+    /** Returns a chain of slabs to the page pool. Lock must not be held. */
+    void release(MempSlab *pSlabs);
+
+    static void unlink(MempSlab *pSlab, MempSlab *&pList);
+    static void link(MempSlab *pSlab, MempSlab *&pList);
+
+    static MempSlab *slabOf(void *mem)
+    {
+        return reinterpret_cast<MempSlab *>(
+            reinterpret_cast<uintptr_t>(mem) & ~(MEMP_SLAB_SIZE - 1));
+    }
+
+    const char *m_Name;
+    size_t m_ObjectSize;
+    size_t m_ObjectsPerSlab;
+    size_t m_SpareSlabs;
+
+    Spinlock m_Lock;
+    /// Slabs with some objects in use and some free.
+    MempSlab *m_pPartial;
+    /// Slabs with no objects in use.
+    MempSlab *m_pEmpty;
+    size_t m_nEmpty;
+    size_t m_nSlabs;
+
+    MempCpuCache *m_pCpuCaches[MEMP_CACHE_SLOTS];
+
+    /// Counters for callers without a per-CPU cache, and for slab traffic.
+    size_t m_Allocations;
+    size_t m_Frees;
+    size_t m_Failures;
+    size_t m_Trimmed;
+};
+
+/// Every cache, newest first. Caches are never destroyed, so the list can
+/// be walked without a lock once its head has been read.
+static MempCache *g_pCaches = nullptr;
+static Spinlock g_CachesLock(false);
+
+/** Returns every cache's spare slabs to the page pool. */
+static size_t trimCaches()
+{
+    size_t n = 0;
+    for (MempCache *pCache = __atomic_load_n(&g_pCaches, __ATOMIC_ACQUIRE);
+         pCache; pCache = pCache->m_pNextCache)
+    {
+        n += pCache->trim();
+    }
+
+    return n;
+}
+
+#ifndef STANDALONE_MEMPOOL
+/**
+ * Empties the memp caches' spare slabs back into the page pool before the
+ * pool itself releases its unused pages.
+ */
+class MempCachePressureHandler : public MemoryPoolPressureHandler
+{
+  public:
+    MempCachePressureHandler() : MemoryPoolPressureHandler(&g_MempPages)
+    {
+    }
+
+    virtual const String getMemoryPressureDescription()
+    {
+        return String("lwIP memp caches: freeing spare slabs");
+    }
+
+    virtual bool compact()
+    {
+        size_t nSlabs = trimCaches();
+        return MemoryPoolPressureHandler::compact() || nSlabs;
+    }
+};
+
+static MempCachePressureHandler g_PressureHandler;
+#endif
+
+static void initialisePages()
+{
+    static bool bInitialised = false;
+    if (__atomic_load_n(&bInitialised, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    // MemoryPool::initialise is itself safe to race; only the first caller
+    // through here registers for memory pressure.
+    if (!g_MempPages.initialise(MEMP_CACHE_POOL_PAGES, MEMP_SLAB_SIZE))
+    {
+        FATAL("lwIP: couldn't set up the memp page pool");
+    }
+
+    if (!__atomic_exchange_n(&bInitialised, true, __ATOMIC_ACQ_REL))
+    {
+#ifndef STANDALONE_MEMPOOL
+        MemoryPressureManager::instance().registerHandler(
+            MemoryPressureManager::HighestPriority, &g_PressureHandler);
+#endif
+    }
+}
+
+MempCache::MempCache(const char *name, size_t objectSize)
+    : m_pNextCache(nullptr), m_Name(name), m_ObjectSize(objectSize),
+      m_ObjectsPerSlab(0), m_SpareSlabs(MEMP_CACHE_MIN_SPARE_SLABS),
+      m_Lock(false), m_pPartial(nullptr),
+      m_pEmpty(nullptr), m_nEmpty(0), m_nSlabs(0), m_pCpuCaches(),
+      m_Allocations(0), m_Frees(0), m_Failures(0), m_Trimmed(0)
+{
+    if (m_ObjectSize < sizeof(void *))
+    {
+        m_ObjectSize = sizeof(void *);
+    }
+
+    // Types too large for a slab stay on the heap.
+    m_ObjectsPerSlab = (MEMP_SLAB_SIZE - MEMP_SLAB_HEADER) / m_ObjectSize;
+    if (m_ObjectsPerSlab &&
+        (MEMP_CACHE_SPARE_OBJECTS / m_ObjectsPerSlab) > m_SpareSlabs)
+    {
+        // Otherwise large types would give pages back and take them again
+        // on every swing between a producer and a consumer.
+        m_SpareSlabs = MEMP_CACHE_SPARE_OBJECTS / m_ObjectsPerSlab;
+    }
+}
+
+MempCache::~MempCache()
+{
+    for (size_t i = 0; i < MEMP_CACHE_SLOTS; ++i)
+    {
+        delete m_pCpuCaches[i];
+    }
+}
+
+MempCpuCache *MempCache::cpuCache(size_t slot)
+{
+    if (slot == MEMP_NO_SLOT)
+    {
+        return nullptr;
+    }
+
+    MempCpuCache *pCpu = m_pCpuCaches[slot];
+    if (UNLIKELY(!pCpu))
+    {
+        // Only this CPU ever touches its slot, so no lock is needed.
+        pCpu = new MempCpuCache;
+        ByteSet(pCpu, 0, sizeof(*pCpu));
+        m_pCpuCaches[slot] = pCpu;
+    }
+
+    return pCpu;
+}
+
+void *MempCache::allocate()
+{
+    if (UNLIKELY(!m_ObjectsPerSlab))
+    {
+        return mem_malloc(m_ObjectSize);
+    }
+
+    while (true)
+    {
+        bool bInterrupts = enterCpuCache();
+
+        MempCpuCache *pCpu = cpuCache(cacheSlot());
+        if (LIKELY(pCpu))
+        {
+            if (LIKELY(pCpu->count))
+            {
+                ++pCpu->hits;
+            }
+            else
+            {
+                LockGuard<Spinlock> guard(m_Lock);
+                pCpu->count = take(pCpu->objects, MEMP_CACHE_BATCH);
+                if (pCpu->count)
+                {
+                    ++pCpu->refills;
+                }
+            }
+
+            if (pCpu->count)
+            {
+                ++pCpu->allocations;
+                void *result = pCpu->objects[--pCpu->count];
+                leaveCpuCache(bInterrupts);
+                return result;
+            }
+        }
+        else
+        {
+            void *result = nullptr;
+            {
+                LockGuard<Spinlock> guard(m_Lock);
+                if (take(&result, 1))
+                {
+                    ++m_Allocations;
+                }
+            }
+
+            if (result)
+            {
+                leaveCpuCache(bInterrupts);
+                return result;
+            }
+        }
+
+        leaveCpuCache(bInterrupts);
+
+        // Out of objects; the page pool may block, so this happens with the
+        // CPU cache released. Another CPU may beat us to the new slab, in
+        // which case we go around again.
+        if (!grow())
+        {
+            __atomic_add_fetch(&m_Failures, 1, __ATOMIC_RELAXED);
+            return nullptr;
+        }
+    }
+}
+
+void MempCache::free(void *mem)
+{
+    if (UNLIKELY(!m_ObjectsPerSlab))
+    {
+        mem_free(mem);
+        return;
+    }
+
+    MempSlab *pSurplus = nullptr;
+
+    bool bInterrupts = enterCpuCache();
+
+    MempCpuCache *pCpu = cpuCache(cacheSlot());
+    if (LIKELY(pCpu))
+    {
+        if (UNLIKELY(pCpu->count == MEMP_CACHE_DEPTH))
+        {
+            // Hand the older half back so the next few frees stay local.
+            LockGuard<Spinlock> guard(m_Lock);
+            put(pCpu->objects, MEMP_CACHE_BATCH, pSurplus);
+            MemoryCopy(
+                pCpu->objects, pCpu->objects + MEMP_CACHE_BATCH,
+                (MEMP_CACHE_DEPTH - MEMP_CACHE_BATCH) * sizeof(void *));
+            pCpu->count -= MEMP_CACHE_BATCH;
+            ++pCpu->flushes;
+        }
+
+        pCpu->objects[pCpu->count++] = mem;
+        ++pCpu->frees;
+    }
+    else
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        put(&mem, 1, pSurplus);
+        ++m_Frees;
+    }
+
+    leaveCpuCache(bInterrupts);
+
+    if (UNLIKELY(pSurplus))
+    {
+        release(pSurplus);
+    }
+}
+
+size_t MempCache::take(void **objects, size_t max)
+{
+    size_t n = 0;
+    while (n < max)
+    {
+        MempSlab *pSlab = m_pPartial;
+        if (!pSlab)
+        {
+            pSlab = m_pEmpty;
+            if (!pSlab)
+            {
+                break;
+            }
+
+            unlink(pSlab, m_pEmpty);
+            link(pSlab, m_pPartial);
+            --m_nEmpty;
+        }
+
+        while (n < max && pSlab->pFree)
+        {
+            void *object = pSlab->pFree;
+            pSlab->pFree = *reinterpret_cast<void **>(object);
+            ++pSlab->nInUse;
+            objects[n++] = object;
+        }
+
+        if (!pSlab->pFree)
+        {
+            // Full slabs sit on no list until something is freed into them.
+            unlink(pSlab, m_pPartial);
+        }
+    }
+
+    return n;
+}
+
+void MempCache::put(void *const *objects, size_t count, MempSlab *&pSurplus)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        void *object = objects[i];
+        MempSlab *pSlab = slabOf(object);
+
+        if (!pSlab->pFree)
+        {
+            link(pSlab, m_pPartial);
+        }
+
+        *reinterpret_cast<void **>(object) = pSlab->pFree;
+        pSlab->pFree = object;
+
+        if (--pSlab->nInUse)
+        {
+            continue;
+        }
+
+        unlink(pSlab, m_pPartial);
+        if (m_nEmpty < m_SpareSlabs)
+        {
+            link(pSlab, m_pEmpty);
+            ++m_nEmpty;
+        }
+        else
+        {
+            pSlab->pNext = pSurplus;
+            pSurplus = pSlab;
+            --m_nSlabs;
+        }
+    }
+}
+
+bool MempCache::grow()
+{
+    uintptr_t page = g_MempPages.allocateNow();
+    if (!page)
+    {
+        return false;
+    }
+
+    MempSlab *pSlab = reinterpret_cast<MempSlab *>(page);
+    pSlab->pNext = pSlab->pPrev = nullptr;
+    pSlab->pFree = nullptr;
+    pSlab->nInUse = 0;
+
+    // Chain back to front so objects are handed out in address order.
+    uintptr_t base = page + MEMP_SLAB_HEADER;
+    for (size_t i = m_ObjectsPerSlab; i > 0; --i)
+    {
+        void *object = reinterpret_cast<void *>(base + (i - 1) * m_ObjectSize);
+        *reinterpret_cast<void **>(object) = pSlab->pFree;
+        pSlab->pFree = object;
+    }
+
+    LockGuard<Spinlock> guard(m_Lock);
+    link(pSlab, m_pEmpty);
+    ++m_nEmpty;
+    ++m_nSlabs;
+
+    return true;
+}
+
+void MempCache::release(MempSlab *pSlabs)
+{
+    while (pSlabs)
+    {
+        MempSlab *pNext = pSlabs->pNext;
+        g_MempPages.free(reinterpret_cast<uintptr_t>(pSlabs));
+        pSlabs = pNext;
+    }
+}
+
+size_t MempCache::trim()
+{
+    MempSlab *pSlabs = nullptr;
+    size_t n = 0;
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        while (m_pEmpty)
+        {
+            MempSlab *pSlab = m_pEmpty;
+            unlink(pSlab, m_pEmpty);
+            pSlab->pNext = pSlabs;
+            pSlabs = pSlab;
+            ++n;
+        }
+
+        m_nEmpty = 0;
+        m_nSlabs -= n;
+        m_Trimmed += n;
+    }
+
+    release(pSlabs);
+    return n;
+}
+
+void MempCache::getStatistics(struct memp_cache_stats &stats)
+{
+    ByteSet(&stats, 0, sizeof(stats));
+    stats.name = m_Name;
+    stats.object_size = m_ObjectSize;
+    stats.objects_per_slab = m_ObjectsPerSlab;
+
+    size_t frees = 0;
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        stats.slabs = m_nSlabs;
+        stats.empty_slabs = m_nEmpty;
+        stats.allocations = m_Allocations;
+        stats.trimmed = m_Trimmed;
+        frees = m_Frees;
+    }
+    stats.failures = __atomic_load_n(&m_Failures, __ATOMIC_RELAXED);
+
+    // Per-CPU counters are read without stopping their owners; the totals
+    // are a snapshot.
+    for (size_t i = 0; i < MEMP_CACHE_SLOTS; ++i)
+    {
+        MempCpuCache *pCpu = m_pCpuCaches[i];
+        if (!pCpu)
+        {
+            continue;
+        }
+
+        stats.allocations += pCpu->allocations;
+        stats.cache_hits += pCpu->hits;
+        stats.refills += pCpu->refills;
+        stats.flushes += pCpu->flushes;
+        frees += pCpu->frees;
+    }
+
+    stats.in_use = stats.allocations > frees ? stats.allocations - frees : 0;
+}
+
+void MempCache::unlink(MempSlab *pSlab, MempSlab *&pList)
+{
+    if (pSlab->pPrev)
+    {
+        pSlab->pPrev->pNext = pSlab->pNext;
+    }
+    else
+    {
+        pList = pSlab->pNext;
+    }
+
+    if (pSlab->pNext)
+    {
+        pSlab->pNext->pPrev = pSlab->pPrev;
+    }
+
+    pSlab->pNext = pSlab->pPrev = nullptr;
+}
+
+void MempCache::link(MempSlab *pSlab, MempSlab *&pList)
+{
+    pSlab->pPrev = nullptr;
+    pSlab->pNext = pList;
+    if (pList)
+    {
+        pList->pPrev = pSlab;
+    }
+    pList = pSlab;
+}
+
+static MempCache *cacheOf(const struct memp_desc *desc)
+{
+    return reinterpret_cast<MempCache *>(desc->cache->impl);
+}
+
+void memp_cache_init(const struct memp_desc *desc, size_t object_size)
+{
+    if (desc->cache->impl)
+    {
+        return;
+    }
+
+    const char *name = "custom";
+    for (size_t i = 0; i < MEMP_MAX; ++i)
+    {
+        if (memp_pools[i] == desc)
+        {
+            name = g_MempNames[i];
+            break;
+        }
+    }
+
+    initialisePages();
+
+    MempCache *pCache = new MempCache(name, object_size);
+
+    LockGuard<Spinlock> guard(g_CachesLock);
+    if (desc->cache->impl)
+    {
+        // Lost a race to initialise the same pool.
+        delete pCache;
+        return;
+    }
+
+    pCache->m_pNextCache = g_pCaches;
+    __atomic_store_n(&g_pCaches, pCache, __ATOMIC_RELEASE);
+    desc->cache->impl = pCache;
+}
+
+void *memp_cache_alloc(const struct memp_desc *desc)
+{
+    return cacheOf(desc)->allocate();
+}
+
+void memp_cache_free(const struct memp_desc *desc, void *mem)
+{
+    cacheOf(desc)->free(mem);
+}
+
+size_t memp_cache_statistics(struct memp_cache_stats *stats, size_t max)
+{
+    size_t n = 0;
+    for (MempCache *pCache = __atomic_load_n(&g_pCaches, __ATOMIC_ACQUIRE);
+         pCache && n < max; pCache = pCache->m_pNextCache)
+    {
+        pCache->getStatistics(stats[n++]);
+    }
+
+    return n;
+}
+
+size_t memp_cache_trim()
+{
+    size_t n = trimCaches();
+    g_MempPages.trim();
+    return n;
+}
+
+#endif  // MEMP_MEM_MALLOC && MEMP_PEDIGREE_POOLS
@@ -22,21 +22,30 @@
 #include "modules/system/ramfs/RamFs.h"
 #include "modules/system/vfs/Filesystem.h"
 #include "modules/system/vfs/VFS.h"
+#include "pedigree/kernel/BootstrapInfo.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/core/BootIO.h"
 #include "pedigree/kernel/machine/Device.h"
 #include "pedigree/kernel/machine/Disk.h"
+#include "pedigree/kernel/machine/IoScheduler.h"
 #include "pedigree/kernel/utilities/Iterator.h"
 #include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/StaticString.h"
 #include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/Tree.h"
+#include "pedigree/kernel/utilities/Vector.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 class File;
 
 static bool bRootMounted = false;
 
+/// Filesystem::MountOptions for every disk we mount.
+static size_t g_MountOptions = 0;
+
+/// Put an IoScheduler between each filesystem and its disk.
+static bool g_bIoScheduler = false;
+
 static void error(const char *s)
 {
     extern BootIO bootIO;
@@ -54,9 +63,15 @@ static Device *probeDisk(Device *diskDevice)
         return diskDevice;
     }
 
+    // Filesystems can talk to the disk through an I/O scheduler, which sorts
+    // and merges their requests before they reach the driver.
     Disk *pDisk = static_cast<Disk *>(diskDevice);
+    if (g_bIoScheduler)
+    {
+        pDisk = new IoScheduler(pDisk);
+    }
     String alias;  // Null - gets assigned by the filesystem.
-    if (VFS::instance().mount(pDisk, alias))
+    if (VFS::instance().mount(pDisk, alias, g_MountOptions))
     {
         // For mount message
         bool didMountAsRoot = false;
@@ -83,12 +98,41 @@ static Device *probeDisk(Device *diskDevice)
             NOTICE("Mounted " << alias << ".");
         }
     }
+    else if (pDisk != diskDevice)
+    {
+        delete pDisk;
+    }
 
     return diskDevice;
 }
 
+static void parseCommandLine()
+{
+    char *cmdline = g_pBootstrapInfo->getCommandLine();
+    if (!cmdline)
+    {
+        return;
+    }
+
+    Vector<String> cmds = String(cmdline).tokenise(' ');
+    for (auto it = cmds.begin(); it != cmds.end(); it++)
+    {
+        auto cmd = *it;
+        if (cmd == String("writeback"))
+        {
+            g_MountOptions |= Filesystem::MountWriteBack;
+        }
+        else if (cmd == String("iosched"))
+        {
+            g_bIoScheduler = true;
+        }
+    }
+}
+
 static bool init()
 {
+    parseCommandLine();
+
     // Mount scratch filesystem (ie, pure ram filesystem, for POSIX /tmp etc)
     RamFs *pRamFs = new RamFs;
     pRamFs->initialise(0);
@@ -18,13 +18,16 @@
  */
 
 #include "Filter.h"
+#include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/utilities/Iterator.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 NetworkFilter NetworkFilter::m_Instance;
 
-NetworkFilter::NetworkFilter() : m_Callbacks()
+NetworkFilter::NetworkFilter()
+    : m_Callbacks(), m_Programs(), m_nFilters(), m_nPrograms(),
+      m_NextProgramId(0), m_ProgramLock(false)
 {
 }
 
@@ -37,6 +40,30 @@ bool NetworkFilter::filter(size_t level, uintptr_t packet, size_t sz)
     // Check for a valid level
     if (level <= 4 && level > 0)
     {
+        if (!__atomic_load_n(&m_nFilters[level], __ATOMIC_ACQUIRE))
+        {
+            return true;
+        }
+
+        // Programs are cheap, so they get the first chance to drop it.
+        if (__atomic_load_n(&m_nPrograms[level], __ATOMIC_ACQUIRE))
+        {
+            LockGuard<Spinlock> guard(m_ProgramLock);
+
+            List<Program *> *programs = m_Programs.lookup(level);
+            if (programs)
+            {
+                const uint8_t *data = reinterpret_cast<const uint8_t *>(packet);
+                for (auto it = programs->begin(); it != programs->end(); ++it)
+                {
+                    if (!(*it)->filter.run(data, sz))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
         // Grab the callback list
         typedef List<void *>::Iterator callbackIterator;
         List<void *> *list = m_Callbacks.lookup(level);
@@ -45,8 +72,14 @@ bool NetworkFilter::filter(size_t level, uintptr_t packet, size_t sz)
             // Iterate, call each callback until one returns false
             for (callbackIterator it = list->begin(); it != list->end(); ++it)
             {
+                void *entry = __atomic_load_n(&(*it), __ATOMIC_ACQUIRE);
+                if (!entry)
+                {
+                    continue;  // Removed.
+                }
+
                 bool (*callback)(uintptr_t, size_t) =
-                    reinterpret_cast<bool (*)(uintptr_t, size_t)>(*it);
+                    reinterpret_cast<bool (*)(uintptr_t, size_t)>(entry);
                 bool result = callback(packet, sz);
                 if (!result)
                     return result;  // Short-circuit. This way we avoid
@@ -60,6 +93,16 @@ bool NetworkFilter::filter(size_t level, uintptr_t packet, size_t sz)
     return true;
 }
 
+bool NetworkFilter::hasCallbacks(size_t level)
+{
+    if (level > 4 || !level)
+    {
+        return false;
+    }
+
+    return __atomic_load_n(&m_nFilters[level], __ATOMIC_ACQUIRE) != 0;
+}
+
 size_t NetworkFilter::installCallback(
     size_t level, bool (*callback)(uintptr_t, size_t))
 {
@@ -77,6 +120,7 @@ size_t NetworkFilter::installCallback(
             // We return the index into the list of this callback
             size_t index = list->count();
             list->pushBack(reinterpret_cast<void *>(callback));
+            __atomic_add_fetch(&m_nFilters[level], 1, __ATOMIC_RELEASE);
             return index;
         }
         // Otherwise, allocate
@@ -93,6 +137,7 @@ size_t NetworkFilter::installCallback(
 
             list->pushBack(reinterpret_cast<void *>(callback));
             m_Callbacks.insert(level, list);
+            __atomic_add_fetch(&m_nFilters[level], 1, __ATOMIC_RELEASE);
 
             // First item
             return 0;
@@ -105,5 +150,95 @@ size_t NetworkFilter::installCallback(
 
 void NetworkFilter::removeCallback(size_t level, size_t id)
 {
-    /// \todo Implement me!
+    List<void *> *list = m_Callbacks.lookup(level);
+    if (!list)
+    {
+        return;
+    }
+
+    // Null out the entry rather than erasing it, so the identifiers handed
+    // out for later callbacks don't shift.
+    size_t index = 0;
+    for (auto it = list->begin(); it != list->end(); ++it, ++index)
+    {
+        if (index != id)
+        {
+            continue;
+        }
+
+        if (__atomic_exchange_n(&(*it), nullptr, __ATOMIC_ACQ_REL))
+        {
+            __atomic_sub_fetch(&m_nFilters[level], 1, __ATOMIC_RELEASE);
+        }
+        break;
+    }
+}
+
+size_t NetworkFilter::installProgram(
+    size_t level, const PacketFilterInstruction *program, size_t count)
+{
+    if (level > 4 || !level)
+    {
+        return static_cast<size_t>(-1);
+    }
+
+    // Compile outside of the lock, packets keep flowing meanwhile.
+    Program *entry = new Program;
+    if (!entry->filter.load(program, count))
+    {
+        NOTICE(
+            "NetworkFilter: rejected program for level " << Dec << level);
+        delete entry;
+        return static_cast<size_t>(-1);
+    }
+
+    LockGuard<Spinlock> guard(m_ProgramLock);
+
+    List<Program *> *list = m_Programs.lookup(level);
+    if (!list)
+    {
+        list = new List<Program *>;
+        m_Programs.insert(level, list);
+    }
+
+    entry->id = m_NextProgramId++;
+    list->pushBack(entry);
+
+    __atomic_add_fetch(&m_nPrograms[level], 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&m_nFilters[level], 1, __ATOMIC_RELEASE);
+
+    return entry->id;
+}
+
+void NetworkFilter::removeProgram(size_t level, size_t id)
+{
+    Program *removed = nullptr;
+
+    {
+        LockGuard<Spinlock> guard(m_ProgramLock);
+
+        List<Program *> *list = m_Programs.lookup(level);
+        if (!list)
+        {
+            return;
+        }
+
+        for (auto it = list->begin(); it != list->end(); ++it)
+        {
+            if ((*it)->id == id)
+            {
+                removed = *it;
+                list->erase(it);
+                break;
+            }
+        }
+
+        if (removed)
+        {
+            __atomic_sub_fetch(&m_nPrograms[level], 1, __ATOMIC_RELEASE);
+            __atomic_sub_fetch(&m_nFilters[level], 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    delete removed;
 }
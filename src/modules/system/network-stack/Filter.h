@@ -20,6 +20,8 @@
 #ifndef NETWORK_STACK_FILTER_H
 #define NETWORK_STACK_FILTER_H
 
+#include "PacketFilter.h"
+#include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/List.h"
@@ -52,6 +54,8 @@ class EXPORTED_PUBLIC NetworkFilter
      * \todo Callbacks should be able to return a code which requests a
      *       specific response, such as ICMP Unreachable or something,
      *       rather than just dropping the packet.
+     * Installed programs run first, so a packet they drop is never seen by
+     * the callbacks.
      * \param level Level of callback to call
      * \param packet Packet buffer, can be modified by callbacks
      * \param size Size of the packet. Can NOT be modified by callbacks
@@ -59,6 +63,11 @@ class EXPORTED_PUBLIC NetworkFilter
      */
     bool filter(size_t level, uintptr_t packet, size_t sz);
 
+    /** Whether any callbacks or programs are installed for \p level, so
+     * callers can skip preparing a packet for filter() when it would be a
+     * no-op. */
+    bool hasCallbacks(size_t level);
+
     /** Installs a callback for a specific level.
      * \return An identifier which can be passed to removeCallback to
      *         uninstall the callback, or ((size_t) -1) if unable to install.
@@ -68,11 +77,44 @@ class EXPORTED_PUBLIC NetworkFilter
     /** Removes a callback for a specific level. */
     void removeCallback(size_t level, size_t id);
 
+    /** Verifies, compiles and installs a BPF program for a specific level.
+     * Packets the program returns 0 for are dropped; any other result
+     * accepts them (a snap length means nothing at this point).
+     * \return An identifier which can be passed to removeProgram, or
+     *         ((size_t) -1) if the program was rejected.
+     */
+    size_t installProgram(
+        size_t level, const PacketFilterInstruction *program, size_t count);
+
+    /** Removes a program installed by installProgram. */
+    void removeProgram(size_t level, size_t id);
+
   private:
     static NetworkFilter m_Instance;
 
-    /// Level -> Callback list mapping
+    struct Program
+    {
+        size_t id;
+        PacketFilter filter;
+    };
+
+    /// Level -> Callback list mapping. Removed callbacks leave a null entry
+    /// behind so that the identifiers of the others stay valid.
     Tree<size_t, List<void *> *> m_Callbacks;
+
+    /// Level -> Program list mapping.
+    Tree<size_t, List<Program *> *> m_Programs;
+
+    /// Callbacks and programs installed per level, checked before touching
+    /// either tree.
+    size_t m_nFilters[5];
+    size_t m_nPrograms[5];
+
+    size_t m_NextProgramId;
+
+    /// Guards m_Programs. Programs always terminate quickly, so they run
+    /// with this held.
+    Spinlock m_ProgramLock;
 };
 
 #endif  // NETWORK_STACK_FILTER_H
@@ -36,14 +36,77 @@ NetworkStack *NetworkStack::stack = 0;
 
 static NetworkStack *g_NetworkStack = 0;
 
-static err_t linkOutput(struct netif *netif, struct pbuf *p)
+/// The packet linkOutput is currently handing to a device, until either the
+/// device completes it or linkOutput returns. linkOutput always runs with the
+/// lwIP core lock held, so there is only ever one.
+static struct pbuf *g_pSending = nullptr;
+
+/// Packets whose sends completed after linkOutput returned. The lwIP thread
+/// drops their references, as the device may have completed them from any
+/// context - including one already holding the core lock.
+static LockFreeQueue<struct pbuf *> g_CompletedSends(NETWORK_TX_RECLAIM_SIZE);
+static struct tcpip_callback_msg *g_pReclaimMessage = nullptr;
+static uint32_t g_ReclaimPending = 0;
+
+static void freeCompletedSends()
 {
-    Network *pDevice = reinterpret_cast<Network *>(netif->state);
+    struct pbuf *p = nullptr;
+    while (g_CompletedSends.pop(p))
+    {
+        pbuf_free(p);
+    }
+}
+
+/// lwIP thread callback: drops the references held for completed sends.
+static void reclaimSends(void *)
+{
+    // Clear first: a send completing after our last pop posts us again.
+    __atomic_store_n(&g_ReclaimPending, 0, __ATOMIC_RELEASE);
+    freeCompletedSends();
+}
+
+static void linkOutputComplete(void *param, bool success)
+{
+    struct pbuf *p = reinterpret_cast<struct pbuf *>(param);
+
+    struct pbuf *expected = p;
+    if (__atomic_compare_exchange_n(
+            &g_pSending, &expected, nullptr, false, __ATOMIC_ACQ_REL,
+            __ATOMIC_ACQUIRE))
+    {
+        // Completed inside sendFragments; linkOutput drops the reference
+        // under the core lock.
+        return;
+    }
+
+    // Completed later, from whatever context the device was in.
+    if (!g_CompletedSends.push(p))
+    {
+        // Unlikely, with the lwIP thread this far behind; this needs a
+        // mailbox slot of its own.
+        if (pbuf_free_callback(p) != ERR_OK)
+        {
+            ERROR("Network Stack: lwIP is too far behind, leaking a packet");
+        }
+        return;
+    }
+
+    if (!__atomic_exchange_n(&g_ReclaimPending, 1, __ATOMIC_ACQ_REL) &&
+        tcpip_trycallback(g_pReclaimMessage) != ERR_OK)
+    {
+        // The lwIP mailbox is full. The next completion tries again, and
+        // linkOutput frees anything queued in the meantime.
+        __atomic_store_n(&g_ReclaimPending, 0, __ATOMIC_RELEASE);
+    }
+}
 
+/** Transmits a copy of \p p in one buffer, for when sending the pbufs
+ * themselves isn't possible. */
+static err_t linkOutputCopy(Network *pDevice, struct pbuf *p)
+{
     size_t totalLength = p->tot_len;
 
     // pull the chain of pbufs into a single packet to transmit
-    size_t offset = 0;
     char *output = new char[totalLength];
 
     pbuf_copy_partial(p, output, totalLength, 0);
@@ -52,6 +115,7 @@ static err_t linkOutput(struct netif *netif, struct pbuf *p)
     if (!NetworkFilter::instance().filter(
             1, reinterpret_cast<uintptr_t>(output), totalLength))
     {
+        delete[] output;
         pDevice->droppedPacket();
         return ERR_IF;  // Drop the packet.
     }
@@ -68,6 +132,79 @@ static err_t linkOutput(struct netif *netif, struct pbuf *p)
     return e;
 }
 
+static err_t linkOutput(struct netif *netif, struct pbuf *p)
+{
+    Network *pDevice = reinterpret_cast<Network *>(netif->state);
+
+    // We hold the core lock, so this is as good a time as any to catch up.
+    freeCompletedSends();
+    if (UNLIKELY(!g_pReclaimMessage))
+    {
+        g_pReclaimMessage = tcpip_callbackmsg_new(reclaimSends, nullptr);
+        if (!g_pReclaimMessage)
+        {
+            ERROR("Network Stack: couldn't allocate a send reclaim message");
+            return ERR_MEM;
+        }
+    }
+
+    size_t totalLength = p->tot_len;
+
+    // Describe the chain to the device rather than flattening it.
+    Network::Fragment fragments[NETWORK_MAX_FRAGMENTS];
+    size_t count = 0;
+    for (struct pbuf *q = p; q != nullptr; q = q->next)
+    {
+        if (!q->len)
+        {
+            continue;
+        }
+
+        if (count == NETWORK_MAX_FRAGMENTS)
+        {
+            return linkOutputCopy(pDevice, p);
+        }
+
+        fragments[count].buffer = reinterpret_cast<uintptr_t>(q->payload);
+        fragments[count].length = q->len;
+        ++count;
+    }
+
+    // Filters need the packet in one piece.
+    if (NetworkFilter::instance().hasCallbacks(1))
+    {
+        if (count != 1)
+        {
+            return linkOutputCopy(pDevice, p);
+        }
+
+        if (!NetworkFilter::instance().filter(
+                1, fragments[0].buffer, totalLength))
+        {
+            pDevice->droppedPacket();
+            return ERR_IF;  // Drop the packet.
+        }
+    }
+
+    // The device holds its own reference until it completes the send.
+    pbuf_ref(p);
+    __atomic_store_n(&g_pSending, p, __ATOMIC_RELEASE);
+
+    bool sent = pDevice->sendFragments(
+        fragments, count, totalLength, linkOutputComplete, p);
+
+    struct pbuf *expected = p;
+    if (!__atomic_compare_exchange_n(
+            &g_pSending, &expected, nullptr, false, __ATOMIC_ACQ_REL,
+            __ATOMIC_ACQUIRE))
+    {
+        // Already completed; the reference is ours to drop.
+        pbuf_free(p);
+    }
+
+    return sent ? ERR_OK : ERR_IF;
+}
+
 static void netifStatusUpdate(struct netif *netif)
 {
     if (netif_is_up(netif))
@@ -113,14 +250,13 @@ static err_t netifInit(struct netif *netif)
 }
 
 NetworkStack::NetworkStack()
-    : RequestQueue("Network Stack"), m_pLoopback(0), m_Children(),
-      m_MemPool("network-pool")
+    : m_pLoopback(0), m_Children(), m_MemPool("network-pool")
 #ifdef UTILITY_LINUX
       ,
       m_Lock(false)
 #endif
       ,
-      m_NextInterfaceNumber(0)
+      m_Interfaces(), m_ReceiveQueues(), m_NextInterfaceNumber(0)
 {
     if (stack)
     {
@@ -129,8 +265,6 @@ NetworkStack::NetworkStack()
 
     stack = this;
 
-    initialise();
-
 #if defined(X86_COMMON) || defined(HOSTED)
     // Lots of RAM to burn! Try 16 MB, then 8 MB, then 4 MB, then give up
     if (!m_MemPool.initialise(4096, 1600))
@@ -151,76 +285,269 @@ NetworkStack::NetworkStack()
 
 NetworkStack::~NetworkStack()
 {
-    destroy();
-
     stack = 0;
 }
 
-uint64_t NetworkStack::executeRequest(
-    uint64_t p1, uint64_t p2, uint64_t p3, uint64_t p4, uint64_t p5,
-    uint64_t p6, uint64_t p7, uint64_t p8)
+NetworkStack::ReceiveQueue::ReceiveQueue(
+    Network *pNewCard, struct netif *pIface)
+    : pCard(pNewCard), iface(pIface), frames(NETWORK_RX_QUEUE_SIZE),
+      pDrainMessage(0), drainPending(0), dying(false), stats()
 {
-    // OK, we are now processing the packet.
-    // We hold a lock that allows us to handle concurrency (not an issue with
-    // a true RequestQueue, but is an issue on other environments).
-#if defined(THREADS) || defined(UTILITY_LINUX)
-    LockGuard<Mutex> guard(m_Lock);
-#endif
-
-    struct pbuf *p = reinterpret_cast<struct pbuf *>(p1);
-    struct netif *iface = reinterpret_cast<struct netif *>(p2);
+    pDrainMessage = tcpip_callbackmsg_new(drainReceiveQueue, this);
+    if (!pDrainMessage)
+    {
+        ERROR("Network Stack: couldn't allocate a receive drain message");
+    }
+}
 
-    iface->input(p, iface);
+NetworkStack::ReceiveQueue::~ReceiveQueue()
+{
+    struct pbuf *p = nullptr;
+    while (frames.pop(p))
+    {
+        pbuf_free(p);
+    }
 
-    return 0;
+    if (pDrainMessage)
+    {
+        tcpip_callbackmsg_delete(pDrainMessage);
+    }
 }
 
-void NetworkStack::receive(
-    size_t nBytes, uintptr_t packet, Network *pCard, uint32_t offset)
+bool NetworkStack::enqueue(ReceiveQueue *pQueue, uintptr_t packet, size_t nBytes)
 {
-    packet += offset;
+    Network *pCard = pQueue->pCard;
 
     // Check for filtering before doing anything else
     if (!NetworkFilter::instance().filter(1, packet, nBytes))
     {
         pCard->droppedPacket();
-        return;  // Drop the packet.
+        return false;  // Drop the packet.
     }
 
-    struct netif *iface = getInterface(pCard);
-    if (!iface)
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, nBytes, PBUF_POOL);
+    if (!p)
     {
-        ERROR("Network Stack: no lwIP interface for received packet");
+        __atomic_add_fetch(&pQueue->stats.noBuffers, 1, __ATOMIC_RELAXED);
         pCard->droppedPacket();
+        return false;
+    }
+
+    for (struct pbuf *buf = p; buf != nullptr; buf = buf->next)
+    {
+        MemoryCopy(buf->payload, reinterpret_cast<void *>(packet), buf->len);
+        packet += buf->len;
+    }
+
+    return queueFrame(pQueue, p);
+}
+
+bool NetworkStack::queueFrame(ReceiveQueue *pQueue, struct pbuf *p)
+{
+    Network *pCard = pQueue->pCard;
+
+    if (!pQueue->frames.push(p))
+    {
+        // lwIP is behind; shed load here rather than stall the driver.
+        pbuf_free(p);
+        __atomic_add_fetch(&pQueue->stats.overruns, 1, __ATOMIC_RELAXED);
+        pCard->droppedPacket();
+        return false;
+    }
+
+    __atomic_add_fetch(&pQueue->stats.queued, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+void NetworkStack::scheduleDrain(ReceiveQueue *pQueue)
+{
+    if (!pQueue->pDrainMessage || pQueue->dying)
+    {
         return;
     }
 
-    struct pbuf *p = pbuf_alloc(PBUF_RAW, nBytes, PBUF_POOL);
-    if (p != 0)
+    if (__atomic_exchange_n(&pQueue->drainPending, 1, __ATOMIC_ACQ_REL))
+    {
+        // Already posted; it will pick up what we just queued.
+        return;
+    }
+
+    if (tcpip_trycallback(pQueue->pDrainMessage) != ERR_OK)
+    {
+        // The lwIP mailbox is full. The next frame to arrive tries again.
+        __atomic_store_n(&pQueue->drainPending, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void NetworkStack::drainReceiveQueue(void *ctx)
+{
+    ReceiveQueue *pQueue = reinterpret_cast<ReceiveQueue *>(ctx);
+
+    struct pbuf *batch[NETWORK_RX_DRAIN_BUDGET];
+    size_t n = pQueue->frames.pop(batch, NETWORK_RX_DRAIN_BUDGET);
+
+    // We're on the lwIP thread already, so skip tcpip_input's extra hop.
+    // ethernet_input consumes the pbuf whatever it returns.
+    for (size_t i = 0; i < n; ++i)
     {
-        struct pbuf *buf = p;
-        while (buf != nullptr)
+        if (UNLIKELY(pQueue->dying))
+        {
+            pbuf_free(batch[i]);
+        }
+        else
         {
-            size_t copyLength = buf->len;
-            MemoryCopy(
-                buf->payload, reinterpret_cast<void *>(packet), buf->len);
+            ethernet_input(batch[i], pQueue->iface);
+        }
+    }
 
-            packet += buf->len;
-            nBytes -= buf->len;
+    pQueue->stats.delivered += n;
+    ++pQueue->stats.drains;
+    if (n > pQueue->stats.largestDrain)
+    {
+        pQueue->stats.largestDrain = n;
+    }
 
-            buf = buf->next;
+    if (n == NETWORK_RX_DRAIN_BUDGET && !pQueue->dying)
+    {
+        // Probably more waiting. Go to the back of the mailbox so timers and
+        // socket calls get a turn, keeping drainPending set.
+        if (tcpip_trycallback(pQueue->pDrainMessage) == ERR_OK)
+        {
+            return;
         }
     }
-    else
+
+    __atomic_store_n(&pQueue->drainPending, 0, __ATOMIC_RELEASE);
+
+    // A frame queued after our last pop would have seen drainPending set and
+    // not posted a drain of its own.
+    if (!pQueue->frames.empty())
     {
-        ERROR("Network Stack: Out of memory pool space, dropping incoming "
-              "packet");
-        pCard->droppedPacket();
+        scheduleDrain(pQueue);
+    }
+}
+
+void NetworkStack::destroyReceiveQueue(void *ctx)
+{
+    ReceiveQueue *pQueue = reinterpret_cast<ReceiveQueue *>(ctx);
+
+    if (__atomic_load_n(&pQueue->drainPending, __ATOMIC_ACQUIRE))
+    {
+        // A drain is still in the mailbox, behind us; let it run first.
+        tcpip_callback_with_block(destroyReceiveQueue, pQueue, 0);
         return;
     }
 
-    uint64_t result = addRequest(
-        0, reinterpret_cast<uint64_t>(p), reinterpret_cast<uintptr_t>(iface));
+    netif_remove(pQueue->iface);
+    delete pQueue->iface;
+    delete pQueue;
+}
+
+bool NetworkStack::receive(
+    size_t nBytes, uintptr_t packet, Network *pCard, uint32_t offset)
+{
+    Frame frame = {packet, nBytes, offset};
+    return receiveBatch(pCard, &frame, 1) == 1;
+}
+
+size_t
+NetworkStack::receiveBatch(Network *pCard, const Frame *frames, size_t count)
+{
+    ReceiveQueue *pQueue = m_ReceiveQueues.lookup(pCard);
+    if (!pQueue)
+    {
+        ERROR("Network Stack: no lwIP interface for received packet");
+        for (size_t i = 0; i < count; ++i)
+        {
+            pCard->droppedPacket();
+        }
+        return 0;
+    }
+
+    size_t accepted = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (enqueue(
+                pQueue, frames[i].buffer + frames[i].offset, frames[i].length))
+        {
+            ++accepted;
+        }
+    }
+
+    if (accepted)
+    {
+        scheduleDrain(pQueue);
+    }
+
+    return accepted;
+}
+
+bool NetworkStack::receive(
+    Network *pCard, const Network::Fragment *fragments, size_t count,
+    size_t nBytes)
+{
+    ReceiveQueue *pQueue = m_ReceiveQueues.lookup(pCard);
+    if (!pQueue)
+    {
+        ERROR("Network Stack: no lwIP interface for received packet");
+        pCard->droppedPacket();
+        return false;
+    }
+
+    // One contiguous pbuf, so the filter can look at it where it lies.
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, nBytes, PBUF_RAM);
+    if (!p)
+    {
+        __atomic_add_fetch(&pQueue->stats.noBuffers, 1, __ATOMIC_RELAXED);
+        pCard->droppedPacket();
+        return false;
+    }
+
+    uint8_t *payload = reinterpret_cast<uint8_t *>(p->payload);
+    for (size_t i = 0; i < count; ++i)
+    {
+        MemoryCopy(
+            payload, reinterpret_cast<void *>(fragments[i].buffer),
+            fragments[i].length);
+        payload += fragments[i].length;
+    }
+
+    if (!NetworkFilter::instance().filter(
+            1, reinterpret_cast<uintptr_t>(p->payload), nBytes))
+    {
+        pbuf_free(p);
+        pCard->droppedPacket();
+        return false;  // Drop the packet.
+    }
+
+    if (!queueFrame(pQueue, p))
+    {
+        return false;
+    }
+
+    scheduleDrain(pQueue);
+    return true;
+}
+
+bool NetworkStack::getReceiveStatistics(
+    Network *pCard, ReceiveStatistics &stats) const
+{
+    ReceiveQueue *pQueue = m_ReceiveQueues.lookup(pCard);
+    if (!pQueue)
+    {
+        return false;
+    }
+
+    stats.queued = __atomic_load_n(&pQueue->stats.queued, __ATOMIC_RELAXED);
+    stats.delivered =
+        __atomic_load_n(&pQueue->stats.delivered, __ATOMIC_RELAXED);
+    stats.overruns = __atomic_load_n(&pQueue->stats.overruns, __ATOMIC_RELAXED);
+    stats.noBuffers =
+        __atomic_load_n(&pQueue->stats.noBuffers, __ATOMIC_RELAXED);
+    stats.drains = __atomic_load_n(&pQueue->stats.drains, __ATOMIC_RELAXED);
+    stats.largestDrain =
+        __atomic_load_n(&pQueue->stats.largestDrain, __ATOMIC_RELAXED);
+    return true;
 }
 
 void NetworkStack::registerDevice(Network *pDevice)
@@ -257,6 +584,7 @@ void NetworkStack::registerDevice(Network *pDevice)
     iface = netif_add(iface, &ipaddr, &netmask, &gateway, pDevice, netifInit, tcpip_input);
 
     m_Interfaces.insert(pDevice, iface);
+    m_ReceiveQueues.insert(pDevice, new ReceiveQueue(pDevice, iface));
 }
 
 Network *NetworkStack::getDevice(size_t n)
@@ -280,10 +608,20 @@ void NetworkStack::deRegisterDevice(Network *pDevice)
             break;
         }
 
+    ReceiveQueue *pQueue = m_ReceiveQueues.lookup(pDevice);
+    m_ReceiveQueues.remove(pDevice);
+
     struct netif *iface = m_Interfaces.lookup(pDevice);
     m_Interfaces.remove(pDevice);
 
-    if (iface != nullptr)
+    if (pQueue)
+    {
+        // A drain may already be posted, so tear the interface down on the
+        // lwIP thread where it's serialised with them.
+        pQueue->dying = true;
+        tcpip_callback(destroyReceiveQueue, pQueue);
+    }
+    else if (iface != nullptr)
     {
         netif_remove(iface);
 
@@ -22,22 +22,40 @@
 
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/Network.h"
+#include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/LockFreeQueue.h"
 #include "pedigree/kernel/utilities/MemoryPool.h"
-#include "pedigree/kernel/utilities/RequestQueue.h"
 #include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/Tree.h"
 #include "pedigree/kernel/utilities/Vector.h"
 
 // lwIP network interface type
 struct netif;
+struct pbuf;
+struct tcpip_callback_msg;
+
+/// Frames each interface can have waiting for the lwIP thread.
+#define NETWORK_RX_QUEUE_SIZE 512
+
+/// Frames handed to lwIP per drain before yielding to other lwIP work.
+#define NETWORK_RX_DRAIN_BUDGET 64
+
+/// Sends completed outside linkOutput that can wait for the lwIP thread to
+/// drop their pbufs.
+#define NETWORK_TX_RECLAIM_SIZE 1024
 
 /**
  * The Pedigree network stack
  * This function is the base for receiving packets, and provides functionality
  * for keeping track of network devices in the system.
+ *
+ * Received frames are copied into pbufs and pushed onto a per-interface
+ * lock-free queue; the lwIP thread drains that queue in batches. Receiving
+ * never waits for lwIP, so a driver can keep emptying its ring during a
+ * burst. When a queue fills, further frames are dropped and counted.
  */
-class EXPORTED_PUBLIC NetworkStack : public RequestQueue
+class EXPORTED_PUBLIC NetworkStack
 {
   public:
     NetworkStack();
@@ -49,10 +67,66 @@ class EXPORTED_PUBLIC NetworkStack : public RequestQueue
         return *stack;
     }
 
-    /** Called when a packet arrives */
-    void
+    /** A received frame, for receiveBatch(). */
+    struct Frame
+    {
+        /// Start of the buffer holding the frame.
+        uintptr_t buffer;
+        /// Length of the frame in bytes.
+        size_t length;
+        /// Offset of the frame within the buffer.
+        uint32_t offset;
+    };
+
+    /** Receive statistics for one interface. */
+    struct ReceiveStatistics
+    {
+        /// Frames queued for lwIP.
+        uint64_t queued;
+        /// Frames handed to lwIP.
+        uint64_t delivered;
+        /// Frames dropped because the interface's queue was full.
+        uint64_t overruns;
+        /// Frames dropped for want of a pbuf.
+        uint64_t noBuffers;
+        /// Drains run by the lwIP thread.
+        uint64_t drains;
+        /// Largest number of frames handed over in one drain.
+        uint64_t largestDrain;
+    };
+
+    /**
+     * Called when a packet arrives. The frame is copied before returning, so
+     * the caller may reuse the buffer immediately; it does not wait for lwIP
+     * to process the frame.
+     * 
+eturn false if the frame was dropped.
+     */
+    bool
     receive(size_t nBytes, uintptr_t packet, Network *pCard, uint32_t offset);
 
+    /**
+     * Receives several frames at once, as receive() does for one. Cheaper
+     * than repeated receive() calls as the lwIP thread is woken at most once.
+     * 
+eturn the number of frames accepted. Frames that were not accepted
+     *         have been counted as dropped on \p pCard.
+     */
+    size_t receiveBatch(Network *pCard, const Frame *frames, size_t count);
+
+    /**
+     * Receives a frame held in several buffers, such as one a loopback device
+     * was asked to transmit with Network::sendFragments. Gathers the frame
+     * straight into the pbuf handed to lwIP.
+     * \return false if the frame was dropped.
+     */
+    bool receive(
+        Network *pCard, const Network::Fragment *fragments, size_t count,
+        size_t nBytes);
+
+    /** Fills \p stats for \p pCard. \return false if it isn't registered. */
+    bool getReceiveStatistics(Network *pCard, ReceiveStatistics &stats) const;
+
     /** Registers a given network device with the stack */
     void registerDevice(Network *pDevice);
 
@@ -129,11 +203,48 @@ class EXPORTED_PUBLIC NetworkStack : public RequestQueue
     }
 
   private:
+    NOT_COPYABLE_OR_ASSIGNABLE(NetworkStack);
+
     static NetworkStack *stack;
 
-    virtual uint64_t executeRequest(
-        uint64_t p1, uint64_t p2, uint64_t p3, uint64_t p4, uint64_t p5,
-        uint64_t p6, uint64_t p7, uint64_t p8);
+    /** Frames waiting for the lwIP thread on one interface. */
+    struct ReceiveQueue
+    {
+        ReceiveQueue(Network *pNewCard, struct netif *pIface);
+        ~ReceiveQueue();
+
+        Network *pCard;
+        struct netif *iface;
+
+        LockFreeQueue<struct pbuf *> frames;
+
+        /// Preallocated lwIP message that runs drainReceiveQueue.
+        struct tcpip_callback_msg *pDrainMessage;
+
+        /// Non-zero while a drain is posted to, or running on, the lwIP
+        /// thread. Keeps the same message from being posted twice.
+        uint32_t drainPending;
+
+        /// Set once the interface is going away; no more drains are posted.
+        volatile bool dying;
+
+        ReceiveStatistics stats;
+    };
+
+    /** Copies one frame into a pbuf and queues it. */
+    bool enqueue(ReceiveQueue *pQueue, uintptr_t packet, size_t nBytes);
+
+    /** Queues \p p for the lwIP thread, or drops and frees it if full. */
+    bool queueFrame(ReceiveQueue *pQueue, struct pbuf *p);
+
+    /** Posts a drain of \p pQueue to the lwIP thread if none is pending. */
+    static void scheduleDrain(ReceiveQueue *pQueue);
+
+    /** lwIP thread callback: hands a batch of queued frames to lwIP. */
+    static void drainReceiveQueue(void *ctx);
+
+    /** lwIP thread callback: frees a deregistered interface's queue. */
+    static void destroyReceiveQueue(void *ctx);
 
     /** Loopback device */
     Network *m_pLoopback;
@@ -151,6 +262,9 @@ class EXPORTED_PUBLIC NetworkStack : public RequestQueue
     /** lwIP interfaces for each of our cards. */
     Tree<Network *, struct netif *> m_Interfaces;
 
+    /** Receive queues for each of our cards. */
+    Tree<Network *, ReceiveQueue *> m_ReceiveQueues;
+
     /** Next interface number to assign. */
     size_t m_NextInterfaceNumber;
 };
@@ -0,0 +1,659 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "PacketFilter.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+/** Operations in compiled programs. Keep in step with the handler table in
+ * PacketFilter::run. */
+enum PacketFilterOp
+{
+    LoadWordAbs,
+    LoadHalfAbs,
+    LoadByteAbs,
+    LoadWordInd,
+    LoadHalfInd,
+    LoadByteInd,
+    LoadLen,
+    LoadImm,
+    LoadMem,
+    LoadXImm,
+    LoadXMem,
+    LoadXLen,
+    LoadXMsh,
+    Store,
+    StoreX,
+    AddK,
+    AddX,
+    SubK,
+    SubX,
+    MulK,
+    MulX,
+    DivK,
+    DivX,
+    ModK,
+    ModX,
+    AndK,
+    AndX,
+    OrK,
+    OrX,
+    XorK,
+    XorX,
+    LshK,
+    LshX,
+    RshK,
+    RshX,
+    Neg,
+    Jump,
+    JeqK,
+    JeqX,
+    JgtK,
+    JgtX,
+    JgeK,
+    JgeX,
+    JsetK,
+    JsetX,
+    // A packet load then "jeq #k2", as one operation.
+    LoadWordAbsJeq,
+    LoadHalfAbsJeq,
+    LoadByteAbsJeq,
+    ReturnK,
+    ReturnA,
+    Tax,
+    Txa,
+    OpCount
+};
+
+/** A compiled operation. Jump targets are indices into the compiled program
+ * rather than relative offsets. */
+struct PacketFilter::Op
+{
+    uint32_t op;
+    uint32_t k;
+    uint32_t k2;
+    uint32_t jt;
+    uint32_t jf;
+};
+
+static inline bool isConditionalJump(uint16_t code)
+{
+    return BPF_CLASS(code) == BPF_JMP && BPF_OP(code) != BPF_JA;
+}
+
+static inline bool inBounds(size_t length, uint64_t offset, size_t size)
+{
+    return offset + size <= length;
+}
+
+static inline uint32_t loadWord(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint32_t loadHalf(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 8) | p[1];
+}
+
+/** Maps a verified instruction to its compiled operation. */
+static uint32_t translate(uint16_t code)
+{
+    switch (code)
+    {
+        case BPF_LD | BPF_W | BPF_ABS:
+            return LoadWordAbs;
+        case BPF_LD | BPF_H | BPF_ABS:
+            return LoadHalfAbs;
+        case BPF_LD | BPF_B | BPF_ABS:
+            return LoadByteAbs;
+        case BPF_LD | BPF_W | BPF_IND:
+            return LoadWordInd;
+        case BPF_LD | BPF_H | BPF_IND:
+            return LoadHalfInd;
+        case BPF_LD | BPF_B | BPF_IND:
+            return LoadByteInd;
+        case BPF_LD | BPF_W | BPF_LEN:
+            return LoadLen;
+        case BPF_LD | BPF_IMM:
+            return LoadImm;
+        case BPF_LD | BPF_MEM:
+            return LoadMem;
+        case BPF_LDX | BPF_W | BPF_IMM:
+            return LoadXImm;
+        case BPF_LDX | BPF_W | BPF_MEM:
+            return LoadXMem;
+        case BPF_LDX | BPF_W | BPF_LEN:
+            return LoadXLen;
+        case BPF_LDX | BPF_B | BPF_MSH:
+            return LoadXMsh;
+        case BPF_ST:
+            return Store;
+        case BPF_STX:
+            return StoreX;
+        case BPF_ALU | BPF_ADD | BPF_K:
+            return AddK;
+        case BPF_ALU | BPF_ADD | BPF_X:
+            return AddX;
+        case BPF_ALU | BPF_SUB | BPF_K:
+            return SubK;
+        case BPF_ALU | BPF_SUB | BPF_X:
+            return SubX;
+        case BPF_ALU | BPF_MUL | BPF_K:
+            return MulK;
+        case BPF_ALU | BPF_MUL | BPF_X:
+            return MulX;
+        case BPF_ALU | BPF_DIV | BPF_K:
+            return DivK;
+        case BPF_ALU | BPF_DIV | BPF_X:
+            return DivX;
+        case BPF_ALU | BPF_MOD | BPF_K:
+            return ModK;
+        case BPF_ALU | BPF_MOD | BPF_X:
+            return ModX;
+        case BPF_ALU | BPF_AND | BPF_K:
+            return AndK;
+        case BPF_ALU | BPF_AND | BPF_X:
+            return AndX;
+        case BPF_ALU | BPF_OR | BPF_K:
+            return OrK;
+        case BPF_ALU | BPF_OR | BPF_X:
+            return OrX;
+        case BPF_ALU | BPF_XOR | BPF_K:
+            return XorK;
+        case BPF_ALU | BPF_XOR | BPF_X:
+            return XorX;
+        case BPF_ALU | BPF_LSH | BPF_K:
+            return LshK;
+        case BPF_ALU | BPF_LSH | BPF_X:
+            return LshX;
+        case BPF_ALU | BPF_RSH | BPF_K:
+            return RshK;
+        case BPF_ALU | BPF_RSH | BPF_X:
+            return RshX;
+        case BPF_ALU | BPF_NEG:
+            return Neg;
+        case BPF_JMP | BPF_JA:
+            return Jump;
+        case BPF_JMP | BPF_JEQ | BPF_K:
+            return JeqK;
+        case BPF_JMP | BPF_JEQ | BPF_X:
+            return JeqX;
+        case BPF_JMP | BPF_JGT | BPF_K:
+            return JgtK;
+        case BPF_JMP | BPF_JGT | BPF_X:
+            return JgtX;
+        case BPF_JMP | BPF_JGE | BPF_K:
+            return JgeK;
+        case BPF_JMP | BPF_JGE | BPF_X:
+            return JgeX;
+        case BPF_JMP | BPF_JSET | BPF_K:
+            return JsetK;
+        case BPF_JMP | BPF_JSET | BPF_X:
+            return JsetX;
+        case BPF_RET | BPF_K:
+            return ReturnK;
+        case BPF_RET | BPF_A:
+            return ReturnA;
+        case BPF_MISC | BPF_TAX:
+            return Tax;
+        case BPF_MISC | BPF_TXA:
+            return Txa;
+        default:
+            return OpCount;
+    }
+}
+
+PacketFilter::PacketFilter() : m_pOps(nullptr), m_nOps(0)
+{
+}
+
+PacketFilter::~PacketFilter()
+{
+    delete[] m_pOps;
+}
+
+bool PacketFilter::verify(const PacketFilterInstruction *program, size_t count)
+{
+    if (!program || !count || count > BPF_MAXINSNS)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const PacketFilterInstruction &insn = program[i];
+        uint32_t op = translate(insn.code);
+        if (op == OpCount)
+        {
+            return false;
+        }
+
+        // Instructions left after this one, the furthest any jump may go.
+        size_t remaining = count - i - 1;
+
+        switch (op)
+        {
+            case LoadWordAbs:
+            case LoadHalfAbs:
+            case LoadByteAbs:
+            case LoadWordInd:
+            case LoadHalfInd:
+            case LoadByteInd:
+                // Negative offsets select Linux's ancillary data.
+                if (insn.k & 0x80000000U)
+                {
+                    return false;
+                }
+                break;
+            case LoadMem:
+            case LoadXMem:
+            case Store:
+            case StoreX:
+                if (insn.k >= BPF_MEMWORDS)
+                {
+                    return false;
+                }
+                break;
+            case DivK:
+            case ModK:
+                if (!insn.k)
+                {
+                    return false;
+                }
+                break;
+            case LshK:
+            case RshK:
+                if (insn.k >= 32)
+                {
+                    return false;
+                }
+                break;
+            case Jump:
+                if (insn.k >= remaining)
+                {
+                    return false;
+                }
+                break;
+            default:
+                if (isConditionalJump(insn.code) &&
+                    (insn.jt >= remaining || insn.jf >= remaining))
+                {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    // Jumps only go forwards, so a program ending in a return always
+    // terminates with one.
+    return BPF_CLASS(program[count - 1].code) == BPF_RET;
+}
+
+bool PacketFilter::load(const PacketFilterInstruction *program, size_t count)
+{
+    delete[] m_pOps;
+    m_pOps = nullptr;
+    m_nOps = 0;
+
+    if (!verify(program, count))
+    {
+        return false;
+    }
+
+    // Fusing a load into the compare after it is only safe if nothing jumps
+    // to the compare on its own.
+    bool *isTarget = new bool[count];
+    ByteSet(isTarget, 0, count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const PacketFilterInstruction &insn = program[i];
+        if (insn.code == (BPF_JMP | BPF_JA))
+        {
+            isTarget[i + 1 + insn.k] = true;
+        }
+        else if (isConditionalJump(insn.code))
+        {
+            isTarget[i + 1 + insn.jt] = true;
+            isTarget[i + 1 + insn.jf] = true;
+        }
+    }
+
+    // Compiled index of each instruction; a fused compare shares its load's.
+    uint32_t *index = new uint32_t[count];
+    Op *ops = new Op[count];
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i, ++n)
+    {
+        const PacketFilterInstruction &insn = program[i];
+        Op &op = ops[n];
+        op.op = translate(insn.code);
+        op.k = insn.k;
+        op.k2 = 0;
+        op.jt = 0;
+        op.jf = 0;
+        index[i] = n;
+
+        bool isLoad = op.op == LoadWordAbs || op.op == LoadHalfAbs ||
+                      op.op == LoadByteAbs;
+        if (isLoad && (i + 1) < count && !isTarget[i + 1] &&
+            program[i + 1].code == (BPF_JMP | BPF_JEQ | BPF_K))
+        {
+            op.op = LoadWordAbsJeq + (op.op - LoadWordAbs);
+            op.k2 = program[i + 1].k;
+            index[++i] = n;
+        }
+    }
+
+    // Resolve jump targets now that every instruction has its final index.
+    for (size_t i = 0; i < count; ++i)
+    {
+        const PacketFilterInstruction &insn = program[i];
+        Op &op = ops[index[i]];
+        if (insn.code == (BPF_JMP | BPF_JA))
+        {
+            op.jt = op.jf = index[i + 1 + insn.k];
+        }
+        else if (isConditionalJump(insn.code))
+        {
+            op.jt = index[i + 1 + insn.jt];
+            op.jf = index[i + 1 + insn.jf];
+
+            // Both ways lead to the same place, so don't bother comparing.
+            if (op.jt == op.jf && op.op < LoadWordAbsJeq)
+            {
+                op.op = Jump;
+            }
+        }
+    }
+
+    delete[] index;
+    delete[] isTarget;
+
+    m_pOps = ops;
+    m_nOps = n;
+    return true;
+}
+
+uint32_t PacketFilter::run(const uint8_t *packet, size_t length) const
+{
+    if (!m_pOps)
+    {
+        return ~0U;
+    }
+
+    static const void *const handlers[] = {
+        &&load_word_abs,
+        &&load_half_abs,
+        &&load_byte_abs,
+        &&load_word_ind,
+        &&load_half_ind,
+        &&load_byte_ind,
+        &&load_len,
+        &&load_imm,
+        &&load_mem,
+        &&loadx_imm,
+        &&loadx_mem,
+        &&loadx_len,
+        &&loadx_msh,
+        &&store,
+        &&storex,
+        &&add_k,
+        &&add_x,
+        &&sub_k,
+        &&sub_x,
+        &&mul_k,
+        &&mul_x,
+        &&div_k,
+        &&div_x,
+        &&mod_k,
+        &&mod_x,
+        &&and_k,
+        &&and_x,
+        &&or_k,
+        &&or_x,
+        &&xor_k,
+        &&xor_x,
+        &&lsh_k,
+        &&lsh_x,
+        &&rsh_k,
+        &&rsh_x,
+        &&neg,
+        &&jump,
+        &&jeq_k,
+        &&jeq_x,
+        &&jgt_k,
+        &&jgt_x,
+        &&jge_k,
+        &&jge_x,
+        &&jset_k,
+        &&jset_x,
+        &&load_word_abs_jeq,
+        &&load_half_abs_jeq,
+        &&load_byte_abs_jeq,
+        &&return_k,
+        &&return_a,
+        &&tax,
+        &&txa,
+    };
+    static_assert(
+        sizeof(handlers) / sizeof(handlers[0]) == OpCount,
+        "PacketFilter handler table is out of step with PacketFilterOp");
+
+    const Op *op = m_pOps;
+    uint32_t A = 0;
+    uint32_t X = 0;
+    uint32_t mem[BPF_MEMWORDS] = {0};
+    uint64_t offset;
+
+#define DISPATCH() goto *handlers[op->op]
+#define NEXT()      \
+    do              \
+    {               \
+        ++op;       \
+        DISPATCH(); \
+    } while (0)
+#define BRANCH(cond)                              \
+    do                                            \
+    {                                             \
+        op = m_pOps + ((cond) ? op->jt : op->jf); \
+        DISPATCH();                               \
+    } while (0)
+
+    DISPATCH();
+
+load_word_abs:
+    if (!inBounds(length, op->k, 4))
+        return 0;
+    A = loadWord(packet + op->k);
+    NEXT();
+load_half_abs:
+    if (!inBounds(length, op->k, 2))
+        return 0;
+    A = loadHalf(packet + op->k);
+    NEXT();
+load_byte_abs:
+    if (!inBounds(length, op->k, 1))
+        return 0;
+    A = packet[op->k];
+    NEXT();
+load_word_ind:
+    offset = static_cast<uint64_t>(X) + op->k;
+    if (!inBounds(length, offset, 4))
+        return 0;
+    A = loadWord(packet + offset);
+    NEXT();
+load_half_ind:
+    offset = static_cast<uint64_t>(X) + op->k;
+    if (!inBounds(length, offset, 2))
+        return 0;
+    A = loadHalf(packet + offset);
+    NEXT();
+load_byte_ind:
+    offset = static_cast<uint64_t>(X) + op->k;
+    if (!inBounds(length, offset, 1))
+        return 0;
+    A = packet[offset];
+    NEXT();
+load_len:
+    A = static_cast<uint32_t>(length);
+    NEXT();
+load_imm:
+    A = op->k;
+    NEXT();
+load_mem:
+    A = mem[op->k];
+    NEXT();
+loadx_imm:
+    X = op->k;
+    NEXT();
+loadx_mem:
+    X = mem[op->k];
+    NEXT();
+loadx_len:
+    X = static_cast<uint32_t>(length);
+    NEXT();
+loadx_msh:
+    if (!inBounds(length, op->k, 1))
+        return 0;
+    X = (packet[op->k] & 0xF) << 2;
+    NEXT();
+store:
+    mem[op->k] = A;
+    NEXT();
+storex:
+    mem[op->k] = X;
+    NEXT();
+add_k:
+    A += op->k;
+    NEXT();
+add_x:
+    A += X;
+    NEXT();
+sub_k:
+    A -= op->k;
+    NEXT();
+sub_x:
+    A -= X;
+    NEXT();
+mul_k:
+    A *= op->k;
+    NEXT();
+mul_x:
+    A *= X;
+    NEXT();
+div_k:
+    A /= op->k;
+    NEXT();
+div_x:
+    if (!X)
+        return 0;
+    A /= X;
+    NEXT();
+mod_k:
+    A %= op->k;
+    NEXT();
+mod_x:
+    if (!X)
+        return 0;
+    A %= X;
+    NEXT();
+and_k:
+    A &= op->k;
+    NEXT();
+and_x:
+    A &= X;
+    NEXT();
+or_k:
+    A |= op->k;
+    NEXT();
+or_x:
+    A |= X;
+    NEXT();
+xor_k:
+    A ^= op->k;
+    NEXT();
+xor_x:
+    A ^= X;
+    NEXT();
+lsh_k:
+    A <<= op->k;
+    NEXT();
+lsh_x:
+    A = X < 32 ? A << X : 0;
+    NEXT();
+rsh_k:
+    A >>= op->k;
+    NEXT();
+rsh_x:
+    A = X < 32 ? A >> X : 0;
+    NEXT();
+neg:
+    A = -A;
+    NEXT();
+jump:
+    op = m_pOps + op->jt;
+    DISPATCH();
+jeq_k:
+    BRANCH(A == op->k);
+jeq_x:
+    BRANCH(A == X);
+jgt_k:
+    BRANCH(A > op->k);
+jgt_x:
+    BRANCH(A > X);
+jge_k:
+    BRANCH(A >= op->k);
+jge_x:
+    BRANCH(A >= X);
+jset_k:
+    BRANCH(A & op->k);
+jset_x:
+    BRANCH(A & X);
+load_word_abs_jeq:
+    if (!inBounds(length, op->k, 4))
+        return 0;
+    A = loadWord(packet + op->k);
+    BRANCH(A == op->k2);
+load_half_abs_jeq:
+    if (!inBounds(length, op->k, 2))
+        return 0;
+    A = loadHalf(packet + op->k);
+    BRANCH(A == op->k2);
+load_byte_abs_jeq:
+    if (!inBounds(length, op->k, 1))
+        return 0;
+    A = packet[op->k];
+    BRANCH(A == op->k2);
+return_k:
+    return op->k;
+return_a:
+    return A;
+tax:
+    X = A;
+    NEXT();
+txa:
+    A = X;
+    NEXT();
+
+#undef BRANCH
+#undef NEXT
+#undef DISPATCH
+}
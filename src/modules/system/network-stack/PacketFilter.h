@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NETWORK_STACK_PACKETFILTER_H
+#define NETWORK_STACK_PACKETFILTER_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/** One classic BPF instruction; the same layout as Linux's sock_filter, so
+ * programs produced by tcpdump -dd or libpcap can be loaded unchanged. */
+struct PacketFilterInstruction
+{
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+};
+
+/** A program as passed in from userspace; the same layout as sock_fprog. */
+struct PacketFilterProgram
+{
+    uint16_t length;
+    PacketFilterInstruction *instructions;
+};
+
+// Opcode fields, matching the classic BPF encoding. These are only defined
+// if a system header hasn't already provided them.
+#ifndef BPF_CLASS
+#define BPF_CLASS(code) ((code) &0x07)
+#define BPF_LD 0x00
+#define BPF_LDX 0x01
+#define BPF_ST 0x02
+#define BPF_STX 0x03
+#define BPF_ALU 0x04
+#define BPF_JMP 0x05
+#define BPF_RET 0x06
+#define BPF_MISC 0x07
+
+#define BPF_SIZE(code) ((code) &0x18)
+#define BPF_W 0x00
+#define BPF_H 0x08
+#define BPF_B 0x10
+
+#define BPF_MODE(code) ((code) &0xe0)
+#define BPF_IMM 0x00
+#define BPF_ABS 0x20
+#define BPF_IND 0x40
+#define BPF_MEM 0x60
+#define BPF_LEN 0x80
+#define BPF_MSH 0xa0
+
+#define BPF_OP(code) ((code) &0xf0)
+#define BPF_ADD 0x00
+#define BPF_SUB 0x10
+#define BPF_MUL 0x20
+#define BPF_DIV 0x30
+#define BPF_OR 0x40
+#define BPF_AND 0x50
+#define BPF_LSH 0x60
+#define BPF_RSH 0x70
+#define BPF_NEG 0x80
+#define BPF_MOD 0x90
+#define BPF_XOR 0xa0
+
+#define BPF_JA 0x00
+#define BPF_JEQ 0x10
+#define BPF_JGT 0x20
+#define BPF_JGE 0x30
+#define BPF_JSET 0x40
+
+#define BPF_SRC(code) ((code) &0x08)
+#define BPF_K 0x00
+#define BPF_X 0x08
+
+#define BPF_RVAL(code) ((code) &0x18)
+#define BPF_A 0x10
+
+#define BPF_MISCOP(code) ((code) &0xf8)
+#define BPF_TAX 0x00
+#define BPF_TXA 0x80
+#endif
+
+#ifndef BPF_MEMWORDS
+#define BPF_MEMWORDS 16
+#endif
+
+#ifndef BPF_MAXINSNS
+#define BPF_MAXINSNS 4096
+#endif
+
+#ifndef BPF_STMT
+#define BPF_STMT(code, k) {static_cast<uint16_t>(code), 0, 0, k}
+#define BPF_JUMP(code, k, jt, jf) {static_cast<uint16_t>(code), jt, jf, k}
+#endif
+
+/**
+ * A verified classic BPF program, compiled for fast repeated execution.
+ *
+ * load() checks the program the same way Linux does for socket filters:
+ * every opcode must be known, every jump must land inside the program (and
+ * jumps only go forwards, so programs always terminate), scratch memory
+ * indices must be in range, constant divisors must be non-zero and the last
+ * instruction must return. Ancillary loads (negative offsets) aren't
+ * supported and are rejected.
+ *
+ * The verified program is then translated into a compact form that run()
+ * dispatches with threaded code: each operation jumps straight to the next
+ * operation's handler rather than going back through one shared switch.
+ * Jump targets are resolved in advance, a conditional jump whose branches
+ * are the same becomes an unconditional one, and a packet load immediately
+ * followed by a compare against a constant (the bulk of any tcpdump
+ * program) is fused into a single operation.
+ */
+class EXPORTED_PUBLIC PacketFilter
+{
+  public:
+    PacketFilter();
+    ~PacketFilter();
+
+    /** Checks a program without loading it. */
+    static bool verify(const PacketFilterInstruction *program, size_t count);
+
+    /** Verifies and compiles \p program, replacing any loaded program.
+     * \return false, leaving the filter empty, if it was rejected. */
+    bool load(const PacketFilterInstruction *program, size_t count);
+
+    bool isLoaded() const
+    {
+        return m_pOps != nullptr;
+    }
+
+    /** Runs the program over a packet.
+     * \return how many bytes of the packet to accept, with 0 meaning drop.
+     *         This may exceed \p length; callers clamp it. An empty filter
+     *         accepts everything. */
+    uint32_t run(const uint8_t *packet, size_t length) const;
+
+  private:
+    NOT_COPYABLE_OR_ASSIGNABLE(PacketFilter);
+
+    struct Op;
+
+    Op *m_pOps;
+    size_t m_nOps;
+};
+
+#endif  // NETWORK_STACK_PACKETFILTER_H
@@ -45,6 +45,7 @@ RamFile::RamFile(
 
 RamFile::~RamFile()
 {
+    quiesce();
     truncate();
 }
 
@@ -38,6 +38,7 @@ class RawFsFile : public File
     RawFsFile(String name, class RawFs *pFs, File *pParent, Disk *pDisk);
     ~RawFsFile()
     {
+        quiesce();
     }
 
     virtual uintptr_t readBlock(uint64_t location);
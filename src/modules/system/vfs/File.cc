@@ -21,6 +21,9 @@
 #include "Filesystem.h"
 #include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/machine/Disk.h"
+#include "pedigree/kernel/process/ConditionVariable.h"
+#include "pedigree/kernel/process/MemoryPressureManager.h"
 #include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
@@ -29,11 +32,94 @@
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/Iterator.h"
+#include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/Pair.h"
+#include "pedigree/kernel/utilities/RequestQueue.h"
 #include "pedigree/kernel/utilities/Result.h"
+#include "pedigree/kernel/utilities/Tree.h"
 #include "pedigree/kernel/utilities/assert.h"
 #include "pedigree/kernel/utilities/utility.h"
 
+#ifdef THREADS
+/// Files that have queued read-ahead, by read-ahead identifier. Requests
+/// may still be queued after the file is gone, so the worker looks the file
+/// up here rather than trusting a pointer.
+static Tree<uint64_t, File *> g_ReadAheadFiles;
+static uint64_t g_NextReadAheadId = 1;
+static Mutex g_ReadAheadLock(false);
+/// Signalled (under g_ReadAheadLock) when a file's read-ahead pins drop.
+static ConditionVariable g_ReadAheadDone;
+
+/** Services read-ahead requests from all files on a worker thread. */
+class FileReadAheadQueue : public RequestQueue
+{
+  public:
+    FileReadAheadQueue() : RequestQueue("File read-ahead")
+    {
+    }
+
+  protected:
+    virtual uint64_t executeRequest(
+        uint64_t p1, uint64_t p2, uint64_t p3, uint64_t p4, uint64_t p5,
+        uint64_t p6, uint64_t p7, uint64_t p8)
+    {
+        File *pFile;
+        {
+            LockGuard<Mutex> guard(g_ReadAheadLock);
+            pFile = g_ReadAheadFiles.lookup(p1);
+            if (!pFile)
+            {
+                return 0;
+            }
+
+            ++pFile->m_nReadAheadPins;
+        }
+
+        pFile->fillReadAhead(p2, p3);
+
+        LockGuard<Mutex> guard(g_ReadAheadLock);
+        --pFile->m_nReadAheadPins;
+        g_ReadAheadDone.broadcast();
+        return 0;
+    }
+
+    virtual bool compareRequests(const Request &a, const Request &b)
+    {
+        return a.p1 == b.p1 && a.p2 == b.p2;
+    }
+};
+
+static FileReadAheadQueue *g_pReadAheadQueue = 0;
+
+/** Flushes write-back data so the caches holding it become evictable. */
+class FileWriteBackHandler : public MemoryPressureHandler
+{
+  public:
+    virtual const String getMemoryPressureDescription()
+    {
+        return String("File write-back flush");
+    }
+
+    virtual bool compact()
+    {
+        // Dirty blocks can't be evicted, so write them all back. That makes
+        // them clean for the caches to evict on the next pass, by which
+        // point there is nothing left here to flush.
+        return File::flushDirtyFiles(false) > 0;
+    }
+};
+
+static FileWriteBackHandler g_WriteBackHandler;
+static bool g_bWriteBackArmed = false;
+static bool g_bWriteBackStopped = true;
+static Mutex g_DirtyFilesLock(false);
+/// Signalled (under g_DirtyFilesLock) when a file's flush pins are dropped.
+static ConditionVariable g_FlushDone;
+#endif
+
+/// Files holding dirty blocks in write-back mode.
+static List<File *> g_DirtyFiles;
+
 void File::writeCallback(
     CacheConstants::CallbackCause cause, uintptr_t loc, uintptr_t page,
     void *meta)
@@ -69,7 +155,10 @@ File::File()
     : m_Name(), m_AccessedTime(0), m_ModifiedTime(0), m_CreationTime(0),
       m_Inode(0), m_pFilesystem(0), m_Size(0), m_pParent(0), m_nWriters(0),
       m_nReaders(0), m_Uid(0), m_Gid(0), m_Permissions(0),
-      m_DataCache(FILE_BAD_BLOCK), m_bDirect(false)
+      m_DataCache(FILE_BAD_BLOCK), m_bDirect(false), m_ReadAhead(),
+      m_ReadAheadId(0), m_nReadAheadPins(0), m_DirtyBlocks(),
+      m_nDirtyBlocks(0), m_DirtyFirst(0), m_DirtyLast(0), m_DirtySince(0),
+      m_bDirtyListed(false), m_nFlushPins(0)
 #ifndef VFS_NOMMU
       ,
       m_FillCache()
@@ -78,6 +167,8 @@ File::File()
       ,
       m_Lock(), m_MonitorTargets()
 #endif
+      ,
+      m_Watchers()
 {
 }
 
@@ -88,7 +179,10 @@ File::File(
     : m_Name(name), m_AccessedTime(accessedTime), m_ModifiedTime(modifiedTime),
       m_CreationTime(creationTime), m_Inode(inode), m_pFilesystem(pFs),
       m_Size(size), m_pParent(pParent), m_nWriters(0), m_nReaders(0), m_Uid(0),
-      m_Gid(0), m_Permissions(0), m_DataCache(FILE_BAD_BLOCK), m_bDirect(false)
+      m_Gid(0), m_Permissions(0), m_DataCache(FILE_BAD_BLOCK), m_bDirect(false),
+      m_ReadAhead(), m_ReadAheadId(0), m_nReadAheadPins(0), m_DirtyBlocks(),
+      m_nDirtyBlocks(0), m_DirtyFirst(0), m_DirtyLast(0), m_DirtySince(0),
+      m_bDirtyListed(false), m_nFlushPins(0)
 #ifndef VFS_NOMMU
       ,
       m_FillCache()
@@ -97,6 +191,8 @@ File::File(
       ,
       m_Lock(), m_MonitorTargets()
 #endif
+      ,
+      m_Watchers()
 {
     size_t maxBlock = size / getBlockSize();
     if (size % getBlockSize())
@@ -110,10 +206,22 @@ File::File(
 
 File::~File()
 {
+    // Subclasses that write back data quiesce in their own destructors, as
+    // by now writeBlock() no longer reaches them. Anything still dirty here
+    // has nowhere to go.
+    if (m_nDirtyBlocks)
+    {
+        WARNING(
+            "File '" << m_Name << "' destroyed with " << m_nDirtyBlocks
+                     << " unwritten blocks");
+    }
+
+    quiesce();
 }
 
-uint64_t
-File::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+uint64_t File::read(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock,
+    ReadAheadState *pReadAhead)
 {
     if (isBytewise())
     {
@@ -142,6 +250,14 @@ File::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
     const size_t blockSize =
         useFillCache() ? PhysicalMemoryManager::getPageSize() : getBlockSize();
 
+    /// \todo read-ahead for the fill cache
+    if (size && !m_bDirect && !useFillCache())
+    {
+        readAhead(
+            location / blockSize, (location + size - 1) / blockSize,
+            pReadAhead);
+    }
+
     size_t n = 0;
     while (size)
     {
@@ -179,6 +295,119 @@ File::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
     return n;
 }
 
+uint64_t File::transfer(
+    uint64_t location, uint64_t size, TransferCallback callback, void *param,
+    bool bCanBlock, ReadAheadState *pReadAhead)
+{
+    TransferSegment segments[MaxTransferSegments];
+
+    if (isBytewise())
+    {
+        // No cache to hand out, so stage the data a page at a time.
+        const size_t pageSize = PhysicalMemoryManager::getPageSize();
+        uint8_t *bounce = new uint8_t[pageSize];
+
+        size_t n = 0;
+        while (size)
+        {
+            uint64_t sz = (size > pageSize) ? pageSize : size;
+            sz = readBytewise(
+                location, sz, reinterpret_cast<uintptr_t>(bounce), bCanBlock);
+            if (!sz)
+            {
+                break;
+            }
+
+            segments[0].buffer = reinterpret_cast<uintptr_t>(bounce);
+            segments[0].size = sz;
+            uint64_t taken = callback(param, segments, 1);
+            n += taken;
+            if (taken < sz)
+            {
+                break;
+            }
+
+            location += sz;
+            size -= sz;
+        }
+
+        delete[] bounce;
+        return n;
+    }
+
+    if (location >= m_Size)
+    {
+        return 0;
+    }
+    if (size > (m_Size - location))
+    {
+        size = m_Size - location;
+    }
+
+    const size_t blockSize =
+        useFillCache() ? PhysicalMemoryManager::getPageSize() : getBlockSize();
+
+    if (size && !m_bDirect && !useFillCache())
+    {
+        readAhead(
+            location / blockSize, (location + size - 1) / blockSize,
+            pReadAhead);
+    }
+
+    size_t n = 0;
+    while (size)
+    {
+        // Gather and pin a batch of blocks, so the callback can take them
+        // all at once (e.g. as a single gathered send).
+        uint64_t firstBlock = location / blockSize;
+        uint64_t batchSize = 0;
+        size_t count = 0;
+        bool bFailed = false;
+        while (count < MaxTransferSegments && batchSize < size)
+        {
+            uint64_t here = location + batchSize;
+            uintptr_t block = here / blockSize;
+            uintptr_t offs = here % blockSize;
+            uint64_t remaining = size - batchSize;
+            uintptr_t sz =
+                (remaining + offs > blockSize) ? blockSize - offs : remaining;
+
+            uintptr_t buff = readIntoCache(block);
+            if (buff == FILE_BAD_BLOCK)
+            {
+                ERROR(
+                    "File::transfer - failed to get page from cache, "
+                    "returning early");
+                bFailed = true;
+                break;
+            }
+
+            pinBlock(block * blockSize);
+            segments[count].buffer = buff + offs;
+            segments[count].size = sz;
+            ++count;
+            batchSize += sz;
+        }
+
+        uint64_t taken = count ? callback(param, segments, count) : 0;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            unpinBlock((firstBlock + i) * blockSize);
+        }
+
+        n += taken;
+        if (bFailed || taken < batchSize)
+        {
+            break;
+        }
+
+        location += batchSize;
+        size -= batchSize;
+    }
+    return n;
+}
+
 uint64_t
 File::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
 {
@@ -203,6 +432,8 @@ File::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
     // Extend the file before writing it if needed.
     extend(location + size, location, size);
 
+    const bool bWriteBack = m_pFilesystem && m_pFilesystem->isWriteBack();
+
     size_t n = 0;
     while (size)
     {
@@ -222,8 +453,16 @@ File::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
             reinterpret_cast<void *>(buff + offs),
             reinterpret_cast<void *>(buffer), sz);
 
-        // Trigger an immediate write-back - write-through cache.
-        writeBlock(block * blockSize, buff);
+        // Write-through unless the filesystem was mounted write-back, in
+        // which case the block is flushed later with its neighbours.
+        if (bWriteBack)
+        {
+            markDirty(block);
+        }
+        else
+        {
+            writeBlock(block * blockSize, buff);
+        }
 
         location += sz;
         buffer += sz;
@@ -350,25 +589,35 @@ void File::returnPhysicalPage(size_t offset)
 
 void File::sync()
 {
+    flushDirty();
+    if (!m_pFilesystem || !m_pFilesystem->isWriteBack())
+    {
 #ifdef THREADS
-    LockGuard<Mutex> guard(m_Lock);
+        LockGuard<Mutex> guard(m_Lock);
 #endif
 
-    const size_t blockSize = getBlockSize();
-    for (size_t i = 0; i < m_DataCache.count(); ++i)
-    {
-        auto result = m_DataCache.getNth(i);
-        if (result.hasError())
+        const size_t blockSize = getBlockSize();
+        for (size_t i = 0; i < m_DataCache.count(); ++i)
         {
-            break;
-        }
+            auto result = m_DataCache.getNth(i);
+            if (result.hasError())
+            {
+                break;
+            }
 
-        uintptr_t buffer = result.value().second();
-        if (buffer != FILE_BAD_BLOCK)
-        {
-            writeBlock(i * blockSize, buffer);
+            uintptr_t buffer = result.value().second();
+            if (buffer != FILE_BAD_BLOCK)
+            {
+                writeBlock(i * blockSize, buffer);
+            }
         }
     }
+
+    // The writes may still be queued up in front of the disk.
+    if (m_pFilesystem && m_pFilesystem->getDisk())
+    {
+        m_pFilesystem->getDisk()->sync();
+    }
 }
 
 void File::sync(size_t offset, bool async)
@@ -670,6 +919,11 @@ void File::dataChanged()
         }
 
         m_MonitorTargets.clear();
+
+        for (auto pWatcher : m_Watchers)
+        {
+            pWatcher->changed();
+        }
     }
 
     // If anything was waiting on a change, wake it up now.
@@ -677,6 +931,11 @@ void File::dataChanged()
     {
         Scheduler::instance().yield();
     }
+#else
+    for (auto pWatcher : m_Watchers)
+    {
+        pWatcher->changed();
+    }
 #endif
 }
 
@@ -710,6 +969,29 @@ void File::cullMonitorTargets(Thread *pThread)
 #endif
 }
 
+void File::watch(FileWatcher *pWatcher)
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Lock);
+#endif
+    m_Watchers.pushBack(pWatcher);
+}
+
+void File::unwatch(FileWatcher *pWatcher)
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Lock);
+#endif
+    for (auto it = m_Watchers.begin(); it != m_Watchers.end(); ++it)
+    {
+        if (*it == pWatcher)
+        {
+            m_Watchers.erase(it);
+            return;
+        }
+    }
+}
+
 void File::getFilesystemLabel(HugeStaticString &s)
 {
     s = m_pFilesystem->getVolumeLabel();
@@ -813,6 +1095,426 @@ bool File::useFillCache() const
 #endif
 }
 
+void File::initialiseReadAhead()
+{
+#ifdef THREADS
+    if (!g_pReadAheadQueue)
+    {
+        g_pReadAheadQueue = new FileReadAheadQueue();
+        g_pReadAheadQueue->initialise();
+    }
+#endif
+}
+
+void File::destroyReadAhead()
+{
+#ifdef THREADS
+    if (g_pReadAheadQueue)
+    {
+        g_pReadAheadQueue->destroy();
+        delete g_pReadAheadQueue;
+        g_pReadAheadQueue = 0;
+    }
+#endif
+}
+
+void File::readAhead(
+    uintptr_t firstBlock, uintptr_t lastBlock, ReadAheadState *pState)
+{
+    if (!pState)
+    {
+        pState = &m_ReadAhead;
+    }
+
+    size_t blockSize = getBlockSize();
+    uintptr_t endBlock = (m_Size + blockSize - 1) / blockSize;
+    size_t nBlocks = (lastBlock - firstBlock) + 1;
+
+    uintptr_t start = 0, count = 0;
+    {
+#ifdef THREADS
+        LockGuard<Mutex> guard(m_Lock);
+#endif
+
+        // Reads that start where the last one finished (or re-read its final
+        // partial block) are sequential - grow the window. Anything else
+        // collapses it, as read-ahead would only pollute the cache.
+        if (firstBlock == pState->next || firstBlock + 1 == pState->next)
+        {
+            size_t window = pState->window * 2;
+            if (window < nBlocks * 2)
+                window = nBlocks * 2;
+            if (window < FILE_READAHEAD_MIN)
+                window = FILE_READAHEAD_MIN;
+            if (window > FILE_READAHEAD_MAX)
+                window = FILE_READAHEAD_MAX;
+            pState->window = window;
+        }
+        else
+        {
+            pState->window = 0;
+            pState->end = 0;
+        }
+
+        pState->next = lastBlock + 1;
+
+        // Top up only once half the window has been consumed so requests go
+        // out in batches rather than a block at a time.
+        if (pState->window)
+        {
+            uintptr_t from = pState->end;
+            if (from < pState->next)
+                from = pState->next;
+            uintptr_t to = pState->next + pState->window;
+            if (to > endBlock)
+                to = endBlock;
+            if (from < to && (from - pState->next) <= (pState->window / 2))
+            {
+                start = from;
+                count = to - from;
+                pState->end = to;
+            }
+        }
+    }
+
+    if (!count)
+    {
+        return;
+    }
+
+#ifdef THREADS
+    if (g_pReadAheadQueue)
+    {
+        g_ReadAheadLock.acquire();
+        if (!m_ReadAheadId)
+        {
+            m_ReadAheadId = g_NextReadAheadId++;
+            g_ReadAheadFiles.insert(m_ReadAheadId, this);
+        }
+        uint64_t id = m_ReadAheadId;
+        g_ReadAheadLock.release();
+
+        g_pReadAheadQueue->addAsyncRequest(1, id, start, count);
+    }
+#else
+    fillReadAhead(start, count);
+#endif
+}
+
+void File::quiesce()
+{
+#ifdef THREADS
+    {
+        LockGuard<Mutex> guard(g_ReadAheadLock);
+
+        // Anything still queued for us is dropped when the worker gets it.
+        if (m_ReadAheadId)
+        {
+            g_ReadAheadFiles.remove(m_ReadAheadId);
+            m_ReadAheadId = 0;
+        }
+
+        while (m_nReadAheadPins)
+        {
+            g_ReadAheadDone.wait(g_ReadAheadLock);
+        }
+    }
+#endif
+
+    flushDirty();
+
+#ifdef THREADS
+    LockGuard<Mutex> guard(g_DirtyFilesLock);
+
+    // A flush that already picked us up must finish before we go away.
+    while (m_nFlushPins)
+    {
+        g_FlushDone.wait(g_DirtyFilesLock);
+    }
+#endif
+
+    // Only still listed if blocks were dirtied while we were flushing.
+    if (!m_bDirtyListed)
+    {
+        return;
+    }
+
+    WARNING(
+        "File '" << m_Name << "' dirtied while being destroyed, dropping "
+                 << m_nDirtyBlocks << " blocks");
+    m_bDirtyListed = false;
+    for (auto it = g_DirtyFiles.begin(); it != g_DirtyFiles.end(); ++it)
+    {
+        if (*it == this)
+        {
+            g_DirtyFiles.erase(it);
+            break;
+        }
+    }
+}
+
+void File::fillReadAhead(uintptr_t block, size_t count)
+{
+    size_t blockSize = getBlockSize();
+    for (size_t i = 0; i < count; ++i)
+    {
+        // The file may have been truncated since the request was queued.
+        if (((block + i) * blockSize) >= m_Size)
+        {
+            break;
+        }
+
+        if (getCachedPage(block + i) != FILE_BAD_BLOCK)
+        {
+            continue;
+        }
+
+        if (readIntoCache(block + i) == FILE_BAD_BLOCK)
+        {
+            break;
+        }
+    }
+}
+
+void File::initialiseWriteBack()
+{
+#ifdef THREADS
+    g_bWriteBackStopped = false;
+    MemoryPressureManager::instance().registerHandler(
+        MemoryPressureManager::HighestPriority, &g_WriteBackHandler);
+#endif
+}
+
+void File::destroyWriteBack()
+{
+#ifdef THREADS
+    MemoryPressureManager::instance().removeHandler(&g_WriteBackHandler);
+
+    g_DirtyFilesLock.acquire();
+    g_bWriteBackStopped = true;
+    g_DirtyFilesLock.release();
+#endif
+
+    flushDirtyFiles(false);
+}
+
+void File::flushFilesystem(Filesystem *pFs)
+{
+    flushDirtyFiles(false, pFs);
+}
+
+void File::writeExtent(uint64_t location, size_t nBlocks)
+{
+    const size_t blockSize = getBlockSize();
+    for (size_t i = 0; i < nBlocks; ++i)
+    {
+        uintptr_t buff = getCachedPage((location / blockSize) + i, false);
+        if (buff != FILE_BAD_BLOCK)
+        {
+            writeBlock(location + (i * blockSize), buff);
+        }
+    }
+}
+
+void File::markDirty(uintptr_t block)
+{
+    {
+#ifdef THREADS
+        LockGuard<Mutex> guard(m_Lock);
+#endif
+
+        if (m_DirtyBlocks.test(block))
+        {
+            return;
+        }
+
+        m_DirtyBlocks.set(block);
+        if (m_nDirtyBlocks++)
+        {
+            if (block < m_DirtyFirst)
+                m_DirtyFirst = block;
+            if (block > m_DirtyLast)
+                m_DirtyLast = block;
+            return;
+        }
+
+        m_DirtyFirst = m_DirtyLast = block;
+    }
+
+    // First dirty block - the file now needs to be flushed at some point.
+    // The dirty list lock is taken before File locks, so ours must be
+    // dropped first.
+#ifdef THREADS
+    LockGuard<Mutex> listGuard(g_DirtyFilesLock);
+#endif
+    if (m_bDirtyListed)
+    {
+        return;
+    }
+
+    m_bDirtyListed = true;
+#ifdef THREADS
+    m_DirtySince = Time::getTimeNanoseconds();
+#endif
+    g_DirtyFiles.pushBack(this);
+
+#ifdef THREADS
+    if (!g_bWriteBackArmed && !g_bWriteBackStopped)
+    {
+        g_bWriteBackArmed = true;
+        Time::runAfter(&flushAgedFiles, 0, FILE_WRITEBACK_INTERVAL);
+    }
+#endif
+}
+
+size_t File::flushDirty()
+{
+    size_t nWritten;
+    {
+#ifdef THREADS
+        LockGuard<Mutex> guard(m_Lock);
+#endif
+        nWritten = writeDirtyBlocks();
+    }
+
+    // Leave the dirty list, unless more blocks were dirtied meanwhile.
+#ifdef THREADS
+    LockGuard<Mutex> listGuard(g_DirtyFilesLock);
+    LockGuard<Mutex> guard(m_Lock);
+#endif
+    if (!m_bDirtyListed || m_nDirtyBlocks)
+    {
+        return nWritten;
+    }
+
+    m_bDirtyListed = false;
+    for (auto it = g_DirtyFiles.begin(); it != g_DirtyFiles.end(); ++it)
+    {
+        if (*it == this)
+        {
+            g_DirtyFiles.erase(it);
+            break;
+        }
+    }
+
+    return nWritten;
+}
+
+size_t File::writeDirtyBlocks()
+{
+    if (!m_nDirtyBlocks)
+    {
+        return 0;
+    }
+
+    // Blocks past the end of the file were truncated away after being
+    // written, so they are dropped rather than written back.
+    const size_t blockSize = getBlockSize();
+    const uintptr_t endBlock = (m_Size + blockSize - 1) / blockSize;
+
+    uintptr_t runStart = 0;
+    size_t runLength = 0;
+    for (uintptr_t block = m_DirtyFirst; block <= m_DirtyLast; ++block)
+    {
+        if (block < endBlock && m_DirtyBlocks.test(block))
+        {
+            if (!runLength)
+            {
+                runStart = block;
+            }
+            ++runLength;
+            continue;
+        }
+
+        if (runLength)
+        {
+            writeExtent(runStart * blockSize, runLength);
+            runLength = 0;
+        }
+    }
+
+    if (runLength)
+    {
+        writeExtent(runStart * blockSize, runLength);
+    }
+
+    size_t nWritten = m_nDirtyBlocks;
+    m_DirtyBlocks = ExtensibleBitmap();
+    m_nDirtyBlocks = 0;
+    return nWritten;
+}
+
+size_t File::flushDirtyFiles(bool aged, Filesystem *pFs)
+{
+    List<File *> files;
+    {
+#ifdef THREADS
+        LockGuard<Mutex> guard(g_DirtyFilesLock);
+        Time::Timestamp now = Time::getTimeNanoseconds();
+#endif
+        for (auto it = g_DirtyFiles.begin(); it != g_DirtyFiles.end(); ++it)
+        {
+            File *pFile = *it;
+            if (pFs && pFile->m_pFilesystem != pFs)
+            {
+                continue;
+            }
+#ifdef THREADS
+            if (aged && pFile->m_pFilesystem &&
+                (now - pFile->m_DirtySince) <
+                    pFile->m_pFilesystem->getWriteBackAge())
+            {
+                continue;
+            }
+#endif
+
+            // Pinned files can't be destroyed until we're done with them.
+            ++pFile->m_nFlushPins;
+            files.pushBack(pFile);
+        }
+    }
+
+    // Flushing does I/O and may dirty other files, so the dirty list can't
+    // stay locked while we do it.
+    size_t nWritten = 0;
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        nWritten += (*it)->flushDirty();
+    }
+
+#ifdef THREADS
+    LockGuard<Mutex> guard(g_DirtyFilesLock);
+#endif
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        --(*it)->m_nFlushPins;
+    }
+#ifdef THREADS
+    g_FlushDone.broadcast();
+#endif
+
+    return nWritten;
+}
+
+int File::flushAgedFiles(void *)
+{
+    flushDirtyFiles(true);
+
+#ifdef THREADS
+    LockGuard<Mutex> guard(g_DirtyFilesLock);
+    if (g_DirtyFiles.count() && !g_bWriteBackStopped)
+    {
+        Time::runAfter(&flushAgedFiles, 0, FILE_WRITEBACK_INTERVAL);
+    }
+    else
+    {
+        g_bWriteBackArmed = false;
+    }
+#endif
+
+    return 0;
+}
+
 uintptr_t File::readIntoCache(uintptr_t block)
 {
     size_t blockSize = getBlockSize();
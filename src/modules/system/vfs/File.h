@@ -26,6 +26,7 @@
 #include "pedigree/kernel/time/Time.h"
 #include "pedigree/kernel/utilities/Cache.h"
 #include "pedigree/kernel/utilities/CacheConstants.h"
+#include "pedigree/kernel/utilities/ExtensibleBitmap.h"
 #include "pedigree/kernel/utilities/HashTable.h"
 #include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/StaticString.h"
@@ -61,11 +62,40 @@ class Thread;
 
 #define FILE_BAD_BLOCK static_cast<uintptr_t>(-1)
 
+/// Smallest and largest read-ahead windows, in filesystem blocks.
+#define FILE_READAHEAD_MIN 4
+#define FILE_READAHEAD_MAX 32
+
+/// How often dirty write-back data is checked against its maximum age.
+#define FILE_WRITEBACK_INTERVAL Time::Multiplier::Second
+
+/**
+ * Persistent observer of a File, registered with File::watch(). Unlike the
+ * one-shot targets given to File::monitor(), a watcher stays registered
+ * across notifications until File::unwatch() removes it.
+ */
+class EXPORTED_PUBLIC FileWatcher
+{
+  public:
+    virtual ~FileWatcher()
+    {
+    }
+
+    /**
+     * Called whenever the watched object's readiness may have changed. This
+     * may run in another thread's context with the object's locks held, so
+     * it must be quick and must not call back into the object.
+     */
+    virtual void changed() = 0;
+};
+
 /** A File is a regular file - it is also the superclass of Directory, Symlink
     and Pipe. */
 class EXPORTED_PUBLIC File
 {
     friend class Filesystem;
+    friend class FileReadAheadQueue;
+    friend class FileWriteBackHandler;
 
   public:
     /** Constructor, creates an invalid file. */
@@ -85,14 +115,35 @@ class EXPORTED_PUBLIC File
     /** Destructor - doesn't do anything. */
     virtual ~File();
 
+    /**
+     * Sequential access detection for read-ahead. Each open file keeps its
+     * own, so interleaved streams on the same file don't reset each other's
+     * window.
+     */
+    struct ReadAheadState
+    {
+        ReadAheadState() : next(0), end(0), window(0)
+        {
+        }
+
+        /// Block the next sequential read is expected to start at.
+        uintptr_t next;
+        /// Block after the last one already queued for read-ahead.
+        uintptr_t end;
+        /// Current read-ahead window, in blocks; zero when reads are random.
+        size_t window;
+    };
+
     /** Reads from the file.
      *  \param[in] buffer Buffer to write the read data into. Can be null, in
      *      which case the data can be found by calling getPhysicalPage.
      *  \param[in] bCanBlock Whether or not the File can block when reading
+     *  \param[in] pReadAhead Read-ahead state of the open file doing the
+     *      read, or null to use one shared by all such callers.
      */
     virtual uint64_t read(
         uint64_t location, uint64_t size, uintptr_t buffer,
-        bool bCanBlock = true) final;
+        bool bCanBlock = true, ReadAheadState *pReadAhead = 0) final;
     /** Writes to the file.
      *  \param[in] bCanBlock Whether or not the File can block when reading
      */
@@ -100,6 +151,36 @@ class EXPORTED_PUBLIC File
         uint64_t location, uint64_t size, uintptr_t buffer,
         bool bCanBlock = true) final;
 
+    /** A run of file data handed out by transfer(). */
+    struct TransferSegment
+    {
+        uintptr_t buffer;
+        uint64_t size;
+    };
+
+    /** Maximum number of segments passed to one TransferCallback call. */
+    static const size_t MaxTransferSegments = 16;
+
+    /**
+     * Takes data from the \param count segments at \param segments, in
+     * order; returns the number of bytes actually taken. A short return
+     * stops the transfer.
+     */
+    typedef uint64_t (*TransferCallback)(
+        void *param, const TransferSegment *segments, size_t count);
+
+    /**
+     * Hands the file's data in [location, location + size) to \param
+     * callback directly from the page cache, so nothing is copied into an
+     * intermediate buffer first. Blocks are gathered into batches of up to
+     * MaxTransferSegments and stay pinned while the callback has them.
+     * Bytewise files are staged through a bounce buffer instead.
+     * \return the number of bytes the callback took.
+     */
+    uint64_t transfer(
+        uint64_t location, uint64_t size, TransferCallback callback,
+        void *param, bool bCanBlock = true, ReadAheadState *pReadAhead = 0);
+
     /** Get the physical address for the given offset into the file.
      * Returns (physical_uintptr_t) ~0 if the offset isn't in the cache.
      */
@@ -126,6 +207,20 @@ class EXPORTED_PUBLIC File
      */
     virtual void sync(size_t offset, bool async);
 
+    /** Starts the worker that services asynchronous read-ahead. */
+    static void initialiseReadAhead();
+    /** Stops the read-ahead worker. */
+    static void destroyReadAhead();
+
+    /** Starts age and memory-pressure flushing of write-back data. */
+    static void initialiseWriteBack();
+    /** Stops flushing write-back data, flushing anything still dirty. */
+    static void destroyWriteBack();
+
+    /** Writes back all dirty data of files on \p pFs, e.g. before it is
+     * unmounted. */
+    static void flushFilesystem(class Filesystem *pFs);
+
     /** Returns the time the file was created. */
     Time::Timestamp getCreationTime();
     /** Sets the time the file was created. */
@@ -208,6 +303,12 @@ class EXPORTED_PUBLIC File
     /** Walks the monitor-target queue, removing all for \p pThread .*/
     void cullMonitorTargets(Thread *pThread);
 
+    /** Adds \p pWatcher to be told of every activity on this File. */
+    void watch(FileWatcher *pWatcher);
+
+    /** Removes a watcher previously added with watch(). */
+    void unwatch(FileWatcher *pWatcher);
+
     /** Does this File object support the given integer-based command? */
     virtual bool supports(const size_t command) const;
 
@@ -260,6 +361,14 @@ class EXPORTED_PUBLIC File
      */
     virtual void writeBlock(uint64_t location, uintptr_t addr);
 
+    /**
+     * Writes back a run of contiguous dirty blocks starting at the given
+     * location, in write-back mode. Called with the File lock held. The
+     * default calls writeBlock() for each block; override to issue a single
+     * extent write to the filesystem instead.
+     */
+    virtual void writeExtent(uint64_t location, size_t nBlocks);
+
     /** Internal function to extend a file to be at least the given size. */
     virtual void extend(size_t newSize);
 
@@ -271,6 +380,14 @@ class EXPORTED_PUBLIC File
      */
     virtual void extend(size_t newSize, uint64_t location, uint64_t size);
 
+    /**
+     * Cancels queued read-ahead, writes back dirty blocks and waits for any
+     * background I/O on the file to finish. This calls readBlock() and
+     * writeExtent(), so subclasses that implement them must call this at
+     * the start of their destructor, before their own state goes away.
+     */
+    void quiesce();
+
     /** Internal function to notify all registered MonitorTargets. */
     void dataChanged();
 
@@ -367,6 +484,30 @@ class EXPORTED_PUBLIC File
 
     bool m_bDirect;
 
+    /** Read-ahead state for reads that don't come from an open file. */
+    ReadAheadState m_ReadAhead;
+    /** Identifies this file to queued read-ahead requests, or zero if none
+     * have been queued. Identifiers are never reused, so requests still
+     * queued after the file is gone are dropped rather than landing on a
+     * new File at the same address (protected by the read-ahead lock). */
+    uint64_t m_ReadAheadId;
+    /** Number of read-ahead requests running against this file, which must
+     * finish before it is destroyed (protected as above). */
+    size_t m_nReadAheadPins;
+
+    /** Blocks written but not yet passed to the filesystem (write-back). */
+    ExtensibleBitmap m_DirtyBlocks;
+    size_t m_nDirtyBlocks;
+    uintptr_t m_DirtyFirst;
+    uintptr_t m_DirtyLast;
+    /** When the oldest dirty block was written. */
+    Time::Timestamp m_DirtySince;
+    /** On the dirty file list (protected by the dirty list's lock). */
+    bool m_bDirtyListed;
+    /** Number of flushDirtyFiles() calls about to flush this file, which
+     * must finish before it is destroyed (protected as above). */
+    size_t m_nFlushPins;
+
 #ifndef VFS_NOMMU
     /**
      * This cache is necessary to handle filesystems with block sizes that are
@@ -394,6 +535,8 @@ class EXPORTED_PUBLIC File
     List<MonitorTarget *> m_MonitorTargets;
 #endif
 
+    List<FileWatcher *> m_Watchers;
+
   private:
     /** Retrieve a page from our cache. */
     uintptr_t getCachedPage(size_t block, bool locked = true);
@@ -407,6 +550,32 @@ class EXPORTED_PUBLIC File
 
     /** Read the given block into the relevant cache. */
     uintptr_t readIntoCache(uintptr_t block);
+
+    /** Track a read of the given blocks and, if the file is being read
+     * sequentially, queue the blocks expected next. */
+    void readAhead(
+        uintptr_t firstBlock, uintptr_t lastBlock, ReadAheadState *pState);
+
+    /** Pull the given blocks into the cache (read-ahead worker). */
+    void fillReadAhead(uintptr_t block, size_t count);
+
+    /** Record a block written in write-back mode. */
+    void markDirty(uintptr_t block);
+
+    /** Write all dirty blocks back, coalescing contiguous runs.
+     * \return the number of blocks written. */
+    size_t flushDirty();
+
+    /** As flushDirty(), but leaves the dirty list alone. Called with the
+     * File lock held. */
+    size_t writeDirtyBlocks();
+
+    /** Flush dirty files; only those past their write-back age if aged, and
+     * only those on \p pFs if given. \return the number of blocks written. */
+    static size_t flushDirtyFiles(bool aged, class Filesystem *pFs = 0);
+
+    /** Periodic write-back age check. */
+    static int flushAgedFiles(void *);
 };
 
 #endif
@@ -32,7 +32,9 @@
 #include "pedigree/kernel/utilities/StringView.h"
 #include "pedigree/kernel/utilities/utility.h"
 
-Filesystem::Filesystem() : m_bReadOnly(false), m_pDisk(0), m_nAliases(0)
+Filesystem::Filesystem()
+    : m_bReadOnly(false), m_pDisk(0), m_bWriteBack(false),
+      m_WriteBackAge(5 * Time::Multiplier::Second), m_nAliases(0)
 {
 }
 
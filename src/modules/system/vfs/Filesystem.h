@@ -22,6 +22,7 @@
 
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/time/Time.h"
 #include "pedigree/kernel/utilities/String.h"
 
 class Disk;
@@ -52,6 +53,14 @@ class EXPORTED_PUBLIC Filesystem
      * \return true on success, false on failure. */
     virtual bool initialise(Disk *pDisk) = 0;
 
+    /** Options that can be given to VFS::mount. */
+    enum MountOptions
+    {
+        /// Buffer File writes and flush them on sync, under memory pressure
+        /// or once they reach the write-back age.
+        MountWriteBack = 1
+    };
+
     /** Type of the probing callback given to the VFS.
         Probe function - if this filesystem is found on the given Disk
         device, create a new instance of it and return that. Else return 0. */
@@ -109,6 +118,30 @@ class EXPORTED_PUBLIC Filesystem
         return m_bReadOnly;
     }
 
+    /** Are File writes buffered rather than written through? */
+    bool isWriteBack() const
+    {
+        return m_bWriteBack;
+    }
+
+    /** Enable or disable write-back for Files on this filesystem. */
+    void setWriteBack(bool bWriteBack)
+    {
+        m_bWriteBack = bWriteBack;
+    }
+
+    /** How long dirty File data may stay unwritten, in nanoseconds. */
+    Time::Timestamp getWriteBackAge() const
+    {
+        return m_WriteBackAge;
+    }
+
+    /** Set the maximum age of dirty File data, in nanoseconds. */
+    void setWriteBackAge(Time::Timestamp age)
+    {
+        m_WriteBackAge = age;
+    }
+
     /** Does the filesystem care about case sensitivity? */
     virtual bool isCaseSensitive()
     {
@@ -135,6 +168,10 @@ class EXPORTED_PUBLIC Filesystem
     bool m_bReadOnly;
     /** Disk device(if any). */
     Disk *m_pDisk;
+    /** Are File writes on this filesystem write-back? */
+    bool m_bWriteBack;
+    /** Maximum age of dirty File data in write-back mode. */
+    Time::Timestamp m_WriteBackAge;
 
   private:
     /** Get the true root of the filesystem, considering potential jails. */
@@ -48,8 +48,8 @@ ZombiePipe::~ZombiePipe()
 }
 
 Pipe::Pipe()
-    : File(), m_bIsAnonymous(true), m_bIsEOF(false), m_Buffer(PIPE_BUF_MAX),
-      m_ReaderSem(0)
+    : File(), m_bIsAnonymous(true), m_bIsEOF(false),
+      m_Buffer(PIPE_RING_PAGES), m_ReaderSem(0)
 {
 #ifdef VERBOSE_KERNEL
     NOTICE("Pipe: new anonymous pipe " << reinterpret_cast<uintptr_t>(this));
@@ -63,8 +63,8 @@ Pipe::Pipe(
     : File(
           name, accessedTime, modifiedTime, creationTime, inode, pFs, size,
           pParent),
-      m_bIsAnonymous(bIsAnonymous), m_bIsEOF(false), m_Buffer(PIPE_BUF_MAX),
-      m_ReaderSem(0)
+      m_bIsAnonymous(bIsAnonymous), m_bIsEOF(false),
+      m_Buffer(PIPE_RING_PAGES), m_ReaderSem(0)
 {
 #ifdef VERBOSE_KERNEL
     NOTICE(
@@ -127,6 +127,76 @@ uint64_t Pipe::writeBytewise(
     return result;
 }
 
+uint64_t Pipe::splice(Pipe *pDest, uint64_t size, bool bCanBlock)
+{
+    if (m_nWriters == 0)
+    {
+        bCanBlock = false;
+    }
+
+    if (pDest->m_nReaders == 0)
+    {
+        return 0;
+    }
+
+    uint64_t result = m_Buffer.splice(pDest->m_Buffer, size, bCanBlock);
+    if (result)
+    {
+        pDest->dataChanged();
+    }
+
+    return result;
+}
+
+uint64_t Pipe::tee(Pipe *pDest, uint64_t size, bool bCanBlock)
+{
+    if (m_nWriters == 0)
+    {
+        bCanBlock = false;
+    }
+
+    if (pDest->m_nReaders == 0)
+    {
+        return 0;
+    }
+
+    uint64_t result = m_Buffer.tee(pDest->m_Buffer, size, bCanBlock);
+    if (result)
+    {
+        pDest->dataChanged();
+    }
+
+    return result;
+}
+
+uint64_t Pipe::spliceFrom(
+    PageRing::Producer producer, void *param, uint64_t size, bool bCanBlock)
+{
+    if (m_nReaders == 0)
+    {
+        return 0;
+    }
+
+    uint64_t result = m_Buffer.produce(producer, param, size, bCanBlock);
+    if (result)
+    {
+        dataChanged();
+    }
+
+    return result;
+}
+
+uint64_t Pipe::spliceTo(
+    PageRing::Consumer consumer, void *param, uint64_t size, bool bCanBlock)
+{
+    if (m_nWriters == 0)
+    {
+        bCanBlock = false;
+    }
+
+    return m_Buffer.consume(consumer, param, size, bCanBlock);
+}
+
 bool Pipe::isPipe() const
 {
     return getName().length() == 0 || m_bIsAnonymous;
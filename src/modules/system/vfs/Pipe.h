@@ -26,10 +26,11 @@
 #include "pedigree/kernel/process/Semaphore.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/time/Time.h"
-#include "pedigree/kernel/utilities/Buffer.h"
+#include "pedigree/kernel/utilities/PageRing.h"
 #include "pedigree/kernel/utilities/String.h"
 
-#define PIPE_BUF_MAX 2048
+/** Number of pages in a pipe (64 KiB with 4 KiB pages). */
+#define PIPE_RING_PAGES 16
 
 /** A first-in-first-out buffer node. */
 class EXPORTED_PUBLIC Pipe : public File
@@ -82,6 +83,28 @@ class EXPORTED_PUBLIC Pipe : public File
     /** FIFOs are not anonymous (have a name). */
     virtual bool isFifo() const;
 
+    /**
+     * Moves up to \param size bytes from this pipe into \param pDest without
+     * copying them.
+     */
+    uint64_t splice(Pipe *pDest, uint64_t size, bool bCanBlock = true);
+
+    /**
+     * Duplicates up to \param size bytes from this pipe into \param pDest
+     * without consuming or copying them.
+     */
+    uint64_t tee(Pipe *pDest, uint64_t size, bool bCanBlock = true);
+
+    /** Writes into the pipe by letting \param producer fill its pages. */
+    uint64_t spliceFrom(
+        PageRing::Producer producer, void *param, uint64_t size,
+        bool bCanBlock = true);
+
+    /** Reads from the pipe by handing its pages to \param consumer. */
+    uint64_t spliceTo(
+        PageRing::Consumer consumer, void *param, uint64_t size,
+        bool bCanBlock = true);
+
     virtual void increaseRefCount(bool bIsWriter);
 
     /** Override decreaseRefCount so we can tell when all writers have hung up
@@ -110,7 +133,7 @@ class EXPORTED_PUBLIC Pipe : public File
     volatile bool m_bIsEOF;
 
     /** Internal pipe buffer. */
-    Buffer<uint8_t> m_Buffer;
+    PageRing m_Buffer;
 
     /** Reader semaphore to allow blocking until a reader arrives. */
     Semaphore m_ReaderSem;
@@ -20,6 +20,7 @@
 #include "VFS.h"
 #include "File.h"
 #include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/machine/Disk.h"
 #include "pedigree/kernel/syscallError.h"
 #include "pedigree/kernel/utilities/Iterator.h"
 #include "pedigree/kernel/utilities/StaticString.h"
@@ -85,7 +86,7 @@ VFS::~VFS()
     }
 }
 
-bool VFS::mount(Disk *pDisk, String &alias)
+bool VFS::mount(Disk *pDisk, String &alias, size_t options)
 {
     for (List<Filesystem::ProbeCallback *>::Iterator it =
              m_ProbeCallbacks.begin();
@@ -95,6 +96,11 @@ bool VFS::mount(Disk *pDisk, String &alias)
         Filesystem *pFs = cb(pDisk);
         if (pFs)
         {
+            if (options & Filesystem::MountWriteBack)
+            {
+                pFs->setWriteBack(true);
+            }
+
             if (alias.length() == 0)
             {
                 alias = pFs->getVolumeLabel();
@@ -187,6 +193,14 @@ void VFS::removeAllAliases(Filesystem *pFs, bool canDelete)
     if (!pFs)
         return;
 
+    // Nothing can reach the filesystem's files once it's gone, so write back
+    // anything they still have buffered, all the way to the disk.
+    File::flushFilesystem(pFs);
+    if (pFs->getDisk())
+    {
+        pFs->getDisk()->sync();
+    }
+
     for (AliasTable::Iterator it = m_Aliases.begin(); it != m_Aliases.end();)
     {
         if (pFs == (*it))
@@ -565,11 +579,15 @@ ssize_t VFS::findColon(const String &path)
 #ifndef VFS_STANDALONE
 static bool initVFS()
 {
+    File::initialiseReadAhead();
+    File::initialiseWriteBack();
     return true;
 }
 
 static void destroyVFS()
 {
+    File::destroyWriteBack();
+    File::destroyReadAhead();
 }
 
 MODULE_INFO("vfs", &initVFS, &destroyVFS, "users");
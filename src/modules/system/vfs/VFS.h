@@ -73,8 +73,9 @@ class EXPORTED_PUBLIC VFS
 
     /** Mounts a Disk device as the alias "alias".
         If alias is zero-length, the Filesystem is asked for its preferred name
-        (usually a volume name of some sort), and returned in "alias" */
-    bool mount(Disk *pDisk, String &alias);
+        (usually a volume name of some sort), and returned in "alias"
+        \param options Filesystem::MountOptions flags for the new mount. */
+    bool mount(Disk *pDisk, String &alias, size_t options = 0);
 
     /** Adds an alias to an existing filesystem.
      *\param pFs The filesystem to add an alias for.
@@ -50,6 +50,44 @@ class SlamCache;
 /// Minimum slab size in bytes
 #define SLAB_MINIMUM_SIZE (4096 * SLAB_SIZE)
 
+/// Maximum number of pages in a slab for objects smaller than a page. Such
+/// slabs are always a power-of-two number of pages and are aligned to their
+/// size, so the slab holding any object can be found with a mask.
+#define SLAM_MAX_SMALL_SLAB_PAGES 4
+
+/// log2 of the number of size classes between each power of two. Caches are
+/// spaced at quarter steps (64, 80, 96, 112, 128, 160, ...) rather than at
+/// every power of two, which bounds internal fragmentation to 25%.
+#define SLAM_SIZE_CLASS_SHIFT 2
+
+/// Object sizes up to this limit find their size class in a lookup table;
+/// larger sizes compute it directly.
+#define SLAM_SMALL_CLASS_LG2 14
+#define SLAM_SMALL_CLASS_LIMIT (1U << SLAM_SMALL_CLASS_LG2)
+
+/// Maximum depth of the summary bitmaps over the slab region bitmap. Each
+/// level has one bit per word of the level below, so eight levels covers far
+/// more than any kernel heap.
+#define SLAM_SUMMARY_MAX_LEVELS 8
+
+/// Number of summaries of free page runs within a bitmap entry, for runs of
+/// 2, 4, ... 32 pages. A run of 64 pages is an empty entry.
+#define SLAM_PAGE_RUN_ORDERS 5
+
+/// Number of summaries of runs of empty bitmap entries, for runs of 2, 4,
+/// ... 64 entries within each word of the used-entry summary.
+#define SLAM_ENTRY_RUN_ORDERS 6
+
+/// Number of size classes with objects up to SLAM_SMALL_CLASS_LIMIT bytes.
+/// Classes between one page and the limit are rounded to whole pages, and
+/// so are fewer than a quarter step would suggest.
+#define SLAM_NUM_SMALL_CLASSES 28
+
+/// Total number of size classes, each served by its own SlamCache.
+#define SLAM_NUM_SIZE_CLASSES \
+    (SLAM_NUM_SMALL_CLASSES +  \
+     ((31 - SLAM_SMALL_CLASS_LG2) << SLAM_SIZE_CLASS_SHIFT))
+
 /// Define if using the magic number method of slab recovery.
 /// This turns recovery into an O(n) instead of O(n^2) algorithm,
 /// but relies on a magic number which introduces false positives
@@ -78,6 +116,23 @@ class SlamCache;
 /// Temporary magic used during allocation.
 #define TEMP_MAGIC 0x67845753
 
+/// Magic for free objects held in a per-CPU magazine or the depot rather than
+/// on a partial list. Recovery treats these as in use.
+#define MAGAZINE_MAGIC 0xba11a57ULL
+
+/// Maximum number of objects held by each per-CPU magazine. Set to zero to
+/// disable the magazine layer.
+#define SLAM_MAGAZINE_ROUNDS 32
+
+/// Maximum number of bytes of objects held by each per-CPU magazine. Caches
+/// with objects too large to fit at least two in a magazine don't use
+/// magazines at all.
+#define SLAM_MAGAZINE_BYTES 0x4000
+
+/// Maximum number of full magazines each cache's depot will hold before
+/// returning further magazines to the partial lists.
+#define SLAM_DEPOT_MAGAZINES 16
+
 /// Adds magic numbers to the start of free blocks, to check for
 /// buffer overruns.
 #ifdef USE_DEBUG_ALLOCATOR
@@ -135,6 +190,14 @@ class SlamCache;
 #define SLAM_LOCKED 0
 #endif
 
+/// Lock the slab region bitmap. Threaded kernels need this, and so do
+/// benchmark builds as they run multi-threaded benchmarks without THREADS.
+#if defined(THREADS) || defined(PEDIGREE_BENCHMARK)
+#define SLAM_LOCK_SLAB_REGION 1
+#else
+#define SLAM_LOCK_SLAB_REGION 0
+#endif
+
 // Define this to enable the debug allocator (which is basically placement new).
 // #define SLAM_USE_DEBUG_ALLOCATOR
 
@@ -170,6 +233,13 @@ class SlamCache
     /** Attempt to recover slabs from this cache. */
     size_t recovery(size_t maxSlabs);
 
+    /**
+     * Return the objects held in this CPU's magazines and in the depot to
+     * the partial lists, so recovery can consider them. Other CPUs are
+     * asked to do the same with theirs on their next allocation or free.
+     */
+    void flushMagazines();
+
     bool isPointerValid(uintptr_t object) const;
 
     inline size_t objectSize() const
@@ -182,6 +252,11 @@ class SlamCache
         return m_SlabSize;
     }
 
+    inline size_t magazineRounds() const
+    {
+        return m_MagazineRounds;
+    }
+
 #if CRIPPLINGLY_VIGILANT
     void trackSlab(uintptr_t slab);
     void check();
@@ -196,10 +271,67 @@ class SlamCache
 #define NUM_LISTS 255
 #else
 #define NUM_LISTS 1
+#endif
+#ifdef PEDIGREE_BENCHMARK
+// Benchmark builds give each thread a slot of its own to stand in for a CPU.
+#define NUM_MAGAZINE_SLOTS 64
+#else
+#define NUM_MAGAZINE_SLOTS NUM_LISTS
 #endif
     typedef volatile Node *alignedNode;
     alignedNode m_PartialLists[NUM_LISTS];
 
+    /**
+     * A magazine is a chain of free objects linked through their Node. Each
+     * is only ever touched by the CPU that has it loaded, with interrupts
+     * disabled, so it needs no atomic operations.
+     */
+    struct Magazine
+    {
+        Node *head;
+        size_t rounds;
+    };
+
+    /** The loaded and previous magazines for a single CPU (Bonwick01). */
+    struct CpuMagazines
+    {
+        Magazine loaded;
+        Magazine previous;
+        /// Set by flushMagazines on another CPU; the owner empties its
+        /// magazines the next time it uses them. Only ever loaded and
+        /// stored, never read-modify-written.
+        bool flushRequested;
+    };
+
+    /** Overlay on the first object of a full magazine held in the depot. */
+    struct DepotMagazine
+    {
+        Node node;
+        DepotMagazine *next;
+    };
+
+    CpuMagazines m_Magazines[NUM_MAGAZINE_SLOTS];
+
+    /** Full magazines available to any CPU. */
+    DepotMagazine *m_pDepot;
+    size_t m_DepotCount;
+    Spinlock m_DepotLock;
+
+    /** Number of objects in a full magazine, zero if magazines are unused. */
+    size_t m_MagazineRounds;
+
+    /** Takes an object from this CPU's magazines, or null if they're empty. */
+    Node *magazineAllocate();
+    /** Puts a freed object into this CPU's magazines. */
+    void magazineFree(Node *N);
+    /** Hands a full magazine to the depot (or the partial lists). */
+    void depositMagazine(const Magazine &mag);
+    /** Returns a chain of magazine objects to the partial list. */
+    void releaseMagazine(Node *head);
+    /** Empties a CPU's magazines into the partial list. Only called by
+     * the CPU that owns them. */
+    void drainMagazines(CpuMagazines &cpu);
+
     Node *pop(alignedNode *head);
     /* newHead = 0 to use newTail. */
     void push(alignedNode *head, Node *newTail, Node *newHead = 0);
@@ -261,6 +393,29 @@ class SlamAllocator
 
     size_t allocSize(uintptr_t mem);
 
+    /** Object size (including headers) of the given size class. */
+    size_t sizeClassSize(size_t sizeClass) const
+    {
+        return m_Caches[sizeClass].objectSize();
+    }
+
+    /** Size class that an allocation of nBytes (plus headers) lands in. */
+    inline size_t sizeClass(size_t nBytes) const
+    {
+        if (LIKELY(nBytes <= SLAM_SMALL_CLASS_LIMIT))
+        {
+            return m_SizeClassIndex[(nBytes + 15) >> 4];
+        }
+
+        // Beyond the table, classes sit at even steps between powers of two.
+        size_t lg2 = 63 - __builtin_clzll(nBytes - 1);
+        size_t shift = lg2 - SLAM_SIZE_CLASS_SHIFT;
+        size_t step = ((nBytes - (1ULL << lg2)) + (1ULL << shift) - 1) >> shift;
+        return SLAM_NUM_SMALL_CLASSES +
+               ((lg2 - SLAM_SMALL_CLASS_LG2) << SLAM_SIZE_CLASS_SHIFT) +
+               (step - 1);
+    }
+
     static SlamAllocator &instance()
     {
 #ifdef PEDIGREE_BENCHMARK
@@ -311,7 +466,41 @@ class SlamAllocator
     /** Wipe out all memory used by the allocator. */
     void wipe();
 
-    SlamCache m_Caches[32];
+    /** freeSlab do-er, called with the slab region lock held. */
+    void freeSlabUnlocked(uintptr_t address, size_t length);
+
+    /**
+     * A 64-ary tree of summary bits over the slab region bitmap. Bit N of
+     * level 0 summarises bitmap entry N; bit N of each higher level is set
+     * only if word N of the level below is entirely set. The top level is a
+     * single word, so finding a clear leaf takes one step per level.
+     */
+    struct BitmapSummary
+    {
+        uint64_t *levels[SLAM_SUMMARY_MAX_LEVELS];
+        size_t words[SLAM_SUMMARY_MAX_LEVELS];
+        size_t numLevels;
+    };
+
+    /** Lays out a summary at base, returning the number of words it uses. */
+    static size_t
+    layoutSummary(BitmapSummary &summary, uint64_t *base, size_t entries);
+    /** Sets the padding bits past the end of each summary level. */
+    static void initialiseSummary(BitmapSummary &summary, size_t entries);
+    /** Sets or clears the summary bit for a bitmap entry. */
+    static void updateSummary(BitmapSummary &summary, size_t entry, bool set);
+    /** Finds the first entry at or after 'from' with a clear summary bit. */
+    static size_t findClear(const BitmapSummary &summary, size_t from);
+
+    /** Marks pages used or free, a bitmap entry at a time. */
+    void markSlabRegion(size_t page, size_t nPages, bool used);
+    /** Refreshes the empty-entry run summaries for a used-summary word. */
+    void updateEntryRuns(size_t word);
+
+    SlamCache m_Caches[SLAM_NUM_SIZE_CLASSES];
+
+    /** Maps (size + 15) / 16 to a size class, for small sizes. */
+    uint8_t m_SizeClassIndex[(SLAM_SMALL_CLASS_LIMIT >> 4) + 1];
 
   public:
     /// Prepended to all allocated data. Basically just information to make
@@ -348,7 +537,7 @@ class SlamAllocator
 
     bool m_bVigilant;
 
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     Spinlock m_SlabRegionLock;
 #endif
 
@@ -357,6 +546,21 @@ class SlamAllocator
     uint64_t *m_SlabRegionBitmap;
     size_t m_SlabRegionBitmapEntries;
 
+    /** Summary bits set where an entry has no free pages. */
+    BitmapSummary m_FullSummary;
+    /** Summary bits set where an entry has at least one page in use. */
+    BitmapSummary m_UsedSummary;
+    /**
+     * Summary bits set where an entry has no free, naturally aligned run of
+     * 2^(N+1) pages, for summary N.
+     */
+    BitmapSummary m_PageRunSummary[SLAM_PAGE_RUN_ORDERS];
+    /**
+     * Summary bits set where a word of m_UsedSummary's first level has no
+     * run of 2^(N+1) empty entries, for summary N.
+     */
+    BitmapSummary m_EntryRunSummary[SLAM_ENTRY_RUN_ORDERS];
+
     uintptr_t m_Base;
 
 #if SLAM_LOCKED
@@ -23,11 +23,11 @@
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/processor/types.h"
-#include "pedigree/kernel/utilities/HashTable.h"
-#include "pedigree/kernel/utilities/SharedPointer.h"
+#include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/StringView.h"
 #include "pedigree/kernel/utilities/Tree.h"
+#include "pedigree/kernel/utilities/Vector.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 class Elf;
@@ -36,10 +36,17 @@ class Elf;
  *  within ELF files. The lookup operation allows multiple
  *  policies to retrieve the wanted symbol.
  *
- *  \note Deletion is not implemented - the normal use case
- *        for this class is insertion and lookup. Deletion
- *        would almost never occur, and so the class is
- *        optimised solely for the first two operations. */
+ *  All definitions of a name, from every ELF, hang off one entry
+ *  in a single index. Each entry also caches the winning Global
+ *  and Weak definitions, which insert and eraseByElf keep up to
+ *  date, so a lookup is one hash probe no matter how many ELFs
+ *  are loaded.
+ *
+ *  Lookups take no lock. Writers are serialised by m_Lock and
+ *  publish with release semantics. Entries and definitions are
+ *  never freed while the table exists: an erased definition is
+ *  marked dead and reused by a later insert of the same name, and
+ *  slot arrays replaced by growth are retired until destruction. */
 class SymbolTable
 {
   public:
@@ -78,7 +85,7 @@ class SymbolTable
     void
     insert(const String &name, Binding binding, Elf *pParent, uintptr_t value);
 
-    /** Insert a symbol into two SymbolTables, using the memory once. */
+    /** Insert a symbol into two SymbolTables at once. */
     void insertMultiple(
         SymbolTable *pOther, const String &name, Binding binding, Elf *pParent,
         uintptr_t value);
@@ -115,51 +122,78 @@ class SymbolTable
         \note NOT implemented. */
     SymbolTable &operator=(const SymbolTable &);
 
-    class Symbol
+    struct IndexEntry;
+
+    /** One definition of a name by one ELF. */
+    struct Definition
     {
-      public:
-        Symbol() : m_pParent(0), m_Binding(Global), m_Value(0)
-        {
-        }
-        Symbol(Elf *pP, Binding b, uintptr_t v)
-            : m_pParent(pP), m_Binding(b), m_Value(v)
-        {
-        }
-
-        Elf *getParent() const
-        {
-            return m_pParent;
-        }
-        Binding getBinding() const
-        {
-            return m_Binding;
-        }
-        uintptr_t getValue() const
-        {
-            return m_Value;
-        }
-
-      private:
-        Elf *m_pParent;
-        Binding m_Binding;
-        uintptr_t m_Value;
+        /** Next (older) definition of the same name. */
+        Definition *pNext;
+        IndexEntry *pEntry;
+        Elf *pParent;
+        Binding binding;
+        uintptr_t value;
+        /** Cleared by eraseByElf; dead definitions are skipped by lookups
+         *  and reused by inserts. */
+        bool bLive;
+        /** Odd while an insert is reusing this definition. Lock-free
+         *  readers go through readDefinition, which retries if it changes
+         *  under them. */
+        uint32_t sequence;
     };
 
-    /** Insert doer. */
-    SharedPointer<Symbol> doInsert(
-        const String &name, Binding binding, Elf *pParent, uintptr_t value);
-    /** Insert the given shared symbol. */
-    void insertShared(const String &name, SharedPointer<Symbol> &symbol);
+    /** Every definition of one name. */
+    struct IndexEntry
+    {
+        String name;
+        uint32_t hash;
+        /** Chain of definitions, newest first. Only ever grows. */
+        Definition *pDefinitions;
+        /** Values of the winning Global and Weak definitions (those from the
+         *  lowest ELF address), or zero if there are none. */
+        uintptr_t globalValue;
+        uintptr_t weakValue;
+    };
 
-    typedef HashTable<String, SharedPointer<Symbol>, HashedStringView> symbolTree_t;
-    typedef Tree<Elf *, SharedPointer<symbolTree_t>> parentedSymbolTree_t;
+    /** Open-addressed slot array for the index; at most half full. */
+    struct IndexSlots
+    {
+        size_t size;
+        IndexEntry **entries;
+    };
 
-    /** Get or insert a Symbol tree. */
-    symbolTree_t *getOrInsertTree(Elf *, Binding table = Local);
+    /** Smallest slot array that is ever allocated. */
+    static const size_t MinimumIndexSize = 64;
 
-    parentedSymbolTree_t m_LocalSymbols;
-    parentedSymbolTree_t m_GlobalSymbols;
-    parentedSymbolTree_t m_WeakSymbols;
+    /** Insert doer, called with m_Lock held. */
+    void doInsert(
+        const String &name, Binding binding, Elf *pParent, uintptr_t value);
+    /** Erase doer, called with m_Lock held. */
+    void doEraseByElf(Elf *pParent);
+
+    /** Takes a consistent copy of a definition's fields. Safe without
+     *  m_Lock. \return false if the definition is dead. */
+    static bool readDefinition(
+        const Definition *pDefinition, Elf *&pParent, Binding &binding,
+        uintptr_t &value);
+
+    /** Finds the entry for a name. Safe without m_Lock. */
+    IndexEntry *findEntry(const HashedStringView &name) const;
+    /** Finds or creates the entry for a name. */
+    IndexEntry *getOrInsertEntry(const String &name);
+    /** Ensures the index can take \p count entries without growing. */
+    void reserveIndex(size_t count);
+    /** Recomputes the cached Global and Weak winners of an entry. */
+    void updateWinners(IndexEntry *pEntry);
+    /** Records that pParent defines pDefinition, for eraseByElf. */
+    void trackDefinition(Elf *pParent, Definition *pDefinition);
+
+    IndexSlots *m_pIndex;
+    size_t m_nIndexEntries;
+    List<IndexSlots *> m_RetiredIndex;
+
+    /** Definitions made by each ELF. */
+    Tree<Elf *, Vector<Definition *> *> m_DefinitionsByElf;
 
     Elf *m_pOriginatingElf;
 
@@ -38,6 +38,25 @@ class EXPORTED_PUBLIC Disk : public Device
         ATAPI
     };
 
+    /**
+     * One segment of a vectored request: a run of blocks that falls within a
+     * single 4096-byte cache page. Drivers are expected to merge adjacent
+     * segments into as few commands as they can.
+     */
+    struct IoSegment
+    {
+        /// Offset from the start of the device, in bytes.
+        uint64_t location;
+        /// Length of the run in bytes, a multiple of the block size.
+        size_t length;
+        /// For reads, set to the address of the data (as read() would return
+        /// for \c location). Unused for writes.
+        uintptr_t buffer;
+    };
+
+    /** Called once every segment of a vectored request has completed. */
+    typedef void (*IoCompletion)(void *param, bool bSuccess);
+
     Disk();
     Disk(Device *p);
     virtual ~Disk();
@@ -75,6 +94,28 @@ class EXPORTED_PUBLIC Disk : public Device
      */
     virtual void write(uint64_t location);
 
+    /**
+     * Reads all of the given segments into the cache as one request, setting
+     * each segment's buffer. The default implementation calls read() for each
+     * segment; drivers that can issue multi-block commands should override.
+     * \param pCompletion Optional callback, called exactly once when the
+     *        request finishes (successfully or not). May be called before
+     *        this function returns.
+     * \return False if the request could not be completed.
+     */
+    virtual bool readVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+
+    /**
+     * Schedules a write back of all of the given segments (see \c write() )
+     * as one request. The default implementation calls write() for each
+     * segment.
+     */
+    virtual bool writeVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+
     /**
      * \brief Sets the page boundary alignment after a specific location on the
      * disk.
@@ -157,6 +198,15 @@ class EXPORTED_PUBLIC Disk : public Device
      * Will not remove the page from cache, that must be done by the caller.
      */
     virtual void flush(uint64_t location);
+
+    /**
+     * \brief Issue any writes that are being held back.
+     *
+     * Writes may be deferred by layers such as an IoScheduler, or by a
+     * disk's own cache; this sends them on to the device, e.g. for fsync()
+     * or before unmounting. The default does nothing.
+     */
+    virtual void sync();
 };
 
 #endif
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_MACHINE_IOSCHEDULER_H
+#define KERNEL_MACHINE_IOSCHEDULER_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/machine/Disk.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/utilities/Tree.h"
+
+class String;
+
+/// Default number of queued writes that forces a dispatch.
+#define IOSCHED_DEFAULT_BATCH 32
+/// Default largest merged command, in bytes.
+#define IOSCHED_DEFAULT_MAX_MERGE 0x20000
+
+/**
+ * Block I/O scheduler. Sits in front of a Disk and queues requests to it,
+ * dispatching them in an order chosen by the policy and merging requests for
+ * adjacent blocks into single vectored commands.
+ *
+ * Reads are synchronous: read() dispatches until its own request completes.
+ * Writes are queued until enough build up, they expire, or flush() or sync()
+ * is called. The target's cache page for a queued write stays pinned until
+ * the write completes, so it can't be evicted while it waits.
+ */
+class EXPORTED_PUBLIC IoScheduler : public Disk
+{
+  public:
+    enum Policy
+    {
+        /// Dispatch in submission order, merging adjacent requests only.
+        NoOp,
+        /// Elevator (C-SCAN) ordering by location, with expiry times so no
+        /// request starves.
+        Deadline
+    };
+
+    struct Statistics
+    {
+        /// Requests currently queued.
+        size_t queueDepth;
+        /// Deepest the queue has been.
+        size_t maxQueueDepth;
+        /// Requests submitted.
+        uint64_t submitted;
+        /// Commands issued to the disk.
+        uint64_t dispatched;
+        /// Requests folded into another request's command.
+        uint64_t merged;
+        /// Requests dispatched early because they expired.
+        uint64_t expired;
+    };
+
+    IoScheduler(Disk *pTarget, Policy policy = Deadline);
+    virtual ~IoScheduler();
+
+    Policy getPolicy() const
+    {
+        return m_Policy;
+    }
+    void setPolicy(Policy policy)
+    {
+        m_Policy = policy;
+    }
+
+    /** Set how long reads and writes may wait before being forced out. */
+    void setExpiry(Time::Timestamp readExpiry, Time::Timestamp writeExpiry);
+
+    /** Set the number of queued writes that forces a dispatch. */
+    void setBatchSize(size_t nRequests)
+    {
+        m_BatchSize = nRequests;
+    }
+
+    /** Set the largest command that merging may build, in bytes. */
+    void setMaxMerge(size_t nBytes)
+    {
+        m_MaxMerge = nBytes;
+    }
+
+    Statistics getStatistics();
+
+    /** Dispatch one command. \return false if the queue was empty. */
+    bool dispatch();
+
+    /** Dispatch everything currently queued. */
+    void drain();
+
+    Disk *getTarget() const
+    {
+        return m_pTarget;
+    }
+
+    virtual void getName(String &str);
+    virtual void dump(String &str);
+
+    virtual uintptr_t read(uint64_t location);
+    virtual void write(uint64_t location);
+    virtual bool readVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+    virtual bool writeVectored(
+        IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion = 0,
+        void *param = 0);
+    virtual void align(uint64_t location);
+    virtual size_t getSize() const;
+    virtual size_t getBlockSize() const;
+    virtual void pin(uint64_t location);
+    virtual void unpin(uint64_t location);
+    virtual bool cacheIsCritical();
+    virtual void flush(uint64_t location);
+    virtual void sync();
+
+  protected:
+    /** Clock used for expiry; overridable for testing. */
+    virtual Time::Timestamp now();
+
+  private:
+    IoScheduler(const IoScheduler &);
+    IoScheduler &operator=(const IoScheduler &);
+
+    /** Completion state shared by the requests of one submission. */
+    struct Batch
+    {
+        size_t remaining;
+        bool bSuccess;
+        IoCompletion pCompletion;
+        void *param;
+    };
+
+    struct Request
+    {
+        uint64_t location;
+        size_t length;
+        bool bWrite;
+        Time::Timestamp deadline;
+        /// Submission order, across both directions.
+        uint64_t sequence;
+        /// Caller's segment (receives the buffer for reads), if any.
+        IoSegment *pSegment;
+        Batch *pBatch;
+        /// Next queued request starting where this one starts.
+        Request *pNextAtStart;
+        /// Next queued request ending where this one ends.
+        Request *pNextAtEnd;
+        /// Neighbours in the FIFO for this request's direction.
+        Request *pOlder;
+        Request *pNewer;
+    };
+
+    /** Queued requests of one direction, oldest first. */
+    struct Fifo
+    {
+        Request *pOldest;
+        Request *pNewest;
+    };
+
+    /** A merged run of requests on its way to the target. */
+    struct Command
+    {
+        IoScheduler *pScheduler;
+        IoSegment *pSegments;
+        Request **pRequests;
+        size_t nRequests;
+    };
+
+    /** Queue a submission, returning false if nothing could be queued. */
+    bool submit(
+        IoSegment *pSegments, size_t nSegments, bool bWrite, Batch *pBatch);
+
+    /** Add a request to the location indexes and its FIFO. */
+    void enqueue(Request *pRequest);
+    /** Remove a request from the location indexes and its FIFO. */
+    void dequeue(Request *pRequest);
+
+    /** The request with the earliest deadline, if it has passed. */
+    Request *mostOverdue(Time::Timestamp currentTime);
+
+    /** Pick the next request per the policy and remove it from the queue. */
+    Request *pickNext();
+
+    /** Pull queued requests adjacent to the given run into it. */
+    void collectMerges(List<Request *> &run);
+
+    /** Completion callback for commands issued to the target. */
+    static void commandComplete(void *param, bool bSuccess);
+
+    /** Signal completion of a request to its batch. */
+    void complete(Request *pRequest, bool bSuccess);
+
+#ifdef THREADS
+    /** Dispatch expired writes on every scheduler; run via Time::runAfter. */
+    static int flushExpired(void *);
+#endif
+
+    Disk *m_pTarget;
+    Policy m_Policy;
+
+    /// Pending requests by location, each the first of a chain of requests
+    /// that start there (in submission order).
+    Tree<uint64_t, Request *> m_ByStart;
+    /// Pending requests by end location, for merging runs backwards.
+    Tree<uint64_t, Request *> m_ByEnd;
+    /// Pending reads and writes, each in submission order. Requests of one
+    /// direction share an expiry, so the oldest is the first to expire.
+    Fifo m_Fifo[2];
+    size_t m_nQueued;
+    uint64_t m_NextSequence;
+    Mutex m_Lock;
+
+    /// Location just past the last dispatched command (elevator head).
+    uint64_t m_Head;
+
+    Time::Timestamp m_ReadExpiry;
+    Time::Timestamp m_WriteExpiry;
+    size_t m_BatchSize;
+    size_t m_MaxMerge;
+    size_t m_nQueuedWrites;
+
+    Statistics m_Stats;
+};
+
+#endif
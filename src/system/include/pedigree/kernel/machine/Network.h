@@ -28,6 +28,9 @@
 
 class String;
 
+/// Most fragments linkOutput will pass to Network::sendFragments at once.
+#define NETWORK_MAX_FRAGMENTS 16
+
 /** Station information - basically information about this station, per NIC */
 class EXPORTED_PUBLIC StationInfo
 {
@@ -81,6 +84,37 @@ class EXPORTED_PUBLIC Network : public Device
      * \param buffer A buffer with the packet to send */
     virtual bool send(size_t nBytes, uintptr_t buffer) = 0;
 
+    /** One piece of a packet passed to sendFragments. */
+    struct Fragment
+    {
+        /// Virtual address of the data.
+        uintptr_t buffer;
+        /// Number of bytes at buffer.
+        size_t length;
+    };
+
+    /** Called when the device has finished with a packet's fragments.
+     * \param param The value passed to sendFragments.
+     * \param success Whether the packet was sent. */
+    typedef void (*SendCompletion)(void *param, bool success);
+
+    /** Sends a packet held in several buffers, without first gathering it
+     * into one. The fragments must stay valid until \p completion is called,
+     * which happens exactly once, possibly before this returns.
+     *
+     * The default implementation copies the fragments into a single buffer
+     * and calls send(); devices that can transmit from the fragments
+     * themselves should override it.
+     * \param fragments The pieces of the packet, in order.
+     * \param count Number of entries in \p fragments.
+     * \param nBytes Total length of the packet.
+     * \param completion Called once the fragments are no longer needed. May
+     *        be null.
+     * \param param Passed to \p completion. */
+    virtual bool sendFragments(
+        const Fragment *fragments, size_t count, size_t nBytes,
+        SendCompletion completion, void *param);
+
     /** Sets station information (such as IP addresses)
      * \param info The information to set as the station info */
     virtual bool setStationInfo(const StationInfo &info);
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LOAD_BALANCING_CORE_ALLOCATOR_H
+#define LOAD_BALANCING_CORE_ALLOCATOR_H
+
+#include "pedigree/kernel/process/ThreadToCoreAllocationAlgorithm.h"
+#include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/List.h"
+
+class PerProcessorScheduler;
+class Thread;
+
+/** Threads that ran within this long aren't stolen by an idle processor. */
+#define LOADBALANCE_IDLE_AFFINITY (500 * Time::Multiplier::Microsecond)
+/** Threads that ran within this long aren't moved by periodic balancing. */
+#define LOADBALANCE_PERIODIC_AFFINITY (5 * Time::Multiplier::Millisecond)
+/** Difference in load between two processors before work is moved. */
+#define LOADBALANCE_IMBALANCE 2
+
+/**
+ * Places new threads on the least loaded processor, and moves waiting threads
+ * from busy processors to idle ones. Threads that ran recently are left where
+ * they are so their cache footprint isn't thrown away.
+ */
+class LoadBalancingCoreAllocator : public ThreadToCoreAllocationAlgorithm
+{
+  public:
+    LoadBalancingCoreAllocator();
+    virtual ~LoadBalancingCoreAllocator();
+
+    virtual bool initialise(List<PerProcessorScheduler *> &procList);
+
+    virtual PerProcessorScheduler *allocateThread(Thread *pThread);
+
+    virtual bool balance(PerProcessorScheduler *pScheduler, bool bIdle);
+
+  private:
+    List<PerProcessorScheduler *> m_Schedulers;
+};
+
+#endif
@@ -22,6 +22,7 @@
 
 #ifdef THREADS
 
+#include "pedigree/kernel/Atomic.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/TimerHandler.h"
 #include "pedigree/kernel/process/ConditionVariable.h"
@@ -34,9 +35,25 @@
 class SchedulingAlgorithm;
 class Spinlock;
 
+/** Number of scheduler ticks between periodic load balancing passes. */
+#define SCHEDULER_BALANCE_TICKS 10
+
 class EXPORTED_PUBLIC PerProcessorScheduler : public TimerHandler
 {
   public:
+    /** Thread migration counters for this processor. */
+    struct Statistics
+    {
+        /** Threads moved onto this processor. */
+        size_t migratedIn;
+        /** Threads moved off this processor. */
+        size_t migratedOut;
+        /** Threads pulled in because this processor was about to idle. */
+        size_t idleSteals;
+        /** Threads pulled in by periodic balancing. */
+        size_t balanceSteals;
+    };
+
     /** Default constructor - Creates an empty scheduler with a new idle thread.
      */
     PerProcessorScheduler();
@@ -100,6 +117,28 @@ class EXPORTED_PUBLIC PerProcessorScheduler : public TimerHandler
 
     void setIdle(Thread *pThread);
 
+    /** Returns the number of threads running or waiting to run here. */
+    size_t getLoad();
+
+    /** Removes a waiting thread so another processor can run it.
+        \param minIdle Threads that ran within this many nanoseconds are
+                       left alone as their cache is probably still warm.
+        \return the thread, or null if none could be moved. */
+    Thread *stealThread(uint64_t minIdle);
+
+    /** Adopts a thread removed from another processor with stealThread.
+        \param bIdle Whether this processor pulled it in because it was
+                     about to go idle. */
+    void acceptThread(Thread *pThread, bool bIdle);
+
+    /** Returns the ID of the processor this scheduler runs on. */
+    size_t getProcessorId() const
+    {
+        return m_ProcessorId;
+    }
+
+    Statistics getStatistics() const;
+
   private:
     /** Copy-constructor
      *  \note Not implemented - singleton class. */
@@ -130,6 +169,20 @@ class EXPORTED_PUBLIC PerProcessorScheduler : public TimerHandler
 
     Thread *m_pIdleThread;
 
+    /** Processor this scheduler runs on. */
+    size_t m_ProcessorId;
+
+    /** Whether the processor is currently running its idle thread. */
+    volatile bool m_bIdle;
+
+    /** Ticks since the last periodic balancing pass. */
+    size_t m_BalanceTicks;
+
+    Atomic<size_t> m_MigratedIn;
+    Atomic<size_t> m_MigratedOut;
+    Atomic<size_t> m_IdleSteals;
+    Atomic<size_t> m_BalanceSteals;
+
 #ifdef ARM_BEAGLE
     size_t m_TickCount;
 #endif
@@ -78,6 +78,21 @@ class EXPORTED_PUBLIC Process
         Reaped,  /// Reaped means the process has had a status retrieved.
     };
 
+    /**
+     * How a new child Process obtains its address space from its parent.
+     */
+    enum AddressSpaceMode
+    {
+        /// Copy-on-write clone of the parent's address space (fork).
+        CopyOnWrite,
+        /// Clone of the parent's address space sharing its pages read/write.
+        Shared,
+        /// Run in the parent's own address space until exec or exit (vfork).
+        Borrowed,
+        /// Start with a fresh, empty address space (spawn).
+        Empty
+    };
+
     /** Default constructor. */
     Process();
 
@@ -90,6 +105,13 @@ class EXPORTED_PUBLIC Process
      */
     Process(Process *pParent, bool bCopyOnWrite = true);
 
+    /** Constructor for creating a new Process from the given parent, with
+     * explicit control over how the address space is obtained. This
+     * constructor does not create any threads.
+     * \param pParent The parent process.
+     * \param mode How to obtain the new address space. */
+    Process(Process *pParent, AddressSpaceMode mode);
+
     /** Destructor. */
     virtual ~Process();
 
@@ -407,6 +429,31 @@ class EXPORTED_PUBLIC Process
         return m_bSharedAddressSpace;
     }
 
+    /**
+     * Get whether this process is still running in its parent's address
+     * space, as a vfork() child does until it calls exec or exits.
+     */
+    bool hasBorrowedAddressSpace() const
+    {
+        return m_bBorrowedAddressSpace;
+    }
+
+    /**
+     * Set a Semaphore to release when this process execs or exits; the
+     * parent of a vfork() child blocks on it.
+     */
+    void setVforkWaiter(Semaphore *pWaiter)
+    {
+        m_pVforkWaiter = pWaiter;
+    }
+
+    /**
+     * Called on exec and exit. Moves a vfork() child that is running in its
+     * parent's address space onto a fresh address space of its own, and then
+     * wakes the parent blocked in vfork().
+     */
+    void releaseVforkParent();
+
     /**
      * Get the init process (first userspace process, parent of all
      * userspace processes).
@@ -420,6 +467,9 @@ class EXPORTED_PUBLIC Process
     Process(const Process &);
     Process &operator=(const Process &);
 
+    /** Wakes the parent blocked in vfork(), if any. */
+    void wakeVforkParent();
+
     /** Called when process times are updated. */
     virtual void
     reportTimesUpdated(Time::Timestamp user, Time::Timestamp system)
@@ -554,6 +604,12 @@ class EXPORTED_PUBLIC Process
     /** Is our address space shared with the parent? */
     bool m_bSharedAddressSpace;
 
+    /** Is our address space the parent's own (vfork)? */
+    bool m_bBorrowedAddressSpace;
+
+    /** Released when we exec or exit, if our parent is waiting in vfork. */
+    Semaphore *m_pVforkWaiter;
+
     /** Init process (terminated processes' children will reparent to this). */
     static Process *m_pInitProcess;
 
@@ -23,6 +23,7 @@
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/state_forward.h"
 
+class PerProcessorScheduler;
 class ThreadToCoreAllocationAlgorithm;
 
 class ProcessorThreadAllocator
@@ -52,6 +53,11 @@ class ProcessorThreadAllocator
     /// rebalance operation or something similar to take place.
     void threadRemoved(Thread *pThread);
 
+    /// Called by a processor's scheduler to pull work from busier processors,
+    /// either periodically or when it has nothing left to run.
+    /// \return true if a thread was moved onto pScheduler.
+    bool balance(PerProcessorScheduler *pScheduler, bool bIdle);
+
     /// Sets the algorithm to use for allocating threads to cores.
     inline void setAlgorithm(ThreadToCoreAllocationAlgorithm *pAlgorithm)
     {
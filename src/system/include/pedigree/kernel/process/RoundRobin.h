@@ -21,12 +21,11 @@
 #define ROUND_ROBIN_H
 
 #include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/process/RunQueue.h"
 #include "pedigree/kernel/process/SchedulingAlgorithm.h"
-#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/utilities/new"
 
-class Thread;
-
 class RoundRobin : public SchedulingAlgorithm
 {
   public:
@@ -44,11 +43,15 @@ class RoundRobin : public SchedulingAlgorithm
 
     virtual void threadStatusChanged(Thread *pThread);
 
+    virtual size_t getLoad();
+
+    virtual Thread *stealThread(uint64_t now, uint64_t minIdle);
+
   private:
     static bool isReady(Thread *pThread);
 
-    typedef List<Thread *> ThreadList;
-    ThreadList m_pReadyQueues[MAX_PRIORITIES];
+    typedef RunQueue<Thread, MAX_PRIORITIES, &Thread::m_ReadyLink> ReadyQueue;
+    ReadyQueue m_ReadyQueue;
 
     Spinlock m_Lock;
 };
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESS_RUNQUEUE_H
+#define KERNEL_PROCESS_RUNQUEUE_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/** Links embedded in each object that can sit on a RunQueue. */
+template <class T>
+struct RunQueueLink
+{
+    T *pNext = nullptr;
+    T *pPrev = nullptr;
+    /// Queue the object is on, or null if it is not queued.
+    const void *pOwner = nullptr;
+    /// Level the object was queued at.
+    size_t level = 0;
+};
+
+/**
+ * Intrusive FIFO queues, one per priority level, with a bitmap of non-empty
+ * levels. Queueing, removal and finding the highest priority object are all
+ * constant time; the links live in the objects, so nothing is allocated.
+ *
+ * Level 0 is the highest priority. The queue does no locking of its own.
+ *
+ * \param T The queued type.
+ * \param Levels Number of priority levels, at most 32.
+ * \param Link Pointer to the RunQueueLink member of T.
+ */
+template <class T, size_t Levels, RunQueueLink<T> T::*Link>
+class RunQueue
+{
+    static_assert(Levels <= 32, "RunQueue supports at most 32 levels");
+
+  public:
+    RunQueue() : m_Bitmap(0), m_Count(0)
+    {
+        for (size_t i = 0; i < Levels; ++i)
+        {
+            m_pHeads[i] = m_pTails[i] = nullptr;
+        }
+    }
+
+    /** Queues an object at the back of the given level.
+     * \return false if the object is already queued, here or elsewhere. */
+    bool pushBack(T *p, size_t level)
+    {
+        RunQueueLink<T> &link = p->*Link;
+        if (link.pOwner)
+        {
+            return false;
+        }
+
+        link.pOwner = this;
+        link.level = level;
+        link.pNext = nullptr;
+        link.pPrev = m_pTails[level];
+        if (m_pTails[level])
+        {
+            (m_pTails[level]->*Link).pNext = p;
+        }
+        else
+        {
+            m_pHeads[level] = p;
+            m_Bitmap |= 1U << level;
+        }
+        m_pTails[level] = p;
+        ++m_Count;
+        return true;
+    }
+
+    /** Unlinks an object. \return false if it was not on this queue. */
+    bool remove(T *p)
+    {
+        RunQueueLink<T> &link = p->*Link;
+        if (link.pOwner != this)
+        {
+            return false;
+        }
+
+        size_t level = link.level;
+        if (link.pPrev)
+        {
+            (link.pPrev->*Link).pNext = link.pNext;
+        }
+        else
+        {
+            m_pHeads[level] = link.pNext;
+        }
+        if (link.pNext)
+        {
+            (link.pNext->*Link).pPrev = link.pPrev;
+        }
+        else
+        {
+            m_pTails[level] = link.pPrev;
+        }
+
+        if (!m_pHeads[level])
+        {
+            m_Bitmap &= ~(1U << level);
+        }
+
+        link.pNext = link.pPrev = nullptr;
+        link.pOwner = nullptr;
+        --m_Count;
+        return true;
+    }
+
+    /** Removes and returns the front object of the highest priority
+     * non-empty level, or null if the queue is empty. */
+    T *popFront()
+    {
+        if (!m_Bitmap)
+        {
+            return nullptr;
+        }
+
+        T *p = m_pHeads[__builtin_ctz(m_Bitmap)];
+        remove(p);
+        return p;
+    }
+
+    /** Whether the object is on this queue. */
+    bool contains(const T *p) const
+    {
+        return (p->*Link).pOwner == this;
+    }
+
+    /** Front object of a level, for walking the queue with getNext(). */
+    T *getFirst(size_t level) const
+    {
+        return m_pHeads[level];
+    }
+
+    /** Object after p on its level, or null. */
+    static T *getNext(const T *p)
+    {
+        return (p->*Link).pNext;
+    }
+
+    size_t count() const
+    {
+        return m_Count;
+    }
+
+    /** Bit n is set if level n has something queued. */
+    uint32_t getBitmap() const
+    {
+        return m_Bitmap;
+    }
+
+  private:
+    NOT_COPYABLE_OR_ASSIGNABLE(RunQueue);
+
+    T *m_pHeads[Levels];
+    T *m_pTails[Levels];
+    uint32_t m_Bitmap;
+    size_t m_Count;
+};
+
+#endif
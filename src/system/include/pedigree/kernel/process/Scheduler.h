@@ -94,6 +94,12 @@ class EXPORTED_PUBLIC Scheduler
     {
         return m_pBspScheduler;
     }
+
+    /** Returns the number of per-processor schedulers. */
+    size_t getNumProcessorSchedulers();
+
+    /** Returns the n-th per-processor scheduler, in processor order. */
+    PerProcessorScheduler *getProcessorScheduler(size_t n);
 #endif  // THREADS
 
   private:
@@ -128,6 +134,9 @@ class EXPORTED_PUBLIC Scheduler
      */
     PerProcessorScheduler *m_pBspScheduler;
 
+    /** All per-processor schedulers, set up in initialise(). */
+    List<PerProcessorScheduler *> m_Schedulers;
+
     /** Main scheduler lock for modifying internal structures. */
     Spinlock m_SchedulerLock;
 #endif  // THREADS
@@ -20,6 +20,8 @@
 #ifndef SCHEDULING_ALGORITHM_H
 #define SCHEDULING_ALGORITHM_H
 
+#include "pedigree/kernel/processor/types.h"
+
 class Thread;
 
 #define MAX_PRIORITIES 8
@@ -50,6 +52,16 @@ class SchedulingAlgorithm
     /** Notifies us that the status of a thread has changed, and that we may
      * need to take action. */
     virtual void threadStatusChanged(Thread *pThread) = 0;
+
+    /** Returns the number of threads waiting to run, for load balancing. */
+    virtual size_t getLoad() = 0;
+
+    /** Removes and returns a waiting thread that may be moved to another
+     * processor, or null if there is none.
+     * \param now The current time, per Time::getTicks().
+     * \param minIdle Threads that ran within this many nanoseconds of now are
+     * considered cache-hot and are left alone. */
+    virtual Thread *stealThread(uint64_t now, uint64_t minIdle) = 0;
 };
 
 #endif
@@ -25,6 +25,7 @@
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/process/Event.h"
+#include "pedigree/kernel/process/RunQueue.h"
 #include "pedigree/kernel/process/SchedulingAlgorithm.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
@@ -54,6 +55,8 @@ class Process;
 class EXPORTED_PUBLIC Thread
 {
     friend class PerProcessorScheduler;
+    // To link threads into its ready queues.
+    friend class RoundRobin;
     // To set uninterruptible state.
     friend class Uninterruptible;
 
@@ -442,10 +445,36 @@ class EXPORTED_PUBLIC Thread
     /** Gets the per-processor scheduler for this Thread. */
     class PerProcessorScheduler *getScheduler() const;
 
+    /** Gets whether this thread must stay on its current CPU. Pinned threads
+     * are never moved by load balancing. */
+    bool isPinned() const
+    {
+        return m_bPinned;
+    }
+
+    /** Pins the thread to its current CPU, or allows it to migrate again. */
+    void setPinned(bool bPinned)
+    {
+        m_bPinned = bPinned;
+    }
+
+    /** Gets the time (per Time::getTicks) this thread last stopped running,
+     * used to judge whether its cache footprint is still warm. */
+    uint64_t getLastRun() const
+    {
+        return m_LastRun;
+    }
+
   protected:
     /** Sets the scheduler for the Thread. */
     void setScheduler(class PerProcessorScheduler *pScheduler);
 
+    /** Records the time the thread stopped running. */
+    void setLastRun(uint64_t when)
+    {
+        m_LastRun = when;
+    }
+
     /** Sets or unsets the interruptible state of the Thread. */
     void setInterruptible(bool state);
 
@@ -578,6 +607,15 @@ class EXPORTED_PUBLIC Thread
 
     /** Whether this thread has been marked interruptible or not. */
     bool m_bInterruptible = true;
+
+    /** Whether this thread may not be migrated to another CPU. */
+    bool m_bPinned = false;
+
+    /** When this thread last stopped running, for cache affinity. */
+    uint64_t m_LastRun = 0;
+
+    /** Links for the scheduler's ready queue. */
+    RunQueueLink<Thread> m_ReadyLink;
 };
 
 #endif
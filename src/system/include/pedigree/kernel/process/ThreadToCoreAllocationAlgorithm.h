@@ -38,6 +38,12 @@ class ThreadToCoreAllocationAlgorithm
     virtual PerProcessorScheduler *allocateThread(Thread *pThread) = 0;
 
     virtual void threadRemoved(Thread *pThread);
+
+    /** Gives the algorithm a chance to move work onto the given processor.
+     * \param pScheduler The scheduler of the calling processor.
+     * \param bIdle Whether the processor has nothing else to run.
+     * \return true if a thread was moved onto pScheduler. */
+    virtual bool balance(PerProcessorScheduler *pScheduler, bool bIdle);
 };
 
 #endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_PAGEREFERENCE_H
+#define KERNEL_PROCESSOR_PAGEREFERENCE_H
+
+#include "pedigree/kernel/processor/types.h"
+
+/** @addtogroup kernelprocessor
+ * @{ */
+
+/**
+ * Reference count kept for a physical page that is mapped more than once.
+ *
+ * A page that isn't active is untracked, which counts as the single
+ * reference held by whoever allocated it. Pinning an untracked page starts
+ * tracking at one reference, whatever an earlier, now inactive, count said;
+ * every further pin adds one. The caller serialises access.
+ */
+struct PageReference
+{
+    PageReference() : active(false), refcount(0)
+    {
+    }
+
+    /** Adds a reference. */
+    void pin()
+    {
+        if (!active)
+        {
+            active = true;
+            refcount = 0;
+        }
+
+        ++refcount;
+    }
+
+    /** Drops a reference, keeping the page allocated for the caller.
+     * \return true if other references remain. */
+    bool unpin()
+    {
+        if (!active)
+        {
+            return false;
+        }
+
+        if (refcount > 1)
+        {
+            --refcount;
+            return true;
+        }
+
+        // Only the caller's reference is left, which is the same as not
+        // tracking the page at all.
+        active = false;
+        refcount = 0;
+        return false;
+    }
+
+    /** Drops a reference on behalf of a free.
+     * \return true if that was the last one and the page should be freed. */
+    bool release()
+    {
+        if (!active)
+        {
+            return true;
+        }
+
+        if (--refcount)
+        {
+            return false;
+        }
+
+        active = false;
+        return true;
+    }
+
+    bool active;
+    size_t refcount;
+};
+
+/** @} */
+
+#endif
@@ -295,6 +295,16 @@ class EXPORTED_PUBLIC Processor
 
 #if defined(X86_COMMON)
     static physical_uintptr_t readCr3();
+
+    /** Drops the non-global TLB entries of every processor, returning once
+     *  all of them have done so. Safe to call with spinlocks held. */
+    static void flushTlbEverywhere();
+#if defined(MULTIPROCESSOR)
+    /** Carries out a flushTlbEverywhere() still pending on this processor.
+     *  Called by its IPI, and by anything waiting with interrupts disabled,
+     *  as the processor that asked may be holding what we wait for. */
+    static void serviceTlbFlush();
+#endif
 #endif
 
 #if defined(ARMV7)
@@ -390,6 +400,13 @@ class EXPORTED_PUBLIC Processor
     /// Used before multiprocessor stuff is turned on as a "safe" info
     /// structure. For stuff like early heap setup and all that.
     static ProcessorInformation m_SafeBspProcessorInformation;
+
+#if defined(X86_COMMON)
+    /// Number of flushTlbEverywhere() calls so far.
+    static size_t m_TlbFlushGeneration;
+    /// Number of flushTlbEverywhere() calls still waiting on a processor.
+    static size_t m_TlbFlushesPending;
+#endif
 #endif
 
     static size_t m_nProcessors;
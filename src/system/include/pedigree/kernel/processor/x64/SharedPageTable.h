@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_X64_SHAREDPAGETABLE_H
+#define KERNEL_PROCESSOR_X64_SHAREDPAGETABLE_H
+
+#include "pedigree/kernel/processor/types.h"
+
+/** @addtogroup kernelprocessorx64
+ * @{ */
+
+/**
+ * Page tables shared between address spaces by a copy-on-write clone.
+ *
+ * A shared table is reached through read-only directory entries marked
+ * SharedTable, and is pinned once for every directory pointing at it. The
+ * first write through one of them unshares it: the last user takes the table
+ * over, anyone else gets a private copy whose pages are copy-on-write.
+ *
+ * Memory provides table(), allocateTable() (zeroed, 0 when out of memory),
+ * pin() and unpin() with the semantics of PageReference. The caller holds
+ * the lock that serialises shared tables and flushes the TLBs of every
+ * processor once an entry changes.
+ */
+template <class Memory>
+class SharedPageTable
+{
+  public:
+    /** Entry flags, as in VirtualAddressSpace.cc. */
+    enum
+    {
+        Present = 0x01,
+        Write = 0x02,
+        HugePage = 0x80,
+        CopyOnWrite = 0x400,
+        SharedPage = 0x800,
+        SharedTable = 0x400
+    };
+
+    /** Number of entries in one table. */
+    static const size_t Entries = 512;
+
+    /** Outcome of unshare(). */
+    enum UnshareResult
+    {
+        NotShared,
+        TookOver,
+        Copied,
+        OutOfMemory
+    };
+
+    static uint64_t flagsOf(uint64_t entry)
+    {
+        return entry & 0x8000000000000FFFULL;
+    }
+
+    static physical_uintptr_t addressOf(uint64_t entry)
+    {
+        return entry & ~0x8000000000000FFFULL;
+    }
+
+    /** Shares the table \p entry points to with a clone.
+     * \return the entry for the clone's directory; \p entry is now the same. */
+    static uint64_t share(uint64_t &entry, Memory &memory)
+    {
+        physical_uintptr_t table = addressOf(entry);
+        if ((entry & SharedTable) != SharedTable)
+        {
+            // Untracked tables already count as one reference, so the first
+            // pin() doesn't add one.
+            memory.pin(table);
+            entry = (entry & ~static_cast<uint64_t>(Write)) | SharedTable;
+        }
+        memory.pin(table);
+
+        return entry;
+    }
+
+    /** Gives the directory \p entry belongs to a table it can write to. */
+    static UnshareResult unshare(uint64_t &entry, Memory &memory)
+    {
+        if ((entry & (Present | HugePage | SharedTable)) !=
+            (Present | SharedTable))
+            return NotShared;
+
+        physical_uintptr_t table = addressOf(entry);
+        uint64_t flags = flagsOf(entry) | Write;
+        flags &= ~static_cast<uint64_t>(SharedTable);
+
+        // If every other address space has let go of the table, it's ours and
+        // can be written to as-is.
+        if (!memory.unpin(table))
+        {
+            entry = table | flags;
+            return TookOver;
+        }
+
+        physical_uintptr_t newTable = memory.allocateTable();
+        if (!newTable)
+        {
+            memory.pin(table);
+            return OutOfMemory;
+        }
+
+        copyEntries(table, newTable, true, memory);
+        entry = newTable | flags;
+        return Copied;
+    }
+
+    /** Lets go of a shared table as its address space is torn down.
+     * \return true if another address space still uses it, in which case
+     *         \p entry is cleared; otherwise the table is the caller's. */
+    static bool release(uint64_t &entry, Memory &memory)
+    {
+        if ((entry & SharedTable) != SharedTable)
+            return false;
+
+        if (!memory.unpin(addressOf(entry)))
+            return false;
+
+        entry = 0;
+        return true;
+    }
+
+    /** Maps the pages of \p source in \p target too, which must be empty. */
+    static void copyEntries(
+        physical_uintptr_t source, physical_uintptr_t target, bool copyOnWrite,
+        Memory &memory)
+    {
+        uint64_t *sourceTable = memory.table(source);
+        uint64_t *targetTable = memory.table(target);
+
+        for (size_t l = 0; l < Entries; l++)
+        {
+            uint64_t &sourceEntry = sourceTable[l];
+            if ((sourceEntry & Present) != Present)
+                continue;
+
+            uint64_t flags = flagsOf(sourceEntry);
+            physical_uintptr_t physicalAddress = addressOf(sourceEntry);
+
+            if (flags & SharedPage)
+            {
+                // The physical address is now referenced (shared) in two
+                // tables, so make sure we hold another reference on it.
+                // Otherwise, if one of the two frees the page, the other may
+                // still refer to the bad page (and eventually double-free).
+                memory.pin(physicalAddress);
+                targetTable[l] = sourceEntry;
+                continue;
+            }
+
+            // Make the page read-only and copy-on-write in *both* tables, as
+            // otherwise writes through the source table would be seen through
+            // the new one.
+            bool bWasCopyOnWrite = (flags & CopyOnWrite);
+            if (copyOnWrite && (flags & Write))
+            {
+                flags |= CopyOnWrite;
+                flags &= ~static_cast<uint64_t>(Write);
+                sourceEntry = physicalAddress | flags;
+            }
+            targetTable[l] = physicalAddress | flags;
+
+            // Pin the page twice - once for each table. But only pin for the
+            // source if the page is not already copy on write. If we pin the
+            // CoW page, it'll be leaked when both tables are freed if the
+            // source is copied again.
+            if (!bWasCopyOnWrite)
+                memory.pin(physicalAddress);
+            memory.pin(physicalAddress);
+        }
+    }
+};
+
+/** @} */
+
+#endif
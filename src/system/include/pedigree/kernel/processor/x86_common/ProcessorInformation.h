@@ -114,6 +114,8 @@ class EXPORTED_PUBLIC X86CommonProcessorInformation
     PerProcessorScheduler *m_Scheduler;
     /** The processor's TLS segment */
     uint16_t m_TlsSelector;
+    /** The last Processor::flushTlbEverywhere() this processor carried out */
+    size_t m_TlbFlushGeneration;
 };
 
 /** @} */
@@ -156,6 +156,25 @@ class EXPORTED_PUBLIC Cache
         CachePage *pNext;
         CachePage *pPrev;
 
+        /// Whether the page has been modified since its last writeback. Only
+        /// used in dirty-tracking mode.
+        bool dirty;
+
+        /// Whether the page was put into the Editing state by markEditing()
+        /// (and will therefore be dirty once editing completes), rather than
+        /// by the initial fill that follows insert().
+        bool editDirties;
+
+        /// Whether the page is currently linked into the pending list.
+        bool pending;
+
+        /// Linked list components for the dirty-tracking pending list.
+        CachePage *pNextPending;
+        CachePage *pPrevPending;
+
+        /// Link for a batch of writebacks queued by the timer handler.
+        CachePage *pNextWriteback;
+
         /// Check the checksum against another.
         bool checkChecksum(uint64_t other[2]) const;
 
@@ -306,9 +325,52 @@ class EXPORTED_PUBLIC Cache
 
     /**
      * Mark the given page as no longer being edited.
+     *
+     * In dirty-tracking mode, pages that were put into the editing state by
+     * markEditing() become dirty here. Pages that were only being filled
+     * after insert() are considered clean.
      */
     void markNoLongerEditing(uintptr_t key, size_t length = 0);
 
+    /**
+     * Enables or disables dirty-tracking mode.
+     *
+     * By default, the write-back timer checksums every page in the cache to
+     * find pages that have changed, which costs time proportional to the size
+     * of the cache. In dirty-tracking mode, only pages that have been reported
+     * as dirty - by markDirty(), by a markEditing()/markNoLongerEditing()
+     * pair, or by the page table dirty bit on platforms that provide one -
+     * are considered for writeback.
+     *
+     * Writers to a dirty-tracking cache that bypass these interfaces on a
+     * platform without page table dirty bits will not have their changes
+     * written back by the timer. Only the cache's own mapping of a page is
+     * checked for the dirty bit, so caches whose pages are mapped shared into
+     * userspace (e.g. file caches, via mmap) must not use this mode.
+     */
+    void setDirtyTracking(bool enabled);
+
+    /** Whether this cache is in dirty-tracking mode. */
+    bool isDirtyTracking() const
+    {
+        return m_bDirtyTracking;
+    }
+
+    /**
+     * Mark the given page(s) as dirty, so the next write-back timer run will
+     * write them back. Only meaningful in dirty-tracking mode.
+     */
+    void markDirty(uintptr_t key, size_t length = 0);
+
+    /** Whether the given page is currently known to be dirty. */
+    bool isDirty(uintptr_t key);
+
+    /**
+     * Writes back changed pages now, as the write-back timer would.
+     * \param async if false, returns once the writebacks are done.
+     */
+    void writeBack(bool async = true);
+
   private:
     /** mapping doer */
     bool map(uintptr_t virt) const;
@@ -358,6 +420,34 @@ class EXPORTED_PUBLIC Cache
      */
     void checksum(const void *data, size_t len, uint64_t out[2]);
 
+    /**
+     * Link the given CachePage to the pending list, which holds pages the
+     * dirty-tracking timer needs to look at.
+     */
+    void linkPending(CachePage *pPage);
+
+    /**
+     * Unlink the given CachePage from the pending list.
+     */
+    void unlinkPending(CachePage *pPage);
+
+    /**
+     * Reads and clears the page table dirty bit for the given CachePage.
+     * \return true if the page table reported the page as dirty.
+     */
+    bool harvestDirtyBit(CachePage *pPage);
+
+    /**
+     * Whether the given CachePage has references beyond the base reference
+     * held by the cache itself, meaning someone may still write to it.
+     */
+    bool isHeld(CachePage *pPage) const;
+
+    /**
+     * writeBack() do-er for dirty-tracking mode.
+     */
+    void writeBackPending(bool async);
+
     struct callbackMeta
     {
         CacheConstants::CallbackCause cause;
@@ -424,6 +514,15 @@ class EXPORTED_PUBLIC Cache
     /** Constraints we need to apply to each page we allocate. */
     size_t m_PageConstraints;
 
+    /** Whether dirty-tracking mode is enabled. */
+    bool m_bDirtyTracking;
+
+    /**
+     * Pages that the dirty-tracking timer needs to look at: pages that are
+     * dirty, being edited, or that have been handed out since the last run.
+     */
+    CachePage *m_pPendingHead;
+
 #ifdef STANDALONE_CACHE
     /** Determines the range of addresses permitted for use for Cache. */
     static void discover_range(uintptr_t &start, uintptr_t &end);
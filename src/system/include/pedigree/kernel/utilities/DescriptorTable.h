@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_DESCRIPTORTABLE_H
+#define KERNEL_UTILITIES_DESCRIPTORTABLE_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+/**
+ * Dense table of T pointers indexed by small integers, e.g. file descriptors.
+ *
+ * lookup() is lock-free: the slot array is published with release semantics
+ * and readers simply load it. Writers must be serialised by the caller. A
+ * slot array replaced by growth is retired rather than freed, as readers may
+ * still be looking at it; arrays only ever double, so retired memory never
+ * exceeds the live array. Retired arrays are freed when the table is
+ * destroyed.
+ */
+template <class T>
+class DescriptorTable
+{
+  public:
+    /** Smallest slot array that is ever allocated. */
+    static const size_t MinimumSize = 16;
+
+    DescriptorTable() : m_pSlots(nullptr), m_Retired()
+    {
+    }
+
+    ~DescriptorTable()
+    {
+        clear();
+        freeSlots(m_pSlots);
+        for (auto pSlots : m_Retired)
+        {
+            freeSlots(pSlots);
+        }
+    }
+
+    /** \return the entry at \p n, or null. Safe without the writer lock. */
+    T *lookup(size_t n) const
+    {
+        Slots *pSlots = __atomic_load_n(&m_pSlots, __ATOMIC_ACQUIRE);
+        if (UNLIKELY(!pSlots || n >= pSlots->size))
+        {
+            return nullptr;
+        }
+
+        return __atomic_load_n(&pSlots->entries[n], __ATOMIC_ACQUIRE);
+    }
+
+    /** \return the number of slots, all of which can be passed to lookup(). */
+    size_t capacity() const
+    {
+        Slots *pSlots = __atomic_load_n(&m_pSlots, __ATOMIC_ACQUIRE);
+        return pSlots ? pSlots->size : 0;
+    }
+
+    /**
+     * Stores \p p at \p n, growing the table as needed.
+     * \return the previous entry, which the caller now owns.
+     */
+    T *set(size_t n, T *p)
+    {
+        Slots *pSlots = writable(n + 1);
+        T *pOld = pSlots->entries[n];
+        __atomic_store_n(&pSlots->entries[n], p, __ATOMIC_RELEASE);
+        return pOld;
+    }
+
+    /** Clears slot \p n. \return the previous entry, owned by the caller. */
+    T *remove(size_t n)
+    {
+        if (!lookup(n))
+        {
+            return nullptr;
+        }
+
+        return set(n, nullptr);
+    }
+
+    /** Deletes every entry. */
+    void clear()
+    {
+        Slots *pSlots = m_pSlots;
+        if (!pSlots)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < pSlots->size; ++i)
+        {
+            T *p = pSlots->entries[i];
+            if (p)
+            {
+                __atomic_store_n(
+                    &pSlots->entries[i], nullptr, __ATOMIC_RELEASE);
+                delete p;
+            }
+        }
+    }
+
+  private:
+    NOT_COPYABLE_OR_ASSIGNABLE(DescriptorTable);
+
+    struct Slots
+    {
+        size_t size;
+        T **entries;
+    };
+
+    /** \return a slot array with at least \p size slots, for writing. */
+    Slots *writable(size_t size)
+    {
+        Slots *pSlots = m_pSlots;
+        if (pSlots && pSlots->size >= size)
+        {
+            return pSlots;
+        }
+
+        size_t newSize = pSlots ? pSlots->size : MinimumSize;
+        while (newSize < size)
+        {
+            newSize *= 2;
+        }
+
+        Slots *pNew = allocateSlots(newSize);
+        if (pSlots)
+        {
+            MemoryCopy(
+                pNew->entries, pSlots->entries, pSlots->size * sizeof(T *));
+        }
+
+        __atomic_store_n(&m_pSlots, pNew, __ATOMIC_RELEASE);
+        if (pSlots)
+        {
+            retire(pSlots);
+        }
+        return pNew;
+    }
+
+    void retire(Slots *pSlots)
+    {
+        m_Retired.pushBack(pSlots);
+    }
+
+    static Slots *allocateSlots(size_t size)
+    {
+        Slots *pSlots = new Slots;
+        pSlots->size = size;
+        pSlots->entries = new T *[size];
+        ByteSet(pSlots->entries, 0, size * sizeof(T *));
+        return pSlots;
+    }
+
+    static void freeSlots(Slots *pSlots)
+    {
+        if (pSlots)
+        {
+            delete[] pSlots->entries;
+            delete pSlots;
+        }
+    }
+
+    Slots *m_pSlots;
+    List<Slots *> m_Retired;
+};
+
+template <class T>
+const size_t DescriptorTable<T>::MinimumSize;
+
+#endif  // KERNEL_UTILITIES_DESCRIPTORTABLE_H
@@ -606,9 +606,16 @@ class HashTable
                 (currentHash + nextIndex(i, index, step)) & m_nMask;
             bucket *b = &m_Buckets[nextHash];
 
+            // Removals rehash, so the probe sequence has no holes and an
+            // empty bucket means the key is not present.
+            if (!b->set)
+            {
+                break;
+            }
+
             // Hash comparison is likely to be faster than raw object
             // comparison so we save the latter for when we have a candidate.
-            if (b->set && (b->key.hash() == khash))
+            if (b->key.hash() == khash)
             {
                 if (b->key == k)
                 {
@@ -635,9 +642,16 @@ class HashTable
                 (currentHash + nextIndex(i, index, step)) & m_nMask;
             const bucket *b = &m_Buckets[nextHash];
 
+            // Removals rehash, so the probe sequence has no holes and an
+            // empty bucket means the key is not present.
+            if (!b->set)
+            {
+                break;
+            }
+
             // Hash comparison is likely to be faster than raw object
             // comparison so we save the latter for when we have a candidate.
-            if (b->set && (b->key.hash() == khash))
+            if (b->key.hash() == khash)
             {
                 if (b->key == k)
                 {
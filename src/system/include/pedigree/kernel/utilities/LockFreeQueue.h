@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_LOCKFREEQUEUE_H
+#define KERNEL_UTILITIES_LOCKFREEQUEUE_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/**
+ * Bounded multi-producer, multi-consumer FIFO that never blocks or takes a
+ * lock, so it can be fed from interrupt handlers and drained from a thread.
+ *
+ * Each slot carries a sequence number which tells producers and consumers
+ * whose turn it is to use it; the head and tail counters are claimed with a
+ * compare-and-swap. A full queue makes push() fail rather than wait, leaving
+ * the caller to decide whether to drop or retry.
+ *
+ * T is copied by assignment and should be small and trivially copyable,
+ * typically a pointer.
+ */
+template <class T>
+class LockFreeQueue
+{
+  public:
+    /** \param capacity slot count, rounded up to a power of two. */
+    explicit LockFreeQueue(size_t capacity)
+        : m_Mask(0), m_pCells(nullptr), m_Padding0(), m_Tail(0), m_Padding1(),
+          m_Head(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        m_Mask = size - 1;
+        m_pCells = new Cell[size];
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_pCells[i].sequence = i;
+        }
+    }
+
+    ~LockFreeQueue()
+    {
+        delete[] m_pCells;
+    }
+
+    /** \return false, leaving the queue untouched, if it is full. */
+    bool push(const T &item)
+    {
+        Cell *pCell;
+        size_t pos = __atomic_load_n(&m_Tail, __ATOMIC_RELAXED);
+        while (true)
+        {
+            pCell = &m_pCells[pos & m_Mask];
+            size_t seq = __atomic_load_n(&pCell->sequence, __ATOMIC_ACQUIRE);
+            intptr_t diff = static_cast<intptr_t>(seq) -
+                            static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (__atomic_compare_exchange_n(
+                        &m_Tail, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // The consumer hasn't released this slot yet: full.
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n(&m_Tail, __ATOMIC_RELAXED);
+            }
+        }
+
+        pCell->value = item;
+        __atomic_store_n(&pCell->sequence, pos + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** \return false if the queue is empty. */
+    bool pop(T &item)
+    {
+        Cell *pCell;
+        size_t pos = __atomic_load_n(&m_Head, __ATOMIC_RELAXED);
+        while (true)
+        {
+            pCell = &m_pCells[pos & m_Mask];
+            size_t seq = __atomic_load_n(&pCell->sequence, __ATOMIC_ACQUIRE);
+            intptr_t diff = static_cast<intptr_t>(seq) -
+                            static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (__atomic_compare_exchange_n(
+                        &m_Head, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Nothing published here yet: empty.
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n(&m_Head, __ATOMIC_RELAXED);
+            }
+        }
+
+        item = pCell->value;
+        __atomic_store_n(
+            &pCell->sequence, pos + m_Mask + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /**
+     * Pops up to \p max entries into \p items, oldest first.
+     * \return the number popped.
+     */
+    size_t pop(T *items, size_t max)
+    {
+        size_t n = 0;
+        while (n < max && pop(items[n]))
+        {
+            ++n;
+        }
+
+        return n;
+    }
+
+    /** \return the number of queued entries; a snapshot under concurrency. */
+    size_t count() const
+    {
+        size_t head = __atomic_load_n(&m_Head, __ATOMIC_ACQUIRE);
+        size_t tail = __atomic_load_n(&m_Tail, __ATOMIC_ACQUIRE);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const
+    {
+        return count() == 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_Mask + 1;
+    }
+
+  private:
+    NOT_COPYABLE_OR_ASSIGNABLE(LockFreeQueue);
+
+    struct Cell
+    {
+        size_t sequence;
+        T value;
+    };
+
+    size_t m_Mask;
+    Cell *m_pCells;
+
+    /** Padding keeps the producer and consumer counters on separate cache
+     * lines without requiring an over-aligned allocation. */
+    uint8_t m_Padding0[64];
+    size_t m_Tail;
+    uint8_t m_Padding1[64 - sizeof(size_t)];
+    size_t m_Head;
+};
+
+#endif
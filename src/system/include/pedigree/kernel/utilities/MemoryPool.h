@@ -38,7 +38,7 @@ class MemoryPool;
  * when memory pressure is seen on the system. Because MemoryPools tend to be
  * full of bursty allocations, it's fairly typical to get a couple pages free.
  */
-class MemoryPoolPressureHandler : public MemoryPressureHandler
+class EXPORTED_PUBLIC MemoryPoolPressureHandler : public MemoryPressureHandler
 {
   public:
     MemoryPoolPressureHandler(MemoryPool *pool);
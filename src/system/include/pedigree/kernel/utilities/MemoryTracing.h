@@ -44,6 +44,8 @@ union AllocationTraceEntry
         uint32_t sz;
         uint64_t ptr;
         uint32_t bt[num_backtrace_entries];
+        /// Bytes actually consumed by an allocation (its size class).
+        uint32_t allocated;
     } data;
 
     char buf[sizeof(data)];
@@ -54,10 +56,12 @@ union AllocationTraceEntry
  * Adds an allocation field to the memory trace.
  *
  * This includes a full backtrace which will NOT include the caller of
- * traceAllocation.
+ * traceAllocation. 'allocated' is the number of bytes the allocator really
+ * used to satisfy the request, if known.
  */
-extern void
-traceAllocation(void *ptr, MemoryTracing::AllocationTrace type, size_t size);
+extern void traceAllocation(
+    void *ptr, MemoryTracing::AllocationTrace type, size_t size,
+    size_t allocated = 0);
 
 /**
  * Adds a metadata field to the memory trace.
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_PAGERING_H
+#define KERNEL_UTILITIES_PAGERING_H
+
+#include "pedigree/kernel/Atomic.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/process/ConditionVariable.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/processor/types.h"
+
+/**
+ * A byte FIFO made of a fixed ring of whole pages.
+ *
+ * Each slot in the ring references a page and the window of that page that
+ * holds unread data. Pages are reference counted, so they can be handed to
+ * another ring without copying (splice) or shared between rings (tee). Pages
+ * that are shared are never written to again. Pages released by readers are
+ * kept for reuse, so a busy ring does not go back to the allocator.
+ *
+ * Blocking follows Buffer: a read blocks until some data is present, a write
+ * blocks until all of it fits, and disabling one side wakes the other side.
+ */
+class EXPORTED_PUBLIC PageRing
+{
+  public:
+    /** Size of each page in the ring. */
+    static const size_t PageSize = 4096;
+
+    /**
+     * Fills \param buffer with at most \param size bytes; returns the number
+     * of bytes actually written. A short return stops the operation. Called
+     * without the ring locked, so it may block.
+     */
+    typedef size_t (*Producer)(void *param, uint8_t *buffer, size_t size);
+
+    /**
+     * Takes at most \param size bytes from \param buffer; returns the number
+     * of bytes actually used. A short return stops the operation. Called
+     * without the ring locked, so it may block.
+     */
+    typedef size_t (*Consumer)(void *param, const uint8_t *buffer, size_t size);
+
+    PageRing(size_t nPages);
+    ~PageRing();
+
+    /** Copies \param count bytes from \param buffer into the ring. */
+    size_t write(const uint8_t *buffer, size_t count, bool block = true);
+
+    /** Copies up to \param count bytes out of the ring into \param buffer. */
+    size_t read(uint8_t *buffer, size_t count, bool block = true);
+
+    /**
+     * Like write(), but \param producer fills the ring's pages directly so
+     * the data does not need to be staged anywhere else first.
+     */
+    size_t
+    produce(Producer producer, void *param, size_t count, bool block = true);
+
+    /**
+     * Like read(), but \param consumer is handed the ring's pages directly.
+     * Bytes are only removed from the ring once the consumer has taken them.
+     */
+    size_t
+    consume(Consumer consumer, void *param, size_t count, bool block = true);
+
+    /**
+     * Moves up to \param count bytes into \param dest. Whole pages change
+     * ring without being copied; a partially-read page is shared.
+     * \return the number of bytes moved.
+     */
+    size_t splice(PageRing &dest, size_t count, bool block = true);
+
+    /**
+     * Duplicates up to \param count bytes into \param dest without consuming
+     * them from this ring. No data is copied.
+     * \return the number of bytes duplicated.
+     */
+    size_t tee(PageRing &dest, size_t count, bool block = true);
+
+    /** Disable further writes, waking up all readers. */
+    void disableWrites();
+
+    /** Disable further reads, waking up all writers. */
+    void disableReads();
+
+    /** Enable writes. \return the previous state of writes. */
+    bool enableWrites();
+
+    /** Enable reads. \return the previous state of reads. */
+    bool enableReads();
+
+    /** Get the number of bytes in the ring now. */
+    size_t getDataSize();
+
+    /** Get the full size of the ring (potential storage). */
+    size_t getSize();
+
+    /** Get the number of pages held for reuse. */
+    size_t getCachedPages();
+
+    /**
+     * Check if the ring can be written to without blocking.
+     * \note This does not guarantee the next write() will succeed.
+     */
+    bool canWrite(bool block);
+
+    /**
+     * Check if the ring can be read from without blocking, which includes
+     * reading EOF once writes have been disabled.
+     */
+    bool canRead(bool block);
+
+    /** Wipes the ring. */
+    void wipe();
+
+  private:
+    WITHOUT_IMPLICIT_CONSTRUCTORS(PageRing);
+
+    struct Page
+    {
+        Page() : refs(1), pNext(0)
+        {
+        }
+
+        /** Number of slots (in any ring) that reference this page. */
+        Atomic<size_t> refs;
+
+        /** Next page on the reuse list. */
+        Page *pNext;
+
+        uint8_t data[PageSize];
+    };
+
+    struct Slot
+    {
+        Page *pPage;
+        size_t offset;
+        size_t length;
+    };
+
+    /** Gets an unshared, empty page. Called with the lock taken. */
+    Page *allocatePage();
+
+    /** Drops a reference to a page. Called with the lock taken. */
+    void releasePage(Page *pPage);
+
+    /** Bytes that may still be appended to the last slot's page. */
+    size_t tailSpace() const;
+
+    /** Returns the slot \param n slots after the head. */
+    Slot &slotAt(size_t n)
+    {
+        return m_pSlots[(m_Head + n) % m_nSlots];
+    }
+
+    /** Appends a slot referencing the given window of \param pPage. */
+    void pushSlot(Page *pPage, size_t offset, size_t length);
+
+    /** Removes the first slot, releasing its page if \param bRelease. */
+    void popSlot(bool bRelease);
+
+    /** Shared implementation of splice() and tee(). */
+    size_t transfer(PageRing &dest, size_t count, bool block, bool bConsume);
+
+    /**
+     * Acquires the locks of this ring and \param other in a stable order so
+     * two rings splicing into each other cannot deadlock.
+     */
+    void lockPair(PageRing &other);
+    void unlockPair(PageRing &other);
+
+    Slot *m_pSlots;
+    size_t m_nSlots;
+    size_t m_Head;
+    size_t m_nUsed;
+    size_t m_DataSize;
+
+    Page *m_pFreePages;
+    size_t m_nFreePages;
+
+    Mutex m_Lock;
+
+    /** Serialises writers (produce() and transfers into this ring), which
+     * run their producer without m_Lock held. */
+    Mutex m_ProduceLock;
+
+    /** Serialises readers (consume(), transfers out of this ring and wipe()),
+     * which run their consumer without m_Lock held. */
+    Mutex m_ConsumeLock;
+
+    ConditionVariable m_WriteCondition;
+    ConditionVariable m_ReadCondition;
+
+    bool m_bCanRead;
+    bool m_bCanWrite;
+};
+
+#endif  // KERNEL_UTILITIES_PAGERING_H
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_TIMERWHEEL_H
+#define KERNEL_UTILITIES_TIMERWHEEL_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+/**
+ * Hierarchical timing wheel.
+ *
+ * Time is divided into ticks of (1 << resolutionShift) nanoseconds. Level 0
+ * has one slot per tick; each higher level has one slot per full rotation of
+ * the level below it. An entry lives in the lowest level that can represent
+ * its expiry and is cascaded down as the wheel turns, so insert and cancel
+ * are O(1) and advancing costs O(1) per tick plus the entries that expire.
+ *
+ * Entries are intrusive: callers embed (or derive from) TimerWheel::Entry,
+ * and the wheel never allocates or frees them. Each entry can carry a key
+ * which find() can look up in O(1), e.g. to cancel by the object the timer
+ * was armed for.
+ *
+ * TimerWheel does no locking of its own.
+ */
+class EXPORTED_PUBLIC TimerWheel
+{
+  public:
+    /** Bits of tick index consumed by each level. */
+    static const size_t LevelBits = 6;
+    /** Number of slots in each level. */
+    static const size_t SlotsPerLevel = 1 << LevelBits;
+    /** Number of levels (~2.4 years of range at 1ms ticks). */
+    static const size_t Levels = 6;
+
+    class Entry
+    {
+        friend class TimerWheel;
+
+      public:
+        Entry();
+
+        /** Absolute expiry time, in nanoseconds. */
+        uint64_t getExpiry() const
+        {
+            return m_Expiry;
+        }
+
+        const void *getKey() const
+        {
+            return m_pKey;
+        }
+
+        /** Whether the entry is currently in a wheel. */
+        bool isPending() const
+        {
+            return m_pSlot != nullptr;
+        }
+
+        /** Next entry in a chain returned by TimerWheel::advance. */
+        Entry *next() const
+        {
+            return m_pNext;
+        }
+
+      private:
+        Entry(const Entry &);
+        Entry &operator=(const Entry &);
+
+        uint64_t m_Expiry;
+        const void *m_pKey;
+        Entry *m_pNext;
+        Entry *m_pPrev;
+        Entry **m_pSlot;
+        Entry *m_pHashNext;
+    };
+
+    explicit TimerWheel(size_t resolutionShift = 20);
+    ~TimerWheel();
+
+    /** Arms \p entry to expire at \p expiry nanoseconds. The entry must not
+     *  already be pending. Entries already due fire on the next advance. */
+    void insert(Entry *entry, uint64_t expiry, const void *key = nullptr);
+
+    /** Disarms \p entry. Does nothing if it is not pending. */
+    void remove(Entry *entry);
+
+    /** Finds a pending entry armed with \p key, or null if none is. */
+    Entry *find(const void *key) const;
+
+    /**
+     * Turns the wheel up to \p now (nanoseconds) and returns the entries
+     * that expired, linked through Entry::next() in expiry-tick order. The
+     * returned entries are no longer pending and may be freed or re-armed.
+     */
+    Entry *advance(uint64_t now);
+
+    /** Number of pending entries. */
+    size_t count() const
+    {
+        return m_Count;
+    }
+
+    /** The next tick the wheel will process, in nanoseconds. */
+    uint64_t getTime() const
+    {
+        return m_Now << m_ResolutionShift;
+    }
+
+  private:
+    TimerWheel(const TimerWheel &);
+    TimerWheel &operator=(const TimerWheel &);
+
+    /** Links an entry into the slot matching its expiry. */
+    void place(Entry *entry);
+
+    /** Unlinks an entry from its slot (but not the key index). */
+    void unlink(Entry *entry);
+
+    /** Re-places every entry in the given slot, one level down. */
+    void cascade(size_t level, size_t slot);
+
+    size_t hashKey(const void *key) const;
+    void rehash(size_t nBuckets);
+
+    size_t m_ResolutionShift;
+
+    /** Next tick to process. */
+    uint64_t m_Now;
+
+    size_t m_Count;
+    size_t m_LevelCount[Levels];
+    Entry *m_Slots[Levels][SlotsPerLevel];
+
+    /** Key index, chained through Entry::m_pHashNext. */
+    Entry **m_pBuckets;
+    size_t m_nBuckets;
+};
+
+/** @} */
+
+#endif
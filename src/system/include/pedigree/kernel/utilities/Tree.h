@@ -221,6 +221,27 @@ class EXPORTED_PUBLIC Tree
         return failed;
     }
 
+    /** Finds the element with the lowest key not below the given key.
+     *\return the element found, or NULL if every key is below it. */
+    E lookupAtOrAfter(const K &key) const
+    {
+        Node *n = root;
+        Node *best = 0;
+        while (n != 0)
+        {
+            if (n->key == key)
+                return n->element;
+            else if (n->key > key)
+            {
+                best = n;
+                n = n->leftChild;
+            }
+            else
+                n = n->rightChild;
+        }
+        return best ? best->element : 0;
+    }
+
     /** Reports whether a given key exists in the tree.
      *\return true if the key exists, false otherwise. */
     bool contains(const K &key) const
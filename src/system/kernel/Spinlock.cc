@@ -100,6 +100,12 @@ bool Spinlock::acquire(bool recurse, bool safe)
 
         Processor::pause();
 
+#if defined(MULTIPROCESSOR) && defined(X86_COMMON)
+        // Interrupts are off, so a TLB flush IPI would wait for us to get the
+        // lock - and whoever sent it may be the one holding it.
+        Processor::serviceTlbFlush();
+#endif
+
 #ifdef TRACK_LOCKS
         if (!m_bAvoidTracking)
         {
@@ -182,7 +182,8 @@ SlamAllocator::SlamAllocator()
       m_SlabRegionLock(false),
 #endif
       m_HeapPageCount(0), m_SlabRegionBitmap(), m_SlabRegionBitmapEntries(0),
-      m_Base(0)
+      m_FullSummary(), m_UsedSummary(), m_PageRunSummary(),
+      m_EntryRunSummary(), m_Base(0)
 {
 }
 
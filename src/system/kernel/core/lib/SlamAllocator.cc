@@ -20,13 +20,13 @@
 #ifndef SLAM_USE_DEBUG_ALLOCATOR
 
 #include "pedigree/kernel/core/SlamAllocator.h"
+#include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/panic.h"
 #include "pedigree/kernel/utilities/assert.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 #ifndef PEDIGREE_BENCHMARK
-#include "pedigree/kernel/LockGuard.h"
 #ifdef MEMORY_TRACING
 #include "pedigree/kernel/utilities/MemoryTracing.h"
 #endif
@@ -111,6 +111,101 @@ inline void spin_pause()
 #endif
 }
 
+#ifdef PEDIGREE_BENCHMARK
+namespace
+{
+/// Benchmark builds have no CPUs to speak of, so each thread is given a
+/// magazine slot of its own for its lifetime to stand in for one.
+class BenchmarkMagazineSlot
+{
+  public:
+    BenchmarkMagazineSlot() : m_Slot(~0UL)
+    {
+        for (size_t i = 0; i < NUM_MAGAZINE_SLOTS; ++i)
+        {
+            if (claim(i))
+            {
+                m_Slot = i;
+                break;
+            }
+        }
+
+        if (m_Slot == ~0UL)
+        {
+            FATAL("SlamAllocator: too many threads for magazine slots");
+        }
+    }
+
+    ~BenchmarkMagazineSlot()
+    {
+        release(m_Slot);
+    }
+
+    size_t slot() const
+    {
+        return m_Slot;
+    }
+
+    /// Takes a slot no thread holds, which is then ours to use.
+    static bool claim(size_t slot)
+    {
+        bool expected = false;
+        return __atomic_compare_exchange_n(
+            &m_SlotsInUse[slot], &expected, true, false, __ATOMIC_ACQUIRE,
+            __ATOMIC_RELAXED);
+    }
+
+    static void release(size_t slot)
+    {
+        __atomic_store_n(&m_SlotsInUse[slot], false, __ATOMIC_RELEASE);
+    }
+
+  private:
+    size_t m_Slot;
+
+    static bool m_SlotsInUse[NUM_MAGAZINE_SLOTS];
+};
+
+bool BenchmarkMagazineSlot::m_SlotsInUse[NUM_MAGAZINE_SLOTS];
+}  // namespace
+#endif
+
+/// Gets the index of the calling CPU's magazines.
+inline size_t magazineSlot()
+{
+#ifdef PEDIGREE_BENCHMARK
+    static thread_local BenchmarkMagazineSlot slot;
+    return slot.slot();
+#elif defined(MULTIPROCESSOR)
+    return Processor::id();
+#else
+    return 0;
+#endif
+}
+
+/// Prevents migration to another CPU (or re-entry from an interrupt handler)
+/// while using this CPU's magazines. Returns the previous interrupt state.
+inline bool enterMagazines()
+{
+#ifdef PEDIGREE_BENCHMARK
+    return false;
+#else
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+    return bInterrupts;
+#endif
+}
+
+inline void leaveMagazines(bool bInterrupts)
+{
+#ifndef PEDIGREE_BENCHMARK
+    if (bInterrupts)
+    {
+        Processor::setInterrupts(true);
+    }
+#endif
+}
+
 inline uintptr_t getHeapBase()
 {
 #ifdef PEDIGREE_BENCHMARK
@@ -213,7 +308,9 @@ inline void unmap(void *addr)
 }
 
 SlamCache::SlamCache()
-    : m_PartialLists(), m_ObjectSize(0), m_SlabSize(0), m_FirstSlab(),
+    : m_PartialLists(), m_Magazines(), m_pDepot(0), m_DepotCount(0),
+      m_DepotLock(false), m_MagazineRounds(0), m_ObjectSize(0), m_SlabSize(0),
+      m_FirstSlab(),
 #ifdef THREADS
       m_RecoveryLock(false),
 #endif
@@ -234,7 +331,27 @@ void SlamCache::initialise(SlamAllocator *parent, size_t objectSize)
     if (m_ObjectSize > SLAB_MINIMUM_SIZE)
         m_SlabSize = m_ObjectSize;
     else
+    {
+        // Objects that don't divide a page nicely waste the tail of each
+        // slab, so grow the slab until no more than an eighth is wasted.
         m_SlabSize = SLAB_MINIMUM_SIZE;
+        size_t bestSize = m_SlabSize;
+        size_t bestWaste = m_SlabSize % m_ObjectSize;
+        while ((m_SlabSize % m_ObjectSize) > (m_SlabSize / 8) &&
+               m_SlabSize < (SLAB_MINIMUM_SIZE * SLAM_MAX_SMALL_SLAB_PAGES))
+        {
+            m_SlabSize *= 2;
+
+            size_t waste = m_SlabSize % m_ObjectSize;
+            if ((waste * bestSize) < (bestWaste * m_SlabSize))
+            {
+                bestSize = m_SlabSize;
+                bestWaste = waste;
+            }
+        }
+
+        m_SlabSize = bestSize;
+    }
 
 #ifdef MULTIPROCESSOR
     /// \todo number of CPUs here
@@ -251,7 +368,17 @@ void SlamCache::initialise(SlamAllocator *parent, size_t objectSize)
 
     m_pParentAllocator = parent;
 
-    assert((m_SlabSize % m_ObjectSize) == 0);
+    // Any magazines left over from a previous life are now invalid.
+    ByteSet(m_Magazines, 0, sizeof(m_Magazines));
+    m_pDepot = 0;
+    m_DepotCount = 0;
+
+    // Only bother with magazines if they can hold a useful number of objects.
+    m_MagazineRounds = SLAM_MAGAZINE_BYTES / m_ObjectSize;
+    if (m_MagazineRounds > SLAM_MAGAZINE_ROUNDS)
+        m_MagazineRounds = SLAM_MAGAZINE_ROUNDS;
+    if (m_MagazineRounds < 2)
+        m_MagazineRounds = 0;
 }
 
 SlamCache::Node *SlamCache::pop(SlamCache::alignedNode *head)
@@ -309,6 +436,15 @@ uintptr_t SlamCache::allocate()
     }
 #endif
 
+    if (LIKELY(m_MagazineRounds))
+    {
+        Node *N = magazineAllocate();
+        if (LIKELY(N != 0))
+        {
+            return reinterpret_cast<uintptr_t>(N);
+        }
+    }
+
 #ifdef MULTIPROCESSOR
     size_t thisCpu = Processor::id();
 #else
@@ -366,12 +502,6 @@ void SlamCache::free(uintptr_t object)
     }
 #endif
 
-#ifdef MULTIPROCESSOR
-    size_t thisCpu = Processor::id();
-#else
-    size_t thisCpu = 0;
-#endif
-
     Node *N = reinterpret_cast<Node *>(object);
 #if OVERRUN_CHECK
     // Grab the footer and check it.
@@ -388,12 +518,241 @@ void SlamCache::free(uintptr_t object)
 #if USING_MAGIC
     // Possible double free?
     assert(N->magic != MAGIC_VALUE);
+    assert(N->magic != MAGAZINE_MAGIC);
+#endif
+
+    if (LIKELY(m_MagazineRounds))
+    {
+        magazineFree(N);
+        return;
+    }
+
+#ifdef MULTIPROCESSOR
+    size_t thisCpu = Processor::id();
+#else
+    size_t thisCpu = 0;
+#endif
+
+#if USING_MAGIC
     N->magic = MAGIC_VALUE;
 #endif
 
     push(&m_PartialLists[thisCpu], N);
 }
 
+SlamCache::Node *SlamCache::magazineAllocate()
+{
+    bool bInterrupts = enterMagazines();
+
+    CpuMagazines &cpu = m_Magazines[magazineSlot()];
+    if (UNLIKELY(__atomic_load_n(&cpu.flushRequested, __ATOMIC_RELAXED)))
+    {
+        drainMagazines(cpu);
+    }
+
+    if (UNLIKELY(!cpu.loaded.rounds))
+    {
+        if (cpu.previous.rounds)
+        {
+            Magazine tmp = cpu.loaded;
+            cpu.loaded = cpu.previous;
+            cpu.previous = tmp;
+        }
+        else
+        {
+            // Both magazines are empty, so try for a full one from the depot.
+            m_DepotLock.acquire();
+            DepotMagazine *pFull = m_pDepot;
+            if (pFull)
+            {
+                m_pDepot = pFull->next;
+                --m_DepotCount;
+            }
+            m_DepotLock.release();
+
+            if (!pFull)
+            {
+                leaveMagazines(bInterrupts);
+                return 0;
+            }
+
+            cpu.loaded.head = &pFull->node;
+            cpu.loaded.rounds = m_MagazineRounds;
+        }
+    }
+
+    Node *N = cpu.loaded.head;
+    cpu.loaded.head = N->next;
+    --cpu.loaded.rounds;
+
+    leaveMagazines(bInterrupts);
+
+#if USING_MAGIC
+    assert(N->magic == MAGAZINE_MAGIC);
+    N->magic = TEMP_MAGIC;
+#endif
+
+    return N;
+}
+
+void SlamCache::magazineFree(Node *N)
+{
+    bool bInterrupts = enterMagazines();
+
+    CpuMagazines &cpu = m_Magazines[magazineSlot()];
+    if (UNLIKELY(__atomic_load_n(&cpu.flushRequested, __ATOMIC_RELAXED)))
+    {
+        drainMagazines(cpu);
+    }
+
+    if (UNLIKELY(cpu.loaded.rounds >= m_MagazineRounds))
+    {
+        if (!cpu.previous.rounds)
+        {
+            Magazine tmp = cpu.loaded;
+            cpu.loaded = cpu.previous;
+            cpu.previous = tmp;
+        }
+        else
+        {
+            // Both magazines are full. The previous one goes to the depot,
+            // and we start filling a new one.
+            Magazine full = cpu.previous;
+            cpu.previous = cpu.loaded;
+            cpu.loaded.head = 0;
+            cpu.loaded.rounds = 0;
+
+            depositMagazine(full);
+        }
+    }
+
+#if USING_MAGIC
+    N->magic = MAGAZINE_MAGIC;
+#endif
+    N->next = cpu.loaded.head;
+    cpu.loaded.head = N;
+    ++cpu.loaded.rounds;
+
+    leaveMagazines(bInterrupts);
+}
+
+void SlamCache::depositMagazine(const Magazine &mag)
+{
+    DepotMagazine *pMagazine = reinterpret_cast<DepotMagazine *>(mag.head);
+
+    m_DepotLock.acquire();
+    if (m_DepotCount < SLAM_DEPOT_MAGAZINES)
+    {
+        pMagazine->next = m_pDepot;
+        m_pDepot = pMagazine;
+        ++m_DepotCount;
+        pMagazine = 0;
+    }
+    m_DepotLock.release();
+
+    // Depot is full, so these objects go back to the partial list.
+    if (pMagazine)
+    {
+        releaseMagazine(mag.head);
+    }
+}
+
+void SlamCache::releaseMagazine(Node *head)
+{
+    if (!head)
+    {
+        return;
+    }
+
+#ifdef MULTIPROCESSOR
+    size_t thisCpu = Processor::id();
+#else
+    size_t thisCpu = 0;
+#endif
+
+    Node *pLast = head;
+    for (Node *N = head; N;)
+    {
+        Node *pNext = N->next;
+#if USING_MAGIC
+        N->magic = MAGIC_VALUE;
+#endif
+        if (pNext)
+        {
+            N->next = tagged(pNext);
+        }
+
+        pLast = N;
+        N = pNext;
+    }
+
+    push(&m_PartialLists[thisCpu], pLast, tagged(head));
+}
+
+void SlamCache::drainMagazines(CpuMagazines &cpu)
+{
+    __atomic_store_n(&cpu.flushRequested, false, __ATOMIC_RELAXED);
+
+    Node *pLoaded = cpu.loaded.head;
+    Node *pPrevious = cpu.previous.head;
+    cpu.loaded.head = cpu.previous.head = 0;
+    cpu.loaded.rounds = cpu.previous.rounds = 0;
+
+    releaseMagazine(pLoaded);
+    releaseMagazine(pPrevious);
+}
+
+void SlamCache::flushMagazines()
+{
+    if (!m_MagazineRounds)
+    {
+        return;
+    }
+
+    bool bInterrupts = enterMagazines();
+
+    // Other CPUs' magazines count too when memory is short, but only their
+    // owners may touch them. They're asked to empty them, which happens on
+    // their next allocation or free.
+    size_t thisSlot = magazineSlot();
+    for (size_t i = 0; i < NUM_MAGAZINE_SLOTS; ++i)
+    {
+        CpuMagazines &cpu = m_Magazines[i];
+        if (i == thisSlot)
+        {
+            drainMagazines(cpu);
+            continue;
+        }
+
+#ifdef PEDIGREE_BENCHMARK
+        // A slot no thread holds is an idle CPU, so empty it ourselves.
+        if (BenchmarkMagazineSlot::claim(i))
+        {
+            drainMagazines(cpu);
+            BenchmarkMagazineSlot::release(i);
+            continue;
+        }
+#endif
+
+        __atomic_store_n(&cpu.flushRequested, true, __ATOMIC_RELAXED);
+    }
+
+    m_DepotLock.acquire();
+    DepotMagazine *pDepot = m_pDepot;
+    m_pDepot = 0;
+    m_DepotCount = 0;
+    m_DepotLock.release();
+
+    while (pDepot)
+    {
+        DepotMagazine *pNext = pDepot->next;
+        releaseMagazine(&pDepot->node);
+        pDepot = pNext;
+    }
+
+    leaveMagazines(bInterrupts);
+}
+
 bool SlamCache::isPointerValid(uintptr_t object) const
 {
 #if SLABS_FOR_HUGE_ALLOCS
@@ -418,7 +777,7 @@ bool SlamCache::isPointerValid(uintptr_t object) const
 
 #if USING_MAGIC
     // Possible double free?
-    if (N->magic == MAGIC_VALUE)
+    if (N->magic == MAGIC_VALUE || N->magic == MAGAZINE_MAGIC)
     {
 #if VERBOSE_ISPOINTERVALID
         WARNING(
@@ -467,6 +826,9 @@ size_t SlamCache::recovery(size_t maxSlabs)
     LockGuard<Spinlock> guard(m_RecoveryLock);
 #endif
 
+    // Objects sitting in magazines can't be recovered, so give them back.
+    flushMagazines();
+
     if (untagged(m_PartialLists[thisCpu]) == &m_EmptyNode)
         return 0;
 
@@ -486,8 +848,8 @@ size_t SlamCache::recovery(size_t maxSlabs)
                 break;
             }
 
-            uintptr_t slab =
-                reinterpret_cast<uintptr_t>(N) & ~(getPageSize() - 1);
+            // Small-object slabs are aligned to their (power-of-two) size.
+            uintptr_t slab = reinterpret_cast<uintptr_t>(N) & ~(m_SlabSize - 1);
 
             // A possible node found! Any luck?
             bool bSlabNotFree = false;
@@ -539,8 +901,8 @@ size_t SlamCache::recovery(size_t maxSlabs)
             while (head != &m_EmptyNode)
             {
                 bool overlaps =
-                    ((head >= reinterpret_cast<void *>(slab)) ||
-                     (head <= reinterpret_cast<void *>(slab + getPageSize())));
+                    ((head >= reinterpret_cast<void *>(slab)) &&
+                     (head < reinterpret_cast<void *>(slab + m_SlabSize)));
 
                 if (overlaps)
                 {
@@ -554,10 +916,8 @@ size_t SlamCache::recovery(size_t maxSlabs)
                         prev = untagged(head->next);
                         m_PartialLists[thisCpu] = touch_tag(head->next);
                     }
-                    else
-                    {
-                        prev = head;
-                    }
+
+                    // Otherwise, prev stays put as it's still in the list.
                 }
                 else
                 {
@@ -701,7 +1061,9 @@ void SlamCache::check()
             {
                 uintptr_t addr = slab + i * m_ObjectSize;
                 Node *pNode = reinterpret_cast<Node *>(addr);
-                if (pNode->magic == MAGIC_VALUE || pNode->magic == TEMP_MAGIC)
+                if (pNode->magic == MAGIC_VALUE ||
+                    pNode->magic == TEMP_MAGIC ||
+                    pNode->magic == MAGAZINE_MAGIC)
                     // Free, continue.
                     continue;
                 SlamAllocator::AllocHeader *pHead =
@@ -791,13 +1153,14 @@ SlamAllocator::SlamAllocator()
       ,
       m_bVigilant(false)
 #endif
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
       ,
       m_SlabRegionLock(false)
 #endif
       ,
       m_HeapPageCount(0), m_SlabRegionBitmap(), m_SlabRegionBitmapEntries(0),
-      m_Base(0)
+      m_FullSummary(), m_UsedSummary(), m_PageRunSummary(),
+      m_EntryRunSummary(), m_Base(0)
 {
 }
 
@@ -811,7 +1174,7 @@ SlamAllocator::~SlamAllocator()
 
 void SlamAllocator::initialise()
 {
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     LockGuard<Spinlock> guard(m_SlabRegionLock);
 #endif
 
@@ -829,6 +1192,34 @@ void SlamAllocator::initialise()
     m_SlabRegionBitmap = reinterpret_cast<uint64_t *>(bitmapBase);
     m_SlabRegionBitmapEntries = bitmapBytes / sizeof(uint64_t);
 
+    // Summaries of the bitmap follow it directly. The entry run summaries
+    // cover the words of the used summary's first level.
+    BitmapSummary *summaries[2 + SLAM_PAGE_RUN_ORDERS + SLAM_ENTRY_RUN_ORDERS];
+    size_t numSummaries = 0;
+    summaries[numSummaries++] = &m_FullSummary;
+    summaries[numSummaries++] = &m_UsedSummary;
+    for (size_t i = 0; i < SLAM_PAGE_RUN_ORDERS; ++i)
+    {
+        summaries[numSummaries++] = &m_PageRunSummary[i];
+    }
+    for (size_t i = 0; i < SLAM_ENTRY_RUN_ORDERS; ++i)
+    {
+        summaries[numSummaries++] = &m_EntryRunSummary[i];
+    }
+
+    uint64_t *summaryBase = m_SlabRegionBitmap + m_SlabRegionBitmapEntries;
+    size_t summaryWords = 0;
+    size_t usedWords = (m_SlabRegionBitmapEntries + 63) / 64;
+    for (size_t i = 0; i < numSummaries; ++i)
+    {
+        size_t entries = (i < 2 + SLAM_PAGE_RUN_ORDERS) ?
+                             m_SlabRegionBitmapEntries :
+                             usedWords;
+        summaryWords +=
+            layoutSummary(*summaries[i], summaryBase + summaryWords, entries);
+    }
+    bitmapBytes += summaryWords * sizeof(uint64_t);
+
     // Ensure the bitmap size is now page-aligned before we allocate it.
     if (bitmapBytes & (getPageSize() - 1))
     {
@@ -836,7 +1227,10 @@ void SlamAllocator::initialise()
         bitmapBytes += getPageSize();
     }
 
-    m_Base = bitmapBase + bitmapBytes;
+    // Slabs are aligned to their size relative to the base, which must
+    // therefore be aligned for the largest small-object slab.
+    const uintptr_t baseAlign = getPageSize() * SLAM_MAX_SMALL_SLAB_PAGES;
+    m_Base = (bitmapBase + bitmapBytes + baseAlign - 1) & ~(baseAlign - 1);
 
 #ifdef KERNEL_NEEDS_ADDRESS_SPACE_SWITCH
     VirtualAddressSpace &va = VirtualAddressSpace::getKernelAddressSpace();
@@ -851,10 +1245,42 @@ void SlamAllocator::initialise()
     for (uintptr_t addr = bitmapBase; addr < m_Base; addr += getPageSize())
     {
         // Don't CoW the first 32 pages so we have some slabs on hand for
-        // startup before CoW is viable
-        allocateAndMapAt(reinterpret_cast<void *>(addr), numPages++ >= 32);
+        // startup before CoW is viable. The same goes for both ends of each
+        // summary level, which are written from the very first slab.
+        bool cowOk = numPages++ >= 32;
+        for (size_t i = 0; cowOk && i < numSummaries; ++i)
+        {
+            const BitmapSummary *summary = summaries[i];
+            for (size_t level = 0; level < summary->numLevels; ++level)
+            {
+                uintptr_t first =
+                    reinterpret_cast<uintptr_t>(summary->levels[level]);
+                uintptr_t last =
+                    first + ((summary->words[level] - 1) * sizeof(uint64_t));
+                if (addr == (first & ~(getPageSize() - 1)) ||
+                    addr == (last & ~(getPageSize() - 1)))
+                {
+                    cowOk = false;
+                    break;
+                }
+            }
+        }
+
+        allocateAndMapAt(reinterpret_cast<void *>(addr), cowOk);
+    }
+
+    for (size_t i = 0; i < numSummaries; ++i)
+    {
+        size_t entries = (i < 2 + SLAM_PAGE_RUN_ORDERS) ?
+                             m_SlabRegionBitmapEntries :
+                             usedWords;
+        initialiseSummary(*summaries[i], entries);
     }
 
+    // Every entry starts out empty, but the padding past the last entry
+    // shortens the runs in the used summary's final word.
+    updateEntryRuns(usedWords - 1);
+
 #ifdef KERNEL_NEEDS_ADDRESS_SPACE_SWITCH
     if (Processor::m_Initialised == 2)
         Processor::switchAddressSpace(currva);
@@ -869,11 +1295,63 @@ void SlamAllocator::initialise()
                                       << "K");
 #endif
 
-    for (size_t i = 0; i < 32; i++)
+    // Small size classes sit at even steps between each power of two.
+    // Above a page they are rounded to whole pages (which can merge them).
+    size_t nClass = 0;
+    size_t lastSize = 0;
+    for (size_t lg2 = 6; lg2 < SLAM_SMALL_CLASS_LG2; ++lg2)
     {
-        m_Caches[i].initialise(this, 1ULL << i);
+        for (size_t step = 0; step < (1U << SLAM_SIZE_CLASS_SHIFT); ++step)
+        {
+            size_t objectSize =
+                (1ULL << lg2) + (step << (lg2 - SLAM_SIZE_CLASS_SHIFT));
+            if (objectSize > getPageSize())
+            {
+                objectSize = (objectSize + getPageSize() - 1) &
+                             ~(getPageSize() - 1);
+            }
+
+            if (objectSize == lastSize)
+            {
+                continue;
+            }
+
+            m_Caches[nClass++].initialise(this, objectSize);
+            lastSize = objectSize;
+        }
+    }
+
+    if (lastSize != SLAM_SMALL_CLASS_LIMIT)
+    {
+        m_Caches[nClass++].initialise(this, SLAM_SMALL_CLASS_LIMIT);
+    }
+
+    assert(nClass == SLAM_NUM_SMALL_CLASSES);
+
+    // Build the size-to-class table for small sizes.
+    size_t tableClass = 0;
+    for (size_t i = 0; i <= (SLAM_SMALL_CLASS_LIMIT >> 4); ++i)
+    {
+        while (m_Caches[tableClass].objectSize() < (i << 4))
+        {
+            ++tableClass;
+        }
+
+        m_SizeClassIndex[i] = tableClass;
+    }
+
+    // Large size classes are all whole pages, and are found arithmetically.
+    for (size_t lg2 = SLAM_SMALL_CLASS_LG2; lg2 < 31; ++lg2)
+    {
+        for (size_t step = 1; step <= (1U << SLAM_SIZE_CLASS_SHIFT); ++step)
+        {
+            m_Caches[nClass++].initialise(
+                this, (1ULL << lg2) + (step << (lg2 - SLAM_SIZE_CLASS_SHIFT)));
+        }
     }
 
+    assert(nClass == SLAM_NUM_SIZE_CLASSES);
+
     m_bInitialised = true;
 }
 
@@ -897,7 +1375,7 @@ void SlamAllocator::wipe()
         return;
     }
 
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     m_SlabRegionLock.acquire();
 #endif
 
@@ -920,7 +1398,7 @@ void SlamAllocator::wipe()
             }
 
             uintptr_t slab = m_Base + (((entry * 64) + bit) * getPageSize());
-            freeSlab(slab, getPageSize());
+            freeSlabUnlocked(slab, getPageSize());
         }
     }
 
@@ -934,11 +1412,51 @@ void SlamAllocator::wipe()
         unmap(reinterpret_cast<void *>(addr));
     }
 
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     m_SlabRegionLock.release();
 #endif
 }
 
+/// Returns the bits of 'free' that start a run of 'length' set bits.
+static uint64_t runStarts(uint64_t free, size_t length)
+{
+    // Double the run each step, then overlap the last step to make up the
+    // rest of the length.
+    size_t run = 1;
+    while ((run * 2) <= length)
+    {
+        free &= free >> run;
+        run *= 2;
+    }
+
+    if (run < length)
+    {
+        free &= free >> (length - run);
+    }
+
+    return free;
+}
+
+/// Returns the bits of a bitmap entry where a slab of nPages (< 64) could
+/// start. Power-of-two sizes stay naturally aligned so SlamCache can find a
+/// slab from any of its objects.
+static uint64_t slabStarts(uint64_t current, size_t nPages)
+{
+    uint64_t starts = runStarts(~current, nPages);
+    if (!(nPages & (nPages - 1)))
+    {
+        starts &= ~0ULL / ((1ULL << nPages) - 1);
+    }
+
+    return starts;
+}
+
+/// Returns the smallest order such that (1 << order) >= n, for n > 0.
+static size_t orderOf(size_t n)
+{
+    return (n > 1) ? (64 - __builtin_clzll(n - 1)) : 0;
+}
+
 uintptr_t SlamAllocator::getSlab(size_t fullSize)
 {
     ssize_t nPages = fullSize / getPageSize();
@@ -947,112 +1465,87 @@ uintptr_t SlamAllocator::getSlab(size_t fullSize)
         panic("Attempted to get a slab smaller than the native page size.");
     }
 
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     m_SlabRegionLock.acquire();
 #endif
 
-    // Try to find space for this allocation.
-    size_t entry = 0;
-    size_t bit = ~0UL;
+    // Try to find space for this allocation. Each case picks the summary
+    // whose clear bits are guaranteed to fit it, so a single descent finds
+    // the first usable entry. Sizes that aren't a power of two look for the
+    // next power of two up, and may pass over a gap that would just fit.
+    size_t entry = ~0UL;
+    size_t bit = 0;
+    size_t order = orderOf(nPages);
     if (nPages == 1)
     {
-        // Fantastic - easy search.
-        for (entry = 0; entry < m_SlabRegionBitmapEntries; ++entry)
+        // Fantastic - easy search. Any entry that isn't full will do.
+        entry = findClear(m_FullSummary, 0);
+        if (entry != ~0UL)
         {
-            if (!m_SlabRegionBitmap[entry])
-            {
-                bit = 0;
-                break;
-            }
-            else if (m_SlabRegionBitmap[entry] != 0xFFFFFFFFFFFFFFFFULL)
-            {
-                // First set of the INVERTED entry will be the first zero bit.
-                // Note - the check for this block ensures we always get a
-                // result from ffsll here.
-                bit = __builtin_ffsll(~m_SlabRegionBitmap[entry]) - 1;
-                break;
-            }
+            bit = __builtin_ctzll(~m_SlabRegionBitmap[entry]);
         }
     }
-    else if (nPages > 64)
+    else if (order <= SLAM_PAGE_RUN_ORDERS)
     {
-        // This allocation does not fit within a single bitmap entry.
-        for (entry = 0; entry < m_SlabRegionBitmapEntries; ++entry)
+        // The first entry with a free, aligned run of 2^order pages.
+        entry = findClear(m_PageRunSummary[order - 1], 0);
+        if (entry != ~0UL)
         {
-            // If there are any bits set in this entry, we must disregard it.
-            if (m_SlabRegionBitmap[entry])
-                continue;
-
-            // This entry has 64 free pages. Now we need to see if we can get
-            // contiguously free bitmap entries.
-            size_t needed = nPages - 64;
-            size_t checkEntry = entry + 1;
-            while (needed >= 64)
-            {
-                // If the entry has any set bits whatsoever, it's no good.
-                if (m_SlabRegionBitmap[checkEntry])
-                    break;
-
-                // Success.
-                ++checkEntry;
-                needed -= 64;
-            }
-
-            // Check for the ideal case.
-            if (needed == 0)
-            {
-                bit = 0;
-                break;
-            }
-            else if (needed < 64)
-            {
-                // Possible! Can we get enough trailing zeroes in the next entry
-                // to make this work?
-                size_t leading =
-                    __builtin_ctzll(m_SlabRegionBitmap[checkEntry]);
-                if (leading >= needed)
-                {
-                    bit = 0;
-                    break;
-                }
-            }
-
-            // Skip already-checked entries.
-            entry = checkEntry;
+            bit = __builtin_ctzll(
+                slabStarts(m_SlabRegionBitmap[entry], nPages));
         }
     }
     else
     {
-        // Have to search within entries.
-        uint64_t search = (1ULL << nPages) - 1;
-        size_t maxBit = 64 - nPages;
-        for (entry = 0; entry < m_SlabRegionBitmapEntries; ++entry)
+        // Everything else takes whole, contiguous, empty bitmap entries.
+        size_t nEntries = (nPages + 63) / 64;
+        size_t entryOrder = orderOf(nEntries);
+        if (!entryOrder)
+        {
+            entry = findClear(m_UsedSummary, 0);
+        }
+        else if (entryOrder <= SLAM_ENTRY_RUN_ORDERS)
         {
-            if (m_SlabRegionBitmap[entry] == 0ULL)
+            // The first word of the used summary with a long enough run.
+            size_t word = findClear(m_EntryRunSummary[entryOrder - 1], 0);
+            if (word != ~0UL)
             {
-                bit = 0;
-                break;
+                uint64_t starts =
+                    runStarts(~m_UsedSummary.levels[0][word], nEntries);
+                entry = (word * 64) + __builtin_ctzll(starts);
             }
-            else if (m_SlabRegionBitmap[entry] != ~0ULL)
+        }
+        else
+        {
+            // Slabs bigger than a whole word of entries need consecutive
+            // empty words. These are rare enough to just check each run of
+            // empty words in turn.
+            size_t nWords = (nEntries + 63) / 64;
+            const BitmapSummary &empty =
+                m_EntryRunSummary[SLAM_ENTRY_RUN_ORDERS - 1];
+            size_t word = findClear(empty, 0);
+            while (word != ~0UL)
             {
-                // Try and see if we fit somewhere.
-                for (bit = 0; bit < maxBit; ++bit)
+                size_t end = word + 1;
+                while (end < (word + nWords) &&
+                       end < m_UsedSummary.words[0] &&
+                       !m_UsedSummary.levels[0][end])
                 {
-                    if (m_SlabRegionBitmap[entry] & (search << bit))
-                        continue;
-
-                    break;
+                    ++end;
                 }
 
-                if (bit < maxBit)
+                if (end == (word + nWords))
+                {
+                    entry = word * 64;
                     break;
+                }
 
-                bit = ~0UL;
+                word = findClear(empty, end);
             }
         }
     }
 
-    if (bit == ~0UL)
+    if (entry == ~0UL)
     {
         FATAL(
             "SlamAllocator::getSlab cannot find a place to allocate this slab ("
@@ -1061,22 +1554,13 @@ uintptr_t SlamAllocator::getSlab(size_t fullSize)
             << " --> " << this);
     }
 
-    uintptr_t slab = m_Base + (((entry * 64) + bit) * getPageSize());
+    size_t firstPage = (entry * 64) + bit;
+    uintptr_t slab = m_Base + (firstPage * getPageSize());
 
-    // Map and mark as used.
-    for (ssize_t i = 0; i < nPages; ++i)
-    {
-        m_SlabRegionBitmap[entry] |= 1ULL << bit;
-
-        // Handle crossing a bitmap entry boundary.
-        if ((++bit) >= 64)
-        {
-            ++entry;
-            bit = 0;
-        }
-    }
+    // Mark as used.
+    markSlabRegion(firstPage, nPages, true);
 
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     // Now that we've marked the slab bits as used, we can map the pages.
     m_SlabRegionLock.release();
 #endif
@@ -1115,10 +1599,17 @@ void SlamAllocator::freeSlab(uintptr_t address, size_t length)
         panic("Attempted to free a slab smaller than the native page size.");
     }
 
-#ifdef THREADS
+#if SLAM_LOCK_SLAB_REGION
     LockGuard<Spinlock> guard(m_SlabRegionLock);
 #endif
 
+    freeSlabUnlocked(address, length);
+}
+
+void SlamAllocator::freeSlabUnlocked(uintptr_t address, size_t length)
+{
+    size_t nPages = length / getPageSize();
+
     // Perform unmapping first (so we can just modify 'address').
 
 #ifdef KERNEL_NEEDS_ADDRESS_SPACE_SWITCH
@@ -1142,24 +1633,169 @@ void SlamAllocator::freeSlab(uintptr_t address, size_t length)
 #endif
 
     // Adjust bitmap.
-    address -= m_Base;
-    address /= getPageSize();
-    size_t entry = address / 64;
-    size_t bit = address % 64;
+    markSlabRegion((address - m_Base) / getPageSize(), nPages, false);
+
+    m_HeapPageCount -= length / getPageSize();
+}
 
-    for (size_t i = 0; i < nPages; ++i)
+void SlamAllocator::markSlabRegion(size_t page, size_t nPages, bool used)
+{
+    size_t entry = page / 64;
+    size_t bit = page % 64;
+    while (nPages)
     {
-        m_SlabRegionBitmap[entry] &= ~(1ULL << bit);
+        size_t count = 64 - bit;
+        if (count > nPages)
+        {
+            count = nPages;
+        }
+
+        uint64_t mask = ~0ULL;
+        if (count < 64)
+        {
+            mask = ((1ULL << count) - 1) << bit;
+        }
+
+        if (used)
+        {
+            m_SlabRegionBitmap[entry] |= mask;
+        }
+        else
+        {
+            m_SlabRegionBitmap[entry] &= ~mask;
+        }
+
+        uint64_t value = m_SlabRegionBitmap[entry];
+        updateSummary(m_FullSummary, entry, value == ~0ULL);
+
+        // Free, aligned runs of each size, built up one order at a time.
+        uint64_t runs = ~value;
+        for (size_t order = 1; order <= SLAM_PAGE_RUN_ORDERS; ++order)
+        {
+            size_t half = 1ULL << (order - 1);
+            runs &= (runs >> half) & (~0ULL / ((1ULL << (half * 2)) - 1));
+            updateSummary(m_PageRunSummary[order - 1], entry, !runs);
+        }
 
-        // Handle overflow (eg, if we cross a bitmap entry.)
-        if ((++bit) >= 64)
+        bool wasUsed = m_UsedSummary.levels[0][entry / 64] &
+                       (1ULL << (entry % 64));
+        if (wasUsed != (value != 0))
         {
-            ++entry;
-            bit = 0;
+            updateSummary(m_UsedSummary, entry, value != 0);
+            updateEntryRuns(entry / 64);
         }
+
+        nPages -= count;
+        bit = 0;
+        ++entry;
     }
+}
 
-    m_HeapPageCount -= length / getPageSize();
+void SlamAllocator::updateEntryRuns(size_t word)
+{
+    uint64_t runs = ~m_UsedSummary.levels[0][word];
+    for (size_t order = 1; order <= SLAM_ENTRY_RUN_ORDERS; ++order)
+    {
+        runs &= runs >> (1ULL << (order - 1));
+        updateSummary(m_EntryRunSummary[order - 1], word, !runs);
+    }
+}
+
+size_t SlamAllocator::layoutSummary(
+    BitmapSummary &summary, uint64_t *base, size_t entries)
+{
+    size_t total = 0;
+    summary.numLevels = 0;
+    do
+    {
+        assert(summary.numLevels < SLAM_SUMMARY_MAX_LEVELS);
+
+        entries = (entries + 63) / 64;
+        summary.levels[summary.numLevels] = base + total;
+        summary.words[summary.numLevels] = entries;
+        ++summary.numLevels;
+
+        total += entries;
+    } while (entries > 1);
+
+    return total;
+}
+
+void SlamAllocator::initialiseSummary(BitmapSummary &summary, size_t entries)
+{
+    // Bits past the end of each level look full, so searches never pick them.
+    for (size_t level = 0; level < summary.numLevels; ++level)
+    {
+        size_t words = summary.words[level];
+        if (entries % 64)
+        {
+            summary.levels[level][words - 1] |= ~((1ULL << (entries % 64)) - 1);
+        }
+
+        entries = words;
+    }
+}
+
+void SlamAllocator::updateSummary(
+    BitmapSummary &summary, size_t entry, bool set)
+{
+    for (size_t level = 0; level < summary.numLevels; ++level)
+    {
+        uint64_t &word = summary.levels[level][entry / 64];
+        uint64_t old = word;
+        if (set)
+        {
+            word |= 1ULL << (entry % 64);
+        }
+        else
+        {
+            word &= ~(1ULL << (entry % 64));
+        }
+
+        // The level above only cares whether this word is entirely set.
+        if ((old == ~0ULL) == (word == ~0ULL))
+        {
+            break;
+        }
+
+        set = word == ~0ULL;
+        entry /= 64;
+    }
+}
+
+size_t SlamAllocator::findClear(const BitmapSummary &summary, size_t from)
+{
+    // Climb until a level has a clear bit at or after our position...
+    size_t level = 0;
+    size_t index = from;
+    while (true)
+    {
+        if (level >= summary.numLevels ||
+            (index / 64) >= summary.words[level])
+        {
+            return ~0UL;
+        }
+
+        uint64_t word = summary.levels[level][index / 64] |
+                        ((1ULL << (index % 64)) - 1);
+        if (word != ~0ULL)
+        {
+            index = (index & ~63ULL) + __builtin_ctzll(~word);
+            break;
+        }
+
+        // Nothing in the rest of this word, try from the next one up.
+        index = (index / 64) + 1;
+        ++level;
+    }
+
+    // ... then descend, taking the first clear bit at each level.
+    while (level--)
+    {
+        index = (index * 64) + __builtin_ctzll(~summary.levels[level][index]);
+    }
+
+    return index;
 }
 
 size_t SlamAllocator::recovery(size_t maxSlabs)
@@ -1167,7 +1803,7 @@ size_t SlamAllocator::recovery(size_t maxSlabs)
     size_t nSlabs = 0;
     size_t nPages = 0;
 
-    for (size_t i = 0; i < 32; ++i)
+    for (size_t i = 0; i < SLAM_NUM_SIZE_CLASSES; ++i)
     {
         // Things without slabs don't get recovered.
         if (!m_Caches[i].slabSize())
@@ -1200,7 +1836,7 @@ uintptr_t SlamAllocator::allocate(size_t nBytes)
 
 #if CRIPPLINGLY_VIGILANT
     if (m_bVigilant)
-        for (int i = 0; i < 32; i++)
+        for (size_t i = 0; i < SLAM_NUM_SIZE_CLASSES; i++)
             m_Caches[i].check();
 #endif
 
@@ -1220,16 +1856,15 @@ uintptr_t SlamAllocator::allocate(size_t nBytes)
     assert(nBytes < (1U << 31));
 
     // Default to minimum object size if we must.
-    size_t lg2 = 0;
     if (UNLIKELY(nBytes < OBJECT_MINIMUM_SIZE))
     {
         nBytes = OBJECT_MINIMUM_SIZE;
     }
 
-    // log2 of nBytes, where nBytes is rounded up to the next power-of-two.
-    lg2 = 32 - __builtin_clz(nBytes);
-    nBytes = 1U << lg2;  // Round up nBytes now.
-    ret = m_Caches[lg2].allocate();
+    // Find the smallest size class that fits and round nBytes up to it.
+    SlamCache *pCache = &m_Caches[sizeClass(nBytes)];
+    nBytes = pCache->objectSize();
+    ret = pCache->allocate();
 
 #if WARN_PAGE_SIZE_OR_LARGER
     // Does the allocation fit inside a slab?
@@ -1269,7 +1904,7 @@ uintptr_t SlamAllocator::allocate(size_t nBytes)
     ret += sizeof(AllocHeader);
 
     // Set up the header
-    head->cache = &m_Caches[lg2];
+    head->cache = pCache;
 #if OVERRUN_CHECK
     head->magic = VIGILANT_MAGIC;
     foot->magic = VIGILANT_MAGIC;
@@ -1306,7 +1941,8 @@ uintptr_t SlamAllocator::allocate(size_t nBytes)
 
 #ifdef MEMORY_TRACING
     traceAllocation(
-        reinterpret_cast<void *>(ret), MemoryTracing::Allocation, origSize);
+        reinterpret_cast<void *>(ret), MemoryTracing::Allocation, origSize,
+        nBytes);
 #endif
 
     return ret;
@@ -1350,7 +1986,7 @@ void SlamAllocator::free(uintptr_t mem)
 
 #if CRIPPLINGLY_VIGILANT
     if (m_bVigilant)
-        for (int i = 0; i < 32; i++)
+        for (size_t i = 0; i < SLAM_NUM_SIZE_CLASSES; i++)
             m_Caches[i].check();
 #endif
 
@@ -1454,7 +2090,7 @@ bool SlamAllocator::isPointerValid(uintptr_t mem)
 
 #if CRIPPLINGLY_VIGILANT
     if (m_bVigilant)
-        for (int i = 0; i < 32; i++)
+        for (size_t i = 0; i < SLAM_NUM_SIZE_CLASSES; i++)
             m_Caches[i].check();
 #endif
 
@@ -1488,15 +2124,10 @@ bool SlamAllocator::isPointerValid(uintptr_t mem)
     }
 
     // Check for a valid cache
-    bool bValid = false;
-    for (int i = 0; i < 32; i++)
-    {
-        if (head->cache == &m_Caches[i])
-        {
-            bValid = true;
-            break;
-        }
-    }
+    uintptr_t cacheOffset = reinterpret_cast<uintptr_t>(head->cache) -
+                            reinterpret_cast<uintptr_t>(&m_Caches[0]);
+    bool bValid = (cacheOffset < sizeof(m_Caches)) &&
+                  ((cacheOffset % sizeof(SlamCache)) == 0);
 
     if (!bValid)
     {
@@ -90,7 +90,8 @@ void toggleTracingAllocations()
 static volatile int g_TraceLock = 0;
 
 void traceAllocation(
-    void *ptr, MemoryTracing::AllocationTrace type, size_t size)
+    void *ptr, MemoryTracing::AllocationTrace type, size_t size,
+    size_t allocated)
 {
     // Don't trace if we're not allowed to.
     if (!traceAllocations)
@@ -113,6 +114,7 @@ void traceAllocation(
     entry.data.type = type;
     entry.data.sz = size & 0xFFFFFFFFU;
     entry.data.ptr = reinterpret_cast<uintptr_t>(ptr);
+    entry.data.allocated = allocated & 0xFFFFFFFFU;
     for (size_t i = 0; i < MemoryTracing::num_backtrace_entries; ++i)
     {
         entry.data.bt[i] = 0;
@@ -19,69 +19,327 @@
 
 #include "instrument.h"
 
-#define USE_LITE_RECORD 1
+#ifdef INSTRUMENTATION
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/utility.h"
+#ifdef X64
+#include "../processor/x64/VirtualAddressSpace.h"
+#endif
+#endif
+
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+
+// Ring sizes; both must be powers of two. Records past the end of the ring
+// overwrite the oldest ones.
+#define INSTRUMENT_MAX_CPUS 8
+#define INSTRUMENT_RECORDS_PER_CPU 16384
 
 extern "C" {
 void __cyg_profile_func_enter(void *func_address, void *call_site)
-    __attribute__((no_instrument_function)) __attribute__((hot));
-
-#define COM1 0x3F8
-#define COM2 0x2F8
-#define COM3 0x3E8
-#define COM4 0x2E8
+    NO_INSTRUMENT __attribute__((hot));
+void __cyg_profile_func_exit(void *func_address, void *call_site)
+    NO_INSTRUMENT __attribute__((hot));
+}
 
 #ifdef INSTRUMENTATION
-static volatile int g_WrittenFirst = 0;
+
+/**
+ * Each CPU writes only to its own ring, so the atomics below never contend in
+ * the common case; they're there because an interrupt can land between
+ * claiming a slot and filling it, and because a preempted thread may finish
+ * its record on another CPU.
+ */
+struct TraceRing
+{
+    /// Total records ever claimed in this ring.
+    uint64_t head;
+    /// Writers between claiming and filling a slot (see instrumentSnapshot).
+    uint64_t inflight;
+} ALIGN(64);
+
+static TraceRing g_TraceRings[INSTRUMENT_MAX_CPUS];
+static InstrumentTraceRecord
+    g_TraceRecords[INSTRUMENT_MAX_CPUS][INSTRUMENT_RECORDS_PER_CPU];
+
+static volatile bool g_TraceEnabled = false;
+static bool g_TraceHaveRdtscp = false;
+static uint64_t g_TraceSampleMask = 0;
+static uintptr_t g_TraceFilterLow = 0;
+static uintptr_t g_TraceFilterHigh = ~0UL;
+
+// TSC and wall clock when tracing was first enabled, to calibrate the TSC.
+static uint64_t g_TraceTsc0 = 0;
+static Time::Timestamp g_TraceTime0 = 0;
+
+static NO_INSTRUMENT uint64_t readTsc()
+{
+#ifdef X64
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo | (static_cast<uint64_t>(hi) << 32ULL);
+#else
+    return 0;
 #endif
+}
 
-void __cyg_profile_func_enter(void *func_address, void *call_site)
+static ALWAYS_INLINE NO_INSTRUMENT void traceFunction(void *fn, bool bExit)
+{
+#ifdef X64
+    // NOTE: you cannot call anything in here, as doing so would re-enter.
+    if (LIKELY(!__atomic_load_n(&g_TraceEnabled, __ATOMIC_RELAXED)))
+    {
+        return;
+    }
+
+    uintptr_t function = reinterpret_cast<uintptr_t>(fn);
+    if (function < g_TraceFilterLow || function >= g_TraceFilterHigh)
+    {
+        return;
+    }
+
+    // RDTSCP hands back the CPU number (IA32_TSC_AUX) with the timestamp.
+    uint32_t lo, hi, cpu = 0;
+    if (LIKELY(g_TraceHaveRdtscp))
+    {
+        asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(cpu));
+    }
+    else
+    {
+        asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    }
+    uint64_t tsc = lo | (static_cast<uint64_t>(hi) << 32ULL);
+
+    if ((tsc >> INSTRUMENT_SAMPLE_SHIFT) & g_TraceSampleMask)
+    {
+        return;
+    }
+
+    TraceRing &ring = g_TraceRings[cpu & (INSTRUMENT_MAX_CPUS - 1)];
+
+    // Announce ourselves before re-checking, so a snapshot that has turned
+    // tracing off either sees us in flight or we see that it's off.
+    __atomic_add_fetch(&ring.inflight, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_TraceEnabled, __ATOMIC_SEQ_CST))
+    {
+        uint64_t slot = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+        InstrumentTraceRecord &record =
+            g_TraceRecords[cpu & (INSTRUMENT_MAX_CPUS - 1)]
+                          [slot & (INSTRUMENT_RECORDS_PER_CPU - 1)];
+
+        record.timestamp = tsc | (bExit ? INSTRUMENT_TRACE_EXIT : 0);
+        record.function = function;
+        record.stack = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    }
+    __atomic_sub_fetch(&ring.inflight, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+void instrumentInitialiseProcessor(size_t processorId)
 {
-#ifdef INSTRUMENTATION
-// NOTE: you cannot call anything in this function, as doing so would
-// re-enter. That means hand-crafted serial writes are necessary.
 #ifdef X64
-    if (UNLIKELY(g_WrittenFirst == 0))
+    uint32_t eax, ebx, ecx, edx;
+    Processor::cpuid(0x80000001, 0, eax, ebx, ecx, edx);
+    if (edx & (1 << 27))
     {
-        if (__sync_bool_compare_and_swap(&g_WrittenFirst, 0, 1))
+        // IA32_TSC_AUX, read back by RDTSCP.
+        Processor::writeMachineSpecificRegister(0xC0000103, processorId);
+
+        // Enabled by the BSP; APs inherit it as they come up.
+        if (processorId == 0)
         {
-            uint8_t flag = 0;
-#if USE_LITE_RECORD
-            flag |= INSTRUMENT_GLOBAL_LITE;
+            g_TraceHaveRdtscp = true;
+        }
+    }
 #endif
-            asm volatile("outb %%al, %%dx" ::"d"(COM2), "a"(flag));
+}
+
+void instrumentSetEnabled(bool bEnabled)
+{
+    if (bEnabled && !g_TraceTsc0)
+    {
+        g_TraceTime0 = Time::getTimeNanoseconds();
+        g_TraceTsc0 = readTsc();
+    }
+
+    __atomic_store_n(&g_TraceEnabled, bEnabled, __ATOMIC_SEQ_CST);
+}
+
+bool instrumentIsEnabled()
+{
+    return __atomic_load_n(&g_TraceEnabled, __ATOMIC_RELAXED);
+}
+
+void instrumentSetSampling(size_t log2Rate)
+{
+    if (log2Rate >= 32)
+    {
+        log2Rate = 31;
+    }
+    g_TraceSampleMask = (1ULL << log2Rate) - 1;
+}
+
+size_t instrumentGetSampling()
+{
+    size_t log2Rate = 0;
+    while (g_TraceSampleMask >> log2Rate)
+    {
+        ++log2Rate;
+    }
+    return log2Rate;
+}
+
+void instrumentSetFilter(uintptr_t low, uintptr_t high)
+{
+    if (!low && !high)
+    {
+        high = ~0UL;
+    }
+
+    // Narrow first so no window exists where the filter is inverted.
+    g_TraceFilterLow = 0;
+    g_TraceFilterHigh = high;
+    g_TraceFilterLow = low;
+}
+
+void instrumentGetFilter(uintptr_t &low, uintptr_t &high)
+{
+    low = g_TraceFilterLow;
+    high = g_TraceFilterHigh;
+}
+
+/** Turns recording off and waits for any writers still in a ring. */
+static bool quiesce()
+{
+    bool bWasEnabled = __atomic_exchange_n(
+        const_cast<bool *>(&g_TraceEnabled), false, __ATOMIC_SEQ_CST);
+    for (size_t i = 0; i < INSTRUMENT_MAX_CPUS; ++i)
+    {
+        while (__atomic_load_n(&g_TraceRings[i].inflight, __ATOMIC_SEQ_CST))
+        {
+            Processor::pause();
         }
     }
 
-#if USE_LITE_RECORD
-    LiteInstrumentationRecord record;
-#else
-    InstrumentationRecord record;
-    record.data.flags = INSTRUMENT_RECORD_ENTRY;
-    record.data.caller = reinterpret_cast<uintptr_t>(call_site);
-    record.data.magic = INSTRUMENT_MAGIC;
+    return bWasEnabled;
+}
+
+void instrumentClear()
+{
+    bool bWasEnabled = quiesce();
+    for (size_t i = 0; i < INSTRUMENT_MAX_CPUS; ++i)
+    {
+        g_TraceRings[i].head = 0;
+    }
+    instrumentSetEnabled(bWasEnabled);
+}
+
+size_t instrumentSnapshotSize()
+{
+    return sizeof(uint8_t) + sizeof(InstrumentTraceHeader) +
+           (INSTRUMENT_MAX_CPUS *
+            (sizeof(InstrumentTraceCpuHeader) +
+             (INSTRUMENT_RECORDS_PER_CPU * sizeof(InstrumentTraceRecord))));
+}
+
+size_t instrumentSnapshot(uint8_t *buffer, size_t size)
+{
+    if (size < instrumentSnapshotSize())
+    {
+        return 0;
+    }
+
+    bool bWasEnabled = quiesce();
+
+    uint8_t *p = buffer;
+    *p++ = INSTRUMENT_GLOBAL_TRACE;
+
+    InstrumentTraceHeader *header =
+        reinterpret_cast<InstrumentTraceHeader *>(p);
+    ByteSet(header, 0, sizeof(*header));
+    header->magic = INSTRUMENT_TRACE_MAGIC;
+    header->version = INSTRUMENT_TRACE_VERSION;
+
+    // Needs a little time to pass for a useful answer.
+    Time::Timestamp elapsed = Time::getTimeNanoseconds() - g_TraceTime0;
+    uint64_t elapsedUs = elapsed / Time::Multiplier::Microsecond;
+    if (g_TraceTsc0 && elapsedUs >= 1000)
+    {
+        const uint64_t usPerSecond =
+            Time::Multiplier::Second / Time::Multiplier::Microsecond;
+        uint64_t ticks = readTsc() - g_TraceTsc0;
+        header->tscHz = ((ticks / elapsedUs) * usPerSecond) +
+                        (((ticks % elapsedUs) * usPerSecond) / elapsedUs);
+    }
+#ifdef X64
+    uintptr_t stackTop = reinterpret_cast<uintptr_t>(KERNEL_VIRTUAL_STACK);
+    header->stackTop = static_cast<uint32_t>(stackTop);
+    header->stackStride =
+        KERNEL_STACK_SIZE + PhysicalMemoryManager::getPageSize();
 #endif
-    record.data.function = reinterpret_cast<uintptr_t>(func_address);
-
-    // Semi-unrolled, all-in-one assembly serial-port write.
-    uintptr_t x = 0;
-    size_t y = 0;
-    asm volatile("pushf; cli;"
-                 ".1:\n"
-                 "movq (%0), %%rax;"
-                 "outb %%al, %%dx;"
-                 "shr $8, %%rax;"
-                 "outb %%al, %%dx;"
-                 "shr $8, %%rax;"
-                 "outb %%al, %%dx;"
-                 "shr $8, %%rax;"
-                 "outb %%al, %%dx;"
-                 "add $4, %0;"
-                 "sub $4, %1;"
-                 "jnz .1; popf"
-                 : "=&r"(x), "=&r"(y)
-                 : "d"(COM2), "0"(record.buffer), "1"(sizeof record.buffer)
-                 : "rax", "memory");
+    header->recordSize = sizeof(InstrumentTraceRecord);
+    p += sizeof(*header);
+
+    for (size_t cpu = 0; cpu < INSTRUMENT_MAX_CPUS; ++cpu)
+    {
+        uint64_t head = g_TraceRings[cpu].head;
+        if (!head)
+        {
+            continue;
+        }
+
+        uint64_t count = head;
+        if (count > INSTRUMENT_RECORDS_PER_CPU)
+        {
+            count = INSTRUMENT_RECORDS_PER_CPU;
+        }
+
+        InstrumentTraceCpuHeader *cpuHeader =
+            reinterpret_cast<InstrumentTraceCpuHeader *>(p);
+        cpuHeader->cpu = cpu;
+        cpuHeader->count = count;
+        cpuHeader->lost = head - count;
+        p += sizeof(*cpuHeader);
+
+        // Unwrap the ring so the oldest record comes first.
+        size_t start = (head - count) & (INSTRUMENT_RECORDS_PER_CPU - 1);
+        size_t first = INSTRUMENT_RECORDS_PER_CPU - start;
+        if (first > count)
+        {
+            first = count;
+        }
+        MemoryCopy(
+            p, &g_TraceRecords[cpu][start],
+            first * sizeof(InstrumentTraceRecord));
+        MemoryCopy(
+            p + (first * sizeof(InstrumentTraceRecord)), g_TraceRecords[cpu],
+            (count - first) * sizeof(InstrumentTraceRecord));
+        p += count * sizeof(InstrumentTraceRecord);
+
+        ++header->nCpus;
+    }
+
+    instrumentSetEnabled(bWasEnabled);
+
+    return p - buffer;
+}
+
+#endif  // INSTRUMENTATION
+
+extern "C" {
+
+void __cyg_profile_func_enter(void *func_address, void *call_site)
+{
+#ifdef INSTRUMENTATION
+    traceFunction(func_address, false);
 #endif
+}
+
+void __cyg_profile_func_exit(void *func_address, void *call_site)
+{
+#ifdef INSTRUMENTATION
+    traceFunction(func_address, true);
 #endif
 }
 
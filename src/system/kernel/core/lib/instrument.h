@@ -25,6 +25,7 @@
 // Global flags are held within the first byte written to the instrumentation
 // stream, and control things like which data types to use.
 #define INSTRUMENT_GLOBAL_LITE (1 << 0)
+#define INSTRUMENT_GLOBAL_TRACE (1 << 1)
 
 // Record flags define how to interpret the specific records.
 #define INSTRUMENT_RECORD_ENTRY (1 << 0)
@@ -32,6 +33,15 @@
 
 #define INSTRUMENT_MAGIC 0x1090U
 
+#define INSTRUMENT_TRACE_MAGIC 0x43525450U  // 'PTRC'
+#define INSTRUMENT_TRACE_VERSION 1
+
+// Sampling windows are 2^INSTRUMENT_SAMPLE_SHIFT TSC ticks long.
+#define INSTRUMENT_SAMPLE_SHIFT 20
+
+// Set in InstrumentTraceRecord::timestamp for function exits.
+#define INSTRUMENT_TRACE_EXIT (1ULL << 63)
+
 /**
  * InstrumentationRecord is the full-size, full-featured instrumentation type.
  * It provides information about callers and allows for flexibility via flags.
@@ -76,4 +86,91 @@ typedef union
     typedef uintptr_t lite;
 } LiteInstrumentationRecord;
 
+/**
+ * A trace stream (INSTRUMENT_GLOBAL_TRACE) is a snapshot of the in-kernel
+ * per-CPU ring buffers. After the global flags byte comes this header, then
+ * for each CPU an InstrumentTraceCpuHeader followed by that CPU's records,
+ * oldest first.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+
+    /// TSC ticks per second, or zero if the kernel couldn't tell.
+    uint64_t tscHz;
+
+    /// Kernel stacks are stackStride bytes apart, growing down from stackTop
+    /// (both truncated to 32 bits, like InstrumentTraceRecord::stack).
+    uint32_t stackTop;
+    uint32_t stackStride;
+
+    uint32_t nCpus;
+    uint32_t recordSize;
+} InstrumentTraceHeader;
+
+typedef struct
+{
+    uint32_t cpu;
+    uint32_t count;
+
+    /// Records overwritten by the ring wrapping before the snapshot.
+    uint64_t lost;
+} InstrumentTraceCpuHeader;
+
+/**
+ * One function entry or exit. Records carry the stack pointer rather than a
+ * thread, as that's all that can be found without calling anything; every
+ * thread has its own kernel stack, so it serves to split the per-CPU stream
+ * into per-thread call stacks.
+ */
+typedef struct
+{
+    /// TSC at the time of the call, INSTRUMENT_TRACE_EXIT set for exits.
+    uint64_t timestamp;
+
+    /// Lower 32 bits of the function address (see LiteInstrumentationRecord).
+    uint32_t function;
+
+    /// Lower 32 bits of the stack pointer.
+    uint32_t stack;
+} InstrumentTraceRecord;
+
+#ifndef PEDIGREE_EXTERNAL_SOURCE
+
+#include "pedigree/kernel/compiler.h"
+
+/** Per-processor setup for the tracer; call once on each CPU. */
+EXPORTED_PUBLIC void instrumentInitialiseProcessor(size_t processorId);
+
+/** Starts or stops recording into the ring buffers. */
+EXPORTED_PUBLIC void instrumentSetEnabled(bool bEnabled);
+EXPORTED_PUBLIC bool instrumentIsEnabled();
+
+/**
+ * Only records during one in every 2^log2Rate windows of TSC time (each
+ * window is 2^INSTRUMENT_SAMPLE_SHIFT ticks). Zero records everything.
+ */
+EXPORTED_PUBLIC void instrumentSetSampling(size_t log2Rate);
+EXPORTED_PUBLIC size_t instrumentGetSampling();
+
+/** Only records functions in [low, high); (0, 0) removes the filter. */
+EXPORTED_PUBLIC void instrumentSetFilter(uintptr_t low, uintptr_t high);
+EXPORTED_PUBLIC void instrumentGetFilter(uintptr_t &low, uintptr_t &high);
+
+/** Discards everything recorded so far. */
+EXPORTED_PUBLIC void instrumentClear();
+
+/** Upper bound on the size of a snapshot, in bytes. */
+EXPORTED_PUBLIC size_t instrumentSnapshotSize();
+
+/**
+ * Writes a trace stream (starting with the global flags byte) into buffer,
+ * returning the number of bytes written. Recording is paused while the rings
+ * are copied.
+ */
+EXPORTED_PUBLIC size_t instrumentSnapshot(uint8_t *buffer, size_t size);
+
+#endif  // PEDIGREE_EXTERNAL_SOURCE
+
 #endif  // KERNEL_INSTRUMENT_H
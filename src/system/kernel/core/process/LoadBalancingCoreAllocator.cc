@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/process/LoadBalancingCoreAllocator.h"
+#include "pedigree/kernel/process/PerProcessorScheduler.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/utilities/Iterator.h"
+
+class Thread;
+
+LoadBalancingCoreAllocator::LoadBalancingCoreAllocator() : m_Schedulers()
+{
+}
+
+LoadBalancingCoreAllocator::~LoadBalancingCoreAllocator()
+{
+}
+
+bool LoadBalancingCoreAllocator::initialise(
+    List<PerProcessorScheduler *> &procList)
+{
+    for (List<PerProcessorScheduler *>::Iterator it = procList.begin();
+         it != procList.end(); it++)
+    {
+        m_Schedulers.pushBack(*it);
+    }
+
+    return m_Schedulers.count() != 0;
+}
+
+PerProcessorScheduler *
+LoadBalancingCoreAllocator::allocateThread(Thread *pThread)
+{
+    // New threads have no cache footprint of their own, so the main concern is
+    // not queueing behind other work. Ties go to this processor, as the new
+    // thread probably shares data with the thread creating it.
+    PerProcessorScheduler *pBest = &Processor::information().getScheduler();
+    size_t bestLoad = pBest->getLoad();
+
+    for (List<PerProcessorScheduler *>::Iterator it = m_Schedulers.begin();
+         it != m_Schedulers.end(); it++)
+    {
+        if (*it == pBest)
+        {
+            continue;
+        }
+
+        size_t load = (*it)->getLoad();
+        if (load < bestLoad)
+        {
+            pBest = *it;
+            bestLoad = load;
+        }
+    }
+
+    return pBest;
+}
+
+bool LoadBalancingCoreAllocator::balance(
+    PerProcessorScheduler *pScheduler, bool bIdle)
+{
+    if (m_Schedulers.count() < 2)
+    {
+        return false;
+    }
+
+    size_t ourLoad = bIdle ? 0 : pScheduler->getLoad();
+
+    PerProcessorScheduler *pBusiest = 0;
+    size_t busiestLoad = 0;
+    for (List<PerProcessorScheduler *>::Iterator it = m_Schedulers.begin();
+         it != m_Schedulers.end(); it++)
+    {
+        if (*it == pScheduler)
+        {
+            continue;
+        }
+
+        size_t load = (*it)->getLoad();
+        if (load > busiestLoad)
+        {
+            pBusiest = *it;
+            busiestLoad = load;
+        }
+    }
+
+    // Moving one thread must leave the two processors more even than before,
+    // or threads would just bounce back and forth between them.
+    if (!pBusiest || busiestLoad < ourLoad + LOADBALANCE_IMBALANCE)
+    {
+        return false;
+    }
+
+    Thread *pThread = pBusiest->stealThread(
+        bIdle ? LOADBALANCE_IDLE_AFFINITY : LOADBALANCE_PERIODIC_AFFINITY);
+    if (!pThread)
+    {
+        return false;
+    }
+
+    pScheduler->acceptThread(pThread, bIdle);
+    return true;
+}
@@ -29,6 +29,7 @@
 #include "pedigree/kernel/panic.h"
 #include "pedigree/kernel/process/Event.h"
 #include "pedigree/kernel/process/Process.h"
+#include "pedigree/kernel/process/ProcessorThreadAllocator.h"
 #include "pedigree/kernel/process/RoundRobin.h"
 #include "pedigree/kernel/process/SchedulingAlgorithm.h"
 #include "pedigree/kernel/process/Thread.h"
@@ -37,6 +38,7 @@
 #include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/processor/state.h"
+#include "pedigree/kernel/time/Time.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 #ifdef TRACK_LOCKS
@@ -45,7 +47,9 @@
 
 PerProcessorScheduler::PerProcessorScheduler()
     : m_pSchedulingAlgorithm(0), m_NewThreadDataLock(false),
-      m_NewThreadDataCondition(), m_NewThreadData(), m_pIdleThread(0)
+      m_NewThreadDataCondition(), m_NewThreadData(), m_pIdleThread(0),
+      m_ProcessorId(0), m_bIdle(false), m_BalanceTicks(0), m_MigratedIn(0),
+      m_MigratedOut(0), m_IdleSteals(0), m_BalanceSteals(0)
 #ifdef ARM_BEAGLE
       ,
       m_TickCount(0)
@@ -143,9 +147,12 @@ void PerProcessorScheduler::initialise(Thread *pThread)
     }
     Machine::instance().getSchedulerTimer()->registerHandler(this);
 
+    m_ProcessorId = Processor::id();
+
     Thread *pAddThread = new Thread(
         pThread->getParent(), processorAddThread,
         reinterpret_cast<void *>(this), 0, false, true);
+    pAddThread->setPinned(true);
     pAddThread->detach();
 }
 
@@ -170,6 +177,24 @@ void PerProcessorScheduler::schedule(
     if (!pNewThread)
     {
         pNextThread = m_pSchedulingAlgorithm->getNext(pCurrentThread);
+
+        // A thread that migrated away can be queued here once more just
+        // before it moves; hand it on to the processor that now owns it.
+        while (pNextThread && pNextThread->getScheduler() != this)
+        {
+            pNextThread->getScheduler()->threadStatusChanged(pNextThread);
+            pNextThread = m_pSchedulingAlgorithm->getNext(pCurrentThread);
+        }
+
+#ifdef MULTIPROCESSOR
+        // About to run out of work - see if a busier processor can spare some.
+        if (pNextThread == 0 &&
+            ProcessorThreadAllocator::instance().balance(this, true))
+        {
+            pNextThread = m_pSchedulingAlgorithm->getNext(pCurrentThread);
+        }
+#endif
+
         if (pNextThread == 0)
         {
             bool needsIdle = false;
@@ -222,6 +247,14 @@ void PerProcessorScheduler::schedule(
     if (pNextThread != pCurrentThread)
         pNextThread->getLock().acquire();
 
+#ifdef MULTIPROCESSOR
+    // Stamp the outgoing thread before it is queued again, so it isn't seen
+    // as cache-cold and stolen while it is still switching out.
+    if (pNextThread != pCurrentThread)
+        pCurrentThread->setLastRun(Time::getTicks());
+#endif
+    m_bIdle = pNextThread == m_pIdleThread;
+
     // Now neither thread can be moved, we're safe to switch.
     if (pCurrentThread != m_pIdleThread)
         pCurrentThread->setStatus(nextStatus);
@@ -524,6 +557,7 @@ void PerProcessorScheduler::addThread(
     }
     pThread->setStatus(Thread::Running);
     Processor::information().setCurrentThread(pThread);
+    m_bIdle = false;
     void *kernelStack = pThread->getKernelStack();
     Processor::information().setKernelStack(
         reinterpret_cast<uintptr_t>(kernelStack));
@@ -648,6 +682,7 @@ void PerProcessorScheduler::addThread(Thread *pThread, SyscallState &state)
     }
     pThread->setStatus(Thread::Running);
     Processor::information().setCurrentThread(pThread);
+    m_bIdle = false;
     void *kernelStack = pThread->getKernelStack();
     Processor::information().setKernelStack(
         reinterpret_cast<uintptr_t>(kernelStack));
@@ -757,6 +792,7 @@ void PerProcessorScheduler::killCurrentThread(Spinlock *pLock)
 
     pNextThread->setStatus(Thread::Running);
     Processor::information().setCurrentThread(pNextThread);
+    m_bIdle = pNextThread == m_pIdleThread;
     void *kernelStack = pNextThread->getKernelStack();
     Processor::information().setKernelStack(
         reinterpret_cast<uintptr_t>(kernelStack));
@@ -816,6 +852,14 @@ void PerProcessorScheduler::timer(uint64_t delta, InterruptState &state)
     if ((m_TickCount % 100) == 0)
     {
 #endif
+#ifdef MULTIPROCESSOR
+        if (++m_BalanceTicks >= SCHEDULER_BALANCE_TICKS)
+        {
+            m_BalanceTicks = 0;
+            ProcessorThreadAllocator::instance().balance(this, false);
+        }
+#endif
+
         schedule();
 
         // Check if the thread should exit.
@@ -835,6 +879,68 @@ void PerProcessorScheduler::threadStatusChanged(Thread *pThread)
 void PerProcessorScheduler::setIdle(Thread *pThread)
 {
     m_pIdleThread = pThread;
+
+    // The idle thread only makes sense on its own processor.
+    pThread->setPinned(true);
+}
+
+size_t PerProcessorScheduler::getLoad()
+{
+    size_t load = 0;
+    if (m_pSchedulingAlgorithm)
+    {
+        load = m_pSchedulingAlgorithm->getLoad();
+    }
+    if (!m_bIdle)
+    {
+        ++load;
+    }
+    return load;
+}
+
+Thread *PerProcessorScheduler::stealThread(uint64_t minIdle)
+{
+    if (!m_pSchedulingAlgorithm)
+    {
+        return 0;
+    }
+
+    Thread *pThread =
+        m_pSchedulingAlgorithm->stealThread(Time::getTicks(), minIdle);
+    if (pThread)
+    {
+        m_MigratedOut += 1;
+    }
+    return pThread;
+}
+
+void PerProcessorScheduler::acceptThread(Thread *pThread, bool bIdle)
+{
+    pThread->setScheduler(this);
+    pThread->setCpuId(m_ProcessorId);
+
+    m_pSchedulingAlgorithm->addThread(pThread);
+    m_pSchedulingAlgorithm->threadStatusChanged(pThread);
+
+    m_MigratedIn += 1;
+    if (bIdle)
+    {
+        m_IdleSteals += 1;
+    }
+    else
+    {
+        m_BalanceSteals += 1;
+    }
+}
+
+PerProcessorScheduler::Statistics PerProcessorScheduler::getStatistics() const
+{
+    Statistics stats;
+    stats.migratedIn = m_MigratedIn;
+    stats.migratedOut = m_MigratedOut;
+    stats.idleSteals = m_IdleSteals;
+    stats.balanceSteals = m_BalanceSteals;
+    return stats;
 }
 
 #endif
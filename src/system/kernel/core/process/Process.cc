@@ -56,7 +56,8 @@ Process::Process()
       m_bUnreportedResume(false), m_State(Active),
       m_BeforeSuspendState(Thread::Ready), m_Lock(false), m_Metadata(),
       m_LastKernelEntry(0), m_LastUserspaceEntry(0), m_pRootFile(0),
-      m_bSharedAddressSpace(false), m_DeadThreads(0)
+      m_bSharedAddressSpace(false), m_bBorrowedAddressSpace(false),
+      m_pVforkWaiter(0), m_DeadThreads(0)
 {
     resetCounts();
     m_Metadata.startTime = Time::getTimeNanoseconds();
@@ -76,6 +77,11 @@ Process::Process()
 }
 
 Process::Process(Process *pParent, bool bCopyOnWrite)
+    : Process(pParent, bCopyOnWrite ? CopyOnWrite : Shared)
+{
+}
+
+Process::Process(Process *pParent, AddressSpaceMode mode)
     : m_Threads(), m_NextTid(0), m_Id(0), str(), m_pParent(pParent),
       m_pAddressSpace(0), m_ExitStatus(0), m_Cwd(pParent->m_Cwd),
       m_Ctty(pParent->m_Ctty), m_SpaceAllocator(pParent->m_SpaceAllocator),
@@ -88,18 +94,57 @@ Process::Process(Process *pParent, bool bCopyOnWrite)
       m_State(pParent->getState()), m_BeforeSuspendState(Thread::Ready),
       m_Lock(false), m_Metadata(pParent->m_Metadata), m_LastKernelEntry(0),
       m_LastUserspaceEntry(0), m_pRootFile(pParent->m_pRootFile),
-      m_bSharedAddressSpace(!bCopyOnWrite), m_DeadThreads(0)
+      m_bSharedAddressSpace(mode == Shared || mode == Borrowed),
+      m_bBorrowedAddressSpace(mode == Borrowed), m_pVforkWaiter(0),
+      m_DeadThreads(0)
 {
-    m_pAddressSpace = pParent->m_pAddressSpace->clone(bCopyOnWrite);
+    switch (mode)
+    {
+        case Borrowed:
+            // Nothing is copied at all - the parent is suspended until we
+            // exec or exit, at which point releaseVforkParent() moves us on.
+            m_pAddressSpace = pParent->m_pAddressSpace;
+            break;
+        case Empty:
+            // The caller is about to load a new image into the process, so
+            // none of the parent's mappings (or its layout) are relevant.
+            m_pAddressSpace = VirtualAddressSpace::create();
+            m_SpaceAllocator.clear();
+            m_DynamicSpaceAllocator.clear();
+            m_SpaceAllocator.free(
+                m_pAddressSpace->getUserStart(),
+                m_pAddressSpace->getUserReservedStart() -
+                    m_pAddressSpace->getUserStart());
+            if (m_pAddressSpace->getDynamicStart())
+            {
+                m_DynamicSpaceAllocator.free(
+                    m_pAddressSpace->getDynamicStart(),
+                    m_pAddressSpace->getDynamicEnd() -
+                        m_pAddressSpace->getDynamicStart());
+            }
+            break;
+        default:
+            m_pAddressSpace =
+                pParent->m_pAddressSpace->clone(mode == CopyOnWrite);
+            break;
+    }
 
     m_Id = Scheduler::instance().addProcess(this);
 
     // Set a temporary description.
     str = m_pParent->str;
-    if (m_bSharedAddressSpace)
+    if (m_bBorrowedAddressSpace)
+    {
+        str += "<V>";  // V for vforked (i.e. parent's address space)
+    }
+    else if (m_bSharedAddressSpace)
     {
         str += "<C>";  // C for cloned (i.e. shared address space)
     }
+    else if (mode == Empty)
+    {
+        str += "<S>";  // S for spawned.
+    }
     else
     {
         str += "<F>";  // F for forked.
@@ -161,17 +206,26 @@ Process::~Process()
     if (m_pSubsystem)
         delete m_pSubsystem;
 
+    // A vfork() child that never reached exec or exit must not tear down
+    // the address space it borrowed from its parent. There's no point in
+    // giving it a fresh one just to destroy that instead.
+    bool bBorrowed = m_bBorrowedAddressSpace;
+    wakeVforkParent();
+
     VirtualAddressSpace &VAddressSpace =
         Processor::information().getVirtualAddressSpace();
 
     bool bInterrupts = Processor::getInterrupts();
     Processor::setInterrupts(false);
 
-    Processor::switchAddressSpace(*m_pAddressSpace);
-    m_pAddressSpace->revertToKernelAddressSpace();
-    Processor::switchAddressSpace(VAddressSpace);
+    if (!bBorrowed)
+    {
+        Processor::switchAddressSpace(*m_pAddressSpace);
+        m_pAddressSpace->revertToKernelAddressSpace();
+        Processor::switchAddressSpace(VAddressSpace);
 
-    delete m_pAddressSpace;
+        delete m_pAddressSpace;
+    }
 
     str.append("<Z>");
 
@@ -186,6 +240,45 @@ Process::~Process()
     }
 }
 
+void Process::releaseVforkParent()
+{
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+
+    if (m_bBorrowedAddressSpace)
+    {
+        // Nothing to tear down - the old address space is still our parent's.
+        m_pAddressSpace = VirtualAddressSpace::create();
+        m_bBorrowedAddressSpace = false;
+        m_bSharedAddressSpace = false;
+
+        if (Processor::information().getCurrentThread()->getParent() == this)
+        {
+            Processor::switchAddressSpace(*m_pAddressSpace);
+        }
+    }
+
+    Processor::setInterrupts(bInterrupts);
+
+    wakeVforkParent();
+}
+
+void Process::wakeVforkParent()
+{
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+
+    Semaphore *pWaiter = m_pVforkWaiter;
+    m_pVforkWaiter = 0;
+
+    Processor::setInterrupts(bInterrupts);
+
+    if (pWaiter)
+    {
+        pWaiter->release();
+    }
+}
+
 size_t Process::addThread(Thread *pThread)
 {
     LockGuard<Spinlock> guard(m_Lock);
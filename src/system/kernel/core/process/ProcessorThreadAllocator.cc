@@ -54,3 +54,14 @@ void ProcessorThreadAllocator::addThread(Thread *pThread, SyscallState &state)
 void ProcessorThreadAllocator::threadRemoved(Thread *pThread)
 {
 }
+
+bool ProcessorThreadAllocator::balance(
+    PerProcessorScheduler *pScheduler, bool bIdle)
+{
+    if (!m_pAlgorithm)
+    {
+        return false;
+    }
+
+    return m_pAlgorithm->balance(pScheduler, bIdle);
+}
@@ -22,11 +22,10 @@
 #include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/types.h"
-#include "pedigree/kernel/utilities/Iterator.h"
 #include "pedigree/kernel/utilities/assert.h"
 #include "pedigree/kernel/utilities/utility.h"
 
-RoundRobin::RoundRobin() : m_Lock(false)
+RoundRobin::RoundRobin() : m_ReadyQueue(), m_Lock(false)
 {
 }
 
@@ -41,38 +40,19 @@ void RoundRobin::addThread(Thread *pThread)
 void RoundRobin::removeThread(Thread *pThread)
 {
     LockGuard<Spinlock> guard(m_Lock);
-
-    for (size_t i = 0; i < MAX_PRIORITIES; i++)
-    {
-        for (ThreadList::Iterator it = m_pReadyQueues[i].begin();
-             it != m_pReadyQueues[i].end(); it++)
-        {
-            if (*it == pThread)
-            {
-                m_pReadyQueues[i].erase(it);
-                return;
-            }
-        }
-    }
+    m_ReadyQueue.remove(pThread);
 }
 
 Thread *RoundRobin::getNext(Thread *pCurrentThread)
 {
     LockGuard<Spinlock> guard(m_Lock);
 
-    Thread *pThread = 0;
-    for (size_t i = 0; i < MAX_PRIORITIES; i++)
+    Thread *pThread;
+    while ((pThread = m_ReadyQueue.popFront()))
     {
-        if (m_pReadyQueues[i].size())
+        if (pThread != pCurrentThread)
         {
-            pThread = m_pReadyQueues[i].popFront();
-            if (pThread == pCurrentThread)
-                continue;
-
-            if (pThread)
-            {
-                return pThread;
-            }
+            return pThread;
         }
     }
     return 0;
@@ -84,20 +64,45 @@ void RoundRobin::threadStatusChanged(Thread *pThread)
     {
         assert(pThread->getPriority() < MAX_PRIORITIES);
 
-        for (List<Thread *>::Iterator it =
-                 m_pReadyQueues[pThread->getPriority()].begin();
-             it != m_pReadyQueues[pThread->getPriority()].end(); ++it)
+        // Other processors may be stealing from this queue. A thread that is
+        // already queued stays where it is.
+        LockGuard<Spinlock> guard(m_Lock);
+        m_ReadyQueue.pushBack(pThread, pThread->getPriority());
+    }
+}
+
+size_t RoundRobin::getLoad()
+{
+    // Only a hint for load balancing, so no need for the lock.
+    return m_ReadyQueue.count();
+}
+
+Thread *RoundRobin::stealThread(uint64_t now, uint64_t minIdle)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    for (size_t i = 0; i < MAX_PRIORITIES; i++)
+    {
+        // The front of the queue has waited longest, so its cache footprint
+        // is the most likely to have gone cold.
+        for (Thread *pThread = m_ReadyQueue.getFirst(i); pThread;
+             pThread = ReadyQueue::getNext(pThread))
         {
-            if ((*it) == pThread)
+            if (pThread->isPinned() || !isReady(pThread))
             {
-                // WARNING("RoundRobin: A thread was already in this priority
-                // queue");
-                return;
+                continue;
+            }
+            if (pThread->getLastRun() + minIdle > now)
+            {
+                continue;
             }
-        }
 
-        m_pReadyQueues[pThread->getPriority()].pushBack(pThread);
+            m_ReadyQueue.remove(pThread);
+            return pThread;
+        }
     }
+
+    return 0;
 }
 
 bool RoundRobin::isReady(Thread *pThread)
@@ -21,9 +21,10 @@
 
 #include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/process/LoadBalancingCoreAllocator.h"
 #include "pedigree/kernel/process/PerProcessorScheduler.h"
 #include "pedigree/kernel/process/ProcessorThreadAllocator.h"
-#include "pedigree/kernel/process/RoundRobinCoreAllocator.h"
+#include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/utilities/Iterator.h"
@@ -44,14 +45,14 @@ Scheduler Scheduler::m_Instance;
 
 Scheduler::Scheduler()
     : m_Processes(), m_NextPid(0), m_PTMap(), m_TPMap(), m_pKernelProcess(0),
-      m_pBspScheduler(0), m_SchedulerLock(false)
+      m_pBspScheduler(0), m_Schedulers(), m_SchedulerLock(false)
 {
 }
 
 bool Scheduler::initialise(Process *pKernelProcess)
 {
-    RoundRobinCoreAllocator *pRoundRobin = new RoundRobinCoreAllocator();
-    ProcessorThreadAllocator::instance().setAlgorithm(pRoundRobin);
+    LoadBalancingCoreAllocator *pAllocator = new LoadBalancingCoreAllocator();
+    ProcessorThreadAllocator::instance().setAlgorithm(pAllocator);
 
     m_pKernelProcess = pKernelProcess;
 
@@ -71,7 +72,13 @@ bool Scheduler::initialise(Process *pKernelProcess)
 
     m_pBspScheduler = &Processor::information().getScheduler();
 
-    pRoundRobin->initialise(procList);
+    pAllocator->initialise(procList);
+
+    for (List<PerProcessorScheduler *>::Iterator it = procList.begin();
+         it != procList.end(); it++)
+    {
+        m_Schedulers.pushBack(*it);
+    }
 
     return true;
 }
@@ -91,6 +98,11 @@ void Scheduler::removeThread(Thread *pThread)
     PerProcessorScheduler *pPpSched = m_TPMap.lookup(pThread);
     if (pPpSched)
     {
+        // Load balancing may have moved the thread since it was added.
+        if (pThread->getScheduler())
+        {
+            pPpSched = pThread->getScheduler();
+        }
         pPpSched->removeThread(pThread);
         m_TPMap.remove(pThread);
     }
@@ -176,6 +188,26 @@ Process *Scheduler::getProcess(size_t n)
     return pResult;
 }
 
+size_t Scheduler::getNumProcessorSchedulers()
+{
+    return m_Schedulers.count();
+}
+
+PerProcessorScheduler *Scheduler::getProcessorScheduler(size_t n)
+{
+    size_t i = 0;
+    for (List<PerProcessorScheduler *>::Iterator it = m_Schedulers.begin();
+         it != m_Schedulers.end(); it++, i++)
+    {
+        if (i == n)
+        {
+            return *it;
+        }
+    }
+
+    return 0;
+}
+
 void Scheduler::threadStatusChanged(Thread *pThread)
 {
     m_SchedulerLock.acquire(
@@ -184,6 +216,11 @@ void Scheduler::threadStatusChanged(Thread *pThread)
     assert(pSched);
     m_SchedulerLock.release();
 
+    if (pThread->getScheduler())
+    {
+        pSched = pThread->getScheduler();
+    }
+
     pSched->threadStatusChanged(pThread);
 }
 
@@ -341,6 +341,10 @@ void Thread::shutdown()
 
 void Thread::forceToStartupProcessor()
 {
+    // Whatever needs the BSP will keep needing it; don't let load balancing
+    // move us off again.
+    m_bPinned = true;
+
     if (m_pScheduler == Scheduler::instance().getBootstrapProcessorScheduler())
     {
         // No need to move - we already think we're associated with the right
@@ -19,6 +19,7 @@
 
 #include "pedigree/kernel/process/ThreadToCoreAllocationAlgorithm.h"
 
+class PerProcessorScheduler;
 class Thread;
 
 ThreadToCoreAllocationAlgorithm::ThreadToCoreAllocationAlgorithm() = default;
@@ -27,3 +28,9 @@ ThreadToCoreAllocationAlgorithm::~ThreadToCoreAllocationAlgorithm() = default;
 void ThreadToCoreAllocationAlgorithm::threadRemoved(Thread *pThread)
 {
 }
+
+bool ThreadToCoreAllocationAlgorithm::balance(
+    PerProcessorScheduler *pScheduler, bool bIdle)
+{
+    return false;
+}
@@ -23,6 +23,7 @@
 #include "InterruptManager.h"
 #include "SyscallManager.h"
 #include "gdt.h"
+#include "../../lib/instrument.h"
 #include "machine/mach_pc/Pc.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/process/initialiseMultitasking.h"
@@ -63,6 +64,10 @@ void Multiprocessor::applicationProcessorStartup()
     // Initialise the machine-specific interface
     Pc::instance().initialiseProcessor();
 
+#ifdef INSTRUMENTATION
+    instrumentInitialiseProcessor(Processor::id());
+#endif
+
     // We need to synchronize the -init section invalidation
     Processor::invalidate(0);
     Processor::invalidate(reinterpret_cast<void *>(0x200000));
@@ -18,6 +18,7 @@
  */
 
 #include "pedigree/kernel/processor/PageFaultHandler.h"
+#include "VirtualAddressSpace.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/Subsystem.h"
 #include "pedigree/kernel/debugger/Debugger.h"
@@ -61,8 +62,31 @@ void PageFaultHandler::interrupt(size_t interruptNumber, InterruptState &state)
     uintptr_t page =
         cr2 & ~(PhysicalMemoryManager::instance().getPageSize() - 1);
 
-    // Check for copy-on-write.
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    // Page tables shared by fork() are read-only until first written to.
+    // Un-sharing makes private writable pages copy-on-write, which is dealt
+    // with below; pages that are still writable just need a retry. That is
+    // also the case if another processor un-shared the table first, and our
+    // read-only translation has been flushed since.
+    if ((code & (PFE_PAGE_PRESENT | PFE_ATTEMPTED_WRITE)) ==
+        (PFE_PAGE_PRESENT | PFE_ATTEMPTED_WRITE))
+    {
+        static_cast<X64VirtualAddressSpace &>(va).unshareTable(
+            reinterpret_cast<void *>(page));
+        if (va.isMapped(reinterpret_cast<void *>(page)))
+        {
+            physical_uintptr_t phys;
+            size_t flags;
+            va.getMapping(reinterpret_cast<void *>(page), phys, flags);
+            if ((flags & VirtualAddressSpace::Write) &&
+                (!(code & PFE_USER_MODE) ||
+                 !(flags & VirtualAddressSpace::KernelMode)))
+                return;
+        }
+    }
+
+    // Check for copy-on-write.
     if (va.isMapped(reinterpret_cast<void *>(page)))
     {
         physical_uintptr_t phys;
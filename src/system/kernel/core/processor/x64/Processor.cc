@@ -23,6 +23,7 @@
 #include "SyscallManager.h"
 #include "VirtualAddressSpace.h"
 #include "gdt.h"
+#include "../../lib/instrument.h"
 #include "pedigree/kernel/process/initialiseMultitasking.h"
 #include "pedigree/kernel/processor/IoPortManager.h"
 #include "pedigree/kernel/processor/NMFaultHandler.h"
@@ -195,6 +196,10 @@ void Processor::initialise2(const BootstrapStruct_t &Info)
 
     doInitialise64(Info);
 
+#ifdef INSTRUMENTATION
+    instrumentInitialiseProcessor(0);
+#endif
+
     m_Initialised = 2;
 
 #if defined(MULTIPROCESSOR)
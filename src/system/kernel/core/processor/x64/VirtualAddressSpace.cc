@@ -18,6 +18,7 @@
  */
 
 #include "VirtualAddressSpace.h"
+#include "../x86_common/PhysicalMemoryManager.h"
 #include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/panic.h"
@@ -27,6 +28,7 @@
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/x64/SharedPageTable.h"
 #include "pedigree/kernel/utilities/utility.h"
 #include "utils.h"
 
@@ -49,6 +51,10 @@
 #define PAGE_NX 0x8000000000000000
 #define PAGE_WRITE_THROUGH (PAGE_PAT | PAGE_WRITE_COMBINE)
 
+// In a page directory entry that points to a page table: the table is shared
+// with at least one other address space, and the entry is read-only.
+#define PAGE_SHARED_TABLE 0x400
+
 //
 // Macros
 //
@@ -74,6 +80,43 @@ X64VirtualAddressSpace X64VirtualAddressSpace::m_KernelSpace(
         reinterpret_cast<uintptr_t>(KERNEL_VIRTUAL_ADDRESS),
     KERNEL_VIRTUAL_STACK);
 
+Spinlock X64VirtualAddressSpace::m_SharedTablesLock(false, true);
+
+/** Page table memory for SharedPageTable. */
+struct TableMemory
+{
+    TableMemory() : pmm(X86CommonPhysicalMemoryManager::instance())
+    {
+    }
+
+    uint64_t *table(physical_uintptr_t address)
+    {
+        return physicalAddress(reinterpret_cast<uint64_t *>(address));
+    }
+
+    physical_uintptr_t allocateTable()
+    {
+        physical_uintptr_t address = pmm.allocatePage();
+        if (address)
+            ByteSet(table(address), 0, PhysicalMemoryManager::getPageSize());
+        return address;
+    }
+
+    void pin(physical_uintptr_t address)
+    {
+        pmm.pin(address);
+    }
+
+    bool unpin(physical_uintptr_t address)
+    {
+        return pmm.unpin(address);
+    }
+
+    X86CommonPhysicalMemoryManager &pmm;
+};
+
+typedef SharedPageTable<TableMemory> SharedTables;
+
 static void trackPages(ssize_t v, ssize_t p, ssize_t s)
 {
     // Track, if we can.
@@ -340,6 +383,8 @@ bool X64VirtualAddressSpace::mapUnlocked(
         return false;
     }
 
+    unshareTableUnlocked(virtualAddress);
+
     size_t pageTableIndex = PAGE_TABLE_INDEX(virtualAddress);
     uint64_t *pageTableEntry = TABLE_ENTRY(
         PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry), pageTableIndex);
@@ -415,6 +460,8 @@ void X64VirtualAddressSpace::setFlags(void *virtualAddress, size_t newFlags)
 {
     LockGuard<Spinlock> guard(m_Lock);
 
+    unshareTableUnlocked(virtualAddress);
+
     // Get a pointer to the page-table entry (Also checks whether the page is
     // actually present or marked swapped out)
     uint64_t *pageTableEntry = 0;
@@ -440,6 +487,8 @@ void X64VirtualAddressSpace::unmap(void *virtualAddress)
 void X64VirtualAddressSpace::unmapUnlocked(
     void *virtualAddress, bool requireMapped)
 {
+    unshareTableUnlocked(virtualAddress);
+
     // Get a pointer to the page-table entry (Also checks whether the page is
     // actually present or marked swapped out)
     uint64_t *pageTableEntry = 0;
@@ -488,6 +537,9 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
     LockGuard<Spinlock> cloneGuard(pClone->m_Lock);
     LockGuard<Spinlock> cloneStacksGuard(pClone->m_StacksLock);
     m_Lock.acquire();
+    m_SharedTablesLock.acquire();
+
+    TableMemory memory;
 
     // The userspace area is only the bottom half of the address space - the top
     // 256 PML4 entries are for the kernel, and these should be mapped anyway.
@@ -497,6 +549,10 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
         if ((*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT)
             continue;
 
+        uint64_t *clonePml4Entry = TABLE_ENTRY(pClone->m_PhysicalPML4, i);
+        if (!pClone->conditionalTableEntryAllocation(clonePml4Entry, Write))
+            continue;
+
         for (uint64_t j = 0; j < 512; j++)
         {
             uint64_t *pdptEntry =
@@ -504,6 +560,11 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
             if ((*pdptEntry & PAGE_PRESENT) != PAGE_PRESENT)
                 continue;
 
+            uint64_t *clonePdptEntry =
+                TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(clonePml4Entry), j);
+            if (!pClone->conditionalTableEntryAllocation(clonePdptEntry, Write))
+                continue;
+
             for (uint64_t k = 0; k < 512; k++)
             {
                 uint64_t *pdEntry =
@@ -511,82 +572,49 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
                 if ((*pdEntry & PAGE_PRESENT) != PAGE_PRESENT)
                     continue;
 
-                /// \todo Deal with 2MB pages here.
-                if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
-                    continue;
+                uint64_t *clonePdEntry =
+                    TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(clonePdptEntry), k);
 
-                for (uint64_t l = 0; l < 512; l++)
+                // 2MB pages only come from mapHuge(), which maps physical
+                // memory the address space neither allocated nor frees, so
+                // the clone can map the very same memory.
+                if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
                 {
-                    uint64_t *ptEntry =
-                        TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pdEntry), l);
-                    if ((*ptEntry & PAGE_PRESENT) != PAGE_PRESENT)
-                        continue;
-
-                    uint64_t flags = PAGE_GET_FLAGS(ptEntry);
-                    physical_uintptr_t physicalAddress =
-                        PAGE_GET_PHYSICAL_ADDRESS(ptEntry);
-
-                    void *virtualAddress = reinterpret_cast<void *>(
-                        ((i & 0x100) ? (~0ULL << 48) :
-                                       0ULL) | /* Sign-extension. */
-                        (i << 39) |
-                        (j << 30) | (k << 21) | (l << 12));
-
-                    if (flags & PAGE_SHARED)
-                    {
-                        // The physical address is now referenced (shared) in
-                        // two address spaces, so make sure we hold another
-                        // reference on it. Otherwise, if one of the two
-                        // address spaces frees the page, the other may still
-                        // refer to the bad page (and eventually double-free).
-                        PhysicalMemoryManager::instance().pin(physicalAddress);
-
-                        // Handle shared mappings - don't copy the original
-                        // page.
-                        pClone->mapUnlocked(
-                            physicalAddress, virtualAddress,
-                            fromFlags(flags, true));
-                        continue;
-                    }
+                    *clonePdEntry = *pdEntry;
+                    continue;
+                }
 
-                    // Map the new page in to the new address space for
-                    // copy-on-write. This implies read-only (so we #PF for copy
-                    // on write).
-                    bool bWasCopyOnWrite = (flags & PAGE_COPY_ON_WRITE);
-                    if (copyOnWrite && (flags & PAGE_WRITE))
-                    {
-                        flags |= PAGE_COPY_ON_WRITE;
-                        flags &= ~PAGE_WRITE;
-                    }
-                    pClone->mapUnlocked(
-                        physicalAddress, virtualAddress,
-                        fromFlags(flags, true));
-
-                    // We need to modify the entry in *this* address space as
-                    // well to also have the read-only and copy-on-write flag
-                    // set, as otherwise writes in the parent process will cause
-                    // the child process to see those changes immediately. Note:
-                    // changes only needed if we're setting copy-on-write as
-                    // otherwise the flags are unchanged in the parent space.
-                    if (copyOnWrite)
-                    {
-                        PAGE_SET_FLAGS(ptEntry, flags);
-                        Processor::invalidate(virtualAddress);
-                    }
+                physical_uintptr_t table = PAGE_GET_PHYSICAL_ADDRESS(pdEntry);
 
-                    // Pin the page twice - once for each side of the clone.
-                    // But only pin for the parent if the parent page is not
-                    // already copy on write. If we pin the CoW page, it'll be
-                    // leaked when both parent and child terminate if the parent
-                    // clone()s again.
-                    if (!bWasCopyOnWrite)
-                        PhysicalMemoryManager::instance().pin(physicalAddress);
-                    PhysicalMemoryManager::instance().pin(physicalAddress);
+                if (copyOnWrite)
+                {
+                    // Share the whole page table instead of copying it. Both
+                    // directory entries become read-only, so the first write
+                    // through either one faults and takes a private copy of
+                    // the table, marking its pages copy-on-write then.
+                    *clonePdEntry = SharedTables::share(*pdEntry, memory);
+                    continue;
                 }
+
+                // Not copy-on-write: the clone gets its own table, which maps
+                // the same pages.
+                if (!pClone->conditionalTableEntryAllocation(
+                        clonePdEntry, Write))
+                    continue;
+                SharedTables::copyEntries(
+                    table, PAGE_GET_PHYSICAL_ADDRESS(clonePdEntry), false,
+                    memory);
             }
         }
     }
 
+    m_SharedTablesLock.release();
+
+    // Our directory entries may have just become read-only, and any processor
+    // running one of our threads could still be writing through them.
+    if (copyOnWrite)
+        Processor::flushTlbEverywhere();
+
     // Before returning the address space, bring across metadata.
     // Note though that if the parent of the clone (ie, this address space)
     // is the kernel address space, we mustn't copy metadata or else the
@@ -658,9 +686,23 @@ void X64VirtualAddressSpace::revertToKernelAddressSpace()
                 if (regionVirtualAddress > KERNEL_SPACE_START)
                     break;
 
-                /// \todo Deal with 2MB pages here.
+                // 2MB pages map memory set up by mapHuge(), which isn't ours
+                // to free.
                 if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
+                {
+                    *pdEntry = 0;
                     continue;
+                }
+
+                // A page table still shared with another address space stays
+                // with that address space.
+                if ((*pdEntry & PAGE_SHARED_TABLE) == PAGE_SHARED_TABLE)
+                {
+                    LockGuard<Spinlock> sharedGuard(m_SharedTablesLock);
+                    TableMemory memory;
+                    if (SharedTables::release(*pdEntry, memory))
+                        continue;
+                }
 
                 for (uint64_t l = 0; l < 512; l++)
                 {
@@ -715,6 +757,56 @@ void X64VirtualAddressSpace::revertToKernelAddressSpace()
     m_HeapEnd = m_Heap;
 }
 
+bool X64VirtualAddressSpace::unshareTable(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    return unshareTableUnlocked(virtualAddress);
+}
+
+bool X64VirtualAddressSpace::unshareTableUnlocked(void *virtualAddress)
+{
+    size_t pml4Index = PML4_INDEX(virtualAddress);
+    uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
+    if ((*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT)
+        return false;
+
+    size_t pageDirectoryPointerIndex =
+        PAGE_DIRECTORY_POINTER_INDEX(virtualAddress);
+    uint64_t *pageDirectoryPointerEntry = TABLE_ENTRY(
+        PAGE_GET_PHYSICAL_ADDRESS(pml4Entry), pageDirectoryPointerIndex);
+    if ((*pageDirectoryPointerEntry & PAGE_PRESENT) != PAGE_PRESENT)
+        return false;
+
+    size_t pageDirectoryIndex = PAGE_DIRECTORY_INDEX(virtualAddress);
+    uint64_t *pageDirectoryEntry = TABLE_ENTRY(
+        PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry),
+        pageDirectoryIndex);
+    if ((*pageDirectoryEntry & (PAGE_PRESENT | PAGE_2MB | PAGE_SHARED_TABLE)) !=
+        (PAGE_PRESENT | PAGE_SHARED_TABLE))
+        return false;
+
+    LockGuard<Spinlock> guard(m_SharedTablesLock);
+
+    TableMemory memory;
+    SharedTables::UnshareResult result =
+        SharedTables::unshare(*pageDirectoryEntry, memory);
+    if (result == SharedTables::OutOfMemory)
+    {
+        ERROR("OOM in X64VirtualAddressSpace::unshareTable!");
+        return false;
+    }
+
+    // Every processor running this address space may still have the read-only
+    // entry cached - and if we copied the table, the pages it left behind in
+    // the shared one just became copy-on-write for everyone else too. Keep
+    // the shared tables locked until that's flushed everywhere, so the table
+    // can't be taken over and rewritten under someone's stale translations.
+    Processor::flushTlbEverywhere();
+
+    return true;
+}
+
 bool X64VirtualAddressSpace::mapPageStructures(
     physical_uintptr_t physAddress, void *virtualAddress, size_t flags)
 {
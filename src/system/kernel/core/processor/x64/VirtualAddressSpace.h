@@ -126,6 +126,14 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     virtual VirtualAddressSpace *clone(bool copyOnWrite = true);
     virtual void revertToKernelAddressSpace();
 
+    /**
+     * Gives this address space a private copy of the page table covering
+     * \p virtualAddress, if clone() left it shared with another address
+     * space. Called by the page fault handler on a write fault.
+     * \return true if the table was shared.
+     */
+    bool unshareTable(void *virtualAddress);
+
     //
     // Needed for the PhysicalMemoryManager
     //
@@ -307,6 +315,9 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
      */
     void unmapUnlocked(void *virtualAddress, bool requireMapped = true);
 
+    /** unshareTable() without taking the lock. */
+    bool unshareTableUnlocked(void *virtualAddress);
+
     /** Allocates a stack with a given size. */
     Stack *doAllocateStack(size_t sSize);
 
@@ -323,6 +334,12 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     /** Lock to guard against multiprocessor reentrancy for stack reuse. */
     Spinlock m_StacksLock;
 
+    /**
+     * Serialises changes to page tables shared between address spaces, as
+     * these are not covered by any one address space's lock.
+     */
+    static Spinlock m_SharedTablesLock;
+
     /** The kernel virtual address space */
     static X64VirtualAddressSpace m_KernelSpace;
 };
@@ -172,21 +172,13 @@ void X86CommonPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
     MetadataTable::LookupResult result = m_PageMetadata.lookup(index);
     if (result.hasValue())
     {
-        struct page p = result.value();
-        if (p.active)
+        PageReference p = result.value();
+        bool bFree = p.release();
+        m_PageMetadata.update(index, p);
+        if (!bFree)
         {
-            if (--p.refcount)
-            {
-                // Still references.
-                m_PageMetadata.update(index, p);
-                return;
-            }
-            else
-            {
-                // No more references, stop tracking page.
-                p.active = false;
-                m_PageMetadata.update(index, p);
-            }
+            // Still references.
+            return;
         }
     }
 
@@ -220,19 +212,33 @@ void X86CommonPhysicalMemoryManager::pin(physical_uintptr_t page)
     MetadataTable::LookupResult result = m_PageMetadata.lookup(index);
     if (result.hasValue())
     {
-        struct page p = result.value();
-        ++p.refcount;
-        p.active = true;
+        PageReference p = result.value();
+        p.pin();
         m_PageMetadata.update(index, p);
     }
     else
     {
-        struct page p;
-        p.refcount = 1;
-        p.active = true;
+        PageReference p;
+        p.pin();
         m_PageMetadata.insert(index, p);
     }
 }
+bool X86CommonPhysicalMemoryManager::unpin(physical_uintptr_t page)
+{
+    RecursingLockGuard<Spinlock> guard(m_Lock);
+
+    PageHashable index(page);
+    MetadataTable::LookupResult result = m_PageMetadata.lookup(index);
+    if (!result.hasValue())
+    {
+        return false;
+    }
+
+    PageReference p = result.value();
+    bool bShared = p.unpin();
+    m_PageMetadata.update(index, p);
+    return bShared;
+}
 bool X86CommonPhysicalMemoryManager::allocateRegion(
     MemoryRegion &Region, size_t cPages, size_t pageConstraints, size_t Flags,
     physical_uintptr_t start)
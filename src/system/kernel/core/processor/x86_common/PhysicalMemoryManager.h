@@ -23,6 +23,7 @@
 #include "pedigree/kernel/Atomic.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/PageReference.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/HashTable.h"
@@ -64,6 +65,13 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
 
     virtual void pin(physical_uintptr_t page);
 
+    /**
+     * Drops a reference taken with pin() but, unlike freePage(), never frees
+     * the page: the caller keeps the last reference.
+     * \return true if other references to the page remain.
+     */
+    bool unpin(physical_uintptr_t page);
+
     /** Initialise the page stack
      *\param[in] Info reference to the multiboot information structure */
     void initialise(const BootstrapStruct_t &Info) INITIALISATION_ONLY;
@@ -254,21 +262,10 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
         physical_uintptr_t m_Page;
     };
 
-    /** Physical page metadata. */
-    struct page
-    {
-        page() : active(false), refcount(0)
-        {
-        }
-
-        bool active;
-        size_t refcount;
-    };
-
-    typedef HashTable<PageHashable, struct page> MetadataTable;
+    typedef HashTable<PageHashable, PageReference> MetadataTable;
 
     /** Page metadata table */
-    HashTable<PageHashable, struct page> m_PageMetadata;
+    MetadataTable m_PageMetadata;
 };
 
 /** @} */
@@ -254,6 +254,71 @@ size_t Processor::getCount()
 {
     return m_ProcessorInformation.count();
 }
+
+size_t Processor::m_TlbFlushGeneration = 0;
+size_t Processor::m_TlbFlushesPending = 0;
+#endif
+
+/** Reloads CR3, dropping every non-global translation. */
+static void reloadCr3()
+{
+    uintptr_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile("mov %0, %%cr3" ::"r"(cr3) : "memory");
+}
+
+void Processor::flushTlbEverywhere()
+{
+#if defined(MULTIPROCESSOR)
+    if (m_Initialised == 2 && getCount() > 1)
+    {
+        __atomic_add_fetch(&m_TlbFlushesPending, 1, __ATOMIC_SEQ_CST);
+        size_t generation =
+            __atomic_add_fetch(&m_TlbFlushGeneration, 1, __ATOMIC_SEQ_CST);
+
+        Pc::instance().getLocalApic().interProcessorInterruptAllExcludingThis(
+            IPI_TLB_FLUSH_VECTOR, LocalApic::deliveryModeFixed);
+
+        // Wait for everyone, this processor included. Another processor may
+        // be waiting on us in the same way, so keep flushing our own TLB for
+        // it while we wait.
+        for (size_t i = 0; i < m_ProcessorInformation.count(); i++)
+        {
+            while (__atomic_load_n(
+                       &m_ProcessorInformation[i]->m_TlbFlushGeneration,
+                       __ATOMIC_ACQUIRE) < generation)
+            {
+                serviceTlbFlush();
+                pause();
+            }
+        }
+
+        __atomic_sub_fetch(&m_TlbFlushesPending, 1, __ATOMIC_SEQ_CST);
+        return;
+    }
+#endif
+
+    reloadCr3();
+}
+
+#if defined(MULTIPROCESSOR)
+void Processor::serviceTlbFlush()
+{
+    if (!__atomic_load_n(&m_TlbFlushesPending, __ATOMIC_ACQUIRE))
+        return;
+
+    ProcessorInformation &info = information();
+
+    // Read the generation first: whatever asked for it changed the page
+    // tables before, so the reload below sees those changes.
+    size_t generation =
+        __atomic_load_n(&m_TlbFlushGeneration, __ATOMIC_ACQUIRE);
+    if (info.m_TlbFlushGeneration == generation)
+        return;
+
+    reloadCr3();
+    __atomic_store_n(&info.m_TlbFlushGeneration, generation, __ATOMIC_RELEASE);
+}
 #endif
 
 void Processor::breakpoint()
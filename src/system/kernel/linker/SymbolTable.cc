@@ -27,25 +27,106 @@
 #define RAII_LOCK
 #endif
 
+const size_t SymbolTable::MinimumIndexSize;
+
 SymbolTable::SymbolTable(Elf *pElf)
-    : m_LocalSymbols(), m_GlobalSymbols(), m_WeakSymbols(),
-      m_pOriginatingElf(pElf)
+    : m_pIndex(nullptr), m_nIndexEntries(0), m_RetiredIndex(),
+      m_DefinitionsByElf(), m_pOriginatingElf(pElf)
 {
 }
 
 SymbolTable::~SymbolTable()
 {
+    if (m_pIndex)
+    {
+        for (size_t i = 0; i < m_pIndex->size; ++i)
+        {
+            IndexEntry *pEntry = m_pIndex->entries[i];
+            if (!pEntry)
+            {
+                continue;
+            }
+
+            Definition *pDefinition = pEntry->pDefinitions;
+            while (pDefinition)
+            {
+                Definition *pNext = pDefinition->pNext;
+                delete pDefinition;
+                pDefinition = pNext;
+            }
+
+            delete pEntry;
+        }
+
+        delete[] m_pIndex->entries;
+        delete m_pIndex;
+    }
+
+    for (auto pSlots : m_RetiredIndex)
+    {
+        delete[] pSlots->entries;
+        delete pSlots;
+    }
+
+    for (auto it = m_DefinitionsByElf.begin(); it != m_DefinitionsByElf.end();
+         ++it)
+    {
+        delete it.value();
+    }
 }
 
 void SymbolTable::copyTable(Elf *pNewElf, const SymbolTable &newSymtab)
 {
     RAII_LOCK;
 
-    // Safe to do this, all members are SharedPointers and will be copy
-    // constructed by these operations.
-    m_LocalSymbols = newSymtab.m_LocalSymbols;
-    m_GlobalSymbols = newSymtab.m_GlobalSymbols;
-    m_WeakSymbols = newSymtab.m_WeakSymbols;
+    // Drop anything we already have, then take every live definition from
+    // the other table. Its index is safe to walk without its lock.
+    while (m_DefinitionsByElf.count())
+    {
+        doEraseByElf(m_DefinitionsByElf.begin().key());
+    }
+
+    IndexSlots *pSlots =
+        __atomic_load_n(&newSymtab.m_pIndex, __ATOMIC_ACQUIRE);
+    if (!pSlots)
+    {
+        return;
+    }
+
+    reserveIndex(newSymtab.m_nIndexEntries);
+    for (size_t i = 0; i < pSlots->size; ++i)
+    {
+        IndexEntry *pEntry =
+            __atomic_load_n(&pSlots->entries[i], __ATOMIC_ACQUIRE);
+        if (!pEntry)
+        {
+            continue;
+        }
+
+        // The chain is newest first; insert oldest first so that, as with the
+        // original, the first definition per ELF and binding is kept.
+        Vector<Definition> chain;
+        for (Definition *pDefinition =
+                 __atomic_load_n(&pEntry->pDefinitions, __ATOMIC_ACQUIRE);
+             pDefinition;
+             pDefinition =
+                 __atomic_load_n(&pDefinition->pNext, __ATOMIC_ACQUIRE))
+        {
+            Definition copy;
+            if (readDefinition(
+                    pDefinition, copy.pParent, copy.binding, copy.value))
+            {
+                chain.pushFront(copy);
+            }
+        }
+
+        for (auto &definition : chain)
+        {
+            doInsert(
+                pEntry->name, definition.binding, definition.pParent,
+                definition.value);
+        }
+    }
 }
 
 void SymbolTable::insert(
@@ -60,158 +141,342 @@ void SymbolTable::insertMultiple(
     SymbolTable *pOther, const String &name, Binding binding, Elf *pParent,
     uintptr_t value)
 {
-    RAII_LOCK;
-#ifdef THREADS
-    LockGuard<Mutex> guard2(pOther->m_Lock);
-#endif
-
-    SharedPointer<Symbol> ptr = doInsert(name, binding, pParent, value);
+    insert(name, binding, pParent, value);
     if (pOther)
-        pOther->insertShared(name, ptr);
+        pOther->insert(name, binding, pParent, value);
 }
 
 void SymbolTable::preallocate(
     size_t numGlobal, size_t numWeak, Elf *localElf, size_t numLocal)
 {
-    auto tree = getOrInsertTree(localElf);
-    tree->reserve(numLocal);
-
-    tree = getOrInsertTree(localElf, Global);
-    tree->reserve(numGlobal);
+    RAII_LOCK;
 
-    tree = getOrInsertTree(localElf, Weak);
-    tree->reserve(numWeak);
+    reserveIndex(numGlobal + numWeak + numLocal);
 }
 
 void SymbolTable::preallocateAdditional(
     size_t numGlobal, size_t numWeak, Elf *localElf, size_t numLocal)
 {
-    auto tree = getOrInsertTree(localElf, Global);
-    tree->reserve(tree->count() + numGlobal);
-
-    tree = getOrInsertTree(localElf, Weak);
-    tree->reserve(tree->count() + numWeak);
+    RAII_LOCK;
 
-    tree = getOrInsertTree(localElf);
-    tree->reserve(tree->count() + numLocal);
+    reserveIndex(m_nIndexEntries + numGlobal + numWeak + numLocal);
 }
 
-SharedPointer<SymbolTable::Symbol> SymbolTable::doInsert(
+void SymbolTable::doInsert(
     const String &name, Binding binding, Elf *pParent, uintptr_t value)
 {
-    Symbol *pSymbol = new Symbol(pParent, binding, value);
-    SharedPointer<Symbol> newSymbol(pSymbol);
+    IndexEntry *pEntry = getOrInsertEntry(name);
 
-    insertShared(name, newSymbol);
-    return newSymbol;
-}
+    // Only the first definition of a name per ELF and binding counts, and a
+    // dead definition from an erased ELF can be recycled.
+    Definition *pFree = nullptr;
+    for (Definition *pDefinition = pEntry->pDefinitions; pDefinition;
+         pDefinition = pDefinition->pNext)
+    {
+        if (!pDefinition->bLive)
+        {
+            if (!pFree)
+                pFree = pDefinition;
+        }
+        else if (
+            (pDefinition->pParent == pParent) &&
+            (pDefinition->binding == binding))
+        {
+            return;
+        }
+    }
 
-void SymbolTable::insertShared(
-    const String &name, SharedPointer<SymbolTable::Symbol> &symbol)
-{
-    auto tree = getOrInsertTree(symbol->getParent(), symbol->getBinding());
-    tree->insert(name, symbol);
+    if (pFree)
+    {
+        // Lookups may still be reading this from before it died.
+        uint32_t sequence = pFree->sequence;
+        __atomic_store_n(&pFree->sequence, sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&pFree->pParent, pParent, __ATOMIC_RELAXED);
+        __atomic_store_n(&pFree->binding, binding, __ATOMIC_RELAXED);
+        __atomic_store_n(&pFree->value, value, __ATOMIC_RELAXED);
+        __atomic_store_n(&pFree->sequence, sequence + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&pFree->bLive, true, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        pFree = new Definition;
+        pFree->pNext = pEntry->pDefinitions;
+        pFree->pEntry = pEntry;
+        pFree->pParent = pParent;
+        pFree->binding = binding;
+        pFree->value = value;
+        pFree->bLive = true;
+        pFree->sequence = 0;
+        __atomic_store_n(&pEntry->pDefinitions, pFree, __ATOMIC_RELEASE);
+    }
+
+    trackDefinition(pParent, pFree);
+
+    if (binding != Local)
+    {
+        updateWinners(pEntry);
+    }
 }
 
 void SymbolTable::eraseByElf(Elf *pParent)
 {
     RAII_LOCK;
 
-    // Will wipe out recursively by destroying the SharedPointers within.
-    m_LocalSymbols.remove(pParent);
-    m_GlobalSymbols.remove(pParent);
-    m_WeakSymbols.remove(pParent);
+    doEraseByElf(pParent);
 }
 
-uintptr_t SymbolTable::lookup(
-    const HashedStringView &name, Elf *pElf, Policy policy, Binding *pBinding)
+void SymbolTable::doEraseByElf(Elf *pParent)
 {
-    RAII_LOCK;
+    Vector<Definition *> *pDefinitions = m_DefinitionsByElf.lookup(pParent);
+    if (!pDefinitions)
+    {
+        return;
+    }
+    m_DefinitionsByElf.remove(pParent);
 
-    // safe empty SharedPointer we can use for lookupRef()'s failed result
-    static SharedPointer<symbolTree_t> failedLookup;
+    for (auto pDefinition : *pDefinitions)
+    {
+        __atomic_store_n(&pDefinition->bLive, false, __ATOMIC_RELEASE);
+        if (pDefinition->binding != Local)
+        {
+            updateWinners(pDefinition->pEntry);
+        }
+    }
 
-    uintptr_t lookupResult = 0;
+    delete pDefinitions;
+}
+
+uintptr_t SymbolTable::lookup(
+    const HashedStringView &name, Elf *pElf, Policy policy, Binding *pBinding)
+{
+    IndexEntry *pEntry = findEntry(name);
+    if (!pEntry)
+    {
+        return 0;
+    }
 
     // Local to the ELF file itself.
     if (policy != NotOriginatingElf)
     {
-        const SharedPointer<symbolTree_t> &symbolTree = m_LocalSymbols.lookupRef(pElf, failedLookup);
-        if (symbolTree)
+        for (Definition *pDefinition =
+                 __atomic_load_n(&pEntry->pDefinitions, __ATOMIC_ACQUIRE);
+             pDefinition;
+             pDefinition =
+                 __atomic_load_n(&pDefinition->pNext, __ATOMIC_ACQUIRE))
         {
-            symbolTree_t::LookupResult result = symbolTree->lookup(name);
-            if (result.hasValue())
+            Elf *pParent;
+            Binding binding;
+            uintptr_t value;
+            if (!readDefinition(pDefinition, pParent, binding, value))
+            {
+                continue;
+            }
+
+            if ((binding == Local) && (pParent == pElf) && value)
             {
-                lookupResult = result.value()->getValue();
+                if (pBinding)
+                    *pBinding = Local;
+                return value;
             }
         }
     }
 
-    // Global lookup across all ELFs that expose global symbols.
-    if (!lookupResult)
+    // Global definitions win over weak ones.
+    uintptr_t lookupResult =
+        __atomic_load_n(&pEntry->globalValue, __ATOMIC_ACQUIRE);
+    if (lookupResult)
     {
-        for (parentedSymbolTree_t::Iterator it = m_GlobalSymbols.begin();
-             it != m_GlobalSymbols.end();
-             ++it)
+        if (pBinding)
+            *pBinding = Global;
+        return lookupResult;
+    }
+
+    lookupResult = __atomic_load_n(&pEntry->weakValue, __ATOMIC_ACQUIRE);
+    if (lookupResult && pBinding)
+        *pBinding = Weak;
+
+    // NOTICE("SymbolTable::lookup(" << name << ", " << pElf->getName() << ")
+    // ==> " << Hex << lookupResult);
+
+    return lookupResult;
+}
+
+bool SymbolTable::readDefinition(
+    const Definition *pDefinition, Elf *&pParent, Binding &binding,
+    uintptr_t &value)
+{
+    while (true)
+    {
+        uint32_t sequence =
+            __atomic_load_n(&pDefinition->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
         {
-            symbolTree_t::LookupResult result = it.value(failedLookup)->lookup(name);
-            if (result.hasValue())
-            {
-                lookupResult = result.value()->getValue();
-                break;
-            }
+            continue;
+        }
+
+        bool bLive = __atomic_load_n(&pDefinition->bLive, __ATOMIC_ACQUIRE);
+        pParent = __atomic_load_n(&pDefinition->pParent, __ATOMIC_RELAXED);
+        binding = __atomic_load_n(&pDefinition->binding, __ATOMIC_RELAXED);
+        value = __atomic_load_n(&pDefinition->value, __ATOMIC_RELAXED);
+
+        // Only a copy taken entirely between two reuses is consistent.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&pDefinition->sequence, __ATOMIC_RELAXED) ==
+            sequence)
+        {
+            return bLive;
         }
     }
+}
 
-    // Finally we try and find a usable weak symbol.
-    if (!lookupResult)
+SymbolTable::IndexEntry *
+SymbolTable::findEntry(const HashedStringView &name) const
+{
+    IndexSlots *pSlots = __atomic_load_n(&m_pIndex, __ATOMIC_ACQUIRE);
+    if (!pSlots)
     {
-        for (parentedSymbolTree_t::Iterator it = m_WeakSymbols.begin();
-             it != m_WeakSymbols.end();
-             ++it)
+        return nullptr;
+    }
+
+    uint32_t hash = name.hash();
+    size_t mask = pSlots->size - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        IndexEntry *pEntry =
+            __atomic_load_n(&pSlots->entries[i], __ATOMIC_ACQUIRE);
+        if (!pEntry)
         {
-            symbolTree_t::LookupResult result = it.value(failedLookup)->lookup(name);
-            if (result.hasValue())
-            {
-                lookupResult = result.value()->getValue();
-                break;
-            }
+            return nullptr;
+        }
+
+        if ((pEntry->hash == hash) && (name == pEntry->name))
+        {
+            return pEntry;
         }
     }
+}
 
-    // NOTICE("SymbolTable::lookup(" << name << ", " << pElf->getName() << ")
-    // ==> " << Hex << lookupResult);
+SymbolTable::IndexEntry *SymbolTable::getOrInsertEntry(const String &name)
+{
+    HashedStringView view(name);
+    IndexEntry *pEntry = findEntry(view);
+    if (pEntry)
+    {
+        return pEntry;
+    }
 
-    return lookupResult;
+    reserveIndex(m_nIndexEntries + 1);
+
+    pEntry = new IndexEntry;
+    pEntry->name = name;
+    pEntry->hash = view.hash();
+    pEntry->pDefinitions = nullptr;
+    pEntry->globalValue = 0;
+    pEntry->weakValue = 0;
+
+    size_t mask = m_pIndex->size - 1;
+    size_t i = pEntry->hash & mask;
+    while (m_pIndex->entries[i])
+    {
+        i = (i + 1) & mask;
+    }
+    __atomic_store_n(&m_pIndex->entries[i], pEntry, __ATOMIC_RELEASE);
+    ++m_nIndexEntries;
+
+    return pEntry;
 }
 
-SymbolTable::symbolTree_t *SymbolTable::getOrInsertTree(Elf *p, Binding table)
+void SymbolTable::reserveIndex(size_t count)
 {
-    // safe empty SharedPointer we can use for lookupRef()'s failed result
-    static SharedPointer<symbolTree_t> v;
+    IndexSlots *pSlots = m_pIndex;
+    if (pSlots && (count * 2) <= pSlots->size)
+    {
+        return;
+    }
 
-    Tree<Elf *, SharedPointer<symbolTree_t>> *tree = nullptr;
-    switch (table)
+    size_t newSize = pSlots ? pSlots->size : MinimumIndexSize;
+    while ((count * 2) > newSize)
     {
-        case Local:
-            tree = &m_LocalSymbols;
-            break;
-        case Global:
-            tree = &m_GlobalSymbols;
-            break;
-        default:
-            tree = &m_WeakSymbols;
-            break;
+        newSize *= 2;
     }
 
-    auto symbolTree = tree->lookupRef(p, v);
-    if (symbolTree)
+    IndexSlots *pNew = new IndexSlots;
+    pNew->size = newSize;
+    pNew->entries = new IndexEntry *[newSize];
+    ByteSet(pNew->entries, 0, newSize * sizeof(IndexEntry *));
+
+    if (pSlots)
+    {
+        size_t mask = newSize - 1;
+        for (size_t n = 0; n < pSlots->size; ++n)
+        {
+            IndexEntry *pEntry = pSlots->entries[n];
+            if (!pEntry)
+            {
+                continue;
+            }
+
+            size_t i = pEntry->hash & mask;
+            while (pNew->entries[i])
+            {
+                i = (i + 1) & mask;
+            }
+            pNew->entries[i] = pEntry;
+        }
+    }
+
+    // Readers may still be probing the old array, so it is retired rather
+    // than freed. Arrays only ever double, so this is bounded by the live one.
+    __atomic_store_n(&m_pIndex, pNew, __ATOMIC_RELEASE);
+    if (pSlots)
+    {
+        m_RetiredIndex.pushBack(pSlots);
+    }
+}
+
+void SymbolTable::updateWinners(IndexEntry *pEntry)
+{
+    // The lowest ELF address wins, which is the order in which lookups used to
+    // walk the per-ELF tables.
+    Definition *pGlobal = nullptr;
+    Definition *pWeak = nullptr;
+    for (Definition *pDefinition = pEntry->pDefinitions; pDefinition;
+         pDefinition = pDefinition->pNext)
+    {
+        if (!pDefinition->bLive)
+        {
+            continue;
+        }
+
+        Definition **pWinner = nullptr;
+        if (pDefinition->binding == Global)
+            pWinner = &pGlobal;
+        else if (pDefinition->binding == Weak)
+            pWinner = &pWeak;
+        else
+            continue;
+
+        if (!*pWinner || (pDefinition->pParent < (*pWinner)->pParent))
+        {
+            *pWinner = pDefinition;
+        }
+    }
+
+    __atomic_store_n(
+        &pEntry->globalValue, pGlobal ? pGlobal->value : 0, __ATOMIC_RELEASE);
+    __atomic_store_n(
+        &pEntry->weakValue, pWeak ? pWeak->value : 0, __ATOMIC_RELEASE);
+}
+
+void SymbolTable::trackDefinition(Elf *pParent, Definition *pDefinition)
+{
+    Vector<Definition *> *pDefinitions = m_DefinitionsByElf.lookup(pParent);
+    if (!pDefinitions)
     {
-        return symbolTree.get();
+        pDefinitions = new Vector<Definition *>();
+        m_DefinitionsByElf.insert(pParent, pDefinitions);
     }
 
-    auto newTree = SharedPointer<symbolTree_t>::allocate();
-    auto result = newTree.get();
-    tree->insert(p, pedigree_std::move(newTree));
-    return result;
+    pDefinitions->pushBack(pDefinition);
 }
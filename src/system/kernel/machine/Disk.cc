@@ -62,6 +62,48 @@ void Disk::write(uint64_t location)
 {
 }
 
+bool Disk::readVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    bool bSuccess = true;
+    for (size_t i = 0; i < nSegments; ++i)
+    {
+        uintptr_t buffer = read(pSegments[i].location);
+        if (!buffer || buffer == static_cast<uintptr_t>(~0))
+        {
+            bSuccess = false;
+            buffer = 0;
+        }
+
+        pSegments[i].buffer = buffer;
+    }
+
+    if (pCompletion)
+    {
+        pCompletion(param, bSuccess);
+    }
+
+    return bSuccess;
+}
+
+bool Disk::writeVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    for (size_t i = 0; i < nSegments; ++i)
+    {
+        write(pSegments[i].location);
+    }
+
+    if (pCompletion)
+    {
+        pCompletion(param, true);
+    }
+
+    return true;
+}
+
 void Disk::align(uint64_t location)
 {
 }
@@ -92,3 +134,7 @@ bool Disk::cacheIsCritical()
 void Disk::flush(uint64_t location)
 {
 }
+
+void Disk::sync()
+{
+}
@@ -0,0 +1,720 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/machine/IoScheduler.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/utilities/StaticString.h"
+#include "pedigree/kernel/utilities/String.h"
+
+#ifdef THREADS
+#include "pedigree/kernel/process/Scheduler.h"
+#endif
+
+/// Size of one Disk cache page, the unit of read() and write().
+#define IOSCHED_PAGE_SIZE 4096
+
+#ifdef THREADS
+/// Schedulers with writes waiting, checked by the expiry flusher.
+static List<IoScheduler *> g_Schedulers;
+static Mutex g_SchedulersLock(false);
+static bool g_bFlusherArmed = false;
+#endif
+
+IoScheduler::IoScheduler(Disk *pTarget, Policy policy)
+    : Disk(), m_pTarget(pTarget), m_Policy(policy), m_ByStart(), m_ByEnd(),
+      m_Fifo(), m_nQueued(0), m_NextSequence(0), m_Lock(false), m_Head(0),
+      m_ReadExpiry(500 * Time::Multiplier::Millisecond),
+      m_WriteExpiry(5 * Time::Multiplier::Second),
+      m_BatchSize(IOSCHED_DEFAULT_BATCH), m_MaxMerge(IOSCHED_DEFAULT_MAX_MERGE),
+      m_nQueuedWrites(0), m_Stats()
+{
+    m_SpecificType = "I/O scheduler";
+    // Not part of the device tree, but report the same place in it.
+    setParent(pTarget->getParent());
+    ByteSet(&m_Stats, 0, sizeof(m_Stats));
+
+#ifdef THREADS
+    LockGuard<Mutex> guard(g_SchedulersLock);
+    g_Schedulers.pushBack(this);
+#endif
+}
+
+IoScheduler::~IoScheduler()
+{
+#ifdef THREADS
+    g_SchedulersLock.acquire();
+    for (List<IoScheduler *>::Iterator it = g_Schedulers.begin();
+         it != g_Schedulers.end(); ++it)
+    {
+        if (*it == this)
+        {
+            g_Schedulers.erase(it);
+            break;
+        }
+    }
+    g_SchedulersLock.release();
+#endif
+
+    drain();
+}
+
+void IoScheduler::setExpiry(
+    Time::Timestamp readExpiry, Time::Timestamp writeExpiry)
+{
+    m_ReadExpiry = readExpiry;
+    m_WriteExpiry = writeExpiry;
+}
+
+IoScheduler::Statistics IoScheduler::getStatistics()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    return m_Stats;
+}
+
+void IoScheduler::getName(String &str)
+{
+    m_pTarget->getName(str);
+}
+
+void IoScheduler::dump(String &str)
+{
+    String target;
+    m_pTarget->dump(target);
+
+    Statistics stats = getStatistics();
+    LargeStaticString s;
+    s += m_Policy == Deadline ? " [deadline, depth " : " [noop, depth ";
+    s += stats.queueDepth;
+    s += " (max ";
+    s += stats.maxQueueDepth;
+    s += "), ";
+    s += stats.submitted;
+    s += " requests, ";
+    s += stats.dispatched;
+    s += " commands, ";
+    s += stats.merged;
+    s += " merged, ";
+    s += stats.expired;
+    s += " expired]";
+
+    str = target;
+    str += static_cast<const char *>(s);
+}
+
+uintptr_t IoScheduler::read(uint64_t location)
+{
+    IoSegment segment;
+    segment.location = location & ~(IOSCHED_PAGE_SIZE - 1);
+    segment.length = IOSCHED_PAGE_SIZE;
+    segment.buffer = 0;
+
+    if (!readVectored(&segment, 1))
+    {
+        return ~0;
+    }
+
+    return segment.buffer + (location & (IOSCHED_PAGE_SIZE - 1));
+}
+
+void IoScheduler::write(uint64_t location)
+{
+    IoSegment segment;
+    segment.location = location & ~(IOSCHED_PAGE_SIZE - 1);
+    segment.length = IOSCHED_PAGE_SIZE;
+    segment.buffer = 0;
+
+    submit(&segment, 1, true, 0);
+}
+
+bool IoScheduler::readVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    // Reads are synchronous, so the batch can live on the stack; its
+    // completion is run here rather than from the dispatcher.
+    Batch batch;
+    batch.remaining = nSegments;
+    batch.bSuccess = true;
+    batch.pCompletion = 0;
+    batch.param = 0;
+
+    if (nSegments && submit(pSegments, nSegments, false, &batch))
+    {
+        while (true)
+        {
+            m_Lock.acquire();
+            bool bDone = batch.remaining == 0;
+            m_Lock.release();
+            if (bDone)
+            {
+                break;
+            }
+
+            if (!dispatch())
+            {
+                // Our requests are in a command issued by someone else.
+#ifdef THREADS
+                Scheduler::instance().yield();
+#else
+                break;
+#endif
+            }
+        }
+    }
+
+    if (pCompletion)
+    {
+        pCompletion(param, batch.bSuccess);
+    }
+
+    return batch.bSuccess;
+}
+
+bool IoScheduler::writeVectored(
+    IoSegment *pSegments, size_t nSegments, IoCompletion pCompletion,
+    void *param)
+{
+    Batch *pBatch = 0;
+    if (pCompletion)
+    {
+        pBatch = new Batch;
+        pBatch->remaining = nSegments;
+        pBatch->bSuccess = true;
+        pBatch->pCompletion = pCompletion;
+        pBatch->param = param;
+    }
+
+    if (!nSegments || !submit(pSegments, nSegments, true, pBatch))
+    {
+        delete pBatch;
+        if (pCompletion)
+        {
+            pCompletion(param, true);
+        }
+    }
+
+    return true;
+}
+
+void IoScheduler::align(uint64_t location)
+{
+    m_pTarget->align(location);
+}
+
+size_t IoScheduler::getSize() const
+{
+    return m_pTarget->getSize();
+}
+
+size_t IoScheduler::getBlockSize() const
+{
+    return m_pTarget->getBlockSize();
+}
+
+void IoScheduler::pin(uint64_t location)
+{
+    m_pTarget->pin(location);
+}
+
+void IoScheduler::unpin(uint64_t location)
+{
+    m_pTarget->unpin(location);
+}
+
+bool IoScheduler::cacheIsCritical()
+{
+    return m_pTarget->cacheIsCritical();
+}
+
+void IoScheduler::flush(uint64_t location)
+{
+    drain();
+    m_pTarget->flush(location);
+}
+
+void IoScheduler::sync()
+{
+    drain();
+    m_pTarget->sync();
+}
+
+Time::Timestamp IoScheduler::now()
+{
+    return Time::getTimeNanoseconds();
+}
+
+bool IoScheduler::submit(
+    IoSegment *pSegments, size_t nSegments, bool bWrite, Batch *pBatch)
+{
+    Time::Timestamp deadline = now() + (bWrite ? m_WriteExpiry : m_ReadExpiry);
+    bool bDispatch = false;
+    bool bQueued = false;
+
+    m_Lock.acquire();
+    for (size_t i = 0; i < nSegments; ++i)
+    {
+        // A plain page write already queued covers a repeat of itself: the
+        // data is taken from the target's cache when it is dispatched.
+        if (bWrite && !pBatch)
+        {
+            bool bDuplicate = false;
+            for (Request *pQueued = m_ByStart.lookup(pSegments[i].location);
+                 pQueued; pQueued = pQueued->pNextAtStart)
+            {
+                if (pQueued->bWrite && !pQueued->pBatch &&
+                    pQueued->length == pSegments[i].length)
+                {
+                    bDuplicate = true;
+                    break;
+                }
+            }
+
+            if (bDuplicate)
+            {
+                ++m_Stats.submitted;
+                ++m_Stats.merged;
+                continue;
+            }
+        }
+
+        Request *pRequest = new Request;
+        pRequest->location = pSegments[i].location;
+        pRequest->length = pSegments[i].length;
+        pRequest->bWrite = bWrite;
+        pRequest->deadline = deadline;
+        pRequest->pSegment = bWrite ? 0 : &pSegments[i];
+        pRequest->pBatch = pBatch;
+        enqueue(pRequest);
+        bQueued = true;
+
+        ++m_Stats.submitted;
+        if (bWrite)
+        {
+            // The data stays in the target's cache until we dispatch, so
+            // keep it there. complete() unpins.
+            m_pTarget->pin(pRequest->location);
+            ++m_nQueuedWrites;
+        }
+    }
+
+    m_Stats.queueDepth = m_nQueued;
+    if (m_Stats.queueDepth > m_Stats.maxQueueDepth)
+    {
+        m_Stats.maxQueueDepth = m_Stats.queueDepth;
+    }
+
+    if (bWrite && m_nQueued)
+    {
+        bDispatch = m_nQueuedWrites >= m_BatchSize || mostOverdue(now());
+    }
+    m_Lock.release();
+
+    if (bDispatch)
+    {
+        drain();
+    }
+#ifdef THREADS
+    else if (bWrite && bQueued)
+    {
+        LockGuard<Mutex> guard(g_SchedulersLock);
+        if (!g_bFlusherArmed)
+        {
+            g_bFlusherArmed = true;
+            Time::runAfter(&flushExpired, 0, m_WriteExpiry);
+        }
+    }
+#endif
+
+    // If a batch had every write deduplicated it is already complete.
+    return bQueued;
+}
+
+void IoScheduler::enqueue(Request *pRequest)
+{
+    pRequest->sequence = m_NextSequence++;
+    pRequest->pNextAtStart = 0;
+    pRequest->pNextAtEnd = 0;
+
+    // Requests starting at the same place keep their submission order, so
+    // the elevator serves them in that order too.
+    Request *pFirst = m_ByStart.lookup(pRequest->location);
+    if (pFirst)
+    {
+        Request *pLast = pFirst;
+        while (pLast->pNextAtStart)
+        {
+            pLast = pLast->pNextAtStart;
+        }
+        pLast->pNextAtStart = pRequest;
+    }
+    else
+    {
+        m_ByStart.insert(pRequest->location, pRequest);
+    }
+
+    uint64_t end = pRequest->location + pRequest->length;
+    pRequest->pNextAtEnd = m_ByEnd.lookup(end);
+    m_ByEnd.insert(end, pRequest);
+
+    Fifo &fifo = m_Fifo[pRequest->bWrite];
+    pRequest->pOlder = fifo.pNewest;
+    pRequest->pNewer = 0;
+    if (fifo.pNewest)
+    {
+        fifo.pNewest->pNewer = pRequest;
+    }
+    else
+    {
+        fifo.pOldest = pRequest;
+    }
+    fifo.pNewest = pRequest;
+
+    ++m_nQueued;
+}
+
+void IoScheduler::dequeue(Request *pRequest)
+{
+    Request *pFirst = m_ByStart.lookup(pRequest->location);
+    if (pFirst == pRequest)
+    {
+        if (pRequest->pNextAtStart)
+        {
+            m_ByStart.insert(pRequest->location, pRequest->pNextAtStart);
+        }
+        else
+        {
+            m_ByStart.remove(pRequest->location);
+        }
+    }
+    else
+    {
+        while (pFirst->pNextAtStart != pRequest)
+        {
+            pFirst = pFirst->pNextAtStart;
+        }
+        pFirst->pNextAtStart = pRequest->pNextAtStart;
+    }
+
+    uint64_t end = pRequest->location + pRequest->length;
+    pFirst = m_ByEnd.lookup(end);
+    if (pFirst == pRequest)
+    {
+        if (pRequest->pNextAtEnd)
+        {
+            m_ByEnd.insert(end, pRequest->pNextAtEnd);
+        }
+        else
+        {
+            m_ByEnd.remove(end);
+        }
+    }
+    else
+    {
+        while (pFirst->pNextAtEnd != pRequest)
+        {
+            pFirst = pFirst->pNextAtEnd;
+        }
+        pFirst->pNextAtEnd = pRequest->pNextAtEnd;
+    }
+
+    Fifo &fifo = m_Fifo[pRequest->bWrite];
+    if (pRequest->pOlder)
+    {
+        pRequest->pOlder->pNewer = pRequest->pNewer;
+    }
+    else
+    {
+        fifo.pOldest = pRequest->pNewer;
+    }
+    if (pRequest->pNewer)
+    {
+        pRequest->pNewer->pOlder = pRequest->pOlder;
+    }
+    else
+    {
+        fifo.pNewest = pRequest->pOlder;
+    }
+
+    --m_nQueued;
+}
+
+IoScheduler::Request *IoScheduler::mostOverdue(Time::Timestamp currentTime)
+{
+    Request *pRead = m_Fifo[0].pOldest;
+    Request *pWrite = m_Fifo[1].pOldest;
+
+    Request *pRequest = pRead;
+    if (!pRead || (pWrite && pWrite->deadline < pRead->deadline))
+    {
+        pRequest = pWrite;
+    }
+
+    if (pRequest && pRequest->deadline <= currentTime)
+    {
+        return pRequest;
+    }
+
+    return 0;
+}
+
+IoScheduler::Request *IoScheduler::pickNext()
+{
+    if (!m_nQueued)
+    {
+        return 0;
+    }
+
+    Request *pRequest = 0;
+    if (m_Policy == Deadline)
+    {
+        // Serve the most overdue request, if any has expired; otherwise
+        // sweep upwards from the head, wrapping to the lowest location.
+        pRequest = mostOverdue(now());
+        if (pRequest)
+        {
+            ++m_Stats.expired;
+        }
+        else
+        {
+            pRequest = m_ByStart.lookupAtOrAfter(m_Head);
+            if (!pRequest)
+            {
+                pRequest = m_ByStart.lookupAtOrAfter(0);
+            }
+        }
+    }
+    else
+    {
+        // Submission order, whichever direction that falls in.
+        Request *pRead = m_Fifo[0].pOldest;
+        Request *pWrite = m_Fifo[1].pOldest;
+        pRequest = pRead;
+        if (!pRead || (pWrite && pWrite->sequence < pRead->sequence))
+        {
+            pRequest = pWrite;
+        }
+    }
+
+    dequeue(pRequest);
+    return pRequest;
+}
+
+void IoScheduler::collectMerges(List<Request *> &run)
+{
+    bool bWrite = (*run.begin())->bWrite;
+    uint64_t start = (*run.begin())->location;
+    uint64_t end = start + (*run.begin())->length;
+
+    // Each step looks up the requests that start where the run ends, then
+    // those that end where it starts.
+    while (true)
+    {
+        Request *pRequest = m_ByStart.lookup(end);
+        while (pRequest && (pRequest->bWrite != bWrite ||
+                            (end - start) + pRequest->length > m_MaxMerge))
+        {
+            pRequest = pRequest->pNextAtStart;
+        }
+
+        if (pRequest)
+        {
+            dequeue(pRequest);
+            run.pushBack(pRequest);
+            end += pRequest->length;
+            continue;
+        }
+
+        pRequest = m_ByEnd.lookup(start);
+        while (pRequest && (pRequest->bWrite != bWrite ||
+                            (end - start) + pRequest->length > m_MaxMerge))
+        {
+            pRequest = pRequest->pNextAtEnd;
+        }
+
+        if (pRequest)
+        {
+            dequeue(pRequest);
+            run.pushFront(pRequest);
+            start = pRequest->location;
+            continue;
+        }
+
+        break;
+    }
+}
+
+bool IoScheduler::dispatch()
+{
+    m_Lock.acquire();
+    Request *pFirst = pickNext();
+    if (!pFirst)
+    {
+        m_Lock.release();
+        return false;
+    }
+
+    List<Request *> run;
+    run.pushBack(pFirst);
+    collectMerges(run);
+
+    size_t nRequests = run.count();
+    ++m_Stats.dispatched;
+    m_Stats.merged += nRequests - 1;
+    m_Stats.queueDepth = m_nQueued;
+    if (pFirst->bWrite)
+    {
+        m_nQueuedWrites -= nRequests;
+    }
+    m_Head = (*run.rbegin())->location + (*run.rbegin())->length;
+    m_Lock.release();
+
+    Command *pCommand = new Command;
+    pCommand->pScheduler = this;
+    pCommand->pSegments = new IoSegment[nRequests];
+    pCommand->pRequests = new Request *[nRequests];
+    pCommand->nRequests = nRequests;
+
+    size_t i = 0;
+    for (List<Request *>::Iterator it = run.begin(); it != run.end();
+         ++it, ++i)
+    {
+        pCommand->pSegments[i].location = (*it)->location;
+        pCommand->pSegments[i].length = (*it)->length;
+        pCommand->pSegments[i].buffer = 0;
+        pCommand->pRequests[i] = *it;
+    }
+
+    // The command is freed by commandComplete, which may already have run
+    // by the time these return.
+    if (pFirst->bWrite)
+    {
+        m_pTarget->writeVectored(
+            pCommand->pSegments, nRequests, &commandComplete, pCommand);
+    }
+    else
+    {
+        m_pTarget->readVectored(
+            pCommand->pSegments, nRequests, &commandComplete, pCommand);
+    }
+
+    return true;
+}
+
+void IoScheduler::drain()
+{
+    while (dispatch())
+        ;
+}
+
+void IoScheduler::commandComplete(void *param, bool bSuccess)
+{
+    Command *pCommand = reinterpret_cast<Command *>(param);
+    for (size_t i = 0; i < pCommand->nRequests; ++i)
+    {
+        Request *pRequest = pCommand->pRequests[i];
+        bool bRequestSuccess = bSuccess;
+        if (pRequest->pSegment)
+        {
+            pRequest->pSegment->buffer = pCommand->pSegments[i].buffer;
+            if (!pCommand->pSegments[i].buffer)
+            {
+                bRequestSuccess = false;
+            }
+        }
+
+        pCommand->pScheduler->complete(pRequest, bRequestSuccess);
+    }
+
+    delete[] pCommand->pSegments;
+    delete[] pCommand->pRequests;
+    delete pCommand;
+}
+
+void IoScheduler::complete(Request *pRequest, bool bSuccess)
+{
+    if (pRequest->bWrite)
+    {
+        m_pTarget->unpin(pRequest->location);
+    }
+
+    Batch *pBatch = pRequest->pBatch;
+    delete pRequest;
+    if (!pBatch)
+    {
+        return;
+    }
+
+    // Read batches live on their waiter's stack and must not be touched
+    // once the count reaches zero, so look at everything under the lock.
+    m_Lock.acquire();
+    if (!bSuccess)
+    {
+        pBatch->bSuccess = false;
+    }
+    IoCompletion pCompletion = pBatch->pCompletion;
+    bool bFinished = --pBatch->remaining == 0;
+    m_Lock.release();
+
+    if (bFinished && pCompletion)
+    {
+        pBatch->pCompletion(pBatch->param, pBatch->bSuccess);
+        delete pBatch;
+    }
+}
+
+#ifdef THREADS
+int IoScheduler::flushExpired(void *)
+{
+    LockGuard<Mutex> guard(g_SchedulersLock);
+
+    bool bPending = false;
+    for (List<IoScheduler *>::Iterator it = g_Schedulers.begin();
+         it != g_Schedulers.end(); ++it)
+    {
+        IoScheduler *pScheduler = *it;
+
+        pScheduler->m_Lock.acquire();
+        bool bExpired = pScheduler->mostOverdue(pScheduler->now()) != 0;
+        pScheduler->m_Lock.release();
+
+        if (bExpired)
+        {
+            pScheduler->drain();
+        }
+
+        pScheduler->m_Lock.acquire();
+        if (pScheduler->m_nQueuedWrites)
+        {
+            bPending = true;
+        }
+        pScheduler->m_Lock.release();
+    }
+
+    if (bPending)
+    {
+        Time::runAfter(&flushExpired, 0, 500 * Time::Multiplier::Millisecond);
+    }
+    else
+    {
+        g_bFlusherArmed = false;
+    }
+
+    return 0;
+}
+#endif
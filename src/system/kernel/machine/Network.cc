@@ -19,6 +19,7 @@
 
 #include "pedigree/kernel/machine/Network.h"
 #include "pedigree/kernel/utilities/String.h"
+#include "pedigree/kernel/utilities/utility.h"
 
 StationInfo::StationInfo()
     : ipv4(), ipv6(0), nIpv6Addresses(0), subnetMask(), broadcast(0xFFFFFFFF),
@@ -68,6 +69,35 @@ void Network::dump(String &str)
     str = "Generic Network Device";
 }
 
+bool Network::sendFragments(
+    const Fragment *fragments, size_t count, size_t nBytes,
+    SendCompletion completion, void *param)
+{
+    bool result = false;
+    uint8_t *packet = new uint8_t[nBytes];
+    if (packet)
+    {
+        size_t offset = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            MemoryCopy(
+                packet + offset, reinterpret_cast<void *>(fragments[i].buffer),
+                fragments[i].length);
+            offset += fragments[i].length;
+        }
+
+        result = send(nBytes, reinterpret_cast<uintptr_t>(packet));
+        delete[] packet;
+    }
+
+    if (completion)
+    {
+        completion(param, result);
+    }
+
+    return result;
+}
+
 bool Network::setStationInfo(const StationInfo &info)
 {
     return false;  // failed by default
@@ -18,6 +18,7 @@
  */
 
 #include "Timer.h"
+#include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/Machine.h"
 #include "pedigree/kernel/process/Event.h"
@@ -41,55 +42,55 @@ uint8_t daysPerMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
 void HostedTimer::addAlarm(Event *pEvent, size_t alarmSecs, size_t alarmUsecs)
 {
-    Alarm *pAlarm = new Alarm(
-        pEvent, alarmSecs * 1000000 + alarmUsecs + getTickCount(),
-        Processor::information().getCurrentThread());
-    m_Alarms.pushBack(pAlarm);
+    uint64_t target = getTickCountNano();
+    target += alarmSecs * 1000000000ULL;
+    target += alarmUsecs * 1000ULL;
+    Alarm *pAlarm =
+        new Alarm(pEvent, Processor::information().getCurrentThread());
+
+    LockGuard<Spinlock> guard(m_AlarmLock);
+    m_Alarms.insert(pAlarm, target, pEvent);
 }
 
 void HostedTimer::removeAlarm(Event *pEvent)
 {
-    for (List<Alarm *>::Iterator it = m_Alarms.begin(); it != m_Alarms.end();
-         it++)
+    LockGuard<Spinlock> guard(m_AlarmLock);
+
+    TimerWheel::Entry *pEntry;
+    while ((pEntry = m_Alarms.find(pEvent)) != 0)
     {
-        if ((*it)->m_pEvent == pEvent)
-        {
-            m_Alarms.erase(it);
-            return;
-        }
+        m_Alarms.remove(pEntry);
+        delete static_cast<Alarm *>(pEntry);
     }
 }
 
 size_t HostedTimer::removeAlarm(class Event *pEvent, bool bRetZero)
 {
-    size_t currTime = getTickCount();
+    LockGuard<Spinlock> guard(m_AlarmLock);
 
-    for (List<Alarm *>::Iterator it = m_Alarms.begin(); it != m_Alarms.end();
-         it++)
+    TimerWheel::Entry *pEntry = m_Alarms.find(pEvent);
+    if (!pEntry)
     {
-        if ((*it)->m_pEvent == pEvent)
-        {
-            size_t ret = 0;
-            if (!bRetZero)
-            {
-                size_t alarmEndTime = (*it)->m_Time;
+        return 0;
+    }
 
-                // Is it later than the end of the alarm?
-                if (alarmEndTime < currTime)
-                    ret = 0;
-                else
-                {
-                    size_t diff = alarmEndTime - currTime;
-                    ret = (diff / 1000) + 1;
-                }
-            }
+    size_t ret = 0;
+    if (!bRetZero)
+    {
+        uint64_t alarmEndTime = pEntry->getExpiry();
+        uint64_t currTime = getTickCountNano();
 
-            m_Alarms.erase(it);
-            return ret;
+        // Is it later than the end of the alarm?
+        if (alarmEndTime >= currTime)
+        {
+            uint64_t diff = alarmEndTime - currTime;
+            ret = (diff / 1000000000ULL) + 1;
         }
     }
 
-    return 0;
+    m_Alarms.remove(pEntry);
+    delete static_cast<Alarm *>(pEntry);
+    return ret;
 }
 
 bool HostedTimer::registerHandler(TimerHandler *handler)
@@ -253,7 +254,7 @@ void HostedTimer::uninitialise()
 HostedTimer::HostedTimer()
     : m_Year(0), m_Month(0), m_DayOfMonth(0), m_DayOfWeek(0), m_Hour(0),
       m_Minute(0), m_Second(0), m_Nanosecond(0), m_IrqId(0), m_Handlers(),
-      m_Alarms()
+      m_Alarms(), m_AlarmLock()
 {
 }
 
@@ -273,23 +274,18 @@ bool HostedTimer::irq(irq_id_t number, InterruptState &state)
     m_Nanosecond += delta;
 
     // Check for alarms.
-    while (true)
     {
-        bool bDispatched = false;
-        for (List<Alarm *>::Iterator it = m_Alarms.begin();
-             it != m_Alarms.end(); it++)
+        LockGuard<Spinlock> guard(m_AlarmLock);
+
+        TimerWheel::Entry *pEntry = m_Alarms.advance(getTickCountNano());
+        while (pEntry)
         {
-            Alarm *pA = *it;
-            if (pA->m_Time <= getTickCount())
-            {
-                pA->m_pThread->sendEvent(pA->m_pEvent);
-                m_Alarms.erase(it);
-                bDispatched = true;
-                break;
-            }
+            Alarm *pA = static_cast<Alarm *>(pEntry);
+            pEntry = pEntry->next();
+
+            pA->m_pThread->sendEvent(pA->m_pEvent);
+            delete pA;
         }
-        if (!bDispatched)
-            break;
     }
 
     if (UNLIKELY(m_Nanosecond >= 1000000ULL))
@@ -20,9 +20,11 @@
 #ifndef KERNEL_MACHINE_HOSTED_COMMON_TIMER_H
 #define KERNEL_MACHINE_HOSTED_COMMON_TIMER_H
 
+#include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/machine/IrqManager.h"
 #include "pedigree/kernel/machine/SchedulerTimer.h"
 #include "pedigree/kernel/machine/Timer.h"
+#include "pedigree/kernel/utilities/TimerWheel.h"
 
 namespace __pedigree_hosted
 {
@@ -121,16 +123,15 @@ class HostedTimer : public Timer, private IrqHandler
     /** All timer handlers installed */
     TimerHandler *m_Handlers[MAX_TIMER_HANDLERS];
 
-    /** Alarm structure. */
-    class Alarm
+    /** Alarm structure, keyed in the wheel by the Event. */
+    class Alarm : public TimerWheel::Entry
     {
       public:
-        Alarm(class Event *pEvent, size_t time, class Thread *pThread)
-            : m_pEvent(pEvent), m_Time(time), m_pThread(pThread)
+        Alarm(class Event *pEvent, class Thread *pThread)
+            : m_pEvent(pEvent), m_pThread(pThread)
         {
         }
         class Event *m_pEvent;
-        size_t m_Time;
         class Thread *m_pThread;
 
       private:
@@ -138,8 +139,10 @@ class HostedTimer : public Timer, private IrqHandler
         Alarm &operator=(const Alarm &);
     };
 
-    /** List of alarms. */
-    List<Alarm *> m_Alarms;
+    /** Pending alarms, by expiry in nanoseconds. */
+    TimerWheel m_Alarms;
+    /** Protects m_Alarms. */
+    Spinlock m_AlarmLock;
 };
 
 /** @} */
@@ -102,6 +102,13 @@ bool LocalApic::initialise(uint64_t physicalAddress)
             IPI_HALT_VECTOR, this))
         return false;
 
+#if defined(MULTIPROCESSOR)
+    // Register the IPI TLB flush vector.
+    if (!InterruptManager::instance().registerInterruptHandler(
+            IPI_TLB_FLUSH_VECTOR, this))
+        return false;
+#endif
+
     return initialiseProcessor();
 }
 
@@ -228,6 +235,15 @@ void LocalApic::interrupt(size_t nInterruptNumber, InterruptState &state)
         }
     }
 
+#if defined(MULTIPROCESSOR)
+    // Another core changed page tables we may have cached.
+    if (nInterruptNumber == IPI_TLB_FLUSH_VECTOR)
+    {
+        Processor::serviceTlbFlush();
+        ack();
+    }
+#endif
+
     // The halt IPI is used in the debugger to stop all other cores.
     if (nInterruptNumber == IPI_HALT_VECTOR)
     {
@@ -35,6 +35,7 @@
 
 class TimerHandler;
 
+#define IPI_TLB_FLUSH_VECTOR 0xFA
 #define IPI_HALT_VECTOR 0xFB
 #define ERROR_VECTOR 0xFC
 #define SPURIOUS_VECTOR 0xFD
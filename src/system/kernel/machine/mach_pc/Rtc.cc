@@ -71,72 +71,72 @@ Rtc Rtc::m_Instance;
 
 void Rtc::addAlarm(Event *pEvent, size_t alarmSecs, size_t alarmUsecs)
 {
-    LockGuard<Spinlock> guard(m_Lock);
-
     // Figure out when to trigger the alarm.
     uint64_t target = m_TickCount;
     uint64_t delta = alarmSecs * Time::Multiplier::Second;
     delta += alarmUsecs * Time::Multiplier::Microsecond;
     target += delta;
     Alarm *pAlarm =
-        new Alarm(pEvent, target, Processor::information().getCurrentThread());
-    m_Alarms.pushBack(pAlarm);
+        new Alarm(pEvent, Processor::information().getCurrentThread());
+
+    AlarmWheel &wheel = m_AlarmWheels[Processor::id() % RTC_ALARM_WHEELS];
+    LockGuard<Spinlock> guard(wheel.lock);
+    wheel.wheel.insert(pAlarm, target, pEvent);
 }
 
-void Rtc::removeAlarm(Event *pEvent)
+Rtc::Alarm *Rtc::takeAlarm(Event *pEvent)
 {
-    LockGuard<Spinlock> guard(m_Lock);
-
-    for (List<Alarm *>::Iterator it = m_Alarms.begin(); it != m_Alarms.end();)
+    // Usually removed from the CPU that added it, so look there first.
+    size_t first = Processor::id() % RTC_ALARM_WHEELS;
+    for (size_t i = 0; i < RTC_ALARM_WHEELS; ++i)
     {
-        if ((*it)->m_pEvent == pEvent)
-        {
-            Alarm *pAlarm = *it;
-            it = m_Alarms.erase(it);
-            delete pAlarm;
-        }
-        else
+        AlarmWheel &wheel = m_AlarmWheels[(first + i) % RTC_ALARM_WHEELS];
+        LockGuard<Spinlock> guard(wheel.lock);
+
+        TimerWheel::Entry *pEntry = wheel.wheel.find(pEvent);
+        if (pEntry)
         {
-            ++it;
+            wheel.wheel.remove(pEntry);
+            return static_cast<Alarm *>(pEntry);
         }
     }
+
+    return 0;
 }
 
-size_t Rtc::removeAlarm(class Event *pEvent, bool bRetZero)
+void Rtc::removeAlarm(Event *pEvent)
 {
-    LockGuard<Spinlock> guard(m_Lock);
-
-    size_t currTime = getTickCount();
+    Alarm *pAlarm;
+    while ((pAlarm = takeAlarm(pEvent)) != 0)
+    {
+        delete pAlarm;
+    }
+}
 
-    for (List<Alarm *>::Iterator it = m_Alarms.begin(); it != m_Alarms.end();
-         it++)
+size_t Rtc::removeAlarm(class Event *pEvent, bool bRetZero)
+{
+    Alarm *pAlarm = takeAlarm(pEvent);
+    if (!pAlarm)
     {
-        if ((*it)->m_pEvent == pEvent)
-        {
-            size_t ret = 0;
-            if (!bRetZero)
-            {
-                size_t alarmEndTime = (*it)->m_Time;
+        return 0;
+    }
 
-                // Is it later than the end of the alarm?
-                if (alarmEndTime < currTime)
-                    ret = 0;
-                else
-                {
-                    /// \todo clarify units
-                    size_t diff = alarmEndTime - currTime;
-                    ret = (diff / 1000) + 1;
-                }
-            }
+    size_t ret = 0;
+    if (!bRetZero)
+    {
+        uint64_t alarmEndTime = pAlarm->getExpiry();
+        uint64_t currTime = m_TickCount;
 
-            Alarm *pAlarm = *it;
-            m_Alarms.erase(it);
-            delete pAlarm;
-            return ret;
+        // Is it later than the end of the alarm?
+        if (alarmEndTime >= currTime)
+        {
+            uint64_t diff = alarmEndTime - currTime;
+            ret = (diff / Time::Multiplier::Second) + 1;
         }
     }
 
-    return 0;
+    delete pAlarm;
+    return ret;
 }
 
 bool Rtc::registerHandler(TimerHandler *handler)
@@ -405,7 +405,7 @@ void Rtc::uninitialise()
 Rtc::Rtc()
     : m_IoPort("CMOS"), m_IrqId(0), m_PeriodicIrqInfoIndex(0), m_bBCD(true),
       m_Year(1970), m_Month(0), m_DayOfMonth(0), m_Hour(0), m_Minute(0),
-      m_Second(0), m_Nanosecond(0), m_TickCount(0), m_Alarms()
+      m_Second(0), m_Nanosecond(0), m_TickCount(0), m_AlarmWheels()
 {
 }
 
@@ -429,27 +429,21 @@ bool Rtc::irq(irq_id_t number, InterruptState &state)
     // Calculate the new time/date
     m_Nanosecond += delta;
 
-    // Check for alarms.
+    // Check for alarms. Dispatch happens with the wheel locked so that a
+    // racing removeAlarm() either wins or finds nothing to remove.
+    for (size_t i = 0; i < RTC_ALARM_WHEELS; ++i)
     {
-        LockGuard<Spinlock> guard(m_Lock);
-        while (true)
+        AlarmWheel &wheel = m_AlarmWheels[i];
+        LockGuard<Spinlock> guard(wheel.lock);
+
+        TimerWheel::Entry *pEntry = wheel.wheel.advance(m_TickCount);
+        while (pEntry)
         {
-            bool bDispatched = false;
-            for (List<Alarm *>::Iterator it = m_Alarms.begin();
-                 it != m_Alarms.end(); it++)
-            {
-                Alarm *pA = *it;
-                if (pA->m_Time <= m_TickCount)
-                {
-                    pA->m_pThread->sendEvent(pA->m_pEvent);
-                    m_Alarms.erase(it);
-                    bDispatched = true;
-                    delete pA;
-                    break;
-                }
-            }
-            if (!bDispatched)
-                break;
+            Alarm *pA = static_cast<Alarm *>(pEntry);
+            pEntry = pEntry->next();
+
+            pA->m_pThread->sendEvent(pA->m_pEvent);
+            delete pA;
         }
     }
 
@@ -28,13 +28,21 @@
 #include "pedigree/kernel/processor/IoPort.h"
 #include "pedigree/kernel/processor/state_forward.h"
 #include "pedigree/kernel/processor/types.h"
-#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/utilities/TimerWheel.h"
 #include "pedigree/kernel/utilities/new"
 
 class TimerHandler;
 
 #define MAX_TIMER_HANDLERS 32
 
+/// Alarms are kept on the wheel of the CPU that armed them; CPU IDs beyond
+/// this share wheels.
+#ifdef MULTIPROCESSOR
+#define RTC_ALARM_WHEELS 8
+#else
+#define RTC_ALARM_WHEELS 1
+#endif
+
 /** @addtogroup kernelmachinex86common
  * @{ */
 
@@ -168,16 +176,15 @@ class Rtc : public Timer, private IrqHandler
     /** All timer handlers installed */
     TimerHandler *m_Handlers[MAX_TIMER_HANDLERS];
 
-    /** Alarm structure. */
-    class Alarm
+    /** Alarm structure, keyed in its wheel by the Event. */
+    class Alarm : public TimerWheel::Entry
     {
       public:
-        Alarm(class Event *pEvent, size_t time, class Thread *pThread)
-            : m_pEvent(pEvent), m_Time(time), m_pThread(pThread)
+        Alarm(class Event *pEvent, class Thread *pThread)
+            : m_pEvent(pEvent), m_pThread(pThread)
         {
         }
         class Event *m_pEvent;
-        size_t m_Time;
         class Thread *m_pThread;
 
       private:
@@ -185,10 +192,23 @@ class Rtc : public Timer, private IrqHandler
         Alarm &operator=(const Alarm &);
     };
 
-    /** List of alarms. */
-    List<Alarm *> m_Alarms;
-    /** Protects m_Alarms. */
-    Spinlock m_Lock;
+    /** A wheel of pending alarms and the lock that protects it. */
+    struct AlarmWheel
+    {
+        AlarmWheel() : wheel(), lock()
+        {
+        }
+
+        TimerWheel wheel;
+        Spinlock lock;
+    };
+
+    /** Removes the first alarm for pEvent from any wheel.
+     * \return the removed alarm, which the caller must delete, or null. */
+    Alarm *takeAlarm(class Event *pEvent);
+
+    /** Per-CPU alarm wheels. */
+    AlarmWheel m_AlarmWheels[RTC_ALARM_WHEELS];
 
     /** Tracks the number of nanoseconds per TSC tick. */
     uint64_t m_TscTicksPerNanosecond;
@@ -194,7 +194,8 @@ void CacheManager::trimThread()
 Cache::Cache(size_t pageConstraints)
     : m_Pages(), m_PageFilter(0xe80000, 11), m_pLruHead(0), m_pLruTail(0),
       m_Lock(false), m_Callback(0), m_Nanoseconds(0),
-      m_PageConstraints(pageConstraints)
+      m_PageConstraints(pageConstraints), m_bDirtyTracking(false),
+      m_pPendingHead(0)
 {
     if (!g_AllocatorInited)
     {
@@ -252,6 +253,12 @@ uintptr_t Cache::lookup(uintptr_t key)
     pPage->refcnt++;
     promotePage(pPage);
 
+    // The caller may write to the page through the returned pointer.
+    if (m_bDirtyTracking)
+    {
+        linkPending(pPage);
+    }
+
     return ptr;
 }
 
@@ -322,6 +329,10 @@ uintptr_t Cache::insert(uintptr_t key, bool *alreadyExisted)
     m_Pages.insert(key, pPage);
     m_PageFilter.add(key);
     linkPage(pPage);
+    if (m_bDirtyTracking)
+    {
+        linkPending(pPage);
+    }
 
     return location;
 }
@@ -391,6 +402,7 @@ uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
         }
 
         pPage = new CachePage;
+        ByteSet(pPage, 0, sizeof(CachePage));
         pPage->key = key + (page * 4096);
         pPage->location = location;
 
@@ -404,6 +416,10 @@ uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
         m_Pages.insert(key + (page * 4096), pPage);
         m_PageFilter.add(key + (page * 4096));
         linkPage(pPage);
+        if (m_bDirtyTracking)
+        {
+            linkPending(pPage);
+        }
 
         location += 4096;
     }
@@ -507,7 +523,17 @@ bool Cache::evict(uintptr_t key, bool bLock, bool bPhysicalLock, bool bRemove)
         ((!m_Callback) && (!pPage->refcnt)))
     {
         // Good to go. Trigger a writeback if we know this was a dirty page.
-        if (!verifyChecksum(pPage))
+        bool bDirty = false;
+        if (m_bDirtyTracking)
+        {
+            bDirty = pPage->dirty || harvestDirtyBit(pPage);
+        }
+        else
+        {
+            bDirty = !verifyChecksum(pPage);
+        }
+
+        if (bDirty && m_Callback)
         {
             m_Callback(
                 CacheConstants::WriteBack, key, pPage->location,
@@ -530,6 +556,7 @@ bool Cache::evict(uintptr_t key, bool bLock, bool bPhysicalLock, bool bRemove)
             m_Pages.remove(key);
             unlinkPage(pPage);
         }
+        unlinkPending(pPage);
 
         // Eviction callback.
         if (m_Callback)
@@ -572,6 +599,11 @@ bool Cache::pin(uintptr_t key)
     pPage->refcnt++;
     promotePage(pPage);
 
+    if (m_bDirtyTracking)
+    {
+        linkPending(pPage);
+    }
+
     return true;
 }
 
@@ -693,6 +725,22 @@ void Cache::timer(uint64_t delta, InterruptState &state)
         return;
     }
 
+    writeBack();
+
+    m_Nanoseconds = 0;
+}
+
+void Cache::writeBack(bool async)
+{
+    if (!m_Callback)
+        return;
+
+    if (m_bDirtyTracking)
+    {
+        writeBackPending(async);
+        return;
+    }
+
     /// \todo something with locks
 
     for (Tree<uintptr_t, CachePage *>::Iterator it = m_Pages.begin();
@@ -748,12 +796,19 @@ void Cache::timer(uint64_t delta, InterruptState &state)
 
         // Queue a writeback for this dirty page to its backing store.
         NOTICE("** writeback @" << Hex << it.key());
-        CacheManager::instance().addAsyncRequest(
-            1, reinterpret_cast<uint64_t>(this), CacheConstants::WriteBack,
-            it.key(), page->location);
+        if (async)
+        {
+            CacheManager::instance().addAsyncRequest(
+                1, reinterpret_cast<uint64_t>(this), CacheConstants::WriteBack,
+                it.key(), page->location);
+        }
+        else
+        {
+            CacheManager::instance().addRequest(
+                1, reinterpret_cast<uint64_t>(this), CacheConstants::WriteBack,
+                it.key(), page->location);
+        }
     }
-
-    m_Nanoseconds = 0;
 }
 
 void Cache::setCallback(Cache::writeback_t newCallback, void *meta)
@@ -780,6 +835,18 @@ uint64_t Cache::executeRequest(
     // Pin page while we do our writeback
     pin(p3);
 
+    if (m_bDirtyTracking)
+    {
+        // Anything written to the page from here on must dirty it again.
+        LockGuard<Spinlock> guard(m_Lock);
+        CachePage *pPage = m_Pages.lookup(p3);
+        if (pPage)
+        {
+            pPage->dirty = false;
+            harvestDirtyBit(pPage);
+        }
+    }
+
 #ifdef SUPERDEBUG
     NOTICE("Cache: writeback for off=" << p3 << " @" << p3 << "!");
 #endif
@@ -913,6 +980,12 @@ void Cache::markEditing(uintptr_t key, size_t length)
         }
 
         pPage->status = CachePage::Editing;
+        pPage->editDirties = true;
+
+        if (m_bDirtyTracking)
+        {
+            linkPending(pPage);
+        }
     }
 }
 
@@ -947,6 +1020,25 @@ void Cache::markNoLongerEditing(uintptr_t key, size_t length)
             continue;
         }
 
+        if (m_bDirtyTracking)
+        {
+            if (pPage->editDirties)
+            {
+                pPage->dirty = true;
+            }
+            else
+            {
+                // Filling a freshly-inserted page doesn't make it dirty.
+                harvestDirtyBit(pPage);
+            }
+
+            pPage->editDirties = false;
+            pPage->status = CachePage::ChecksumStable;
+            linkPending(pPage);
+            continue;
+        }
+
+        pPage->editDirties = false;
         pPage->status = CachePage::EditTransition;
 
         // We have to checksum here as a write could happen between now and the
@@ -956,6 +1048,250 @@ void Cache::markNoLongerEditing(uintptr_t key, size_t length)
     }
 }
 
+void Cache::setDirtyTracking(bool enabled)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (enabled == m_bDirtyTracking)
+    {
+        return;
+    }
+
+    for (Tree<uintptr_t, CachePage *>::Iterator it = m_Pages.begin();
+         it != m_Pages.end(); ++it)
+    {
+        CachePage *pPage = it.value();
+        if (enabled)
+        {
+            // Pages that aren't being edited are assumed to match their
+            // backing store at this point.
+            pPage->dirty = false;
+            if (pPage->status == CachePage::Editing)
+            {
+                linkPending(pPage);
+            }
+            else
+            {
+                harvestDirtyBit(pPage);
+                pPage->status = CachePage::ChecksumStable;
+            }
+        }
+        else
+        {
+            unlinkPending(pPage);
+            if (pPage->status == CachePage::Editing)
+            {
+                continue;
+            }
+
+            // Dirty pages go through ChecksumChanging so the next timer run
+            // sees a stable checksum and writes them back.
+            calculateChecksum(pPage);
+            pPage->status = pPage->dirty ? CachePage::ChecksumChanging
+                                         : CachePage::ChecksumStable;
+            pPage->dirty = false;
+        }
+    }
+
+    m_bDirtyTracking = enabled;
+}
+
+void Cache::markDirty(uintptr_t key, size_t length)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (!m_bDirtyTracking)
+    {
+        return;
+    }
+
+    if (length % 4096)
+    {
+        WARNING(
+            "Cache::markDirty called with a length that isn't page-aligned");
+        length &= ~0xFFFU;
+    }
+
+    if (!length)
+    {
+        length = 4096;
+    }
+
+    size_t nPages = length / 4096;
+
+    for (size_t page = 0; page < nPages; page++)
+    {
+        if (!m_PageFilter.contains(key + (page * 4096)))
+        {
+            continue;
+        }
+
+        CachePage *pPage = m_Pages.lookup(key + (page * 4096));
+        if (!pPage)
+        {
+            continue;
+        }
+
+        pPage->dirty = true;
+        linkPending(pPage);
+    }
+}
+
+bool Cache::isDirty(uintptr_t key)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (!m_PageFilter.contains(key))
+    {
+        return false;
+    }
+
+    CachePage *pPage = m_Pages.lookup(key);
+    if (!pPage)
+    {
+        return false;
+    }
+
+    return pPage->dirty;
+}
+
+void Cache::linkPending(CachePage *pPage)
+{
+    if (pPage->pending)
+    {
+        return;
+    }
+
+    pPage->pPrevPending = 0;
+    pPage->pNextPending = m_pPendingHead;
+    if (m_pPendingHead)
+        m_pPendingHead->pPrevPending = pPage;
+    m_pPendingHead = pPage;
+    pPage->pending = true;
+}
+
+void Cache::unlinkPending(CachePage *pPage)
+{
+    if (!pPage->pending)
+    {
+        return;
+    }
+
+    if (pPage->pPrevPending)
+        pPage->pPrevPending->pNextPending = pPage->pNextPending;
+    if (pPage->pNextPending)
+        pPage->pNextPending->pPrevPending = pPage->pPrevPending;
+    if (pPage == m_pPendingHead)
+        m_pPendingHead = pPage->pNextPending;
+
+    pPage->pNextPending = pPage->pPrevPending = 0;
+    pPage->pending = false;
+}
+
+bool Cache::harvestDirtyBit(CachePage *pPage)
+{
+#ifdef STANDALONE_CACHE
+    // No page tables to look at.
+    return false;
+#else
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    void *loc = reinterpret_cast<void *>(pPage->location);
+    if (!va.isMapped(loc))
+    {
+        return false;
+    }
+
+    physical_uintptr_t phys;
+    size_t flags;
+    va.getMapping(loc, phys, flags);
+
+    // Architectures that don't track dirty pages never report this flag.
+    if ((flags & VirtualAddressSpace::Dirty) == 0)
+    {
+        return false;
+    }
+
+    flags &= ~VirtualAddressSpace::Dirty;
+    va.setFlags(loc, flags | VirtualAddressSpace::ClearDirty);
+    return true;
+#endif
+}
+
+bool Cache::isHeld(CachePage *pPage) const
+{
+    // With a callback, the cache holds a base reference of its own.
+    return pPage->refcnt > (m_Callback ? 1U : 0U);
+}
+
+void Cache::writeBackPending(bool async)
+{
+    CachePage *pBatch = 0;
+
+    // Only pages on the pending list can have changed since the last run, so
+    // this is proportional to the write activity rather than the cache size.
+    m_Lock.acquire();
+    CachePage *pPage = m_pPendingHead;
+    while (pPage)
+    {
+        CachePage *pNext = pPage->pNextPending;
+
+        // Pages being edited stay pending until the edit completes.
+        if (pPage->status != CachePage::Editing)
+        {
+            if (harvestDirtyBit(pPage))
+            {
+                pPage->dirty = true;
+            }
+
+            // Pages still held by someone else may be written to again via
+            // an existing pointer, so keep an eye on them.
+            if (!isHeld(pPage))
+            {
+                unlinkPending(pPage);
+            }
+
+            if (pPage->dirty)
+            {
+                pPage->dirty = false;
+                promotePage(pPage);
+
+                // Hold a reference so the page can't be evicted before its
+                // writeback has been queued.
+                pPage->refcnt++;
+                pPage->pNextWriteback = pBatch;
+                pBatch = pPage;
+            }
+        }
+
+        pPage = pNext;
+    }
+    m_Lock.release();
+
+    // Queue writebacks without the lock held, as the request may be executed
+    // synchronously and need to take the lock itself.
+    while (pBatch)
+    {
+        CachePage *pNext = pBatch->pNextWriteback;
+        uintptr_t key = pBatch->key;
+
+        if (async)
+        {
+            CacheManager::instance().addAsyncRequest(
+                1, reinterpret_cast<uint64_t>(this), CacheConstants::WriteBack,
+                key, pBatch->location);
+        }
+        else
+        {
+            CacheManager::instance().addRequest(
+                1, reinterpret_cast<uint64_t>(this), CacheConstants::WriteBack,
+                key, pBatch->location);
+        }
+        release(key);
+
+        pBatch = pNext;
+    }
+}
+
 CachePageGuard::CachePageGuard(Cache &cache, uintptr_t location)
     : m_Cache(cache), m_Location(location)
 {
@@ -237,14 +237,18 @@ uintptr_t MemoryPool::allocateDoer(bool canBlock)
 #endif
 
     uintptr_t result = poolBase + (n * 0x1000);
-    map(result);
-
     --m_BufferCount;
 
+    // The buffer is ours now that its bit is set, and trim() leaves buffers
+    // with set bits alone, so it's safe to map it without the lock. Mapping
+    // may allocate a page, which can run the memory pressure handlers and
+    // with them our own trim(), so holding the lock here would deadlock.
 #ifdef THREADS
     m_Lock.release();
 #endif
 
+    map(result);
+
     return result;
 }
 
@@ -266,6 +270,13 @@ void MemoryPool::free(uintptr_t buffer)
 
 bool MemoryPool::trim()
 {
+#ifdef THREADS
+    // Keep the bitmap stable while we look at it. allocateDoer() sets a
+    // buffer's bit before it drops the lock to map it, so a buffer being
+    // handed out is never unmapped here.
+    LockGuard<Mutex> guard(m_Lock);
+#endif
+
     size_t poolSize = m_Pool.size();
     size_t nBuffers = poolSize / m_BufferSize;
     uintptr_t poolBase = reinterpret_cast<uintptr_t>(m_Pool.virtualAddress());
@@ -0,0 +1,623 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/PageRing.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+const size_t PageRing::PageSize;
+
+static size_t copyIntoRing(void *param, uint8_t *buffer, size_t size)
+{
+    const uint8_t **source = reinterpret_cast<const uint8_t **>(param);
+    MemoryCopy(buffer, *source, size);
+    *source += size;
+    return size;
+}
+
+static size_t copyFromRing(void *param, const uint8_t *buffer, size_t size)
+{
+    uint8_t **target = reinterpret_cast<uint8_t **>(param);
+    MemoryCopy(*target, buffer, size);
+    *target += size;
+    return size;
+}
+
+static bool acquireFor(Mutex &lock, bool block)
+{
+    if (block)
+    {
+        return lock.acquire();
+    }
+
+    return lock.tryAcquire();
+}
+
+PageRing::PageRing(size_t nPages)
+    : m_pSlots(0), m_nSlots(nPages ? nPages : 1), m_Head(0), m_nUsed(0),
+      m_DataSize(0), m_pFreePages(0), m_nFreePages(0), m_Lock(false),
+      m_ProduceLock(false), m_ConsumeLock(false), m_WriteCondition(), m_ReadCondition(), m_bCanRead(true),
+      m_bCanWrite(true)
+{
+    m_pSlots = new Slot[m_nSlots];
+}
+
+PageRing::~PageRing()
+{
+    // Wake up all readers and writers to finish up existing operations.
+    disableReads();
+    disableWrites();
+
+    // Clean up the entire ring, then the pages kept for reuse.
+    wipe();
+
+    m_Lock.acquire();
+    while (m_pFreePages)
+    {
+        Page *pPage = m_pFreePages;
+        m_pFreePages = pPage->pNext;
+        delete pPage;
+    }
+    m_nFreePages = 0;
+
+    delete[] m_pSlots;
+    m_pSlots = 0;
+    m_Lock.release();
+}
+
+size_t PageRing::write(const uint8_t *buffer, size_t count, bool block)
+{
+    return produce(copyIntoRing, &buffer, count, block);
+}
+
+size_t PageRing::read(uint8_t *buffer, size_t count, bool block)
+{
+    return consume(copyFromRing, &buffer, count, block);
+}
+
+size_t
+PageRing::produce(Producer producer, void *param, size_t count, bool block)
+{
+    if (!acquireFor(m_ProduceLock, block))
+    {
+        return 0;
+    }
+
+    m_Lock.acquire();
+
+    size_t countSoFar = 0;
+    while (count)
+    {
+        if (!m_bCanWrite)
+        {
+            break;
+        }
+
+        // Fill the last page if we still own it outright, otherwise start a
+        // new one in the next slot.
+        Page *pPage = 0;
+        size_t offset = 0;
+        size_t space = tailSpace();
+        bool bNewPage = false;
+        if (space)
+        {
+            Slot &tail = slotAt(m_nUsed - 1);
+            pPage = tail.pPage;
+            offset = tail.offset + tail.length;
+
+            // Readers may drain the slot while the producer runs.
+            pPage->refs += 1;
+        }
+        else if (m_nUsed < m_nSlots)
+        {
+            pPage = allocatePage();
+            space = PageSize;
+            bNewPage = true;
+        }
+        else
+        {
+            if (!block || !m_bCanRead)
+            {
+                break;
+            }
+
+            // Let other writers in while we sleep.
+            m_ProduceLock.release();
+            ConditionVariable::WaitResult result =
+                m_WriteCondition.wait(m_Lock);
+            if (result.hasError())
+            {
+                return countSoFar;
+            }
+            m_Lock.release();
+            m_ProduceLock.acquire();
+            m_Lock.acquire();
+            continue;
+        }
+
+        // The producer may block (e.g. reading from a socket for splice), so
+        // it runs without the ring lock. m_ProduceLock keeps other writers
+        // off the tail, and our reference keeps the page alive.
+        size_t wanted = (count < space) ? count : space;
+        m_Lock.release();
+        size_t produced = producer(param, &pPage->data[offset], wanted);
+        m_Lock.acquire();
+        if (produced > wanted)
+        {
+            produced = wanted;
+        }
+
+        // Readers never move the end of a slot, so if the page is still at
+        // the tail the new bytes simply extend it. Otherwise they drained it
+        // meanwhile and the new bytes need a slot of their own.
+        if (!bNewPage && m_nUsed && slotAt(m_nUsed - 1).pPage == pPage)
+        {
+            slotAt(m_nUsed - 1).length += produced;
+            m_DataSize += produced;
+            releasePage(pPage);
+        }
+        else if (produced)
+        {
+            pushSlot(pPage, offset, produced);
+        }
+        else
+        {
+            releasePage(pPage);
+        }
+
+        countSoFar += produced;
+        count -= produced;
+
+        if (produced)
+        {
+            m_ReadCondition.signal();
+        }
+
+        if (produced < wanted)
+        {
+            break;
+        }
+    }
+
+    m_Lock.release();
+    m_ProduceLock.release();
+
+    return countSoFar;
+}
+
+size_t
+PageRing::consume(Consumer consumer, void *param, size_t count, bool block)
+{
+    if (!acquireFor(m_ConsumeLock, block))
+    {
+        return 0;
+    }
+
+    m_Lock.acquire();
+
+    size_t countSoFar = 0;
+    while (count)
+    {
+        if (!m_bCanRead)
+        {
+            break;
+        }
+
+        if (!m_nUsed)
+        {
+            if (!block || !m_bCanWrite)
+            {
+                break;
+            }
+
+            // Let other readers in while we sleep.
+            m_ConsumeLock.release();
+            ConditionVariable::WaitResult result = m_ReadCondition.wait(m_Lock);
+            if (result.hasError())
+            {
+                return countSoFar;
+            }
+            m_Lock.release();
+            m_ConsumeLock.acquire();
+            m_Lock.acquire();
+            continue;
+        }
+
+        // As in produce(), the consumer may block so it runs without the ring
+        // lock. Nothing else removes data while we hold m_ConsumeLock, so the
+        // head slot stays put; writers may only lengthen it.
+        Slot &head = slotAt(0);
+        Page *pPage = head.pPage;
+        size_t offset = head.offset;
+        size_t wanted = (count < head.length) ? count : head.length;
+        m_Lock.release();
+        size_t consumed = consumer(param, &pPage->data[offset], wanted);
+        m_Lock.acquire();
+        if (consumed > wanted)
+        {
+            consumed = wanted;
+        }
+
+        head.offset += consumed;
+        head.length -= consumed;
+        m_DataSize -= consumed;
+        if (!head.length)
+        {
+            popSlot(true);
+        }
+
+        countSoFar += consumed;
+        count -= consumed;
+
+        if (consumed)
+        {
+            m_WriteCondition.signal();
+        }
+
+        if (consumed < wanted)
+        {
+            break;
+        }
+
+        // Once we've read at least some bytes, don't block - just return what
+        // we've read so far if we loop back around and have no data.
+        block = false;
+    }
+
+    m_Lock.release();
+    m_ConsumeLock.release();
+
+    return countSoFar;
+}
+
+size_t PageRing::splice(PageRing &dest, size_t count, bool block)
+{
+    return transfer(dest, count, block, true);
+}
+
+size_t PageRing::tee(PageRing &dest, size_t count, bool block)
+{
+    return transfer(dest, count, block, false);
+}
+
+size_t
+PageRing::transfer(PageRing &dest, size_t count, bool block, bool bConsume)
+{
+    if (&dest == this || !count)
+    {
+        return 0;
+    }
+
+    while (true)
+    {
+        // Keep out readers of this ring and writers of dest that may be
+        // running their callbacks without the ring locks.
+        if (!acquireFor(m_ConsumeLock, block))
+        {
+            return 0;
+        }
+        if (!acquireFor(dest.m_ProduceLock, block))
+        {
+            m_ConsumeLock.release();
+            return 0;
+        }
+
+        lockPair(dest);
+
+        if (!m_bCanRead || !dest.m_bCanWrite)
+        {
+            unlockPair(dest);
+            dest.m_ProduceLock.release();
+            m_ConsumeLock.release();
+            return 0;
+        }
+
+        size_t moved = 0;
+        size_t n = 0;
+        while (count && n < m_nUsed && dest.m_nUsed < dest.m_nSlots)
+        {
+            Slot &slot = slotAt(n);
+            size_t length = (count < slot.length) ? count : slot.length;
+
+            if (bConsume && length == slot.length)
+            {
+                // The whole slot moves, and our reference moves with it.
+                dest.pushSlot(slot.pPage, slot.offset, length);
+                popSlot(false);
+            }
+            else
+            {
+                slot.pPage->refs += 1;
+                dest.pushSlot(slot.pPage, slot.offset, length);
+                if (bConsume)
+                {
+                    slot.offset += length;
+                    slot.length -= length;
+                    m_DataSize -= length;
+                }
+                else
+                {
+                    ++n;
+                }
+            }
+
+            moved += length;
+            count -= length;
+        }
+
+        if (moved)
+        {
+            dest.m_ReadCondition.signal();
+            if (bConsume)
+            {
+                m_WriteCondition.signal();
+            }
+        }
+
+        // Nothing moved either because we're empty or dest is full; work out
+        // whether anyone could ever change that before we go to sleep.
+        bool bEmpty = !m_nUsed;
+        bool bCanWait =
+            block && !moved && (bEmpty ? m_bCanWrite : dest.m_bCanRead);
+
+        unlockPair(dest);
+        dest.m_ProduceLock.release();
+        m_ConsumeLock.release();
+
+        if (!bCanWait)
+        {
+            return moved;
+        }
+
+        // On error the wait returns with the lock already released.
+        if (bEmpty)
+        {
+            m_Lock.acquire();
+            while (!m_nUsed && m_bCanRead && m_bCanWrite)
+            {
+                ConditionVariable::WaitResult result =
+                    m_ReadCondition.wait(m_Lock);
+                if (result.hasError())
+                {
+                    return 0;
+                }
+            }
+            m_Lock.release();
+        }
+        else
+        {
+            dest.m_Lock.acquire();
+            while (dest.m_nUsed == dest.m_nSlots && dest.m_bCanWrite &&
+                   dest.m_bCanRead)
+            {
+                ConditionVariable::WaitResult result =
+                    dest.m_WriteCondition.wait(dest.m_Lock);
+                if (result.hasError())
+                {
+                    return 0;
+                }
+            }
+            dest.m_Lock.release();
+        }
+    }
+}
+
+void PageRing::disableWrites()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    m_bCanWrite = false;
+
+    // All pending readers need to now return.
+    m_ReadCondition.broadcast();
+}
+
+void PageRing::disableReads()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    m_bCanRead = false;
+
+    // All pending writers need to now return.
+    m_WriteCondition.broadcast();
+}
+
+bool PageRing::enableWrites()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    bool previous = m_bCanWrite;
+    m_bCanWrite = true;
+    return previous;
+}
+
+bool PageRing::enableReads()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    bool previous = m_bCanRead;
+    m_bCanRead = true;
+    return previous;
+}
+
+size_t PageRing::getDataSize()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    return m_DataSize;
+}
+
+size_t PageRing::getSize()
+{
+    return m_nSlots * PageSize;
+}
+
+size_t PageRing::getCachedPages()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    return m_nFreePages;
+}
+
+bool PageRing::canWrite(bool block)
+{
+    m_Lock.acquire();
+
+    // We can get woken here if we stop being able to write.
+    while (block && m_bCanWrite && m_bCanRead && m_nUsed == m_nSlots &&
+           !tailSpace())
+    {
+        ConditionVariable::WaitResult result = m_WriteCondition.wait(m_Lock);
+        if (result.hasError())
+        {
+            return false;
+        }
+    }
+
+    // A write can't block once the readers are gone either.
+    bool result =
+        m_bCanWrite && (m_nUsed < m_nSlots || tailSpace() || !m_bCanRead);
+    m_Lock.release();
+    return result;
+}
+
+bool PageRing::canRead(bool block)
+{
+    m_Lock.acquire();
+
+    // We can get woken here if we stop being able to read.
+    while (block && m_bCanRead && m_bCanWrite && !m_DataSize)
+    {
+        ConditionVariable::WaitResult result = m_ReadCondition.wait(m_Lock);
+        if (result.hasError())
+        {
+            return false;
+        }
+    }
+
+    // A read can't block once the writers are gone (EOF).
+    bool result = m_bCanRead && (m_DataSize || !m_bCanWrite);
+    m_Lock.release();
+    return result;
+}
+
+void PageRing::wipe()
+{
+    LockGuard<Mutex> consumeGuard(m_ConsumeLock);
+    LockGuard<Mutex> guard(m_Lock);
+
+    while (m_nUsed)
+    {
+        popSlot(true);
+    }
+
+    // Notify writers that might have been waiting for space.
+    m_WriteCondition.signal();
+}
+
+PageRing::Page *PageRing::allocatePage()
+{
+    if (m_pFreePages)
+    {
+        Page *pPage = m_pFreePages;
+        m_pFreePages = pPage->pNext;
+        --m_nFreePages;
+
+        pPage->pNext = 0;
+        pPage->refs += 1;
+        return pPage;
+    }
+
+    return new Page();
+}
+
+void PageRing::releasePage(Page *pPage)
+{
+    if (pPage->refs -= 1)
+    {
+        // Still referenced by another ring.
+        return;
+    }
+
+    // Keep enough pages around to refill the whole ring.
+    if (m_nFreePages < m_nSlots)
+    {
+        pPage->pNext = m_pFreePages;
+        m_pFreePages = pPage;
+        ++m_nFreePages;
+    }
+    else
+    {
+        delete pPage;
+    }
+}
+
+size_t PageRing::tailSpace() const
+{
+    if (!m_nUsed)
+    {
+        return 0;
+    }
+
+    const Slot &tail = m_pSlots[(m_Head + m_nUsed - 1) % m_nSlots];
+    if (tail.pPage->refs != 1U)
+    {
+        // Shared pages are read-only.
+        return 0;
+    }
+
+    return PageSize - (tail.offset + tail.length);
+}
+
+void PageRing::pushSlot(Page *pPage, size_t offset, size_t length)
+{
+    Slot &slot = slotAt(m_nUsed++);
+    slot.pPage = pPage;
+    slot.offset = offset;
+    slot.length = length;
+    m_DataSize += length;
+}
+
+void PageRing::popSlot(bool bRelease)
+{
+    Slot &slot = slotAt(0);
+    m_DataSize -= slot.length;
+    if (bRelease)
+    {
+        releasePage(slot.pPage);
+    }
+    slot.pPage = 0;
+
+    m_Head = (m_Head + 1) % m_nSlots;
+    --m_nUsed;
+}
+
+void PageRing::lockPair(PageRing &other)
+{
+    if (this < &other)
+    {
+        m_Lock.acquire();
+        other.m_Lock.acquire();
+    }
+    else
+    {
+        other.m_Lock.acquire();
+        m_Lock.acquire();
+    }
+}
+
+void PageRing::unlockPair(PageRing &other)
+{
+    other.m_Lock.release();
+    m_Lock.release();
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/TimerWheel.h"
+#include "pedigree/kernel/utilities/assert.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+#define SLOT_MASK (TimerWheel::SlotsPerLevel - 1)
+#define LEVEL_SHIFT(level) ((level) * TimerWheel::LevelBits)
+
+/// Furthest ahead (in ticks) an entry can be placed; beyond this, entries
+/// sit in the last slot reachable and are re-placed as it comes around.
+#define MAX_TICK_DELTA ((1ULL << LEVEL_SHIFT(TimerWheel::Levels)) - 1)
+
+#define INITIAL_BUCKETS 64
+
+TimerWheel::Entry::Entry()
+    : m_Expiry(0), m_pKey(nullptr), m_pNext(nullptr), m_pPrev(nullptr),
+      m_pSlot(nullptr), m_pHashNext(nullptr)
+{
+}
+
+TimerWheel::TimerWheel(size_t resolutionShift)
+    : m_ResolutionShift(resolutionShift), m_Now(0), m_Count(0),
+      m_LevelCount(), m_Slots(), m_pBuckets(nullptr), m_nBuckets(0)
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    delete[] m_pBuckets;
+}
+
+void TimerWheel::insert(Entry *entry, uint64_t expiry, const void *key)
+{
+    assert(!entry->isPending());
+
+    entry->m_Expiry = expiry;
+    entry->m_pKey = key;
+    place(entry);
+    ++m_Count;
+
+    if (key)
+    {
+        if (m_Count > m_nBuckets)
+        {
+            rehash(m_nBuckets ? m_nBuckets * 2 : INITIAL_BUCKETS);
+        }
+
+        size_t bucket = hashKey(key);
+        entry->m_pHashNext = m_pBuckets[bucket];
+        m_pBuckets[bucket] = entry;
+    }
+}
+
+void TimerWheel::remove(Entry *entry)
+{
+    if (!entry->isPending())
+    {
+        return;
+    }
+
+    unlink(entry);
+    --m_Count;
+
+    if (entry->m_pKey)
+    {
+        Entry **link = &m_pBuckets[hashKey(entry->m_pKey)];
+        while (*link != entry)
+        {
+            link = &(*link)->m_pHashNext;
+        }
+        *link = entry->m_pHashNext;
+        entry->m_pHashNext = nullptr;
+    }
+}
+
+TimerWheel::Entry *TimerWheel::find(const void *key) const
+{
+    if (!key || !m_nBuckets)
+    {
+        return nullptr;
+    }
+
+    for (Entry *entry = m_pBuckets[hashKey(key)]; entry;
+         entry = entry->m_pHashNext)
+    {
+        if (entry->m_pKey == key)
+        {
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+TimerWheel::Entry *TimerWheel::advance(uint64_t now)
+{
+    uint64_t target = now >> m_ResolutionShift;
+
+    Entry *head = nullptr;
+    Entry *tail = nullptr;
+
+    while (m_Now <= target)
+    {
+        if (!m_Count)
+        {
+            // Nothing to cascade or fire, so just catch up.
+            m_Now = target + 1;
+            break;
+        }
+
+        // Skip over ticks that can't do anything: if every level below
+        // 'level' is empty, nothing happens until that level cascades.
+        size_t level = 0;
+        while (!m_LevelCount[level])
+        {
+            ++level;
+        }
+        if (level)
+        {
+            uint64_t mask = (1ULL << LEVEL_SHIFT(level)) - 1;
+            if (m_Now & mask)
+            {
+                // Don't go past 'now', or later inserts would land late.
+                uint64_t next = (m_Now | mask) + 1;
+                m_Now = (next <= target) ? next : target + 1;
+                continue;
+            }
+        }
+
+        // Pull entries down from higher levels as the lower ones wrap.
+        for (size_t i = 1; i < Levels; ++i)
+        {
+            if (m_Now & ((1ULL << LEVEL_SHIFT(i)) - 1))
+            {
+                break;
+            }
+            cascade(i, (m_Now >> LEVEL_SHIFT(i)) & SLOT_MASK);
+        }
+
+        Entry *entry;
+        while ((entry = m_Slots[0][m_Now & SLOT_MASK]) != nullptr)
+        {
+            remove(entry);
+
+            if (tail)
+            {
+                tail->m_pNext = entry;
+            }
+            else
+            {
+                head = entry;
+            }
+            tail = entry;
+        }
+
+        ++m_Now;
+    }
+
+    if (tail)
+    {
+        tail->m_pNext = nullptr;
+    }
+
+    return head;
+}
+
+void TimerWheel::place(Entry *entry)
+{
+    uint64_t granule = 1ULL << m_ResolutionShift;
+    uint64_t tick = (entry->m_Expiry >> m_ResolutionShift) +
+                    ((entry->m_Expiry & (granule - 1)) ? 1 : 0);
+    if (tick < m_Now)
+    {
+        tick = m_Now;
+    }
+    else if (tick - m_Now > MAX_TICK_DELTA)
+    {
+        tick = m_Now + MAX_TICK_DELTA;
+    }
+
+    uint64_t delta = tick - m_Now;
+    size_t level = 0;
+    while (delta >= (1ULL << LEVEL_SHIFT(level + 1)))
+    {
+        ++level;
+    }
+
+    Entry **slot = &m_Slots[level][(tick >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    entry->m_pSlot = slot;
+    entry->m_pPrev = nullptr;
+    entry->m_pNext = *slot;
+    if (*slot)
+    {
+        (*slot)->m_pPrev = entry;
+    }
+    *slot = entry;
+
+    ++m_LevelCount[level];
+}
+
+void TimerWheel::unlink(Entry *entry)
+{
+    size_t level = (entry->m_pSlot - &m_Slots[0][0]) / SlotsPerLevel;
+    --m_LevelCount[level];
+
+    if (entry->m_pPrev)
+    {
+        entry->m_pPrev->m_pNext = entry->m_pNext;
+    }
+    else
+    {
+        *entry->m_pSlot = entry->m_pNext;
+    }
+    if (entry->m_pNext)
+    {
+        entry->m_pNext->m_pPrev = entry->m_pPrev;
+    }
+
+    entry->m_pSlot = nullptr;
+    entry->m_pNext = entry->m_pPrev = nullptr;
+}
+
+void TimerWheel::cascade(size_t level, size_t slot)
+{
+    Entry *entry = m_Slots[level][slot];
+    m_Slots[level][slot] = nullptr;
+    while (entry)
+    {
+        Entry *next = entry->m_pNext;
+        --m_LevelCount[level];
+        place(entry);
+        entry = next;
+    }
+}
+
+size_t TimerWheel::hashKey(const void *key) const
+{
+    // Keys are usually heap objects, so the low bits carry little entropy.
+    uint64_t k = reinterpret_cast<uintptr_t>(key) >> 4;
+    k *= 0x9E3779B97F4A7C15ULL;
+    return (k >> 32) & (m_nBuckets - 1);
+}
+
+void TimerWheel::rehash(size_t nBuckets)
+{
+    Entry **pOld = m_pBuckets;
+    size_t nOld = m_nBuckets;
+
+    m_pBuckets = new Entry *[nBuckets];
+    m_nBuckets = nBuckets;
+    ByteSet(m_pBuckets, 0, nBuckets * sizeof(Entry *));
+
+    for (size_t i = 0; i < nOld; ++i)
+    {
+        Entry *entry = pOld[i];
+        while (entry)
+        {
+            Entry *next = entry->m_pHashNext;
+            size_t bucket = hashKey(entry->m_pKey);
+            entry->m_pHashNext = m_pBuckets[bucket];
+            m_pBuckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    delete[] pOld;
+}
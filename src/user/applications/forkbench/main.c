@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Measures fork() and fork()+exec() latency with a heap of a given size
+ * touched by the parent, which is where page table copying used to hurt.
+ *
+ * Usage: forkbench [heap MiB] [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void reap(pid_t pid)
+{
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        ;
+}
+
+int main(int argc, char *argv[])
+{
+    // exec() target: exit straight away.
+    if (argc > 1 && !strcmp(argv[1], "--child"))
+    {
+        return 0;
+    }
+
+    size_t heapMiB = argc > 1 ? strtoul(argv[1], 0, 0) : 64;
+    int iterations = argc > 2 ? atoi(argv[2]) : 100;
+
+    size_t heapSize = heapMiB << 20;
+    char *heap = heapSize ? malloc(heapSize) : 0;
+    if (heapSize && !heap)
+    {
+        perror("forkbench: malloc");
+        return 1;
+    }
+    memset(heap, 0xAB, heapSize);
+
+    uint64_t forkTotal = 0, forkExecTotal = 0, forkWriteTotal = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        // fork() + _exit(): the cost of cloning the address space.
+        uint64_t start = now();
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("forkbench: fork");
+            return 1;
+        }
+        else if (pid == 0)
+        {
+            _exit(0);
+        }
+        forkTotal += now() - start;
+        reap(pid);
+
+        // fork() + exec(): the usual way to start a program.
+        start = now();
+        pid = fork();
+        if (pid < 0)
+        {
+            perror("forkbench: fork");
+            return 1;
+        }
+        else if (pid == 0)
+        {
+            execl(argv[0], argv[0], "--child", (char *) 0);
+            _exit(127);
+        }
+        reap(pid);
+        forkExecTotal += now() - start;
+
+        // fork(), then have the child dirty the whole heap: the worst case
+        // for copying on demand.
+        start = now();
+        pid = fork();
+        if (pid < 0)
+        {
+            perror("forkbench: fork");
+            return 1;
+        }
+        else if (pid == 0)
+        {
+            for (size_t off = 0; off < heapSize; off += 4096)
+            {
+                heap[off] = 0;
+            }
+            _exit(0);
+        }
+        reap(pid);
+        forkWriteTotal += now() - start;
+    }
+
+    printf(
+        "forkbench: %zu MiB heap, %d iterations\n", heapMiB, iterations);
+    printf("  fork+_exit:       %llu us\n",
+        (unsigned long long) (forkTotal / iterations / 1000));
+    printf("  fork+exec+wait:   %llu us\n",
+        (unsigned long long) (forkExecTotal / iterations / 1000));
+    printf("  fork+touch+wait:  %llu us\n",
+        (unsigned long long) (forkWriteTotal / iterations / 1000));
+
+    free(heap);
+    return 0;
+}
@@ -33,6 +33,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #define PACKED __attribute__((packed))
 
@@ -41,12 +42,16 @@
 #define _NO_ELF_CLASS
 #include <Elf.h>
 
+#include "prelink.h"
+
 #define STB_LOCAL 0
 #define STB_GLOBAL 1
 #define STB_WEAK 2
 #define STB_LOPROC 13
 #define STB_HIPROC 15
 
+#define SHT_GNU_HASH 0x6ffffff6
+
 typedef void (*entry_point_t)(const char *[], char **);
 typedef void (*init_fini_func_t)();
 
@@ -68,7 +73,9 @@ typedef struct _object_meta
           dyn_strtab_sz(0), rela(0), rel(0), rela_sz(0), rel_sz(0),
           uses_rela(false), got(0), plt_rela(0), plt_rel(0), init_func(0),
           fini_func(0), plt_sz(0), hash(0), hash_buckets(0), hash_chains(0),
-          preloads(), objects(), parent(0)
+          gnu_nbuckets(0), gnu_symoffset(0), gnu_bloom_size(0),
+          gnu_bloom_shift(0), gnu_bloom(0), gnu_buckets(0), gnu_chains(0),
+          ident(0), preloads(), objects(), parent(0)
     {
     }
 
@@ -132,12 +139,34 @@ typedef struct _object_meta
     const Elf_Word *hash_buckets;
     const Elf_Word *hash_chains;
 
+    // DT_GNU_HASH table, preferred over the SysV table when present.
+    Elf_Word gnu_nbuckets;
+    Elf_Word gnu_symoffset;
+    Elf_Word gnu_bloom_size;
+    Elf_Word gnu_bloom_shift;
+    const uintptr_t *gnu_bloom;
+    const Elf_Word *gnu_buckets;
+    const Elf_Word *gnu_chains;
+
+    /// Identity of the file and where it was loaded, for the prelink cache.
+    uint64_t ident;
+
     std::list<struct _object_meta *> preloads;
     std::list<struct _object_meta *> objects;
 
     struct _object_meta *parent;
 } object_meta_t;
 
+/// A symbol name along with both of its hashes, computed once per lookup.
+typedef struct _symbol_key
+{
+    _symbol_key(const char *n);
+
+    const char *name;
+    uint32_t sysv_hash;
+    uint32_t gnu_hash;
+} symbol_key_t;
+
 #define IS_NOT_PAGE_ALIGNED(x) (((x) & (getpagesize() - 1)) != 0)
 
 extern "C" void *pedigree_sys_request_mem(size_t len);
@@ -153,16 +182,22 @@ bool findSymbol(
     const char *symbol, object_meta_t *meta, ElfSymbol_t &sym,
     LookupPolicy policy = LocalFirst);
 
+bool findSymbolUncached(
+    const symbol_key_t &key, object_meta_t *meta, ElfSymbol_t &sym,
+    LookupPolicy policy);
+
 bool lookupSymbol(
-    const char *symbol, object_meta_t *meta, ElfSymbol_t &sym, bool bWeak,
-    bool bGlobal = true);
+    const symbol_key_t &key, object_meta_t *meta, ElfSymbol_t &sym,
+    bool bWeak, bool bGlobal = true);
 
 void doRelocation(object_meta_t *meta);
 
-uintptr_t doThisRelocation(ElfRel_t rel, object_meta_t *meta);
-uintptr_t doThisRelocation(ElfRela_t rel, object_meta_t *meta);
+uintptr_t doThisRelocation(
+    ElfRel_t rel, object_meta_t *meta, prelink_entry_t *prelink = 0);
+uintptr_t doThisRelocation(
+    ElfRela_t rel, object_meta_t *meta, prelink_entry_t *prelink = 0);
 
-std::string symbolName(
+const char *symbolName(
     const ElfSymbol_t &sym, object_meta_t *meta, bool bNoDynamic = false);
 
 std::string findObject(std::string name, bool envpath);
@@ -181,6 +216,9 @@ std::set<std::string> g_LoadedObjects;
 
 std::map<std::string, uintptr_t> g_LibLoadSymbols;
 
+/// Directory holding prelink caches ($LD_PRELINK_CACHE), empty if disabled.
+std::string g_PrelinkCacheDir;
+
 extern char __elf_start;
 extern char __start_bss;
 extern char __end_bss;
@@ -203,6 +241,190 @@ size_t elfhash(const char *name)
     return h;
 }
 
+uint32_t gnuhash(const char *name)
+{
+    uint32_t h = 5381;
+    while (*name)
+    {
+        h = (h << 5) + h + static_cast<unsigned char>(*name++);
+    }
+
+    return h;
+}
+
+_symbol_key::_symbol_key(const char *n)
+    : name(n), sysv_hash(elfhash(n)), gnu_hash(gnuhash(n))
+{
+}
+
+/**
+ * Caches the result of findSymbol for the life of the process, so the same
+ * symbol referenced by many relocations (or resolved lazily through the PLT
+ * over and over) only walks the hash chains of every loaded object once.
+ *
+ * Results depend on the requesting object and the lookup policy, so both
+ * form part of the key. Loading a new object may change which definition
+ * wins, so the cache is flushed whenever that happens.
+ */
+class ResolvedSymbolCache
+{
+  public:
+    ResolvedSymbolCache() : m_Entries(), m_nEntries(0), m_Lock(false)
+    {
+    }
+
+    bool lookup(
+        const symbol_key_t &key, object_meta_t *meta, LookupPolicy policy,
+        ElfSymbol_t &sym)
+    {
+        bool bFound = false;
+
+        acquire();
+        if (m_nEntries)
+        {
+            size_t mask = m_Entries.size() - 1;
+            for (size_t i = slot(key.gnu_hash, meta, policy) & mask;
+                 m_Entries[i].name; i = (i + 1) & mask)
+            {
+                const Entry &e = m_Entries[i];
+                if (e.hash == key.gnu_hash && e.meta == meta &&
+                    e.policy == policy && !strcmp(e.name, key.name))
+                {
+                    sym = e.sym;
+                    bFound = true;
+                    break;
+                }
+            }
+        }
+        release();
+
+        return bFound;
+    }
+
+    void insert(
+        const symbol_key_t &key, object_meta_t *meta, LookupPolicy policy,
+        const ElfSymbol_t &sym)
+    {
+        acquire();
+        if ((m_nEntries + 1) * 2 > m_Entries.size())
+        {
+            grow();
+        }
+
+        size_t mask = m_Entries.size() - 1;
+        size_t i = slot(key.gnu_hash, meta, policy) & mask;
+        while (m_Entries[i].name)
+        {
+            const Entry &e = m_Entries[i];
+            if (e.hash == key.gnu_hash && e.meta == meta &&
+                e.policy == policy && !strcmp(e.name, key.name))
+            {
+                // Raced with another resolution of the same symbol.
+                release();
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+
+        Entry &e = m_Entries[i];
+        e.name = strdup(key.name);
+        e.hash = key.gnu_hash;
+        e.meta = meta;
+        e.policy = policy;
+        e.sym = sym;
+        ++m_nEntries;
+        release();
+    }
+
+    void clear()
+    {
+        acquire();
+        for (size_t i = 0; i < m_Entries.size(); ++i)
+        {
+            free(const_cast<char *>(m_Entries[i].name));
+        }
+        m_Entries.clear();
+        m_nEntries = 0;
+        release();
+    }
+
+  private:
+    struct Entry
+    {
+        Entry() : name(0), hash(0), meta(0), policy(LocalFirst), sym()
+        {
+        }
+
+        const char *name;
+        uint32_t hash;
+        object_meta_t *meta;
+        LookupPolicy policy;
+        ElfSymbol_t sym;
+    };
+
+    static size_t slot(uint32_t hash, object_meta_t *meta, LookupPolicy policy)
+    {
+        uintptr_t m = reinterpret_cast<uintptr_t>(meta);
+        return hash ^ (m >> 4) ^ (m >> 16) ^ (policy * 0x9e3779b9U);
+    }
+
+    void grow()
+    {
+        std::vector<Entry> old;
+        old.swap(m_Entries);
+        m_Entries.resize(old.empty() ? 256 : old.size() * 2);
+
+        size_t mask = m_Entries.size() - 1;
+        for (size_t i = 0; i < old.size(); ++i)
+        {
+            const Entry &e = old[i];
+            if (!e.name)
+            {
+                continue;
+            }
+
+            size_t j = slot(e.hash, e.meta, e.policy) & mask;
+            while (m_Entries[j].name)
+            {
+                j = (j + 1) & mask;
+            }
+            m_Entries[j] = e;
+        }
+    }
+
+    // Lazy PLT fixups may come in from any thread.
+    void acquire()
+    {
+        while (__atomic_test_and_set(&m_Lock, __ATOMIC_ACQUIRE))
+            ;
+    }
+
+    void release()
+    {
+        __atomic_clear(&m_Lock, __ATOMIC_RELEASE);
+    }
+
+    std::vector<Entry> m_Entries;
+    size_t m_nEntries;
+    bool m_Lock;
+};
+
+ResolvedSymbolCache g_ResolvedSymbols;
+
+/// FNV-1a, used to build prelink cache keys.
+uint64_t
+fnv1a(const void *data, size_t len, uint64_t h = 0xcbf29ce484222325ULL)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
 extern char **environ;
 
 /**
@@ -249,6 +471,7 @@ extern "C" int main(int argc, const char *argv[])
     char *ld_libpath = getenv("LD_LIBRARY_PATH");
     char *ld_preload = getenv("LD_PRELOAD");
     char *ld_debug = getenv("LD_DEBUG");
+    char *ld_prelink_cache = getenv("LD_PRELINK_CACHE");
 
     g_lSearchPaths.push_back(std::string("root»/libraries"));
     g_lSearchPaths.push_back(std::string("."));
@@ -271,6 +494,13 @@ extern "C" int main(int argc, const char *argv[])
         }
     }
 
+    // A setuid program would otherwise pick up relocations from a cache its
+    // invoker controls.
+    if (ld_prelink_cache && getuid() == geteuid() && getgid() == getegid())
+    {
+        g_PrelinkCacheDir = ld_prelink_cache;
+    }
+
     if (ld_debug)
     {
         fprintf(stderr, "libload.so: search path is\n");
@@ -529,6 +759,10 @@ bool loadSharedObjectHelper(
         parent->objects.push_back(object);
         g_LoadedObjects.insert(object->filename);
 
+        // The new object may provide a better match for names resolved
+        // earlier (e.g. a strong definition of something found weak).
+        g_ResolvedSymbols.clear();
+
         if (object->needed.size())
         {
             for (std::list<std::string>::iterator it = object->needed.begin();
@@ -640,6 +874,12 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
 
     meta->mapped_file_sz = st.st_size;
 
+    meta->ident = fnv1a(meta->path.c_str(), meta->path.length());
+    meta->ident = fnv1a(&st.st_dev, sizeof(st.st_dev), meta->ident);
+    meta->ident = fnv1a(&st.st_ino, sizeof(st.st_ino), meta->ident);
+    meta->ident = fnv1a(&st.st_size, sizeof(st.st_size), meta->ident);
+    meta->ident = fnv1a(&st.st_mtime, sizeof(st.st_mtime), meta->ident);
+
     const char *pBuffer = (const char *) mmap(
         0, meta->mapped_file_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
     if (pBuffer == MAP_FAILED)
@@ -985,13 +1225,36 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
         meta->phdrs = 0;
     }
 
-    // Do another pass over section headers to try and get the hash table.
+    // Do another pass over section headers to try and get the hash tables.
     meta->hash = 0;
     meta->hash_buckets = 0;
     meta->hash_chains = 0;
     for (size_t i = 0; i < header.shnum; i++)
     {
-        if (meta->shdrs[i].type == SHT_HASH)
+        if (meta->shdrs[i].type == SHT_GNU_HASH)
+        {
+            uintptr_t vaddr = meta->shdrs[meta->shdrs[i].link].addr;
+            if (((uintptr_t) meta->dyn_symtab) == vaddr)
+            {
+                const Elf_Word *words =
+                    (const Elf_Word *) &pBuffer[meta->shdrs[i].offset];
+                meta->gnu_nbuckets = words[0];
+                meta->gnu_symoffset = words[1];
+                meta->gnu_bloom_size = words[2];
+                meta->gnu_bloom_shift = words[3];
+                meta->gnu_bloom = (const uintptr_t *) &words[4];
+                meta->gnu_buckets =
+                    (const Elf_Word *) &meta->gnu_bloom[meta->gnu_bloom_size];
+                meta->gnu_chains = &meta->gnu_buckets[meta->gnu_nbuckets];
+
+                // An empty table can't answer anything; fall back to SysV.
+                if (!meta->gnu_nbuckets || !meta->gnu_bloom_size)
+                {
+                    meta->gnu_buckets = 0;
+                }
+            }
+        }
+        else if (meta->shdrs[i].type == SHT_HASH)
         {
             uintptr_t vaddr = meta->shdrs[meta->shdrs[i].link].addr;
             if (((uintptr_t) meta->dyn_symtab) == vaddr)
@@ -1008,6 +1271,10 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
         }
     }
 
+    // Where the object landed matters as much as which file it was.
+    meta->ident =
+        fnv1a(&meta->load_base, sizeof(meta->load_base), meta->ident);
+
     // Patch up the GOT so we can start resolving symbols when needed.
     if (meta->got)
     {
@@ -1021,92 +1288,163 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
     return true;
 }
 
-bool lookupSymbol(
-    const char *symbol, object_meta_t *meta, ElfSymbol_t &sym, bool bWeak,
-    bool bGlobal)
+/**
+ * Ranks a name match found while walking a hash chain. Locals (and weak
+ * symbols, if wanted) are taken as soon as they're found; globals are only
+ * used if the whole chain has no better match.
+ */
+static int symbolRank(const ElfSymbol_t &sym, bool bWeak, bool bGlobal)
 {
-    if (!meta)
+    if (ST_BIND(sym.info) == STB_LOCAL && sym.shndx)
     {
-        return false;
+        return 2;
     }
-
-    // Allow preloads to override the main object symbol table, as well as any
-    // others.
-    for (std::list<object_meta_t *>::iterator it = meta->preloads.begin();
-         it != meta->preloads.end(); ++it)
+    else if (bWeak && ST_BIND(sym.info) == STB_WEAK)
     {
-        if (lookupSymbol(symbol, *it, sym, false))
-            return true;
+        return 2;
+    }
+    else if (bGlobal && ST_BIND(sym.info) == STB_GLOBAL && sym.shndx)
+    {
+        return 1;
     }
 
-    std::string sname(symbol);
+    return 0;
+}
 
-    size_t hash = elfhash(symbol);
-    size_t y = meta->hash_buckets[hash % meta->hash->nbucket];
+/// Walks the SysV hash chain for the key, returning a symbol index or zero.
+static size_t sysvLookup(
+    const symbol_key_t &key, object_meta_t *meta, bool bWeak, bool bGlobal)
+{
+    size_t y = meta->hash_buckets[key.sysv_hash % meta->hash->nbucket];
     if (y > meta->hash->nchain)
     {
-        return false;
+        return 0;
+    }
+
+    size_t candidate = 0;
+    for (; y != 0; y = meta->hash_chains[y])
+    {
+        const ElfSymbol_t &sym = meta->dyn_symtab[y];
+        if (strcmp(symbolName(sym, meta), key.name))
+        {
+            continue;
+        }
+
+        int rank = symbolRank(sym, bWeak, bGlobal);
+        if (rank == 2)
+        {
+            return y;
+        }
+        else if (rank == 1 && !candidate)
+        {
+            candidate = y;
+        }
+    }
+
+    return candidate;
+}
+
+/// Walks the GNU hash chain for the key, returning a symbol index or zero.
+static size_t gnuLookup(
+    const symbol_key_t &key, object_meta_t *meta, bool bWeak, bool bGlobal)
+{
+    const size_t bits = sizeof(uintptr_t) * 8;
+    uint32_t h = key.gnu_hash;
+
+    // Most lookups miss most objects; the Bloom filter rejects nearly all of
+    // those without touching the buckets or the string table.
+    uintptr_t word = meta->gnu_bloom[(h / bits) % meta->gnu_bloom_size];
+    uintptr_t mask = (static_cast<uintptr_t>(1) << (h % bits)) |
+                     (static_cast<uintptr_t>(1)
+                      << ((h >> meta->gnu_bloom_shift) % bits));
+    if ((word & mask) != mask)
+    {
+        return 0;
     }
 
-    // Try a local lookup first.
-    do
+    size_t y = meta->gnu_buckets[h % meta->gnu_nbuckets];
+    if (y < meta->gnu_symoffset)
     {
-        sym = meta->dyn_symtab[y];
-        if (symbolName(sym, meta) == sname)
+        return 0;
+    }
+
+    size_t candidate = 0;
+    while (true)
+    {
+        Elf_Word chainHash = meta->gnu_chains[y - meta->gnu_symoffset];
+        if ((chainHash | 1) == (h | 1))
         {
-            if (ST_BIND(sym.info) == STB_LOCAL)
+            const ElfSymbol_t &sym = meta->dyn_symtab[y];
+            if (!strcmp(symbolName(sym, meta), key.name))
             {
-                if (sym.shndx)
+                int rank = symbolRank(sym, bWeak, bGlobal);
+                if (rank == 2)
                 {
-                    break;
+                    return y;
                 }
-            }
-            if (bWeak)
-            {
-                if (ST_BIND(sym.info) == STB_WEAK)
+                else if (rank == 1 && !candidate)
                 {
-                    // sym.value = ~0UL;
-                    break;
+                    candidate = y;
                 }
             }
         }
-        y = meta->hash_chains[y];
-    } while (y != 0);
 
-    // No local symbols found - try a global lookup.
-    if ((bGlobal) && (y == 0))
-    {
-        y = meta->hash_buckets[hash % meta->hash->nbucket];
-        do
+        // Low bit marks the end of the chain.
+        if (chainHash & 1)
         {
-            sym = meta->dyn_symtab[y];
-            if (symbolName(sym, meta) == sname)
-            {
-                if (ST_BIND(sym.info) == STB_GLOBAL)
-                {
-                    if (sym.shndx)
-                    {
-                        break;
-                    }
-                }
-            }
-            y = meta->hash_chains[y];
-        } while (y != 0);
+            break;
+        }
+        ++y;
     }
 
-    if (y != 0)
+    return candidate;
+}
+
+bool lookupSymbol(
+    const symbol_key_t &key, object_meta_t *meta, ElfSymbol_t &sym,
+    bool bWeak, bool bGlobal)
+{
+    if (!meta)
     {
-        // Patch up the value.
-        if (ST_TYPE(sym.info) < 3)
-        {  // && ST_BIND(sym.info) != STB_WEAK) {
-            if (sym.shndx && meta->relocated)
-            {
-                sym.value += meta->load_base;
-            }
+        return false;
+    }
+
+    // Allow preloads to override the main object symbol table, as well as any
+    // others.
+    for (std::list<object_meta_t *>::iterator it = meta->preloads.begin();
+         it != meta->preloads.end(); ++it)
+    {
+        if (lookupSymbol(key, *it, sym, false))
+            return true;
+    }
+
+    size_t y = 0;
+    if (meta->gnu_buckets)
+    {
+        y = gnuLookup(key, meta, bWeak, bGlobal);
+    }
+    else if (meta->hash)
+    {
+        y = sysvLookup(key, meta, bWeak, bGlobal);
+    }
+
+    if (y == 0)
+    {
+        return false;
+    }
+
+    sym = meta->dyn_symtab[y];
+
+    // Patch up the value.
+    if (ST_TYPE(sym.info) < 3)
+    {  // && ST_BIND(sym.info) != STB_WEAK) {
+        if (sym.shndx && meta->relocated)
+        {
+            sym.value += meta->load_base;
         }
     }
 
-    return y != 0;
+    return true;
 }
 
 bool findSymbol(
@@ -1118,12 +1456,31 @@ bool findSymbol(
         return false;
     }
 
+    symbol_key_t key(symbol);
+    if (g_ResolvedSymbols.lookup(key, meta, policy, sym))
+    {
+        return true;
+    }
+
+    if (!findSymbolUncached(key, meta, sym, policy))
+    {
+        return false;
+    }
+
+    g_ResolvedSymbols.insert(key, meta, policy, sym);
+    return true;
+}
+
+bool findSymbolUncached(
+    const symbol_key_t &key, object_meta_t *meta, ElfSymbol_t &sym,
+    LookupPolicy policy)
+{
     // Do we override or not?
     std::map<std::string, uintptr_t>::iterator it =
-        g_LibLoadSymbols.find(std::string(symbol));
+        g_LibLoadSymbols.find(std::string(key.name));
     if (it != g_LibLoadSymbols.end())
     {
-        if (it->first == symbol)
+        if (it->first == key.name)
         {
             sym.value = it->second;
             return true;
@@ -1140,19 +1497,19 @@ bool findSymbol(
     for (std::list<object_meta_t *>::iterator it = ext_meta->preloads.begin();
          it != ext_meta->preloads.end(); ++it)
     {
-        if (lookupSymbol(symbol, *it, sym, false))
+        if (lookupSymbol(key, *it, sym, false))
             return true;
     }
 
     // If we are allowed, check for non-weak symbols in this binary.
     if (policy != NotThisObject && policy != LocalLast)
     {
-        if (lookupSymbol(symbol, meta, sym, false, false))
+        if (lookupSymbol(key, meta, sym, false, false))
             return true;
     }
 
     // Try the parent object.
-    if ((meta != ext_meta) && lookupSymbol(symbol, ext_meta, sym, false))
+    if ((meta != ext_meta) && lookupSymbol(key, ext_meta, sym, false))
         return true;
 
     // Now, try any loaded objects we might have.
@@ -1162,7 +1519,7 @@ bool findSymbol(
         if (*it == meta)
             continue;  // Already handling.
 
-        if (lookupSymbol(symbol, *it, sym, false))
+        if (lookupSymbol(key, *it, sym, false))
         {
             return true;
         }
@@ -1171,7 +1528,7 @@ bool findSymbol(
     // Try a local lookup if not found.
     if (policy == LocalLast)
     {
-        if (lookupSymbol(symbol, meta, sym, false, false))
+        if (lookupSymbol(key, meta, sym, false, false))
             return true;
     }
 
@@ -1182,36 +1539,36 @@ bool findSymbol(
         if (*it == meta)
             continue;  // Already handling this object.
 
-        if (lookupSymbol(symbol, *it, sym, true))
+        if (lookupSymbol(key, *it, sym, true))
         {
             return true;
         }
     }
 
     // Try weak symbols in the parent object.
-    if ((meta != ext_meta) && lookupSymbol(symbol, ext_meta, sym, true))
+    if ((meta != ext_meta) && lookupSymbol(key, ext_meta, sym, true))
         return true;
 
     // No luck? Try weak symbols in the main object.
     if (policy != NotThisObject)
     {
-        if (lookupSymbol(symbol, meta, sym, true))
+        if (lookupSymbol(key, meta, sym, true))
             return true;
     }
 
     return false;
 }
 
-std::string
+const char *
 symbolName(const ElfSymbol_t &sym, object_meta_t *meta, bool bNoDynamic)
 {
     if (!meta)
     {
-        return std::string("");
+        return "";
     }
     else if (sym.name == 0)
     {
-        return std::string("");
+        return "";
     }
 
     const char *strtab = meta->strtab;
@@ -1225,26 +1582,74 @@ symbolName(const ElfSymbol_t &sym, object_meta_t *meta, bool bNoDynamic)
         strtab = meta->dyn_strtab;
     }
 
-    const char *name = strtab + sym.name;
-    return std::string(name);
+    return strtab + sym.name;
+}
+
+/**
+ * Hashes everything symbol resolution for the given object depends on: the
+ * identity and load address of every object in its search scope, plus
+ * libload itself. Any change means a different prelink cache file.
+ */
+static uint64_t prelinkScope(object_meta_t *meta)
+{
+    object_meta_t *ext_meta = meta;
+    while (ext_meta->parent)
+    {
+        ext_meta = ext_meta->parent;
+    }
+
+    uint64_t h = fnv1a(&meta->ident, sizeof(meta->ident));
+    h = fnv1a(&ext_meta->ident, sizeof(ext_meta->ident), h);
+    for (std::list<object_meta_t *>::iterator it = ext_meta->preloads.begin();
+         it != ext_meta->preloads.end(); ++it)
+    {
+        h = fnv1a(&(*it)->ident, sizeof((*it)->ident), h);
+    }
+    for (std::list<object_meta_t *>::iterator it = ext_meta->objects.begin();
+         it != ext_meta->objects.end(); ++it)
+    {
+        h = fnv1a(&(*it)->ident, sizeof((*it)->ident), h);
+    }
+
+    uintptr_t self = reinterpret_cast<uintptr_t>(&_libload_dlopen);
+    return fnv1a(&self, sizeof(self), h);
 }
 
 void doRelocation(object_meta_t *meta)
 {
-    if (meta->rel)
+    size_t nRel = meta->rel ? (meta->rel_sz / sizeof(ElfRel_t)) : 0;
+    size_t nRela = meta->rela ? (meta->rela_sz / sizeof(ElfRela_t)) : 0;
+
+    // With a prelink cache, every symbol this object needed last time is
+    // already known and resolution is skipped entirely.
+    std::vector<prelink_entry_t> prelink;
+    uint64_t scope = 0;
+    bool bPrelinked = false;
+    if (!g_PrelinkCacheDir.empty() && (nRel + nRela))
     {
-        for (size_t i = 0; i < (meta->rel_sz / sizeof(ElfRel_t)); i++)
-        {
-            doThisRelocation(meta->rel[i], meta);
-        }
+        prelink.resize(nRel + nRela);
+        scope = prelinkScope(meta);
+        bPrelinked = loadPrelinkCache(
+            prelinkPath(g_PrelinkCacheDir, meta->ident, scope), meta->ident,
+            scope, prelink);
     }
 
-    if (meta->rela)
+    prelink_entry_t *entry = prelink.empty() ? 0 : &prelink[0];
+    for (size_t i = 0; i < nRel; i++)
     {
-        for (size_t i = 0; i < (meta->rela_sz / sizeof(ElfRela_t)); i++)
-        {
-            doThisRelocation(meta->rela[i], meta);
-        }
+        doThisRelocation(meta->rel[i], meta, entry ? entry++ : 0);
+    }
+
+    for (size_t i = 0; i < nRela; i++)
+    {
+        doThisRelocation(meta->rela[i], meta, entry ? entry++ : 0);
+    }
+
+    if (!prelink.empty() && !bPrelinked)
+    {
+        savePrelinkCache(
+            prelinkPath(g_PrelinkCacheDir, meta->ident, scope), meta->ident,
+            scope, prelink);
     }
 
     // Relocated binaries need to have the GOTPLT fixed up, as each entry points
@@ -1337,7 +1742,8 @@ void doRelocation(object_meta_t *meta)
 #define R_386_GOTOFF 9
 #define R_386_GOTPC 10
 
-uintptr_t doThisRelocation(ElfRel_t rel, object_meta_t *meta)
+uintptr_t
+doThisRelocation(ElfRel_t rel, object_meta_t *meta, prelink_entry_t *prelink)
 {
     const ElfSymbol_t *symtab = meta->symtab;
     if (meta->dyn_symtab)
@@ -1362,7 +1768,7 @@ uintptr_t doThisRelocation(ElfRel_t rel, object_meta_t *meta)
     uintptr_t A = *((uintptr_t *) P);
     uintptr_t S = 0;
 
-    std::string symbolname = symbolName(*sym, meta);
+    const char *symbolname = symbolName(*sym, meta);
     size_t symbolSize = sizeof(uintptr_t);
 
     // Patch in section header?
@@ -1373,7 +1779,7 @@ uintptr_t doThisRelocation(ElfRel_t rel, object_meta_t *meta)
             printf(
                 "symbol lookup for '%s' needed a section header, which wasn't "
                 "present.\n",
-                symbolname.c_str());
+                symbolname);
             return 0;
         }
         S = sh->addr;
@@ -1394,13 +1800,24 @@ uintptr_t doThisRelocation(ElfRel_t rel, object_meta_t *meta)
             }
 
             // Attempt to find the symbol.
-            if (!findSymbol(symbolname.c_str(), meta, lookupsym, policy))
+            if (prelink && (prelink->flags & PrelinkResolved))
+            {
+                lookupsym.value = prelink->value;
+                lookupsym.size = prelink->size;
+            }
+            else if (!findSymbol(symbolname, meta, lookupsym, policy))
             {
                 printf(
                     "symbol lookup for '%s' (needed in '%s') failed.\n",
-                    symbolname.c_str(), meta->path.c_str());
+                    symbolname, meta->path.c_str());
                 lookupsym.value = ~0UL;
             }
+            else if (prelink)
+            {
+                prelink->value = lookupsym.value;
+                prelink->size = lookupsym.size;
+                prelink->flags = PrelinkResolved;
+            }
 
             S = lookupsym.value;
             symbolSize = lookupsym.size;
@@ -1447,7 +1864,8 @@ uintptr_t doThisRelocation(ElfRel_t rel, object_meta_t *meta)
     return result;
 }
 
-uintptr_t doThisRelocation(ElfRela_t rel, object_meta_t *meta)
+uintptr_t
+doThisRelocation(ElfRela_t rel, object_meta_t *meta, prelink_entry_t *prelink)
 {
     const ElfSymbol_t *symtab = meta->symtab;
     if (meta->dyn_symtab)
@@ -1472,7 +1890,7 @@ uintptr_t doThisRelocation(ElfRela_t rel, object_meta_t *meta)
     uintptr_t A = rel.addend;
     uintptr_t S = 0;
 
-    std::string symbolname = symbolName(*sym, meta);
+    const char *symbolname = symbolName(*sym, meta);
     size_t symbolSize = sizeof(uintptr_t);
 
     // Patch in section header?
@@ -1483,7 +1901,7 @@ uintptr_t doThisRelocation(ElfRela_t rel, object_meta_t *meta)
             printf(
                 "symbol lookup for '%s' needed a section header, which wasn't "
                 "present.\n",
-                symbolname.c_str());
+                symbolname);
             return 0;
         }
         S = sh->addr;
@@ -1504,13 +1922,24 @@ uintptr_t doThisRelocation(ElfRela_t rel, object_meta_t *meta)
             }
 
             // Attempt to find the symbol.
-            if (!findSymbol(symbolname.c_str(), meta, lookupsym, policy))
+            if (prelink && (prelink->flags & PrelinkResolved))
+            {
+                lookupsym.value = prelink->value;
+                lookupsym.size = prelink->size;
+            }
+            else if (!findSymbol(symbolname, meta, lookupsym, policy))
             {
                 printf(
                     "symbol lookup for '%s' (needed in '%s') failed.\n",
-                    symbolname.c_str(), meta->path.c_str());
+                    symbolname, meta->path.c_str());
                 lookupsym.value = ~0UL;
             }
+            else if (prelink)
+            {
+                prelink->value = lookupsym.value;
+                prelink->size = lookupsym.size;
+                prelink->flags = PrelinkResolved;
+            }
 
             S = lookupsym.value;
             symbolSize = lookupsym.size;
@@ -1567,7 +1996,7 @@ uintptr_t doThisRelocation(ElfRela_t rel, object_meta_t *meta)
             klog(
                 LOG_WARNING,
                 "libload: unsupported relocation for '%s' in %s: %d",
-                symbolname.c_str(), meta->filename.c_str(), R_TYPE(rel.info));
+                symbolname, meta->filename.c_str(), R_TYPE(rel.info));
     }
 
     if (R_TYPE(rel.info) != R_X86_64_COPY)
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBLOAD_PRELINK_H
+#define LIBLOAD_PRELINK_H
+
+// On-disk prelink cache files for libload, kept apart from loader.cc so the
+// host test suite can exercise them.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#define PRELINK_MAGIC 0x4b4e4c50  // 'PLNK'
+#define PRELINK_VERSION 1
+
+/// Flags for a prelink cache entry.
+enum PrelinkFlags
+{
+    PrelinkResolved = 1
+};
+
+/// One resolved relocation in the on-disk prelink cache.
+typedef struct _prelink_entry
+{
+    uintptr_t value;
+    uintptr_t size;
+    uintptr_t flags;
+} prelink_entry_t;
+
+/// Header of a prelink cache file; entries follow, one per relocation.
+typedef struct _prelink_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ident;
+    uint64_t scope;
+    uint64_t count;
+} prelink_header_t;
+
+/** Path of the cache file in \p dir for an object and its lookup scope. */
+inline std::string
+prelinkPath(const std::string &dir, uint64_t ident, uint64_t scope)
+{
+    char name[64];
+    snprintf(
+        name, sizeof(name), "/%016llx-%016llx.prelink",
+        static_cast<unsigned long long>(ident),
+        static_cast<unsigned long long>(scope));
+    return dir + name;
+}
+
+/**
+ * Reads a cache file into \p entries, which must already be sized for the
+ * object's relocations. The values end up in the relocated image, so only
+ * files that nobody else could have written are used: regular files owned
+ * by the effective user and not writable by group or others.
+ * \return false (with \p entries zeroed) if the file is missing, untrusted
+ *         or was written for a different object or scope.
+ */
+inline bool loadPrelinkCache(
+    const std::string &path, uint64_t ident, uint64_t scope,
+    std::vector<prelink_entry_t> &entries)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool bValid = false;
+    struct stat st;
+    prelink_header_t header;
+    size_t len = entries.size() * sizeof(prelink_entry_t);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_uid == geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH)) &&
+        read(fd, &header, sizeof(header)) == sizeof(header) &&
+        header.magic == PRELINK_MAGIC && header.version == PRELINK_VERSION &&
+        header.ident == ident && header.scope == scope &&
+        header.count == entries.size())
+    {
+        bValid = read(fd, &entries[0], len) == static_cast<ssize_t>(len);
+    }
+
+    close(fd);
+
+    if (!bValid)
+    {
+        // Don't trust a partial read.
+        memset(&entries[0], 0, len);
+    }
+
+    return bValid;
+}
+
+/** Writes \p entries to the cache file at \p path, replacing it atomically. */
+inline void savePrelinkCache(
+    const std::string &path, uint64_t ident, uint64_t scope,
+    const std::vector<prelink_entry_t> &entries)
+{
+    // Write to a private file and rename it in, so a concurrent launch never
+    // sees a half-written cache.
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d", getpid());
+    std::string tmp = path + suffix;
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    prelink_header_t header;
+    header.magic = PRELINK_MAGIC;
+    header.version = PRELINK_VERSION;
+    header.ident = ident;
+    header.scope = scope;
+    header.count = entries.size();
+
+    size_t len = entries.size() * sizeof(prelink_entry_t);
+    bool bOk = write(fd, &header, sizeof(header)) == sizeof(header) &&
+               write(fd, &entries[0], len) == static_cast<ssize_t>(len);
+    close(fd);
+
+    if (!bOk || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+    }
+}
+
+#endif  // LIBLOAD_PRELINK_H
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Compares how quickly a parent with a heap of a given size can start (and
+ * reap) trivial programs using fork()+exec(), vfork()+exec() and
+ * posix_spawn().
+ *
+ * Usage: spawnbench [heap MiB] [iterations]
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void reap(pid_t pid)
+{
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        ;
+}
+
+static void report(const char *what, uint64_t total, int iterations)
+{
+    uint64_t each = total / iterations;
+    printf(
+        "  %-24s %6llu us/spawn  %8.1f spawns/s\n", what,
+        (unsigned long long) (each / 1000),
+        each ? 1000000000.0 / each : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    // exec() target: exit straight away.
+    if (argc > 1 && !strcmp(argv[1], "--child"))
+    {
+        return 0;
+    }
+
+    size_t heapMiB = argc > 1 ? strtoul(argv[1], 0, 0) : 64;
+    int iterations = argc > 2 ? atoi(argv[2]) : 100;
+    if (iterations <= 0)
+    {
+        iterations = 1;
+    }
+
+    // Give the parent something to (not) copy.
+    size_t heapSize = heapMiB << 20;
+    char *heap = heapSize ? malloc(heapSize) : 0;
+    if (heapSize && !heap)
+    {
+        perror("spawnbench: malloc");
+        return 1;
+    }
+    memset(heap, 0xAB, heapSize);
+
+    char *childArgv[] = {argv[0], "--child", 0};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(
+        &actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, 1, 2);
+
+    uint64_t forkTotal = 0, vforkTotal = 0, spawnTotal = 0;
+    uint64_t spawnActionsTotal = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        // fork() + exec(): copies (or at least shares) the whole address
+        // space only to throw it away again.
+        uint64_t start = now();
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("spawnbench: fork");
+            return 1;
+        }
+        else if (pid == 0)
+        {
+            execv(argv[0], childArgv);
+            _exit(127);
+        }
+        reap(pid);
+        forkTotal += now() - start;
+
+        // vfork() + exec(): the child borrows our address space until it
+        // calls exec.
+        start = now();
+        pid = vfork();
+        if (pid < 0)
+        {
+            perror("spawnbench: vfork");
+            return 1;
+        }
+        else if (pid == 0)
+        {
+            execv(argv[0], childArgv);
+            _exit(127);
+        }
+        reap(pid);
+        vforkTotal += now() - start;
+
+        // posix_spawn(): the kernel builds the child from scratch.
+        start = now();
+        int err = posix_spawn(&pid, argv[0], 0, 0, childArgv, environ);
+        if (err)
+        {
+            fprintf(stderr, "spawnbench: posix_spawn: %s\n", strerror(err));
+            return 1;
+        }
+        reap(pid);
+        spawnTotal += now() - start;
+
+        // posix_spawn() with the sort of redirections a shell would do.
+        start = now();
+        err = posix_spawn(&pid, argv[0], &actions, 0, childArgv, environ);
+        if (err)
+        {
+            fprintf(stderr, "spawnbench: posix_spawn: %s\n", strerror(err));
+            return 1;
+        }
+        reap(pid);
+        spawnActionsTotal += now() - start;
+    }
+
+    printf(
+        "spawnbench: %zu MiB heap, %d iterations\n", heapMiB, iterations);
+    report("fork+exec+wait:", forkTotal, iterations);
+    report("vfork+exec+wait:", vforkTotal, iterations);
+    report("posix_spawn+wait:", spawnTotal, iterations);
+    report("posix_spawn(fa)+wait:", spawnActionsTotal, iterations);
+
+    posix_spawn_file_actions_destroy(&actions);
+    free(heap);
+    return 0;
+}